@@ -17,6 +17,16 @@ import <chrono>;
 import <string>;
 import <iomanip>;
 import <filesystem>;
+import <unordered_map>;
+import <cmath>;
+import <thread>;
+import <cstddef>;
+import <algorithm>;
+import <fstream>;
+import <map>;
+import <functional>;
+import <typeindex>;
+import <iostream>;
 
 import vc;
 import util;
@@ -25,6 +35,18 @@ import linalg;
 import solver;
 import symbolic;
 import expr;
+import derivative_cache;
+import dag;
+import evaluator;
+import cpp_kernels;
+import jit;
+import cpu_shader;
+import batched_linalg;
+import nlsq_solver;
+import voxel_scheduler;
+import stream_executor;
+import mapped_file;
+import vcdat;
 import symm;
 import nlsq;
 import nlsq_symbolic;
@@ -37,6 +59,7 @@ import shader;
 import func_factory;
 
 import tensor_var;
+import thread_pool;
 
 //
 //void test_function_factory()
@@ -867,7 +890,9 @@ void test_new_autogen() {
 	
 }
 
-void run_qmri_ivim() {
+// Fits the ivim model to the whole volume with the guess, partial and full shaders in workgroups of
+// local_size, print shows the shaders and the buffers of the first, middle and last voxel
+void run_qmri_ivim(uint32_t local_size = 64, bool print = true) {
 
 	uint32_t ndata = 21;
 	uint32_t nconst = 1;
@@ -890,27 +915,31 @@ void run_qmri_ivim() {
 	auto upper_bound = std::make_shared<glsl::VectorVariable>("upper_bound", 4, glsl::ShaderVariableType::FLOAT);
 	auto lower_bound = std::make_shared<glsl::VectorVariable>("lower_bound", 4, glsl::ShaderVariableType::FLOAT);
 
-	auto pShader1 = glsl::qmri::ivim_guess_shader(ndata, true);
-	auto shaderStr1 = pShader1->compile();
-	std::cout << shaderStr1 << std::endl;
-	std::cout << "\n\n\n" << std::endl;
+	// derivatives of earlier runs, the symbolic shaders below only differentiate new terms
+	auto derivatives_path = std::filesystem::current_path() / "shader_cache" / "derivatives.txt";
+	expression::derivative_cache().load(derivatives_path);
 
+	auto pShader1 = glsl::qmri::ivim_guess_shader(ndata, true);
+	pShader1->setLocalSize(local_size);
 	auto pShader2 = glsl::qmri::ivim_partial_nlsq_shader(ndata, true);
-	auto shaderStr2 = pShader2->compile();
-	std::cout << shaderStr2 << std::endl;
-	std::cout << "\n\n\n" << std::endl;
-
+	pShader2->setLocalSize(local_size);
 	auto pShader3 = glsl::qmri::ivim_full_nlsq_shader(ndata, true);
-	auto shaderStr3 = pShader3->compile();
+	pShader3->setLocalSize(local_size);
+
+	if (print) {
+		for (auto& shader : { pShader1, pShader2, pShader3 }) {
+			std::cout << shader->compile() << std::endl;
+			std::cout << "\n\n\n" << std::endl;
+		}
+	}
 
-	std::cout << shaderStr3 << std::endl;
-	std::cout << "\n\n\n" << std::endl;
+	expression::derivative_cache().save(derivatives_path);
 
 	namespace fs = std::filesystem;
 	auto d_path = fs::current_path() / "data" / "ivim_data.vcdat";
 	auto c_path = fs::current_path() / "data" / "ivim_bvals.vcdat";
 
-	size_t nelem = fs::file_size(d_path) / ndata / sizeof(float);
+	size_t nelem = glsl::VcdatFile(d_path, glsl::ShaderVariableType::FLOAT, ndata).info().nelem;
 
 	auto mgr = std::make_shared<kp::Manager>();
 
@@ -938,20 +967,34 @@ void run_qmri_ivim() {
 	auto kp_hessian = glsl::tensor_from_matrix(mgr, hessian, nelem);
 
 
-	auto spirv1 = glsl::compileSource(shaderStr1);
-	auto spirv2 = glsl::compileSource(shaderStr2);
-	auto spirv3 = glsl::compileSource(shaderStr3);
+	glsl::setShaderCache(std::make_shared<glsl::SpirvCache>(fs::current_path() / "shader_cache"));
+
+	auto compile_start = std::chrono::steady_clock::now();
+
+	util::ThreadPool pool(3);
+	auto spirv_futures = glsl::compileShaders({ pShader1, pShader2, pShader3 }, pool);
+	auto spirv1 = spirv_futures[0].get();
+	auto spirv2 = spirv_futures[1].get();
+	auto spirv3 = spirv_futures[2].get();
+
+	auto compile_end = std::chrono::steady_clock::now();
+
+	std::cout << "compile time: " << std::chrono::duration_cast<std::chrono::milliseconds>(compile_end - compile_start).count() << std::endl;
+
+	auto cache_stats = glsl::getShaderCache()->getStats();
+	std::cout << "shader cache hits: " << cache_stats.hits << " misses: " << cache_stats.misses << std::endl;
 
 	std::vector<std::shared_ptr<kp::Tensor>> shader_inputs = {
 		kp_params, kp_consts, kp_data, kp_bsplit, kp_weights, kp_lambda, kp_step_type,
 		kp_nlstep, kp_error, kp_new_error, kp_residuals, kp_jacobian, kp_hessian
 	};
 
-	kp::Workgroup wg{ (size_t)nelem, 1, 1 };
+	kp::Workgroup wg = pShader3->getWorkgroup(nelem);
+	std::vector<uint32_t> push_consts = { (uint32_t)nelem };
 	
-	std::shared_ptr<kp::Algorithm> algo1 = mgr->algorithm(shader_inputs, spirv1, wg);
-	std::shared_ptr<kp::Algorithm> algo2 = mgr->algorithm(shader_inputs, spirv2, wg);
-	std::shared_ptr<kp::Algorithm> algo3 = mgr->algorithm(shader_inputs, spirv3, wg);
+	std::shared_ptr<kp::Algorithm> algo1 = mgr->algorithm<float, uint32_t>(shader_inputs, spirv1, wg, {}, push_consts);
+	std::shared_ptr<kp::Algorithm> algo2 = mgr->algorithm<float, uint32_t>(shader_inputs, spirv2, wg, {}, push_consts);
+	std::shared_ptr<kp::Algorithm> algo3 = mgr->algorithm<float, uint32_t>(shader_inputs, spirv3, wg, {}, push_consts);
 
 	auto start = std::chrono::steady_clock::now();
 
@@ -969,9 +1012,9 @@ void run_qmri_ivim() {
 
 	auto end = std::chrono::steady_clock::now();
 
-	std::cout << "run time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << std::endl;
+	std::cout << "run time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms for " <<
+		nelem << " voxels in workgroups of " << local_size << std::endl;
 
-	bool print = true;
 	if (print) {
 		std::cout.precision(10);
 		std::cout << "CONST TYPES: " << std::endl;
@@ -1045,9 +1088,1066 @@ void run_qmri_ivim() {
 
 }
 
-int main() {
+// the whole volume fit for the workgroup sizes that are sensible on current hardware
+void run_qmri_ivim_local_sizes()
+{
+	for (uint32_t local_size : { 64u, 128u, 256u }) {
+		run_qmri_ivim(local_size, false);
+	}
+}
+
+// Runs the guess and partial ivim fit with all per voxel buffers in the given layout,
+// returns the fitted parameters in file (AoS) order
+std::vector<float> run_qmri_ivim_partial(glsl::BufferLayout layout)
+{
+	uint32_t ndata = 21;
+	uint32_t local_size = 64;
+
+	auto params = std::make_shared<glsl::VectorVariable>("params", 4, glsl::ShaderVariableType::FLOAT);
+	auto data = std::make_shared<glsl::VectorVariable>("data", ndata, glsl::ShaderVariableType::FLOAT);
+	auto bsplit = std::make_shared<glsl::VectorVariable>("bsplit", 2, glsl::ShaderVariableType::INT);
+	auto weights = std::make_shared<glsl::VectorVariable>("weights", ndata, glsl::ShaderVariableType::FLOAT);
+
+	auto pShader1 = glsl::qmri::ivim_guess_shader(ndata, true, layout);
+	pShader1->setLocalSize(local_size);
+	auto pShader2 = glsl::qmri::ivim_partial_nlsq_shader(ndata, true, layout);
+	pShader2->setLocalSize(local_size);
+
+	auto spirv1 = glsl::compileSource(pShader1->compile());
+	auto spirv2 = glsl::compileSource(pShader2->compile());
+
+	namespace fs = std::filesystem;
+	auto d_path = fs::current_path() / "data" / "ivim_data.vcdat";
+	auto c_path = fs::current_path() / "data" / "ivim_bvals.vcdat";
+
+	size_t nelem = glsl::VcdatFile(d_path, glsl::ShaderVariableType::FLOAT, ndata).info().nelem;
+
+	auto mgr = std::make_shared<kp::Manager>();
+
+	auto kp_params = glsl::tensor_from_vector(mgr, params, nelem);
+	auto kp_consts = glsl::tensor_from_file(mgr, glsl::ShaderVariableType::FLOAT, c_path);
+	auto kp_data = glsl::tensor_from_vector_file(mgr, data, d_path, layout);
+	auto kp_bsplit = glsl::tensor_from_vector(mgr, bsplit, 1);
+	std::vector<int32_t> data_bsplit(2); data_bsplit[0] = 11; data_bsplit[1] = 15;
+	std::memcpy(kp_bsplit->data<int32_t>(), data_bsplit.data(), sizeof(int32_t) * data_bsplit.size());
+
+	auto kp_weights = glsl::tensor_from_vector(mgr, weights, 1);
+	std::vector<float> data_weights(ndata, 1.0f);
+	std::memcpy(kp_weights->data<float>(), data_weights.data(), sizeof(float) * data_weights.size());
+
+	std::vector<std::shared_ptr<kp::Tensor>> shader_inputs = {
+		kp_params, kp_consts, kp_data, kp_bsplit, kp_weights
+	};
+
+	kp::Workgroup wg = pShader2->getWorkgroup(nelem);
+	std::vector<uint32_t> push_consts = { (uint32_t)nelem };
+
+	std::shared_ptr<kp::Algorithm> algo1 = mgr->algorithm<float, uint32_t>(shader_inputs, spirv1, wg, {}, push_consts);
+	std::shared_ptr<kp::Algorithm> algo2 = mgr->algorithm<float, uint32_t>(shader_inputs, spirv2, wg, {}, push_consts);
+
+	mgr->sequence()
+		->record<kp::OpTensorSyncDevice>(shader_inputs)
+		->record<kp::OpAlgoDispatch>(algo1)
+		->record<kp::OpMemoryBarrier>(shader_inputs, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead,
+			vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader)
+		->record<kp::OpAlgoDispatch>(algo2)
+		->record<kp::OpTensorSyncLocal>(shader_inputs)
+		->eval();
+
+	glsl::transpose_layout(kp_params, params->getNDim(), layout, glsl::BufferLayout::AOS);
+
+	return std::vector<float>(kp_params->data<float>(), kp_params->data<float>() + kp_params->size());
+}
+
+// Runs the guess, partial and full ivim fits through the GPU and through the C++ translation of the
+// same shaders, on copies of the same buffers, then times the cpu backend for doubling thread counts
+void compare_cpu_backend(float tolerance = 1e-4f)
+{
+	uint32_t ndata = 21;
+	uint32_t local_size = 64;
+
+	auto params = std::make_shared<glsl::VectorVariable>("params", 4, glsl::ShaderVariableType::FLOAT);
+	auto data = std::make_shared<glsl::VectorVariable>("data", ndata, glsl::ShaderVariableType::FLOAT);
+	auto bsplit = std::make_shared<glsl::VectorVariable>("bsplit", 2, glsl::ShaderVariableType::INT);
+	auto weights = std::make_shared<glsl::VectorVariable>("weights", ndata, glsl::ShaderVariableType::FLOAT);
+	auto lambda = std::make_shared<glsl::SingleVariable>("lambda", glsl::ShaderVariableType::FLOAT, std::nullopt);
+	auto step_type = std::make_shared<glsl::SingleVariable>("step_type", glsl::ShaderVariableType::INT, std::nullopt);
+	auto nlstep = std::make_shared<glsl::VectorVariable>("nlstep", 4, glsl::ShaderVariableType::FLOAT);
+	auto error = std::make_shared<glsl::SingleVariable>("error", glsl::ShaderVariableType::FLOAT, std::nullopt);
+	auto new_error = std::make_shared<glsl::SingleVariable>("new_error", glsl::ShaderVariableType::FLOAT, std::nullopt);
+	auto residuals = std::make_shared<glsl::VectorVariable>("residuals", ndata, glsl::ShaderVariableType::FLOAT);
+	auto jacobian = std::make_shared<glsl::MatrixVariable>("jacobian", ndata, 4, glsl::ShaderVariableType::FLOAT);
+	auto hessian = std::make_shared<glsl::MatrixVariable>("hessian", 4, 4, glsl::ShaderVariableType::FLOAT);
+
+	auto pShader1 = glsl::qmri::ivim_guess_shader(ndata, true);
+	pShader1->setLocalSize(local_size);
+	auto pShader2 = glsl::qmri::ivim_partial_nlsq_shader(ndata, true);
+	pShader2->setLocalSize(local_size);
+	auto pShader3 = glsl::qmri::ivim_full_nlsq_shader(ndata, true);
+	pShader3->setLocalSize(local_size);
+
+	cpu::JitCompiler jit(std::filesystem::current_path() / "jit_cache");
+	auto compile_start = std::chrono::steady_clock::now();
+	cpu::CpuShader cpu_shader1(*pShader1, jit);
+	cpu::CpuShader cpu_shader2(*pShader2, jit);
+	cpu::CpuShader cpu_shader3(*pShader3, jit);
+	auto compile_end = std::chrono::steady_clock::now();
+	std::cout << "cpu shaders ready in " << std::chrono::duration<double, std::milli>(compile_end - compile_start).count() <<
+		" ms" << std::endl;
+
+	auto spirv1 = glsl::compileSource(pShader1->compile());
+	auto spirv2 = glsl::compileSource(pShader2->compile());
+	auto spirv3 = glsl::compileSource(pShader3->compile());
+
+	namespace fs = std::filesystem;
+	auto d_path = fs::current_path() / "data" / "ivim_data.vcdat";
+	auto c_path = fs::current_path() / "data" / "ivim_bvals.vcdat";
+
+	uint32_t nelem = glsl::VcdatFile(d_path, glsl::ShaderVariableType::FLOAT, ndata).info().nelem;
+
+	auto mgr = std::make_shared<kp::Manager>();
+
+	auto kp_params = glsl::tensor_from_vector(mgr, params, nelem);
+	auto kp_consts = glsl::tensor_from_file(mgr, glsl::ShaderVariableType::FLOAT, c_path);
+	auto kp_data = glsl::tensor_from_vector_file(mgr, data, d_path);
+	auto kp_bsplit = glsl::tensor_from_vector(mgr, bsplit, 1);
+	std::vector<int32_t> data_bsplit(2); data_bsplit[0] = 11; data_bsplit[1] = 15;
+	std::memcpy(kp_bsplit->data<int32_t>(), data_bsplit.data(), sizeof(int32_t) * data_bsplit.size());
+
+	auto kp_weights = glsl::tensor_from_vector(mgr, weights, 1);
+	std::vector<float> data_weights(ndata, 1.0f);
+	std::memcpy(kp_weights->data<float>(), data_weights.data(), sizeof(float) * data_weights.size());
+
+	auto kp_lambda = glsl::tensor_from_single(mgr, lambda, nelem);
+	std::vector<float> data_lambda(nelem, 1.0f);
+	std::memcpy(kp_lambda->data<float>(), data_lambda.data(), data_lambda.size() * sizeof(float));
+
+	auto kp_step_type = glsl::tensor_from_single(mgr, step_type, nelem);
+	auto kp_nlstep = glsl::tensor_from_vector(mgr, nlstep, nelem);
+	auto kp_error = glsl::tensor_from_single(mgr, error, nelem);
+	auto kp_new_error = glsl::tensor_from_single(mgr, new_error, nelem);
+	auto kp_residuals = glsl::tensor_from_vector(mgr, residuals, nelem);
+	auto kp_jacobian = glsl::tensor_from_matrix(mgr, jacobian, nelem);
+	auto kp_hessian = glsl::tensor_from_matrix(mgr, hessian, nelem);
+
+	std::vector<std::shared_ptr<kp::Tensor>> shader_inputs = {
+		kp_params, kp_consts, kp_data, kp_bsplit, kp_weights, kp_lambda, kp_step_type,
+		kp_nlstep, kp_error, kp_new_error, kp_residuals, kp_jacobian, kp_hessian
+	};
+
+	// the cpu gets the buffers in the same binding order as the algorithm
+	std::vector<std::vector<std::byte>> initial_buffers;
+	for (auto& tensor : shader_inputs) {
+		auto bytes = static_cast<const std::byte*>(tensor->rawData());
+		initial_buffers.emplace_back(bytes, bytes + tensor->memorySize());
+	}
+	auto cpu_buffers = initial_buffers;
+	auto buffer_pointers = [&cpu_buffers]() {
+		std::vector<void*> ret;
+		for (auto& buffer : cpu_buffers) {
+			ret.push_back(buffer.data());
+		}
+		return ret;
+	};
+
+	kp::Workgroup wg = pShader3->getWorkgroup(nelem);
+	std::vector<uint32_t> push_consts = { nelem };
+
+	std::shared_ptr<kp::Algorithm> algo1 = mgr->algorithm<float, uint32_t>(shader_inputs, spirv1, wg, {}, push_consts);
+	std::shared_ptr<kp::Algorithm> algo2 = mgr->algorithm<float, uint32_t>(shader_inputs, spirv2, wg, {}, push_consts);
+	std::shared_ptr<kp::Algorithm> algo3 = mgr->algorithm<float, uint32_t>(shader_inputs, spirv3, wg, {}, push_consts);
+
+	auto gpu_start = std::chrono::steady_clock::now();
+	mgr->sequence()
+		->record<kp::OpTensorSyncDevice>(shader_inputs)
+		->record<kp::OpAlgoDispatch>(algo1)
+		->record<kp::OpMemoryBarrier>(shader_inputs, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead,
+			vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader)
+		->record<kp::OpAlgoDispatch>(algo2)
+		->record<kp::OpMemoryBarrier>(shader_inputs, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead,
+			vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader)
+		->record<kp::OpAlgoDispatch>(algo3)
+		->record<kp::OpTensorSyncLocal>(shader_inputs)
+		->eval();
+	auto gpu_end = std::chrono::steady_clock::now();
+
+	double gpu_seconds = std::chrono::duration<double>(gpu_end - gpu_start).count();
+	std::cout << "gpu: " << nelem / gpu_seconds * 1e-6 << " Melem/s (including transfers)" << std::endl;
+
+	vc::ui32 max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+	for (vc::ui32 nthreads = 1; ; nthreads = std::min(2 * nthreads, max_threads)) {
+		cpu_buffers = initial_buffers;
+		auto pointers = buffer_pointers();
+
+		auto start = std::chrono::steady_clock::now();
+		if (nthreads == 1) {
+			cpu_shader1.run(nelem, pointers);
+			cpu_shader2.run(nelem, pointers);
+			cpu_shader3.run(nelem, pointers);
+		}
+		else {
+			// the calling thread takes part in the work
+			util::ThreadPool pool(nthreads - 1);
+			cpu_shader1.run(nelem, pointers, pool);
+			cpu_shader2.run(nelem, pointers, pool);
+			cpu_shader3.run(nelem, pointers, pool);
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		std::cout << "cpu, " << nthreads << " threads: " << nelem / seconds * 1e-6 << " Melem/s" << std::endl;
+
+		if (nthreads == max_threads)
+			break;
+	}
+
+	const float* gpu_params = kp_params->data<float>();
+	const float* cpu_params = reinterpret_cast<const float*>(cpu_buffers[0].data());
+	float max_diff = 0.0f;
+	vc::ui64 nfailed = 0;
+	for (vc::ui64 i = 0; i < kp_params->size(); ++i) {
+		float diff = std::abs(gpu_params[i] - cpu_params[i]) / std::max(std::abs(gpu_params[i]), 1e-6f);
+		if (std::isnan(gpu_params[i]) && std::isnan(cpu_params[i]))
+			continue;
+		if (!(diff <= tolerance))
+			++nfailed;
+		max_diff = std::max(max_diff, diff);
+	}
+
+	std::cout << "max relative difference between gpu and cpu params: " << max_diff << ", " << nfailed <<
+		" of " << kp_params->size() << " outside tolerance " << tolerance << std::endl;
+}
+
+// Both layouts should give the same fit, run with VK_ICD_FILENAMES pointing to a software
+// driver (lavapipe, SwiftShader) to check the emitted SoA indexing without a GPU
+void compare_ivim_layouts()
+{
+	auto aos_params = run_qmri_ivim_partial(glsl::BufferLayout::AOS);
+	auto soa_params = run_qmri_ivim_partial(glsl::BufferLayout::SOA);
+
+	if (aos_params.size() != soa_params.size())
+		throw std::runtime_error("AoS and SoA runs returned different number of parameters");
+
+	float max_diff = 0.0f;
+	for (size_t i = 0; i < aos_params.size(); ++i) {
+		max_diff = std::max(max_diff, std::abs(aos_params[i] - soa_params[i]));
+	}
+
+	std::cout << "max abs difference between AoS and SoA params: " << max_diff << std::endl;
+}
+
+// Runs the guess and partial ivim fit with the voxels split between the GPU and the cpu translation
+// of the shaders, and compares against the whole volume on the GPU. With all_devices every physical
+// device gets its own manager and a share of the voxels. With VK_ICD_FILENAMES pointing to software
+// drivers (lavapipe, SwiftShader) all backends run on the cpu cores
+void run_qmri_ivim_scheduled(glsl::VoxelSchedulerOptions options = {}, bool all_devices = false, float tolerance = 1e-4f)
+{
+	uint32_t ndata = 21;
+	uint32_t local_size = 64;
+
+	auto pShader1 = glsl::qmri::ivim_guess_shader(ndata, true);
+	pShader1->setLocalSize(local_size);
+	auto pShader2 = glsl::qmri::ivim_partial_nlsq_shader(ndata, true);
+	pShader2->setLocalSize(local_size);
+
+	namespace fs = std::filesystem;
+	auto read_floats = [](const fs::path& path, vc::ui32 ndim) {
+		glsl::VcdatFile file(path, glsl::ShaderVariableType::FLOAT, ndim);
+		std::vector<float> ret(file.info().nelem * file.info().components());
+		file.read(0, file.info().nelem, ret.data());
+		return ret;
+	};
+
+	auto data = read_floats(fs::current_path() / "data" / "ivim_data.vcdat", ndata);
+	auto consts = read_floats(fs::current_path() / "data" / "ivim_bvals.vcdat", 1);
+	uint32_t nelem = data.size() / ndata;
+
+	std::vector<float> params(nelem * 4);
+	std::vector<int32_t> bsplit = { 11, 15 };
+	std::vector<float> weights(ndata, 1.0f);
+
+	std::vector<glsl::VoxelBuffer> buffers = {
+		{ params.data(), glsl::ShaderVariableType::FLOAT, 4, true },
+		{ consts.data(), glsl::ShaderVariableType::FLOAT, (vc::ui32)consts.size(), false },
+		{ data.data(), glsl::ShaderVariableType::FLOAT, ndata, true },
+		{ bsplit.data(), glsl::ShaderVariableType::INT, 2, false },
+		{ weights.data(), glsl::ShaderVariableType::FLOAT, ndata, false },
+	};
+
+	std::vector<std::shared_ptr<kp::Manager>> managers;
+	if (options.use_gpu && all_devices)
+		managers = glsl::create_device_managers();
+	else if (options.use_gpu)
+		managers.push_back(std::make_shared<kp::Manager>());
+
+	cpu::JitCompiler jit(fs::current_path() / "jit_cache");
+	glsl::VoxelScheduler scheduler({ pShader1, pShader2 }, managers, jit, options);
+
+	util::ThreadPool pool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+	auto stats = scheduler.run(nelem, buffers, pool);
+
+	std::cout << "scheduled " << nelem << " voxels in " << stats.seconds << " s, " <<
+		nelem / stats.seconds * 1e-6 << " Mvoxels/s" << std::endl;
+	for (auto& backend : stats.backends) {
+		std::cout << backend.name << ": " << 100.0 * backend.voxels / nelem << "% of the voxels in " << backend.chunks <<
+			" chunks, " << backend.throughput * 1e-6 << " Mvoxels/s" << std::endl;
+	}
+
+	if (!options.use_gpu)
+		return;
+
+	auto gpu_params = run_qmri_ivim_partial(glsl::BufferLayout::AOS);
+	float max_diff = 0.0f;
+	vc::ui64 nfailed = 0;
+	for (vc::ui64 i = 0; i < params.size(); ++i) {
+		if (std::isnan(gpu_params[i]) && std::isnan(params[i]))
+			continue;
+		float diff = std::abs(gpu_params[i] - params[i]) / std::max(std::abs(gpu_params[i]), 1e-6f);
+		if (!(diff <= tolerance))
+			++nfailed;
+		max_diff = std::max(max_diff, diff);
+	}
+
+	std::cout << "max relative difference to the gpu only params: " << max_diff << ", " << nfailed <<
+		" of " << params.size() << " outside tolerance " << tolerance << std::endl;
+}
+
+// Runs the guess, partial and full ivim fit through the stream executor, only a few chunks of the
+// per voxel buffers are on the device at a time. The scratch buffers (residuals, jacobian, hessian, ...)
+// never leave it and the data is uploaded straight from the mapped file. If run_qmri_ivim has written
+// its parameters they are compared against
+void run_qmri_ivim_streamed(vc::ui64 memory_budget = 256ull * 1024ull * 1024ull, float tolerance = 1e-4f)
+{
+	uint32_t ndata = 21;
+	uint32_t local_size = 64;
+
+	auto pShader1 = glsl::qmri::ivim_guess_shader(ndata, true);
+	pShader1->setLocalSize(local_size);
+	auto pShader2 = glsl::qmri::ivim_partial_nlsq_shader(ndata, true);
+	pShader2->setLocalSize(local_size);
+	auto pShader3 = glsl::qmri::ivim_full_nlsq_shader(ndata, true);
+	pShader3->setLocalSize(local_size);
+
+	namespace fs = std::filesystem;
+	glsl::VcdatFile data_file(fs::current_path() / "data" / "ivim_data.vcdat", glsl::ShaderVariableType::FLOAT, ndata);
+	glsl::VcdatFile consts_file(fs::current_path() / "data" / "ivim_bvals.vcdat");
+	auto data = data_file.mapData();
+	auto consts = consts_file.mapData();
+	if (!data.has_value() || data_file.info().layout != glsl::BufferLayout::AOS || !consts.has_value())
+		throw std::runtime_error("ivim_data.vcdat must be stored in AoS order with its chunks back to back to be streamed");
+	uint32_t nelem = data_file.info().nelem;
+
+	std::vector<float> params(nelem * 4);
+	std::vector<int32_t> bsplit = { 11, 15 };
+	std::vector<float> weights(ndata, 1.0f);
+	std::vector<float> lambda(nelem, 1.0f);
+
+	auto mapped = [](const util::MappedFile& file) { return const_cast<std::byte*>(file.data()); };
+	auto scratch = [](glsl::ShaderVariableType type, vc::ui32 components) {
+		return glsl::StreamBuffer{ { nullptr, type, components, true }, glsl::StreamTransfer::NONE };
+	};
+
+	using glsl::ShaderVariableType;
+	using glsl::StreamTransfer;
+	std::vector<glsl::StreamBuffer> buffers = {
+		{ { params.data(), ShaderVariableType::FLOAT, 4, true }, StreamTransfer::DOWNLOAD },
+		{ { mapped(*consts), ShaderVariableType::FLOAT, (vc::ui32)(consts->size() / sizeof(float)), false }, StreamTransfer::NONE },
+		{ { mapped(*data), ShaderVariableType::FLOAT, ndata, true }, StreamTransfer::UPLOAD },
+		{ { bsplit.data(), ShaderVariableType::INT, 2, false }, StreamTransfer::NONE },
+		{ { weights.data(), ShaderVariableType::FLOAT, ndata, false }, StreamTransfer::NONE },
+		{ { lambda.data(), ShaderVariableType::FLOAT, 1, true }, StreamTransfer::UPLOAD },
+		scratch(ShaderVariableType::INT, 1),
+		scratch(ShaderVariableType::FLOAT, 4),
+		scratch(ShaderVariableType::FLOAT, 1),
+		scratch(ShaderVariableType::FLOAT, 1),
+		scratch(ShaderVariableType::FLOAT, ndata),
+		scratch(ShaderVariableType::FLOAT, ndata * 4),
+		scratch(ShaderVariableType::FLOAT, 4 * 4),
+	};
+
+	glsl::StreamExecutorOptions options;
+	options.memory_budget = memory_budget;
+	options.timestamps = true;
+	auto mgr = glsl::create_stream_manager(0, options);
+	glsl::StreamExecutor executor({ pShader1, pShader2, pShader3 }, mgr, options);
+
+	auto stats = executor.run(nelem, buffers);
+
+	std::cout << "streamed " << nelem << " voxels in " << stats.nchunks << " chunks of " << stats.chunk_size << ", " <<
+		stats.device_bytes / (1024.0 * 1024.0) << " MiB of per voxel buffers, " << nelem / stats.seconds * 1e-6 <<
+		" Mvoxels/s" << std::endl;
+
+	// the device time of the stages against the time they had, above one the stages ran at the same time
+	double busy_seconds = stats.upload_seconds + stats.compute_seconds + stats.download_seconds;
+	std::cout << "queues upload " << options.upload_queue << ", compute " << options.compute_queue << ", download " <<
+		options.download_queue << ", stages busy upload " << stats.upload_seconds << " s, compute " << stats.compute_seconds <<
+		" s, download " << stats.download_seconds << " s in " << stats.stream_seconds << " s of streaming, overlap " <<
+		busy_seconds / stats.stream_seconds << std::endl;
+
+	auto p_path = fs::current_path() / "data" / "ivim_params.vcdat";
+	if (!fs::exists(p_path))
+		return;
+
+	util::MappedFile whole_params(p_path);
+	if (whole_params.size() != params.size() * sizeof(float))
+		throw std::runtime_error("ivim_params.vcdat does not hold the parameters of every voxel");
+
+	const float* expected = reinterpret_cast<const float*>(whole_params.data());
+	float max_diff = 0.0f;
+	vc::ui64 nfailed = 0;
+	for (vc::ui64 i = 0; i < params.size(); ++i) {
+		if (std::isnan(expected[i]) && std::isnan(params[i]))
+			continue;
+		float diff = std::abs(expected[i] - params[i]) / std::max(std::abs(expected[i]), 1e-6f);
+		if (!(diff <= tolerance))
+			++nfailed;
+		max_diff = std::max(max_diff, diff);
+	}
+
+	std::cout << "max relative difference to the whole volume params: " << max_diff << ", " << nfailed <<
+		" of " << params.size() << " outside tolerance " << tolerance << std::endl;
+}
+
+// Writes the ivim data as a .vcdat v2 file, verifies the checksum of every chunk and checks reads of
+// random voxel ranges in both layouts against the whole volume
+void run_vcdat_conversion(vc::ui64 chunk_size = glsl::VCDAT_DEFAULT_CHUNK_SIZE,
+	glsl::BufferLayout layout = glsl::BufferLayout::AOS, int nreads = 100)
+{
+	uint32_t ndata = 21;
+
+	namespace fs = std::filesystem;
+	auto d_path = fs::current_path() / "data" / "ivim_data.vcdat";
+	auto v2_path = fs::current_path() / "data" / "ivim_data_v2.vcdat";
+
+	glsl::VcdatFile source(d_path, glsl::ShaderVariableType::FLOAT, ndata);
+	vc::ui64 nelem = source.info().nelem;
+	std::vector<float> data(nelem * ndata);
+	source.read(0, nelem, data.data());
+
+	auto start = std::chrono::steady_clock::now();
+	glsl::write_vcdat(v2_path, data.data(), glsl::ShaderVariableType::FLOAT, nelem, ndata, 1, layout, chunk_size);
+	auto write_time = std::chrono::steady_clock::now() - start;
+
+	glsl::VcdatFile file(v2_path);
+	if (file.info().version != glsl::VCDAT_VERSION || file.info().nelem != nelem || file.info().components() != ndata)
+		throw std::runtime_error("ivim_data_v2.vcdat header does not match the written data");
+
+	for (vc::ui64 c = 0; c < file.info().chunks.size(); ++c) {
+		if (!file.verifyChunk(c))
+			throw std::runtime_error("Checksum mismatch in chunk " + std::to_string(c) + " of ivim_data_v2.vcdat");
+	}
+
+	std::mt19937_64 rng(1234);
+	std::vector<float> values;
+	vc::ui64 nmismatch = 0;
+	start = std::chrono::steady_clock::now();
+	for (int r = 0; r < nreads; ++r) {
+		vc::ui64 first = std::uniform_int_distribution<vc::ui64>(0, nelem)(rng);
+		vc::ui64 count = std::uniform_int_distribution<vc::ui64>(0, std::min<vc::ui64>(nelem - first, 2 * chunk_size))(rng);
+		auto read_layout = r % 2 == 0 ? glsl::BufferLayout::AOS : glsl::BufferLayout::SOA;
+
+		values.resize(count * ndata);
+		file.read(first, count, values.data(), read_layout);
+		for (vc::ui64 e = 0; e < count; ++e) {
+			for (vc::ui32 i = 0; i < ndata; ++i) {
+				float value = read_layout == glsl::BufferLayout::AOS ? values[e * ndata + i] : values[i * count + e];
+				if (std::memcmp(&value, &data[(first + e) * ndata + i], sizeof(float)) != 0)
+					++nmismatch;
+			}
+		}
+	}
+	auto read_time = std::chrono::steady_clock::now() - start;
+
+	std::cout << "wrote " << nelem << " voxels in " << file.info().chunks.size() << " chunks in " <<
+		std::chrono::duration<double>(write_time).count() << " s, " << nreads << " random reads in " <<
+		std::chrono::duration<double>(read_time).count() << " s, " << nmismatch << " mismatching values" << std::endl;
+}
+
+// Times building the full ivim shader (symbolic differentiation) and generating its GLSL
+// separately, the first compile of a shader is when the function templates are rendered
+void benchmark_codegen(int iterations = 20, glsl::DerivativeMode derivative_mode = glsl::DerivativeMode::SYMBOLIC)
+{
+	vc::ui16 ndata = 21;
+
+	std::chrono::steady_clock::duration build_time{};
+	std::chrono::steady_clock::duration codegen_time{};
+	size_t code_size = 0;
+
+	for (int i = 0; i < iterations; ++i) {
+		for (bool single_precision : { true, false }) {
+			auto build_start = std::chrono::steady_clock::now();
+			auto pShader = glsl::qmri::ivim_full_nlsq_shader(ndata, single_precision,
+				glsl::BufferLayout::AOS, derivative_mode);
+			auto codegen_start = std::chrono::steady_clock::now();
+			code_size += pShader->compile().size();
+			auto codegen_end = std::chrono::steady_clock::now();
+
+			build_time += codegen_start - build_start;
+			codegen_time += codegen_end - codegen_start;
+		}
+	}
+
+	int nshaders = 2 * iterations;
+	std::cout << "shader build time: " <<
+		std::chrono::duration<double, std::micro>(build_time).count() / nshaders << " us" << std::endl;
+	std::cout << "codegen time: " <<
+		std::chrono::duration<double, std::micro>(codegen_time).count() / nshaders << " us" << std::endl;
+	std::cout << "generated " << code_size / nshaders << " characters per shader" << std::endl;
+
+	// instruction counts with and without the simplify rewrites
+	for (bool simplify : { false, true }) {
+		for (bool single_precision : { true, false }) {
+			auto spirv = glsl::compileSource(glsl::qmri::ivim_full_nlsq_shader(ndata, single_precision,
+				glsl::BufferLayout::AOS, derivative_mode, simplify)->compile());
+			std::cout << (single_precision ? "single" : "double") << " precision SPIR-V instructions " <<
+				(simplify ? "with" : "without") << " simplify: " << glsl::countSpirvInstructions(spirv) << std::endl;
+		}
+	}
+
+	auto derivative_stats = expression::derivative_cache().get_stats();
+	std::cout << "derivative cache hits: " << derivative_stats.hits << " misses: " << derivative_stats.misses << std::endl;
+}
+
+// op of every node type of the parsed tree, the nodes that only wrap their child have none
+const std::unordered_map<std::type_index, expression::DagOp>& tree_walk_ops()
+{
+	using namespace expression;
+	static const std::unordered_map<std::type_index, DagOp> ops = {
+		{ typeid(NegNode), DagOp::NEG }, { typeid(AddNode), DagOp::ADD }, { typeid(SubNode), DagOp::SUB },
+		{ typeid(MulNode), DagOp::MUL }, { typeid(DivNode), DagOp::DIV }, { typeid(PowNode), DagOp::POW },
+		{ typeid(SgnNode), DagOp::SGN }, { typeid(AbsNode), DagOp::ABS }, { typeid(SqrtNode), DagOp::SQRT },
+		{ typeid(ExpNode), DagOp::EXP }, { typeid(LogNode), DagOp::LOG }, { typeid(SinNode), DagOp::SIN },
+		{ typeid(CosNode), DagOp::COS }, { typeid(TanNode), DagOp::TAN }, { typeid(AsinNode), DagOp::ASIN },
+		{ typeid(AcosNode), DagOp::ACOS }, { typeid(AtanNode), DagOp::ATAN }, { typeid(SinhNode), DagOp::SINH },
+		{ typeid(CoshNode), DagOp::COSH }, { typeid(TanhNode), DagOp::TANH }, { typeid(AsinhNode), DagOp::ASINH },
+		{ typeid(AcoshNode), DagOp::ACOSH }, { typeid(AtanhNode), DagOp::ATANH },
+		{ typeid(VariableNode), DagOp::VARIABLE }, { typeid(TokenNode), DagOp::NUMBER },
+	};
+	return ops;
+}
+
+// naive evaluation of one point, walks the parsed expression tree as it is, without the sharing or
+// rewrites of the dag. Numbers and variables are read from leaf_values by node, so the walk measures
+// interpretation and not name lookups or literal parsing
+double tree_walk(const expression::Node& node, const std::unordered_map<const expression::Node*, double>& leaf_values)
+{
+	using expression::DagOp;
+
+	auto op = tree_walk_ops().find(typeid(node));
+	if (op == tree_walk_ops().end())
+		return tree_walk(*node.children[0], leaf_values);
+
+	auto arg = [&](int i) { return tree_walk(*node.children[i], leaf_values); };
+
+	switch (op->second) {
+	case DagOp::NUMBER:
+	case DagOp::VARIABLE: return leaf_values.at(&node);
+	case DagOp::NEG: return -arg(0);
+	case DagOp::ADD: return arg(0) + arg(1);
+	case DagOp::SUB: return arg(0) - arg(1);
+	case DagOp::MUL: return arg(0) * arg(1);
+	case DagOp::DIV: return arg(0) / arg(1);
+	case DagOp::POW: return std::pow(arg(0), arg(1));
+	case DagOp::SGN: { double x = arg(0); return static_cast<double>((0.0 < x) - (x < 0.0)); }
+	case DagOp::ABS: return std::abs(arg(0));
+	case DagOp::SQRT: return std::sqrt(arg(0));
+	case DagOp::EXP: return std::exp(arg(0));
+	case DagOp::LOG: return std::log(arg(0));
+	case DagOp::SIN: return std::sin(arg(0));
+	case DagOp::COS: return std::cos(arg(0));
+	case DagOp::TAN: return std::tan(arg(0));
+	case DagOp::ASIN: return std::asin(arg(0));
+	case DagOp::ACOS: return std::acos(arg(0));
+	case DagOp::ATAN: return std::atan(arg(0));
+	case DagOp::SINH: return std::sinh(arg(0));
+	case DagOp::COSH: return std::cosh(arg(0));
+	case DagOp::TANH: return std::tanh(arg(0));
+	case DagOp::ASINH: return std::asinh(arg(0));
+	case DagOp::ACOSH: return std::acosh(arg(0));
+	case DagOp::ATANH: return std::atanh(arg(0));
+	default:
+		throw std::runtime_error("tree_walk can't evaluate the node");
+	}
+}
+
+void benchmark_evaluator(size_t npoints = 1 << 20)
+{
+	// the ivim model, and an expression with every op of the bytecode for inputs in [0, 1)
+	std::vector<std::pair<std::string, std::vector<std::string>>> benchmarks = {
+		{ "s0*(f*exp(-b*d1)+(1-f)*exp(-b*d2))", { "s0","f","d1","d2","b" } },
+		{ "sgn(x-0.5)*abs(y-z)+sqrt(x)*exp(-y)/log(2+z)+pow(x,y)+x**3+sin(x)*cos(y)-tan(z)+asin(0.5*x)*acos(0.5*y)-atan(z)"
+			"+sinh(x)/cosh(y)+tanh(z)+asinh(w)-acosh(1+w)+atanh(0.5*w)", { "x","y","z","w" } },
+	};
+
+	for (auto& [expresh, vars] : benchmarks) {
+		expression::Expression expr(expresh, vars);
+
+		std::vector<std::vector<double>> inputs(vars.size(), std::vector<double>(npoints));
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<double> dist(0.0, 1.0);
+		for (auto& input : inputs) {
+			for (auto& v : input) {
+				v = dist(rng);
+			}
+		}
+
+		// numbers are parsed once, variable nodes get the index of their input
+		std::unordered_map<const expression::Node*, double> leaf_values;
+		std::vector<std::pair<const expression::Node*, size_t>> variable_slots;
+		std::vector<const expression::Node*> stack = { &expr };
+		while (!stack.empty()) {
+			auto node = stack.back();
+			stack.pop_back();
+			for (auto& child : node->children) {
+				stack.push_back(child.get());
+			}
+			if (typeid(*node) == typeid(expression::TokenNode)) {
+				leaf_values[node] = std::stod(node->str());
+			}
+			else if (typeid(*node) == typeid(expression::VariableNode)) {
+				auto it = std::find(vars.begin(), vars.end(), node->str());
+				if (it == vars.end())
+					throw std::runtime_error("Unknown variable " + node->str() + " in the benchmark expression");
+				leaf_values[node] = 0.0;
+				variable_slots.emplace_back(node, it - vars.begin());
+			}
+		}
+
+		std::vector<double> tree_output(npoints);
+		auto tree_start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < npoints; ++i) {
+			for (auto& [node, v] : variable_slots) {
+				leaf_values[node] = inputs[v][i];
+			}
+			tree_output[i] = tree_walk(expr, leaf_values);
+		}
+		auto tree_end = std::chrono::steady_clock::now();
+
+		expression::BatchEvaluator evaluator({ &expr }, vars);
+		std::vector<const double*> input_ptrs;
+		for (auto& input : inputs) {
+			input_ptrs.push_back(input.data());
+		}
+		std::vector<double> batch_output(npoints);
+		auto batch_start = std::chrono::steady_clock::now();
+		evaluator.evaluate(input_ptrs, { batch_output.data() }, npoints);
+		auto batch_end = std::chrono::steady_clock::now();
+
+		// the bytecode is simplified, x/c becomes x*(1/c) and pow with small integer exponents products
+		double max_error = 0.0;
+		for (size_t i = 0; i < npoints; ++i) {
+			max_error = std::max(max_error, std::abs(tree_output[i] - batch_output[i]) /
+				std::max(std::abs(tree_output[i]), 1.0));
+		}
+
+		auto throughput = [npoints](std::chrono::steady_clock::duration d) {
+			return npoints / std::chrono::duration<double>(d).count() * 1e-6;
+		};
+		std::cout << expresh << std::endl;
+		std::cout << "tree walk: " << throughput(tree_end - tree_start) << " Mpoints/s" << std::endl;
+		std::cout << "batch evaluator: " << throughput(batch_end - batch_start) << " Mpoints/s, " <<
+			evaluator.get_n_instructions() << " instructions, " << evaluator.get_n_registers() << " registers" << std::endl;
+		std::cout << "max relative difference: " << max_error << std::endl;
+	}
+}
+
+void benchmark_cpu_jit(int nproblems = 100000)
+{
+	constexpr vc::ui16 ndata = 21;
+	constexpr vc::ui16 nparam = 4;
+
+	std::vector<std::string> vars = { "s0","f","d1","d2","b" };
+	expression::Expression expr("s0*(f*exp(-b*d1)+(1-f)*exp(-b*d2))", vars);
+	glsl::SymbolicContext context;
+	context.insert_const(std::make_pair("b", 0));
+	context.insert_param(std::make_pair("s0", 0));
+	context.insert_param(std::make_pair("f", 1));
+	context.insert_param(std::make_pair("d1", 2));
+	context.insert_param(std::make_pair("d2", 3));
+
+	auto kernel = cpu::nlsq_cpp_kernel(expr, context, ndata, nparam, 1, true, 2);
+
+	cpu::JitCompiler jit(std::filesystem::current_path() / "jit_cache");
+	auto compile_start = std::chrono::steady_clock::now();
+	auto func = jit.get_function<cpu::NlsqKernel<float>>(kernel.source, kernel.name);
+	auto compile_end = std::chrono::steady_clock::now();
+
+	std::vector<float> params(nproblems * nparam);
+	std::vector<float> consts(nproblems * ndata);
+	std::vector<float> data(nproblems * ndata, 0.0f);
+	for (int p = 0; p < nproblems; ++p) {
+		params[p * nparam + 0] = 1.0f;
+		params[p * nparam + 1] = 0.2f;
+		params[p * nparam + 2] = 0.1f;
+		params[p * nparam + 3] = 0.001f;
+		for (int i = 0; i < ndata; ++i) {
+			consts[p * ndata + i] = 50.0f * i;
+		}
+	}
+	std::vector<float> residuals(nproblems * ndata);
+	std::vector<float> jacobian(nproblems * ndata * nparam);
+	std::vector<float> hessian(nproblems * nparam * nparam);
+
+	auto run_start = std::chrono::steady_clock::now();
+	func(nproblems, params.data(), consts.data(), data.data(), residuals.data(), jacobian.data(), hessian.data());
+	auto run_end = std::chrono::steady_clock::now();
+
+	float max_error = 0.0f;
+	for (int i = 0; i < ndata; ++i) {
+		float b = consts[i];
+		float expected = 1.0f * (0.2f * std::exp(-b * 0.1f) + 0.8f * std::exp(-b * 0.001f));
+		max_error = std::max(max_error, std::abs(residuals[i] - expected));
+	}
+
+	auto stats = jit.get_stats();
+	std::cout << "jit kernel ready in " << std::chrono::duration<double, std::milli>(compile_end - compile_start).count() <<
+		" ms (" << stats.compilations << " compilations, " << stats.loads << " cached loads)" << std::endl;
+	std::cout << "jit residuals/jacobian/hessian: " <<
+		nproblems / std::chrono::duration<double>(run_end - run_start).count() * 1e-6 << " Mproblems/s" << std::endl;
+	std::cout << "max residual difference: " << max_error << std::endl;
+}
+
+// The batched workload of Playground/timing.py: per voxel the gradient -J^T r and gauss newton
+// hessian J^T J of an ndata x nparam jacobian, then an LU solve, repeated 30 times. Runs the unrolled
+// kernels one voxel at a time (lanes = 1, plain row major storage) and with one voxel per SIMD lane
+template<int nparam>
+void benchmark_batched_linalg(vc::ui64 nelem = 500000)
+{
+	constexpr int ndata = 21;
+	constexpr int lanes = cpu::simd_lanes<float>;
+	constexpr int repeats = 30;
+
+	vc::ui64 nblocks = (nelem + lanes - 1) / lanes;
+
+	std::vector<float> jacobian(nelem * ndata * nparam);
+	std::vector<float> residuals(nelem * ndata);
+	std::mt19937 gen(1);
+	std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+	for (auto& x : jacobian)
+		x = dist(gen);
+	for (auto& x : residuals)
+		x = dist(gen);
+
+	std::vector<float> jacobian_blocks(nblocks * lanes * ndata * nparam);
+	std::vector<float> residual_blocks(nblocks * lanes * ndata);
+	cpu::interleave<ndata, nparam, lanes>(nelem, jacobian.data(), jacobian_blocks.data());
+	cpu::interleave<1, ndata, lanes>(nelem, residuals.data(), residual_blocks.data());
+
+	auto run = [&]<int L>(const std::vector<float>& jac, const std::vector<float>& res, std::vector<float>& sol,
+		vc::ui64 first, vc::ui64 last)
+	{
+		float hessian[nparam * nparam * L];
+		float grad[nparam * L];
+		vc::i32 pivot[nparam * L];
+		for (vc::ui64 b = first; b < last; ++b) {
+			const float* J = jac.data() + b * ndata * nparam * L;
+			const float* r = res.data() + b * ndata * L;
+			float* x = sol.data() + b * nparam * L;
+			for (int rep = 0; rep < repeats; ++rep) {
+				cpu::mul_transpose_vec<ndata, nparam, L>(J, r, grad);
+				for (int e = 0; e < nparam * L; ++e)
+					grad[e] = -grad[e];
+				cpu::mul_transpose_mat<ndata, nparam, L>(J, hessian);
+				cpu::lu_partial_pivot<nparam, L>(hessian, pivot);
+				cpu::lu_solve<nparam, L>(hessian, pivot, grad, x);
+			}
+		}
+	};
+
+	std::vector<float> scalar_sol(nelem * nparam);
+	auto scalar_start = std::chrono::steady_clock::now();
+	run.template operator()<1>(jacobian, residuals, scalar_sol, 0, nelem);
+	auto scalar_end = std::chrono::steady_clock::now();
+
+	std::vector<float> simd_blocks(nblocks * lanes * nparam);
+	auto simd_start = std::chrono::steady_clock::now();
+	run.template operator()<lanes>(jacobian_blocks, residual_blocks, simd_blocks, 0, nblocks);
+	auto simd_end = std::chrono::steady_clock::now();
+
+	util::ThreadPool pool;
+	auto pool_start = std::chrono::steady_clock::now();
+	util::parallel_for(pool, 0, nblocks, 64, [&](vc::ui64 first, vc::ui64 last) {
+		run.template operator()<lanes>(jacobian_blocks, residual_blocks, simd_blocks, first, last);
+		});
+	auto pool_end = std::chrono::steady_clock::now();
+
+	std::vector<float> simd_sol(nelem * nparam);
+	cpu::deinterleave<1, nparam, lanes>(nelem, simd_blocks.data(), simd_sol.data());
+	float max_diff = 0.0f;
+	for (vc::ui64 i = 0; i < simd_sol.size(); ++i) {
+		max_diff = std::max(max_diff, std::abs(simd_sol[i] - scalar_sol[i]) / std::max(std::abs(scalar_sol[i]), 1.0f));
+	}
+
+	auto mvoxels = [nelem](auto start, auto end) {
+		return nelem * repeats / std::chrono::duration<double>(end - start).count() * 1e-6;
+	};
+	std::cout << nparam << "x" << nparam << " lu solves, " << mvoxels(scalar_start, scalar_end) << " Mvoxels/s one voxel at a time, " <<
+		mvoxels(simd_start, simd_end) << " Mvoxels/s over " << lanes << " lanes, " <<
+		mvoxels(pool_start, pool_end) << " Mvoxels/s on " << pool.size() + 1 << " threads" << std::endl;
+	std::cout << "max relative difference between lane and scalar solutions: " << max_diff << std::endl;
+}
+
+// Fits the full ivim model to synthetic voxels with the cpu levenberg marquardt solver, on one
+// thread and on doubling thread counts, and prints the throughput per core. T is the precision of the fit
+template<typename T = float>
+void benchmark_cpu_nlsq(vc::ui32 nproblems = 500000, vc::ui32 iterations = 10)
+{
+	constexpr vc::ui16 ndata = 21;
+	constexpr vc::ui16 nparam = 4;
+
+	std::vector<std::string> vars = { "s0","f","d1","d2","b" };
+	expression::Expression expr("s0*(f*exp(-b*d1)+(1-f)*exp(-b*d2))", vars);
+	glsl::SymbolicContext context;
+	context.insert_const(std::make_pair("b", 0));
+	context.insert_param(std::make_pair("s0", 0));
+	context.insert_param(std::make_pair("f", 1));
+	context.insert_param(std::make_pair("d1", 2));
+	context.insert_param(std::make_pair("d2", 3));
+
+	cpu::JitCompiler jit(std::filesystem::current_path() / "jit_cache");
+	auto compile_start = std::chrono::steady_clock::now();
+	cpu::NlsqSolver<T> solver(expr, context, ndata, nparam, 1, jit);
+	auto compile_end = std::chrono::steady_clock::now();
+	std::cout << "nlsq solver ready in " << std::chrono::duration<double, std::milli>(compile_end - compile_start).count() <<
+		" ms" << std::endl;
+
+	std::vector<T> bvals(ndata);
+	for (int i = 0; i < ndata; ++i) {
+		bvals[i] = T(40) * i;
+	}
+
+	std::mt19937 gen(1);
+	std::uniform_real_distribution<T> dist(0, 1);
+	std::normal_distribution<T> noise(0, 10);
+
+	std::vector<T> truth(nproblems * nparam);
+	std::vector<T> initial_params(nproblems * nparam);
+	std::vector<T> data(nproblems * ndata);
+	std::vector<T> lower_bound(nproblems * nparam, T(0));
+	std::vector<T> upper_bound(nproblems * nparam);
+	for (vc::ui32 p = 0; p < nproblems; ++p) {
+		T* t = &truth[p * nparam];
+		t[0] = 1000 + 1000 * dist(gen);
+		t[1] = T(0.05) + T(0.25) * dist(gen);
+		t[2] = T(0.02) + T(0.05) * dist(gen);
+		t[3] = T(0.0005) + T(0.002) * dist(gen);
+		for (int i = 0; i < ndata; ++i) {
+			data[p * ndata + i] = t[0] * (t[1] * std::exp(-bvals[i] * t[2]) + (1 - t[1]) * std::exp(-bvals[i] * t[3])) +
+				noise(gen);
+		}
+		for (int k = 0; k < nparam; ++k) {
+			initial_params[p * nparam + k] = t[k] * (T(0.7) + T(0.6) * dist(gen));
+		}
+		// the bounds of the full ivim shader
+		upper_bound[p * nparam + 0] = data[p * ndata] * 20;
+		upper_bound[p * nparam + 1] = 1;
+		upper_bound[p * nparam + 2] = 10000;
+		upper_bound[p * nparam + 3] = 10000;
+	}
+
+	std::vector<T> params;
+	std::vector<T> lambda;
+	std::vector<vc::i32> step_type;
+
+	cpu::NlsqProblems<T> problems;
+	problems.nproblems = nproblems;
+	problems.consts = bvals.data();
+	problems.shared_consts = true;
+	problems.data = data.data();
+	problems.lower_bound = lower_bound.data();
+	problems.upper_bound = upper_bound.data();
+
+	auto reset = [&]() {
+		params = initial_params;
+		lambda.assign(nproblems, T(1));
+		step_type.assign(nproblems, 0);
+		problems.params = params.data();
+		problems.lambda = lambda.data();
+		problems.step_type = step_type.data();
+	};
+
+	vc::ui32 max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+	for (vc::ui32 nthreads = 1; ; nthreads = std::min(2 * nthreads, max_threads)) {
+		reset();
+
+		auto start = std::chrono::steady_clock::now();
+		if (nthreads == 1) {
+			solver.solve(problems, iterations);
+		}
+		else {
+			util::ThreadPool pool(nthreads - 1);
+			solver.solve(problems, iterations, pool);
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		double voxels_per_second = nproblems / std::chrono::duration<double>(end - start).count();
+		std::cout << "cpu nlsq, " << nthreads << " threads: " << voxels_per_second * 1e-6 << " Mvoxels/s, " <<
+			voxels_per_second / nthreads * 1e-6 << " Mvoxels/s per core" << std::endl;
+
+		if (nthreads == max_threads)
+			break;
+	}
+
+	std::vector<double> errors(nproblems);
+	for (int k = 0; k < nparam; ++k) {
+		for (vc::ui32 p = 0; p < nproblems; ++p) {
+			errors[p] = std::abs(params[p * nparam + k] - truth[p * nparam + k]) / truth[p * nparam + k];
+		}
+		std::nth_element(errors.begin(), errors.begin() + nproblems / 2, errors.end());
+		std::cout << vars[k] << " median relative error " << errors[nproblems / 2] << std::endl;
+	}
+}
+
+// Runs the two parameter fit of ivim_partial_nlsq_shader with NlsqSolver and with the cpu translation of the
+// shader, both compiled with exact_jit_options, and counts the voxels whose parameters differ in their bits.
+// Under fast math the compiler may reorder the two differently, so the comparison only holds without it
+void compare_cpu_nlsq(vc::ui32 nproblems = 65536)
+{
+	constexpr vc::ui16 ndata = 21;
+
+	std::vector<std::string> vars = { "s0","f","d1","d2","b" };
+	expression::Expression expr("s0*(f*exp(-b*d1)+(1-f)*exp(-b*d2))", vars);
+	// the context of ivim_partial_nlsq_shader, s0 and d2 are held fixed
+	glsl::SymbolicContext context;
+	context.insert_const(std::make_pair("b", 0));
+	context.insert_const(std::make_pair("s0", 1));
+	context.insert_const(std::make_pair("d2", 2));
+	context.insert_param(std::make_pair("f", 0));
+	context.insert_param(std::make_pair("d1", 1));
+
+	cpu::JitCompiler jit(std::filesystem::current_path() / "jit_cache", cpu::exact_jit_options());
+	cpu::CpuShader shader(*glsl::qmri::ivim_partial_nlsq_shader(ndata, true), jit);
+	cpu::NlsqSolver<float> solver(expr, context, ndata, 2, 3, jit);
+
+	std::vector<float> bvals(ndata);
+	for (int i = 0; i < ndata; ++i) {
+		bvals[i] = 40.0f * i;
+	}
+
+	std::mt19937 gen(1);
+	std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+	std::normal_distribution<float> noise(0.0f, 10.0f);
+
+	std::vector<float> shader_params(nproblems * 4);
+	std::vector<float> data(nproblems * ndata);
+	std::vector<float> params(nproblems * 2);
+	std::vector<float> consts(nproblems * ndata * 3);
+	for (vc::ui32 p = 0; p < nproblems; ++p) {
+		float t[4] = { 1000.0f + 1000.0f * dist(gen), 0.05f + 0.25f * dist(gen), 0.02f + 0.05f * dist(gen),
+			0.0005f + 0.002f * dist(gen) };
+		float* guess = &shader_params[p * 4];
+		for (int k = 0; k < 4; ++k) {
+			guess[k] = t[k] * (0.7f + 0.6f * dist(gen));
+		}
+		params[p * 2 + 0] = guess[1];
+		params[p * 2 + 1] = guess[2];
+		for (int i = 0; i < ndata; ++i) {
+			data[p * ndata + i] = t[0] * (t[1] * std::exp(-bvals[i] * t[2]) + (1.0f - t[1]) * std::exp(-bvals[i] * t[3])) +
+				noise(gen);
+			consts[(p * ndata + i) * 3 + 0] = bvals[i];
+			consts[(p * ndata + i) * 3 + 1] = guess[0];
+			consts[(p * ndata + i) * 3 + 2] = guess[3];
+		}
+	}
+
+	std::vector<float> weights(ndata, 1.0f);
+	shader.run(nproblems, { shader_params.data(), bvals.data(), data.data(), nullptr, weights.data() });
+
+	// five steps from step_type 12 and the uninitialized lambda of the shader, which the translation zeroes,
+	// with f and d1 clamped to [0, 1]
+	std::vector<float> lambda(nproblems, 0.0f);
+	std::vector<vc::i32> step_type(nproblems, 12);
+	std::vector<float> lower_bound(nproblems * 2, 0.0f);
+	std::vector<float> upper_bound(nproblems * 2, 1.0f);
+
+	cpu::NlsqProblems<float> problems;
+	problems.nproblems = nproblems;
+	problems.params = params.data();
+	problems.consts = consts.data();
+	problems.data = data.data();
+	problems.lambda = lambda.data();
+	problems.step_type = step_type.data();
+	problems.lower_bound = lower_bound.data();
+	problems.upper_bound = upper_bound.data();
+	solver.solve(problems, 5);
+
+	vc::ui32 nmismatch = 0;
+	for (vc::ui32 p = 0; p < nproblems; ++p) {
+		nmismatch += std::memcmp(&params[p * 2], &shader_params[p * 4 + 1], 2 * sizeof(float)) != 0;
+	}
+
+	std::cout << "cpu nlsq solver against the translated partial ivim shader: " << nmismatch << " of " << nproblems <<
+		" voxels differ in their bits" << std::endl;
+}
+
+// parses a model and its derivative strings over and over, like a model registry loading its models
+void benchmark_parser(int iterations = 2000)
+{
+	std::vector<std::string> vars = { "s0","f","d1","d2","b" };
+	expression::Expression expr("s0*(f*exp(-b*d1)+(1-f)*exp(-b*d2))", vars);
+
+	std::vector<std::string> strings = { expr.str() };
+	for (auto& x : { "s0", "f", "d1", "d2" }) {
+		strings.push_back(expr.diff(x)->str());
+		for (auto& y : { "s0", "f", "d1", "d2" }) {
+			strings.push_back(expr.diff(x)->diff(y)->str());
+		}
+	}
+
+	size_t nchars = 0;
+	for (auto& str : strings) {
+		nchars += str.size();
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	size_t nparsed = 0;
+	for (int i = 0; i < iterations; ++i) {
+		for (auto& str : strings) {
+			expression::Expression parsed(str, expr.get_context());
+			nparsed += parsed.children.size();
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	double seconds = std::chrono::duration<double>(end - start).count();
+	std::cout << "parsed " << nparsed / seconds << " expressions/s, " <<
+		nchars * iterations / seconds * 1e-6 << " MB/s" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+
+	// the check or benchmark is chosen by name, the ivim fit runs when none is given
+	std::map<std::string, std::function<void()>> runs = {
+		{ "run_qmri_ivim", [] { run_qmri_ivim(); } },
+		{ "run_qmri_ivim_local_sizes", [] { run_qmri_ivim_local_sizes(); } },
+		{ "run_qmri_ivim_scheduled", [] { run_qmri_ivim_scheduled(); } },
+		{ "run_qmri_ivim_scheduled_all_devices", [] { run_qmri_ivim_scheduled({}, true); } },
+		{ "run_qmri_ivim_streamed", [] { run_qmri_ivim_streamed(); } },
+		{ "run_vcdat_conversion", [] { run_vcdat_conversion(); } },
+		{ "compare_cpu_backend", [] { compare_cpu_backend(); } },
+		{ "compare_ivim_layouts", [] { compare_ivim_layouts(); } },
+		{ "compare_cpu_nlsq", [] { compare_cpu_nlsq(); } },
+		{ "benchmark_codegen", [] { benchmark_codegen(); } },
+		{ "benchmark_codegen_ad", [] { benchmark_codegen(20, glsl::DerivativeMode::FORWARD_AD); } },
+		{ "benchmark_evaluator", [] { benchmark_evaluator(); } },
+		{ "benchmark_cpu_jit", [] { benchmark_cpu_jit(); } },
+		{ "benchmark_batched_linalg", [] { benchmark_batched_linalg<4>(); } },
+		{ "benchmark_cpu_nlsq", [] { benchmark_cpu_nlsq<float>(); } },
+		{ "benchmark_cpu_nlsq_double", [] { benchmark_cpu_nlsq<double>(); } },
+		{ "benchmark_parser", [] { benchmark_parser(); } },
+	};
+
+	std::string name = argc > 1 ? argv[1] : "run_qmri_ivim";
+	auto run = runs.find(name);
+	if (run == runs.end()) {
+		std::cerr << "unknown run '" << name << "', expected one of:" << std::endl;
+		for (auto& [run_name, _] : runs) {
+			std::cerr << "  " << run_name << std::endl;
+		}
+		return 1;
+	}
 
-	run_qmri_ivim();
+	run->second();
 
 	return 0;
 }
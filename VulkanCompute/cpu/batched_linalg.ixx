@@ -0,0 +1,539 @@
+module;
+
+// the unrolled loop bodies are lambdas, without this large kernels end up as calls per index
+#ifdef _MSC_VER
+#define VC_FORCE_INLINE __forceinline
+#else
+#define VC_FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+export module batched_linalg;
+
+import <utility>;
+import <type_traits>;
+import <cmath>;
+
+import vc;
+
+namespace cpu {
+
+	// Native counterparts of the GLSL linalg kernels for batches of small matrices. The sizes are template
+	// parameters and every loop over them is unrolled at compile time. The voxels of a batch are stored in
+	// blocks of lanes voxels, element e of lane v at block[e*lanes + v]. Every scalar of the GLSL code is
+	// an array over the lanes here and every operation a loop over contiguous lanes, these compile to one
+	// SIMD lane per voxel. Branches are done per lane with selects. Unless noted the kernels compute the
+	// same thing as the GLSL function of the same name
+
+	// lanes of one 256 bit register
+	export template<typename T>
+	constexpr int simd_lanes = 32 / sizeof(T);
+
+	template<int Begin, typename F, int... I>
+	VC_FORCE_INLINE void static_for_impl(F& func, std::integer_sequence<int, I...>)
+	{
+		(func(std::integral_constant<int, Begin + I>{}), ...);
+	}
+
+	// calls func(std::integral_constant<int, i>) for i in [Begin, End)
+	export template<int Begin, int End, typename F>
+	VC_FORCE_INLINE void static_for(F&& func)
+	{
+		if constexpr (Begin < End)
+			static_for_impl<Begin>(func, std::make_integer_sequence<int, End - Begin>{});
+	}
+
+	// index of matrix element (i, j) of lane 0 in a block
+	template<int ncol, int lanes>
+	constexpr int at(int i, int j)
+	{
+		return (i * ncol + j) * lanes;
+	}
+
+	// copies nvoxels row major matrices (or vectors, nrow = 1) of size nrow*ncol into blocks, lanes
+	// of the last block past nvoxels are filled with the identity so they stay well conditioned
+	export template<int nrow, int ncol, int lanes, typename T>
+	void interleave(vc::ui64 nvoxels, const T* matrices, T* blocks)
+	{
+		constexpr int size = nrow * ncol;
+		vc::ui64 nblocks = (nvoxels + lanes - 1) / lanes;
+		for (vc::ui64 b = 0; b < nblocks; ++b) {
+			T* block = blocks + b * size * lanes;
+			for (int v = 0; v < lanes; ++v) {
+				vc::ui64 voxel = b * lanes + v;
+				for (int e = 0; e < size; ++e) {
+					block[e * lanes + v] = voxel < nvoxels ? matrices[voxel * size + e] :
+						T(e / ncol == e % ncol ? 1 : 0);
+				}
+			}
+		}
+	}
+
+	export template<int nrow, int ncol, int lanes, typename T>
+	void deinterleave(vc::ui64 nvoxels, const T* blocks, T* matrices)
+	{
+		constexpr int size = nrow * ncol;
+		for (vc::ui64 voxel = 0; voxel < nvoxels; ++voxel) {
+			const T* block = blocks + (voxel / lanes) * size * lanes;
+			int v = voxel % lanes;
+			for (int e = 0; e < size; ++e) {
+				matrices[voxel * size + e] = block[e * lanes + v];
+			}
+		}
+	}
+
+	// MATRIX PRODUCTS
+
+	// omat = mat^T * mat
+	export template<int nrow, int ncol, int lanes, typename T>
+	inline void mul_transpose_mat(const T* mat, T* omat)
+	{
+		static_for<0, ncol>([&](auto i) {
+			static_for<0, i + 1>([&](auto j) {
+				T entry[lanes] = {};
+				static_for<0, nrow>([&](auto k) {
+					for (int v = 0; v < lanes; ++v)
+						entry[v] += mat[at<ncol, lanes>(k, i) + v] * mat[at<ncol, lanes>(k, j) + v];
+				});
+				for (int v = 0; v < lanes; ++v) {
+					omat[at<ncol, lanes>(i, j) + v] = entry[v];
+					omat[at<ncol, lanes>(j, i) + v] = entry[v];
+				}
+			});
+		});
+	}
+
+	// ovec = mat^T * vec
+	export template<int nrow, int ncol, int lanes, typename T>
+	inline void mul_transpose_vec(const T* mat, const T* vec, T* ovec)
+	{
+		static_for<0, ncol>([&](auto i) {
+			T entry[lanes] = {};
+			static_for<0, nrow>([&](auto k) {
+				for (int v = 0; v < lanes; ++v)
+					entry[v] += mat[at<ncol, lanes>(k, i) + v] * vec[k * lanes + v];
+			});
+			for (int v = 0; v < lanes; ++v)
+				ovec[i * lanes + v] = entry[v];
+		});
+	}
+
+	// SUBSTITUTION
+
+	export enum class SubsDiag {
+		// divide by the diagonal of mat unless unit
+		NONE,
+		// weighted by a separate diagonal vector
+		VECTOR,
+		// unit triangular factor with the diagonal stored on the diagonal of mat, as left by ldl
+		MATRIX
+	};
+
+	// Solves a triangular system like the GLSL forward_subs* (forward) and backward_subs* (!forward)
+	// functions. transposed reads the factor from mat^T. Forward substitution weighs the terms by the
+	// diagonal of the solved for index, backward by that of the current row, as the shaders do. rhs and
+	// solution may be the same block
+	export template<int ndim, int lanes, bool forward, bool transposed, bool unit, SubsDiag diag, typename T>
+	inline void substitution(const T* mat, const T* rhs, const T* dvec, T* solution)
+	{
+		auto a = [mat](int i, int j) {
+			return transposed ? mat + at<ndim, lanes>(j, i) : mat + at<ndim, lanes>(i, j);
+		};
+		auto d = [mat, dvec](int i, int v) {
+			if constexpr (diag == SubsDiag::VECTOR)
+				return dvec[i * lanes + v];
+			else if constexpr (diag == SubsDiag::MATRIX)
+				return mat[at<ndim, lanes>(i, i) + v];
+			else
+				return T(1);
+		};
+
+		T sol[ndim * lanes];
+		static_for<0, ndim>([&](auto step) {
+			constexpr int i = forward ? step : ndim - 1 - step;
+			T* si = sol + i * lanes;
+			for (int v = 0; v < lanes; ++v)
+				si[v] = rhs[i * lanes + v];
+			static_for<forward ? 0 : i + 1, forward ? i : ndim>([&](auto j) {
+				const T* aij = a(i, j);
+				for (int v = 0; v < lanes; ++v)
+					si[v] -= aij[v] * d(forward ? int(j) : i, v) * sol[j * lanes + v];
+			});
+			if constexpr (!unit) {
+				const T* aii = a(i, i);
+				for (int v = 0; v < lanes; ++v)
+					si[v] /= aii[v] * d(i, v);
+			}
+			else if constexpr (diag != SubsDiag::NONE) {
+				for (int v = 0; v < lanes; ++v)
+					si[v] /= d(i, v);
+			}
+		});
+
+		for (int e = 0; e < ndim * lanes; ++e)
+			solution[e] = sol[e];
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void forward_subs(const T* mat, const T* rhs, T* solution)
+	{
+		substitution<ndim, lanes, true, false, false, SubsDiag::NONE>(mat, rhs, (const T*)nullptr, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void forward_subs_t(const T* mat, const T* rhs, T* solution)
+	{
+		substitution<ndim, lanes, true, true, false, SubsDiag::NONE>(mat, rhs, (const T*)nullptr, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void forward_subs_unit(const T* mat, const T* rhs, T* solution)
+	{
+		substitution<ndim, lanes, true, false, true, SubsDiag::NONE>(mat, rhs, (const T*)nullptr, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void forward_subs_unit_t(const T* mat, const T* rhs, T* solution)
+	{
+		substitution<ndim, lanes, true, true, true, SubsDiag::NONE>(mat, rhs, (const T*)nullptr, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void forward_subs_diag(const T* mat, const T* rhs, const T* diag, T* solution)
+	{
+		substitution<ndim, lanes, true, false, false, SubsDiag::VECTOR>(mat, rhs, diag, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void forward_subs_t_diag(const T* mat, const T* rhs, const T* diag, T* solution)
+	{
+		substitution<ndim, lanes, true, true, false, SubsDiag::VECTOR>(mat, rhs, diag, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void forward_subs_unit_diag(const T* mat, const T* rhs, const T* diag, T* solution)
+	{
+		substitution<ndim, lanes, true, false, true, SubsDiag::VECTOR>(mat, rhs, diag, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void forward_subs_unit_t_diag(const T* mat, const T* rhs, const T* diag, T* solution)
+	{
+		substitution<ndim, lanes, true, true, true, SubsDiag::VECTOR>(mat, rhs, diag, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void forward_subs_unit_diaged(const T* mat, const T* rhs, T* solution)
+	{
+		substitution<ndim, lanes, true, false, true, SubsDiag::MATRIX>(mat, rhs, (const T*)nullptr, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void forward_subs_unit_t_diaged(const T* mat, const T* rhs, T* solution)
+	{
+		substitution<ndim, lanes, true, true, true, SubsDiag::MATRIX>(mat, rhs, (const T*)nullptr, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void backward_subs(const T* mat, const T* rhs, T* solution)
+	{
+		substitution<ndim, lanes, false, false, false, SubsDiag::NONE>(mat, rhs, (const T*)nullptr, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void backward_subs_t(const T* mat, const T* rhs, T* solution)
+	{
+		substitution<ndim, lanes, false, true, false, SubsDiag::NONE>(mat, rhs, (const T*)nullptr, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void backward_subs_unit(const T* mat, const T* rhs, T* solution)
+	{
+		substitution<ndim, lanes, false, false, true, SubsDiag::NONE>(mat, rhs, (const T*)nullptr, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void backward_subs_unit_t(const T* mat, const T* rhs, T* solution)
+	{
+		substitution<ndim, lanes, false, true, true, SubsDiag::NONE>(mat, rhs, (const T*)nullptr, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void backward_subs_diag(const T* mat, const T* rhs, const T* diag, T* solution)
+	{
+		substitution<ndim, lanes, false, false, false, SubsDiag::VECTOR>(mat, rhs, diag, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void backward_subs_t_diag(const T* mat, const T* rhs, const T* diag, T* solution)
+	{
+		substitution<ndim, lanes, false, true, false, SubsDiag::VECTOR>(mat, rhs, diag, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void backward_subs_unit_diag(const T* mat, const T* rhs, const T* diag, T* solution)
+	{
+		substitution<ndim, lanes, false, false, true, SubsDiag::VECTOR>(mat, rhs, diag, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void backward_subs_unit_t_diag(const T* mat, const T* rhs, const T* diag, T* solution)
+	{
+		substitution<ndim, lanes, false, true, true, SubsDiag::VECTOR>(mat, rhs, diag, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void backward_subs_unit_diaged(const T* mat, const T* rhs, T* solution)
+	{
+		substitution<ndim, lanes, false, false, true, SubsDiag::MATRIX>(mat, rhs, (const T*)nullptr, solution);
+	}
+
+	export template<int ndim, int lanes, typename T>
+	inline void backward_subs_unit_t_diaged(const T* mat, const T* rhs, T* solution)
+	{
+		substitution<ndim, lanes, false, true, true, SubsDiag::MATRIX>(mat, rhs, (const T*)nullptr, solution);
+	}
+
+	// SYMMETRIC DECOMPOSITIONS
+
+	// the outer product update of step i of ldl and gmw81, the multipliers of column i are
+	// divided by d and the trailing lower triangle updated with the undivided column
+	template<int ndim, int lanes, int i, typename T>
+	VC_FORCE_INLINE void ldl_step(T* mat, const T* d)
+	{
+		T arr[ndim * lanes];
+		static_for<i + 1, ndim>([&](auto j) {
+			T* mji = mat + at<ndim, lanes>(j, i);
+			for (int v = 0; v < lanes; ++v) {
+				arr[j * lanes + v] = mji[v];
+				mji[v] /= d[v];
+			}
+		});
+		static_for<i + 1, ndim>([&](auto j) {
+			static_for<j, ndim>([&](auto k) {
+				T* mkj = mat + at<ndim, lanes>(k, j);
+				const T* mki = mat + at<ndim, lanes>(k, i);
+				for (int v = 0; v < lanes; ++v)
+					mkj[v] -= arr[j * lanes + v] * mki[v];
+			});
+		});
+	}
+
+	// mat = L D L^T in place, L unit lower below the diagonal and D on it, the upper part is left as is
+	export template<int ndim, int lanes, typename T>
+	inline void ldl(T* mat)
+	{
+		static_for<0, ndim>([&](auto i) {
+			ldl_step<ndim, lanes, i>(mat, mat + at<ndim, lanes>(i, i));
+		});
+	}
+
+	// Gill, Murray and Wright's modified cholesky, an ldl of mat plus a diagonal making it
+	// sufficiently positive definite, with the bounds of the shader
+	export template<int ndim, int lanes, typename T>
+	inline void gmw81(T* mat)
+	{
+		T beta2[lanes] = {};
+		T m2[lanes] = {};
+		static_for<0, ndim>([&](auto i) {
+			static_for<0, i + 1>([&](auto j) {
+				const T* mij = mat + at<ndim, lanes>(i, j);
+				T* max = i == j ? beta2 : m2;
+				for (int v = 0; v < lanes; ++v)
+					max[v] = std::max(max[v], std::abs(mij[v]));
+			});
+		});
+		if constexpr (ndim > 1) {
+			const T scale = T(1) / T(std::sqrt(T(ndim * ndim - 1)));
+			for (int v = 0; v < lanes; ++v)
+				beta2[v] = std::max(beta2[v], m2[v] * scale);
+		}
+
+		static_for<0, ndim>([&](auto i) {
+			T offdiag[lanes] = {};
+			static_for<i + 1, ndim>([&](auto j) {
+				const T* mji = mat + at<ndim, lanes>(j, i);
+				for (int v = 0; v < lanes; ++v)
+					offdiag[v] = std::max(offdiag[v], std::abs(mji[v]));
+			});
+
+			T* mii = mat + at<ndim, lanes>(i, i);
+			for (int v = 0; v < lanes; ++v) {
+				T d = std::max(std::abs(mii[v]), T(5e-7));
+				T o = offdiag[v] * offdiag[v];
+				mii[v] = o > d * beta2[v] ? o / beta2[v] : d;
+			}
+
+			ldl_step<ndim, lanes, i>(mat, mii);
+		});
+	}
+
+	// solves L D L^T sol = rhs with the factorization of ldl or gmw81
+	export template<int ndim, int lanes, typename T>
+	inline void ldl_solve(const T* mat, const T* rhs, T* sol)
+	{
+		T arr[ndim * lanes];
+		forward_subs_unit_diaged<ndim, lanes>(mat, rhs, arr);
+		backward_subs_unit_t<ndim, lanes>(mat, arr, sol);
+	}
+
+	// LU DECOMPOSITION
+
+	// P mat = L U in place, L unit lower below the diagonal. Row k was interchanged with row pivot[k] at
+	// step k. The pivot is the entry of largest magnitude in column k on or below the diagonal, columns
+	// whose pivot is not larger than machine epsilon in magnitude are not eliminated
+	export template<int ndim, int lanes, typename T>
+	inline void lu_partial_pivot(T* mat, vc::i32* pivot)
+	{
+		constexpr T machine_eps = std::is_same_v<T, float> ? T(1e-6) : T(1e-15);
+
+		static_for<0, ndim - 1>([&](auto k) {
+			vc::i32 p[lanes];
+			T max[lanes];
+			T* mkk = mat + at<ndim, lanes>(k, k);
+			for (int v = 0; v < lanes; ++v) {
+				p[v] = k;
+				max[v] = std::abs(mkk[v]);
+			}
+			static_for<k + 1, ndim>([&](auto i) {
+				const T* mik = mat + at<ndim, lanes>(i, k);
+				for (int v = 0; v < lanes; ++v) {
+					T val = std::abs(mik[v]);
+					p[v] = val > max[v] ? int(i) : p[v];
+					max[v] = val > max[v] ? val : max[v];
+				}
+			});
+
+			static_for<k + 1, ndim>([&](auto i) {
+				static_for<0, ndim>([&](auto j) {
+					T* mkj = mat + at<ndim, lanes>(k, j);
+					T* mij = mat + at<ndim, lanes>(i, j);
+					for (int v = 0; v < lanes; ++v) {
+						T a = mkj[v];
+						T b = mij[v];
+						mkj[v] = p[v] == i ? b : a;
+						mij[v] = p[v] == i ? a : b;
+					}
+				});
+			});
+			for (int v = 0; v < lanes; ++v)
+				pivot[k * lanes + v] = p[v];
+
+			// zero if the column is not eliminated
+			T inv[lanes];
+			for (int v = 0; v < lanes; ++v)
+				inv[v] = std::abs(mkk[v]) > machine_eps ? T(1) / mkk[v] : T(0);
+
+			static_for<k + 1, ndim>([&](auto i) {
+				T l[lanes];
+				T* mik = mat + at<ndim, lanes>(i, k);
+				for (int v = 0; v < lanes; ++v) {
+					l[v] = mik[v] * inv[v];
+					mik[v] = inv[v] != T(0) ? l[v] : mik[v];
+				}
+				static_for<k + 1, ndim>([&](auto j) {
+					T* mij = mat + at<ndim, lanes>(i, j);
+					const T* mkj = mat + at<ndim, lanes>(k, j);
+					for (int v = 0; v < lanes; ++v)
+						mij[v] -= l[v] * mkj[v];
+				});
+			});
+		});
+
+		for (int v = 0; v < lanes; ++v)
+			pivot[(ndim - 1) * lanes + v] = ndim - 1;
+	}
+
+	// The lu shader step for step, so results compare against the GPU. At step k the pivot is the largest
+	// positive entry of row k from column k on, as max_mag_subrow finds it, and row k is interchanged with
+	// the row of its column index, row 0 if there is none. Columns whose pivot is not larger than machine
+	// epsilon are not eliminated. Use lu_partial_pivot where the factorization must be stable
+	export template<int ndim, int lanes, typename T>
+	inline void lu(T* mat, vc::i32* pivot)
+	{
+		constexpr T machine_eps = std::is_same_v<T, float> ? T(1e-6) : T(1e-15);
+
+		static_for<0, ndim - 1>([&](auto k) {
+			vc::i32 p[lanes];
+			T max[lanes];
+			for (int v = 0; v < lanes; ++v) {
+				p[v] = 0;
+				max[v] = T(0);
+			}
+			static_for<k, ndim>([&](auto j) {
+				const T* mkj = mat + at<ndim, lanes>(k, j);
+				for (int v = 0; v < lanes; ++v) {
+					T val = mkj[v];
+					p[v] = val > max[v] ? int(j) : p[v];
+					max[v] = val > max[v] ? val : max[v];
+				}
+			});
+
+			static_for<0, ndim>([&](auto i) {
+				static_for<0, ndim>([&](auto j) {
+					T* mkj = mat + at<ndim, lanes>(k, j);
+					T* mij = mat + at<ndim, lanes>(i, j);
+					for (int v = 0; v < lanes; ++v) {
+						T a = mkj[v];
+						T b = mij[v];
+						mkj[v] = p[v] == i ? b : a;
+						mij[v] = p[v] == i ? a : b;
+					}
+				});
+			});
+			for (int v = 0; v < lanes; ++v)
+				pivot[k * lanes + v] = p[v];
+
+			const T* mkk = mat + at<ndim, lanes>(k, k);
+			bool eliminate[lanes];
+			T div[lanes];
+			for (int v = 0; v < lanes; ++v) {
+				eliminate[v] = mkk[v] > machine_eps;
+				div[v] = eliminate[v] ? mkk[v] : T(1);
+			}
+
+			static_for<k + 1, ndim>([&](auto i) {
+				T l[lanes];
+				T* mik = mat + at<ndim, lanes>(i, k);
+				for (int v = 0; v < lanes; ++v) {
+					l[v] = eliminate[v] ? mik[v] / div[v] : T(0);
+					mik[v] = eliminate[v] ? l[v] : mik[v];
+				}
+				static_for<k + 1, ndim>([&](auto j) {
+					T* mij = mat + at<ndim, lanes>(i, j);
+					const T* mkj = mat + at<ndim, lanes>(k, j);
+					for (int v = 0; v < lanes; ++v)
+						mij[v] -= l[v] * mkj[v];
+				});
+			});
+		});
+
+		for (int v = 0; v < lanes; ++v)
+			pivot[(ndim - 1) * lanes + v] = ndim - 1;
+	}
+
+	// solves mat sol = rhs with the factorization of lu or lu_partial_pivot, rhs and sol may be the same block
+	export template<int ndim, int lanes, typename T>
+	inline void lu_solve(const T* mat, const vc::i32* pivot, const T* rhs, T* sol)
+	{
+		T arr[ndim * lanes];
+		for (int e = 0; e < ndim * lanes; ++e)
+			arr[e] = rhs[e];
+
+		static_for<0, ndim - 1>([&](auto k) {
+			const vc::i32* p = pivot + k * lanes;
+			// lu may interchange with rows above k
+			static_for<0, ndim>([&](auto i) {
+				for (int v = 0; v < lanes; ++v) {
+					T a = arr[k * lanes + v];
+					T b = arr[i * lanes + v];
+					arr[k * lanes + v] = p[v] == i ? b : a;
+					arr[i * lanes + v] = p[v] == i ? a : b;
+				}
+			});
+		});
+
+		forward_subs_unit<ndim, lanes>(mat, arr, arr);
+		backward_subs<ndim, lanes>(mat, arr, sol);
+	}
+
+}
@@ -0,0 +1,223 @@
+module;
+
+export module cpp_kernels;
+
+import <string>;
+
+import vc;
+import expr;
+import dag;
+import symbolic;
+import code_template;
+import nlsq_symbolic;
+import nlsq;
+import function;
+import cpu_shader;
+
+namespace cpu {
+
+	using namespace vc;
+
+	// Kernel over nproblems problems stored one after the other, per problem nparam params,
+	// ndata*nconst consts, ndata data, ndata residuals, ndata*nparam jacobian and nparam*nparam
+	// hessian values. jacobian and hessian are only touched by kernels of high enough order
+	export template<typename T>
+	using NlsqKernel = void(*)(i32 nproblems, const T* params, const T* consts, const T* data,
+		T* residuals, T* jacobian, T* hessian);
+
+	// One nlsq_slmh_w_step followed by nlsq_clamping, niter times, for the problems [first, last). Per problem
+	// nparam params, ndata data, a lambda and step_type (flags of StepType) that are updated, ndata*nconst
+	// consts every consts_stride values (0 if shared) and nparam lower and upper bounds, which may be null
+	// to not clamp. weights are the ndata weights shared by all problems
+	export template<typename T>
+	using NlsqSolverKernel = void(*)(i32 first, i32 last, i32 niter, i32 consts_stride,
+		T* params, const T* consts, const T* data, const T* weights, const T* lower_bound, const T* upper_bound,
+		T* lambda, i32* step_type, T mu, T eta, T acc, T dec);
+
+	export struct CppKernel {
+		std::string name;
+		std::string source;
+	};
+
+	// C++ source of the residuals (order 0), jacobian (order 1) and gauss newton hessian with its
+	// second order part (order 2) of expr. The per data point statements are the ones of the symbolic
+	// GLSL generators printed as C++, so params and consts are indexed through the same SymbolicContext
+	export CppKernel nlsq_cpp_kernel(const expression::Expression& expr, const glsl::SymbolicContext& context,
+		ui16 ndata, ui16 nparam, ui16 nconst, bool single_precision, int order)
+	{
+		static const glsl::CodeTemplate code =
+R"cpp(
+#include <cmath>
+
+template<typename T>
+static inline T vc_sign(T x) { return T((T(0) < x) - (x < T(0))); }
+
+#ifdef _WIN32
+#define VC_EXPORT extern "C" __declspec(dllexport)
+#else
+#define VC_EXPORT extern "C"
+#endif
+
+VC_EXPORT void KERNEL_NAME(int nproblems, const float* all_params, const float* all_consts, const float* all_data,
+	float* all_residuals, float* all_jacobian, float* all_hessian)
+{
+	constexpr int order = ORDER;
+
+	for (int p = 0; p < nproblems; ++p) {
+		const float* params = all_params + p*nparam;
+		const float* consts = all_consts + p*ndata*nconst;
+		const float* data = all_data + p*ndata;
+		float* residuals = all_residuals + p*ndata;
+		float* jacobian = order > 0 ? all_jacobian + p*ndata*nparam : nullptr;
+		float* hessian = order > 1 ? all_hessian + p*nparam*nparam : nullptr;
+
+		if (order > 1) {
+			for (int k = 0; k < nparam*nparam; ++k) {
+				hessian[k] = 0;
+			}
+		}
+
+		for (int i = 0; i < ndata; ++i) {
+			// shared subexpressions
+SUBEXPRESSIONS
+			// eval
+RESIDUAL_EXPRESSIONS
+			// jacobian
+JACOBIAN_EXPRESSIONS
+			// second order part of hessian
+HESSIAN_EXPRESSIONS
+		}
+
+		if (order > 1) {
+			// copy to upper part
+			for (int k = 1; k < nparam; ++k) {
+				for (int l = 0; l < k; ++l) {
+					hessian[l*nparam + k] = hessian[k*nparam + l];
+				}
+			}
+
+			// add first order part of hessian
+			for (int k = 0; k < nparam; ++k) {
+				for (int l = 0; l < nparam; ++l) {
+					float sum = 0;
+					for (int i = 0; i < ndata; ++i) {
+						sum += jacobian[i*nparam + k] * jacobian[i*nparam + l];
+					}
+					hessian[k*nparam + l] += sum;
+				}
+			}
+		}
+	}
+}
+)cpp";
+
+		auto statements = glsl::nlsq::symbolic_statements(expr, context, nparam, nconst, single_precision, order,
+			"", expression::CodeSyntax::CPP);
+
+		std::string uniqueid = glsl::nlsq::nlsq_residuals_uniqueid(expr, context, ndata, nparam, nconst, single_precision);
+		std::string name = "nlsq_kernel_" + std::to_string(order) + "_" + uniqueid;
+
+		std::string source = code.render({
+			{ "KERNEL_NAME", name },
+			{ "ORDER", std::to_string(order) },
+			{ "SUBEXPRESSIONS", statements.subexpressions },
+			{ "RESIDUAL_EXPRESSIONS", statements.residuals },
+			{ "JACOBIAN_EXPRESSIONS", statements.jacobian },
+			{ "HESSIAN_EXPRESSIONS", statements.hessian },
+			{ "ndata", std::to_string(ndata) },
+			{ "nparam", std::to_string(nparam) },
+			{ "nconst", std::to_string(nconst) },
+			{ "float", glsl::precision_type(single_precision) }
+			});
+
+		return CppKernel{ std::move(name), std::move(source) };
+	}
+
+	// C++ source of the weighted levenberg marquardt iterations of nlsq_slmh_w_step and nlsq_clamping. The
+	// GLSL functions of the shaders, with all their dependencies, are translated like the code of a CpuShader,
+	// so the kernel runs the same operations in the same order as the cpu translation of a shader calling them
+	export CppKernel nlsq_slmh_w_cpp_kernel(const expression::Expression& expr, const glsl::SymbolicContext& context,
+		ui16 ndata, ui16 nparam, ui16 nconst, bool single_precision)
+	{
+		static const glsl::CodeTemplate code =
+R"cpp(
+#include <algorithm>
+
+VC_EXPORT void KERNEL_NAME(int first, int last, int niter, int consts_stride,
+	float* all_params, const float* all_consts, const float* all_data, const float* all_weights,
+	const float* all_lower_bound, const float* all_upper_bound,
+	float* all_lambda, int* all_step_type, float mu, float eta, float acc, float dec)
+{
+	using namespace vc_glsl;
+
+	std::array<float, ndata> weights;
+	std::copy_n(all_weights, ndata, weights.begin());
+
+	// outputs of the step that the shaders keep in buffers
+	std::array<float, nparam> nlstep{};
+	float error = 0;
+	float new_error = 0;
+	std::array<float, ndata> residuals{};
+	std::array<float, ndata*nparam> jacobian{};
+	std::array<float, nparam*nparam> hessian{};
+	std::array<float, nparam*nparam> lambda_hessian{};
+
+	std::array<float, nparam> params;
+	std::array<float, ndata*nconst> consts;
+	std::array<float, ndata> data;
+	std::array<float, nparam> lower_bound;
+	std::array<float, nparam> upper_bound;
+
+	for (int p = first; p < last; ++p) {
+		std::copy_n(all_params + p*nparam, nparam, params.begin());
+		std::copy_n(all_consts + p*consts_stride, ndata*nconst, consts.begin());
+		std::copy_n(all_data + p*ndata, ndata, data.begin());
+		if (all_lower_bound) {
+			std::copy_n(all_lower_bound + p*nparam, nparam, lower_bound.begin());
+			std::copy_n(all_upper_bound + p*nparam, nparam, upper_bound.begin());
+		}
+		float lambda = all_lambda[p];
+		int step_type = all_step_type[p];
+
+		for (int iter = 0; iter < niter; ++iter) {
+			STEP_NAME(params, consts, data, weights, lambda, step_type, mu, eta, acc, dec,
+				nlstep, error, new_error, residuals, jacobian, hessian, lambda_hessian);
+			if (all_lower_bound) {
+				CLAMPING_NAME(params, upper_bound, lower_bound);
+			}
+		}
+
+		std::copy_n(params.begin(), nparam, all_params + p*nparam);
+		all_lambda[p] = lambda;
+		all_step_type[p] = step_type;
+	}
+}
+)cpp";
+
+		glsl::FunctionRegistry functions;
+		auto step = functions.add(glsl::nlsq::nlsq_slmh_w_step(expr, context, ndata, nparam, nconst, single_precision));
+		auto clamping = functions.add(glsl::nlsq::nlsq_clamping(nparam, single_precision));
+
+		std::string glsl_functions;
+		for (auto& func : functions.getFunctions()) {
+			glsl_functions += func->getCode();
+		}
+
+		std::string uniqueid = glsl::nlsq::nlsq_slmh_w_step_uniqueid(expr, context,
+			ndata, nparam, nconst, single_precision);
+		std::string name = "nlsq_slmh_w_kernel_" + uniqueid + (single_precision ? "_S" : "_D");
+
+		std::string source = glsl_functions_to_cpp(glsl_functions) + code.render({
+			{ "KERNEL_NAME", name },
+			{ "STEP_NAME", functions[step]->getName() },
+			{ "CLAMPING_NAME", functions[clamping]->getName() },
+			{ "ndata", std::to_string(ndata) },
+			{ "nparam", std::to_string(nparam) },
+			{ "nconst", std::to_string(nconst) },
+			{ "float", glsl::precision_type(single_precision) }
+			});
+
+		return CppKernel{ std::move(name), std::move(source) };
+	}
+
+}
@@ -0,0 +1,365 @@
+module;
+
+module cpu_shader;
+
+import <string>;
+import <vector>;
+import <regex>;
+import <optional>;
+import <unordered_set>;
+import <algorithm>;
+import <functional>;
+import <stdexcept>;
+
+import vc;
+import util;
+import shader;
+import thread_pool;
+import jit;
+import code_template;
+
+using namespace vc;
+using namespace cpu;
+
+namespace {
+
+	constexpr const char* entry_name = "vc_cpu_shader";
+
+	const std::regex header_regex(R"(#version[^\n]*|layout\s*\(\s*local_size_x[^)]*\)\s*in\s*;)");
+
+	const std::regex push_constant_regex(R"(layout\s*\(\s*push_constant\s*\)\s*uniform\s+\w+\s*\{([^}]*)\}\s*;)");
+
+	const std::regex buffer_regex(
+		R"(layout\s*\(\s*set\s*=\s*\d+\s*,\s*binding\s*=\s*(\d+)\s*\)\s*buffer\s+\w+\s*\{\s*(\w+)\s+(\w+)\s*(\[\s*(\d*)\s*\])?\s*;\s*\}\s*;)");
+
+	const std::regex signature_regex(R"((void|float|double|int|uint|bool)\s+(\w+)\s*\()");
+
+	const std::regex parameter_regex(R"(^(?:(in|out|inout)\s+)?(const\s+)?(\w+)\s+(\w+)\s*(?:\[([^\]]+)\])?$)");
+
+	const std::regex local_array_regex(R"(\b(float|double|int|uint|bool)(\s+)(\w+)\s*\[([^\]]+)\])");
+
+	const std::regex uninitialized_regex(R"((\n[ \t]*(?:std::array<[^>]*>|float|double|int|uint|bool)\s+\w+)\s*;)");
+
+	const std::regex float_literal_regex(
+		R"((\b\d+\.\d*(?:[eE][+-]?\d+)?|\.\d+(?:[eE][+-]?\d+)?|\b\d+[eE][+-]?\d+)(lf|LF|f|F)?(?!\w))");
+
+	bool is_scalar_type(const std::string& type)
+	{
+		return type == "float" || type == "double" || type == "int" || type == "uint" || type == "bool";
+	}
+
+	std::string trim_whitespace(const std::string& str)
+	{
+		auto first = str.find_first_not_of(" \t\r\n");
+		if (first == std::string::npos)
+			return "";
+		auto last = str.find_last_not_of(" \t\r\n");
+		return str.substr(first, last - first + 1);
+	}
+
+	std::string regex_replace(const std::string& str, const std::regex& regex,
+		const std::function<std::string(const std::smatch&)>& replacement)
+	{
+		std::string ret;
+		ret.reserve(str.size() + str.size() / 8);
+		auto last = str.cbegin();
+		for (auto it = std::sregex_iterator(str.cbegin(), str.cend(), regex); it != std::sregex_iterator(); ++it) {
+			ret.append(last, (*it)[0].first);
+			ret += replacement(*it);
+			last = (*it)[0].second;
+		}
+		ret.append(last, str.cend());
+		return ret;
+	}
+
+	std::string array_type(const std::string& type, const std::string& size)
+	{
+		return "std::array<" + type + ", " + size + ">";
+	}
+
+	// arrays are passed by value for in and by reference for out and inout, like GLSL
+	// copies them in and out, scalars likewise
+	std::string rewrite_parameter(const std::string& parameter)
+	{
+		std::string param = trim_whitespace(parameter);
+		if (param.empty() || param == "void")
+			return "";
+
+		std::smatch match;
+		if (!std::regex_match(param, match, parameter_regex))
+			throw std::runtime_error("Unsupported function parameter in shader: " + param);
+
+		bool reference = match[1] == "out" || match[1] == "inout";
+		std::string type = match[5].matched ? array_type(match[3], match[5]) : match[3].str();
+
+		return match[2].str() + type + (reference ? "& " : " ") + match[4].str();
+	}
+
+	// rewrites the parameter lists of the function definitions, they start at the beginning of a line
+	std::string rewrite_signatures(const std::string& code)
+	{
+		std::string ret;
+		ret.reserve(code.size() + code.size() / 4);
+
+		size_t pos = 0;
+		while (pos < code.size()) {
+			std::smatch match;
+			if (std::regex_search(code.cbegin() + pos, code.cend(), match, signature_regex,
+				std::regex_constants::match_continuous))
+			{
+				size_t open = pos + match.length(0);
+				size_t close = code.find(')', open);
+				if (close == std::string::npos)
+					throw std::runtime_error("Unterminated parameter list of " + match[2].str() + " in shader");
+
+				std::string params = code.substr(open, close - open);
+				std::string new_params;
+				size_t start = 0;
+				for (;;) {
+					size_t comma = params.find(',', start);
+					std::string param = rewrite_parameter(params.substr(start,
+						comma == std::string::npos ? std::string::npos : comma - start));
+					if (!param.empty())
+						new_params += (new_params.empty() ? "" : ", ") + param;
+					if (comma == std::string::npos)
+						break;
+					start = comma + 1;
+				}
+
+				ret += match[0].str() + new_params + ")";
+				pos = close + 1;
+				continue;
+			}
+
+			size_t eol = code.find('\n', pos);
+			eol = eol == std::string::npos ? code.size() : eol + 1;
+			ret.append(code, pos, eol - pos);
+			pos = eol;
+		}
+
+		return ret;
+	}
+
+	void check_push_constants(const std::string& members)
+	{
+		std::string remaining = members;
+		util::remove_all(remaining, "uint nelem;");
+		if (!trim_whitespace(remaining).empty())
+			throw std::runtime_error("Only the nelem push constant is supported on the cpu, got: " + trim_whitespace(members));
+	}
+
+	// includes, export macro and the GLSL builtins of the translations in namespace vc_glsl
+	const char* const prelude =
+R"cpp(
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+#ifdef _WIN32
+#define VC_EXPORT extern "C" __declspec(dllexport)
+#else
+#define VC_EXPORT extern "C"
+#endif
+
+namespace vc_glsl {
+
+	using uint = unsigned int;
+
+	struct uvec3 { uint x = 0; uint y = 0; uint z = 0; };
+
+	template<typename T> inline T abs(T x) { return x < T(0) ? -x : x; }
+	template<typename T> inline T sign(T x) { return T((T(0) < x) - (x < T(0))); }
+
+	// GLSL has no integer overloads of these, integer arguments are converted to float
+	template<typename T> using genfloat = std::conditional_t<std::is_integral_v<T>, float, T>;
+
+	template<typename T> inline genfloat<T> exp(T x) { return std::exp(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> exp2(T x) { return std::exp2(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> log(T x) { return std::log(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> log2(T x) { return std::log2(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> sqrt(T x) { return std::sqrt(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> inversesqrt(T x) { return genfloat<T>(1) / std::sqrt(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> sin(T x) { return std::sin(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> cos(T x) { return std::cos(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> tan(T x) { return std::tan(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> asin(T x) { return std::asin(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> acos(T x) { return std::acos(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> atan(T x) { return std::atan(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> sinh(T x) { return std::sinh(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> cosh(T x) { return std::cosh(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> tanh(T x) { return std::tanh(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> floor(T x) { return std::floor(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> ceil(T x) { return std::ceil(genfloat<T>(x)); }
+	template<typename T> inline genfloat<T> fract(T x) { return x - std::floor(genfloat<T>(x)); }
+
+	template<typename A, typename B> inline genfloat<std::common_type_t<A, B>> atan(A y, B x) { using T = genfloat<std::common_type_t<A, B>>; return std::atan2(T(y), T(x)); }
+	template<typename A, typename B> inline genfloat<std::common_type_t<A, B>> pow(A x, B y) { using T = genfloat<std::common_type_t<A, B>>; return std::pow(T(x), T(y)); }
+	template<typename A, typename B> inline std::common_type_t<A, B> mod(A x, B y) { return x - y * std::floor(x / y); }
+	template<typename A, typename B> inline std::common_type_t<A, B> min(A x, B y) { return y < x ? y : x; }
+	template<typename A, typename B> inline std::common_type_t<A, B> max(A x, B y) { return x < y ? y : x; }
+	template<typename A, typename B, typename C>
+	inline std::common_type_t<A, B, C> clamp(A x, B lo, C hi) { return min(max(x, lo), hi); }
+	template<typename A, typename B, typename C>
+	inline std::common_type_t<A, B, C> fma(A a, B b, C c) { return a * b + c; }
+	template<typename A, typename B, typename C>
+	inline std::common_type_t<A, B, C> mix(A x, B y, C a) { return x + (y - x) * a; }
+
+	// on the bits, the shared library may be compiled with fast math
+	inline bool isnan(float x) { std::uint32_t u; std::memcpy(&u, &x, sizeof(u)); return (u & 0x7fffffffu) > 0x7f800000u; }
+	inline bool isinf(float x) { std::uint32_t u; std::memcpy(&u, &x, sizeof(u)); return (u & 0x7fffffffu) == 0x7f800000u; }
+	inline bool isnan(double x) { std::uint64_t u; std::memcpy(&u, &x, sizeof(u)); return (u & 0x7fffffffffffffffull) > 0x7ff0000000000000ull; }
+	inline bool isinf(double x) { std::uint64_t u; std::memcpy(&u, &x, sizeof(u)); return (u & 0x7fffffffffffffffull) == 0x7ff0000000000000ull; }
+
+}
+)cpp";
+
+	// function definitions, local arrays and literals of GLSL code as C++
+	std::string translate_code(std::string glsl)
+	{
+		glsl = rewrite_signatures(glsl);
+
+		glsl = std::regex_replace(glsl, local_array_regex, "std::array<$1, $4>$2$3");
+
+		// GLSL leaves uninitialized locals undefined, zeroing them keeps cpu runs reproducible
+		glsl = std::regex_replace(glsl, uninitialized_regex, "$1{};");
+
+		// unsuffixed float literals are single precision in GLSL
+		return regex_replace(glsl, float_literal_regex, [](const std::smatch& match) {
+			std::string suffix = match[2];
+			return match[1].str() + (suffix == "lf" || suffix == "LF" ? "" : "f");
+			});
+	}
+
+}
+
+CpuProgram cpu::glsl_to_cpp(const std::string& glsl_source)
+{
+	static const glsl::CodeTemplate code =
+R"cpp(
+namespace vc_glsl {
+
+	struct Shader {
+
+		Shader(uint nelem, void* const* buffers)
+			: nelem(nelem)BUFFER_INITS
+		{}
+
+		uint nelem;
+		uvec3 gl_GlobalInvocationID;
+
+BUFFER_MEMBERS
+SHADER_CODE
+	};
+
+}
+
+VC_EXPORT void ENTRY_NAME(unsigned int first, unsigned int last, unsigned int nelem, void* const* buffers)
+{
+	vc_glsl::Shader shader(nelem, buffers);
+	for (unsigned int i = first; i < last; ++i) {
+		shader.gl_GlobalInvocationID.x = i;
+		shader.main();
+	}
+}
+)cpp";
+
+	std::string glsl = std::regex_replace(glsl_source, header_regex, "");
+
+	std::smatch push_match;
+	if (std::regex_search(glsl, push_match, push_constant_regex))
+		check_push_constants(push_match[1]);
+	glsl = std::regex_replace(glsl, push_constant_regex, "");
+
+	CpuProgram ret;
+	ret.entry = entry_name;
+
+	std::unordered_set<std::string> single_values;
+	glsl = regex_replace(glsl, buffer_regex, [&ret, &single_values](const std::smatch& match) {
+		std::string type = match[2];
+		if (!is_scalar_type(type))
+			throw std::runtime_error("Unsupported buffer type " + type + " of " + match[3].str() + " in shader");
+
+		CpuBinding binding{ static_cast<ui16>(std::stoul(match[1])), type, match[3] };
+		if (!match[4].matched) {
+			binding.size = 1;
+			single_values.insert(binding.name);
+		}
+		else if (match[5].length() > 0)
+			binding.size = static_cast<ui32>(std::stoul(match[5]));
+		ret.bindings.push_back(std::move(binding));
+		return std::string();
+		});
+
+	if (glsl.find("layout") != std::string::npos)
+		throw std::runtime_error("Shader has layout qualifiers that are not supported on the cpu");
+
+	std::sort(ret.bindings.begin(), ret.bindings.end(),
+		[](const CpuBinding& a, const CpuBinding& b) { return a.binding < b.binding; });
+
+	std::string buffer_members;
+	std::string buffer_inits;
+	for (auto& b : ret.bindings) {
+		std::string index = "buffers[" + std::to_string(b.binding) + "]";
+		if (!b.size.has_value()) {
+			buffer_members += "\t\t" + b.type + "* " + b.name + ";\n";
+			buffer_inits += ", " + b.name + "(static_cast<" + b.type + "*>(" + index + "))";
+		}
+		else {
+			// fixed size and single value buffers are used like arrays and variables of that type
+			std::string type = single_values.contains(b.name) ? b.type : array_type(b.type, std::to_string(b.size.value()));
+			buffer_members += "\t\t" + type + "& " + b.name + ";\n";
+			buffer_inits += ", " + b.name + "(*static_cast<" + type + "*>(" + index + "))";
+		}
+	}
+
+	glsl = translate_code(std::move(glsl));
+
+	ret.source = prelude + code.render({
+		{ "BUFFER_INITS", buffer_inits },
+		{ "BUFFER_MEMBERS", buffer_members },
+		{ "SHADER_CODE", glsl },
+		{ "ENTRY_NAME", ret.entry }
+		});
+
+	return ret;
+}
+
+std::string cpu::glsl_functions_to_cpp(const std::string& glsl_functions)
+{
+	// internal linkage, the functions are only called from the appended code and can all be inlined
+	return prelude + std::string("\nnamespace vc_glsl {\nnamespace {\n") + translate_code(glsl_functions) + "\n}\n}\n";
+}
+
+CpuShader::CpuShader(const glsl::ShaderBase& shader, JitCompiler& jit)
+	: CpuShader(shader.compile(), jit)
+{}
+
+CpuShader::CpuShader(const std::string& glsl_source, JitCompiler& jit)
+	: m_Program(glsl_to_cpp(glsl_source))
+{
+	m_Entry = jit.get_function<CpuShaderEntry>(m_Program.source, m_Program.entry);
+}
+
+void CpuShader::run(ui32 nelem, const std::vector<void*>& buffers) const
+{
+	check_buffers(buffers);
+	m_Entry(0, nelem, nelem, buffers.data());
+}
+
+void CpuShader::run(ui32 nelem, const std::vector<void*>& buffers, util::ThreadPool& pool, ui32 grain) const
+{
+	check_buffers(buffers);
+	util::parallel_for(pool, 0, nelem, grain, [this, nelem, &buffers](ui64 first, ui64 last) {
+		m_Entry(static_cast<ui32>(first), static_cast<ui32>(last), nelem, buffers.data());
+		});
+}
+
+void CpuShader::check_buffers(const std::vector<void*>& buffers) const
+{
+	for (auto& b : m_Program.bindings) {
+		if (b.binding >= buffers.size() || buffers[b.binding] == nullptr)
+			throw std::runtime_error("No buffer given for binding " + std::to_string(b.binding) + " (" + b.name + ")");
+	}
+}
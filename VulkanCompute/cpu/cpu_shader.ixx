@@ -0,0 +1,77 @@
+module;
+
+export module cpu_shader;
+
+import <string>;
+import <vector>;
+import <optional>;
+
+import vc;
+import shader;
+import thread_pool;
+import jit;
+
+namespace cpu {
+
+	// A storage buffer of a shader. size is the element count of fixed size buffers, unsized
+	// buffers have no size and single value buffers a size of one
+	export struct CpuBinding {
+		vc::ui16 binding;
+		std::string type;
+		std::string name;
+		std::optional<vc::ui32> size;
+	};
+
+	export struct CpuProgram {
+		std::string source;
+		std::string entry;
+		// sorted by binding
+		std::vector<CpuBinding> bindings;
+	};
+
+	// Invokes main() for the invocations [first, last) of a dispatch over nelem elements,
+	// buffers[b] is the memory bound to binding b
+	export using CpuShaderEntry = void(*)(vc::ui32 first, vc::ui32 last, vc::ui32 nelem, void* const* buffers);
+
+	// Translates a compute shader of AutogenShader into C++. Functions become members of a struct
+	// holding the buffers and gl_GlobalInvocationID, arrays become std::array that are passed by value
+	// for in and by reference for out and inout parameters, as GLSL copies them in and out. Float
+	// literals without suffix stay single precision and the GLSL builtins the generated shaders use
+	// are provided in the source. Only the nelem push constant is supported
+	export CpuProgram glsl_to_cpp(const std::string& glsl_source);
+
+	// GLSL function definitions translated like the functions of a shader, as free functions in
+	// namespace vc_glsl after the builtins. Functions must come after the functions they call, code
+	// calling them can be appended to the returned source
+	export std::string glsl_functions_to_cpp(const std::string& glsl_functions);
+
+	// The C++ translation of a shader compiled by a JitCompiler, which must outlive the CpuShader.
+	// Buffers are given in binding order like the tensors of a kompute algorithm, unsized buffers
+	// must hold the values of nelem elements
+	export class CpuShader {
+	public:
+
+		CpuShader(const glsl::ShaderBase& shader, JitCompiler& jit);
+
+		CpuShader(const std::string& glsl_source, JitCompiler& jit);
+
+		const CpuProgram& get_program() const { return m_Program; }
+
+		const std::vector<CpuBinding>& get_bindings() const { return m_Program.bindings; }
+
+		// all invocations on the calling thread
+		void run(vc::ui32 nelem, const std::vector<void*>& buffers) const;
+
+		// invocations split into chunks of grain, spread over the pool and the calling thread
+		void run(vc::ui32 nelem, const std::vector<void*>& buffers, util::ThreadPool& pool, vc::ui32 grain = 64) const;
+
+	private:
+
+		void check_buffers(const std::vector<void*>& buffers) const;
+
+	private:
+		CpuProgram m_Program;
+		CpuShaderEntry m_Entry;
+	};
+
+}
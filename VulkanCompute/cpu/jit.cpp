@@ -0,0 +1,448 @@
+module;
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <cerrno>
+#include <cstring>
+extern char** environ;
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define VC_JIT_CPUID
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define VC_JIT_CPUID
+#endif
+
+module jit;
+
+import <string>;
+import <filesystem>;
+import <fstream>;
+import <sstream>;
+import <unordered_map>;
+import <vector>;
+import <mutex>;
+import <atomic>;
+import <thread>;
+import <functional>;
+import <stdexcept>;
+import <cstdlib>;
+import <array>;
+
+import vc;
+import util;
+
+using namespace vc;
+using namespace cpu;
+
+namespace {
+
+#ifdef _WIN32
+	constexpr const char* library_extension = ".dll";
+#else
+	constexpr const char* library_extension = ".so";
+#endif
+
+	std::atomic<ui64> tmp_counter = 0;
+
+	std::string tmp_suffix()
+	{
+		return ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "_" +
+			std::to_string(tmp_counter++);
+	}
+
+	std::string read_file(const std::filesystem::path& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		std::stringstream ss;
+		ss << file.rdbuf();
+		return ss.str();
+	}
+
+	void* load_library(const std::filesystem::path& path)
+	{
+#ifdef _WIN32
+		void* handle = reinterpret_cast<void*>(LoadLibraryW(path.c_str()));
+		if (!handle)
+			throw std::runtime_error("Could not load jit library " + path.string());
+#else
+		void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+		if (!handle)
+			throw std::runtime_error("Could not load jit library " + path.string() + ": " + dlerror());
+#endif
+		return handle;
+	}
+
+	void* find_symbol(void* handle, const std::string& symbol)
+	{
+#ifdef _WIN32
+		return reinterpret_cast<void*>(GetProcAddress(reinterpret_cast<HMODULE>(handle), symbol.c_str()));
+#else
+		return dlsym(handle, symbol.c_str());
+#endif
+	}
+
+	void close_library(void* handle)
+	{
+#ifdef _WIN32
+		FreeLibrary(reinterpret_cast<HMODULE>(handle));
+#else
+		dlclose(handle);
+#endif
+	}
+
+	std::string read_host_cpu_id()
+	{
+#if defined(VC_JIT_CPUID)
+		auto cpuid = [](ui32 leaf, ui32 subleaf) {
+			std::array<ui32, 4> regs;
+#ifdef _MSC_VER
+			int r[4];
+			__cpuidex(r, leaf, subleaf);
+			for (int i = 0; i < 4; ++i)
+				regs[i] = static_cast<ui32>(r[i]);
+#else
+			__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+			return regs;
+		};
+		auto hex = [](ui32 reg) { return util::to_hex(reg).substr(8); };
+
+		// vendor, signature and feature flags, ebx of leaf 1 holds the apic id of the core and is skipped
+		auto leaf0 = cpuid(0, 0);
+		std::string ret(reinterpret_cast<const char*>(&leaf0[1]), 4);
+		ret += std::string(reinterpret_cast<const char*>(&leaf0[3]), 4);
+		ret += std::string(reinterpret_cast<const char*>(&leaf0[2]), 4);
+		if (leaf0[0] >= 1) {
+			auto leaf1 = cpuid(1, 0);
+			ret += hex(leaf1[0]) + hex(leaf1[2]) + hex(leaf1[3]);
+		}
+		if (leaf0[0] >= 7) {
+			auto leaf7 = cpuid(7, 0);
+			ret += hex(leaf7[1]) + hex(leaf7[2]) + hex(leaf7[3]);
+		}
+		if (cpuid(0x80000000, 0)[0] >= 0x80000001) {
+			auto ext1 = cpuid(0x80000001, 0);
+			ret += hex(ext1[2]) + hex(ext1[3]);
+		}
+		return ret;
+#elif defined(__linux__)
+		// the first core's entries, the cores of a machine share one instruction set
+		std::ifstream cpuinfo("/proc/cpuinfo");
+		std::string ret;
+		std::string line;
+		while (std::getline(cpuinfo, line) && !line.empty()) {
+			if (line.starts_with("Features") || line.starts_with("CPU implementer") ||
+				line.starts_with("CPU architecture") || line.starts_with("CPU part") ||
+				line.starts_with("isa") || line.starts_with("cpu model"))
+			{
+				ret += line + "\n";
+			}
+		}
+		return ret;
+#else
+		return "";
+#endif
+	}
+
+	// libraries built with -march=native only run on cpus with the instruction set of the build machine
+	const std::string& host_cpu_id()
+	{
+		static const std::string id = read_host_cpu_id();
+		return id;
+	}
+
+	using native_string = std::filesystem::path::string_type;
+
+	void split_arguments(const std::string& str, std::vector<native_string>& args)
+	{
+		std::istringstream ss(str);
+		std::string arg;
+		while (ss >> arg)
+			args.emplace_back(std::filesystem::path(arg).native());
+	}
+
+#ifdef _WIN32
+	// quoted so that CommandLineToArgvW and the C runtime give back arg unchanged
+	std::wstring quote_argument(const std::wstring& arg)
+	{
+		if (!arg.empty() && arg.find_first_of(L" \t\n\v\"") == std::wstring::npos)
+			return arg;
+
+		std::wstring ret = L"\"";
+		size_t backslashes = 0;
+		for (wchar_t c : arg) {
+			if (c == L'\\') {
+				++backslashes;
+				continue;
+			}
+			ret.append(c == L'"' ? 2 * backslashes + 1 : backslashes, L'\\');
+			backslashes = 0;
+			ret += c;
+		}
+		ret.append(2 * backslashes, L'\\');
+		ret += L'"';
+		return ret;
+	}
+#endif
+
+	// runs args[0] with the arguments args without a shell, stdout and stderr go to log_path,
+	// returns true if it exited successfully
+	bool run_process(const std::vector<native_string>& args, const std::filesystem::path& log_path)
+	{
+#ifdef _WIN32
+		std::wstring cmd;
+		for (auto& arg : args) {
+			if (!cmd.empty())
+				cmd += L' ';
+			cmd += quote_argument(arg);
+		}
+
+		SECURITY_ATTRIBUTES attributes{ sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE };
+		HANDLE log = CreateFileW(log_path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, &attributes,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (log == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Could not create jit log " + log_path.string());
+
+		STARTUPINFOW startup{};
+		startup.cb = sizeof(startup);
+		startup.dwFlags = STARTF_USESTDHANDLES;
+		startup.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+		startup.hStdOutput = log;
+		startup.hStdError = log;
+
+		PROCESS_INFORMATION process{};
+		BOOL started = CreateProcessW(nullptr, cmd.data(), nullptr, nullptr, TRUE, CREATE_NO_WINDOW,
+			nullptr, nullptr, &startup, &process);
+		CloseHandle(log);
+		if (!started)
+			throw std::runtime_error("Could not start jit compiler " + std::filesystem::path(args[0]).string());
+
+		WaitForSingleObject(process.hProcess, INFINITE);
+		DWORD exit_code = 1;
+		GetExitCodeProcess(process.hProcess, &exit_code);
+		CloseHandle(process.hThread);
+		CloseHandle(process.hProcess);
+		return exit_code == 0;
+#else
+		std::vector<char*> argv;
+		for (auto& arg : args)
+			argv.push_back(const_cast<char*>(arg.c_str()));
+		argv.push_back(nullptr);
+
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+
+		pid_t pid;
+		int err = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+		posix_spawn_file_actions_destroy(&actions);
+		if (err)
+			throw std::runtime_error("Could not start jit compiler " + args[0] + ": " + std::strerror(err));
+
+		int status;
+		while (waitpid(pid, &status, 0) == -1) {
+			if (errno != EINTR)
+				throw std::runtime_error("Could not wait for jit compiler " + args[0]);
+		}
+		return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+	}
+
+}
+
+JitOptions cpu::default_jit_options()
+{
+#ifdef _WIN32
+	JitOptions options{ "cl", "/nologo /O2 /fp:fast /LD" };
+#else
+	JitOptions options{ "c++", "-std=c++17 -O3 -march=native -ffast-math -fPIC -shared" };
+#endif
+	if (const char* compiler = std::getenv("VC_JIT_CXX"))
+		options.compiler = compiler;
+	if (const char* flags = std::getenv("VC_JIT_FLAGS"))
+		options.flags = flags;
+	return options;
+}
+
+JitOptions cpu::exact_jit_options()
+{
+#ifdef _WIN32
+	JitOptions options{ "cl", "/nologo /O2 /fp:precise /LD" };
+#else
+	JitOptions options{ "c++", "-std=c++17 -O3 -march=native -ffp-contract=off -fPIC -shared" };
+#endif
+	if (const char* compiler = std::getenv("VC_JIT_CXX"))
+		options.compiler = compiler;
+	return options;
+}
+
+JitCompiler::JitCompiler(const std::filesystem::path& directory, JitOptions options)
+	: m_Directory(directory), m_Options(std::move(options))
+{
+	std::filesystem::create_directories(m_Directory);
+}
+
+JitCompiler::~JitCompiler()
+{
+	for (auto& [key, handle] : m_Libraries) {
+		close_library(handle);
+	}
+	std::error_code ec;
+	for (auto& path : m_TmpLibraries) {
+		std::filesystem::remove(path, ec);
+	}
+}
+
+void* JitCompiler::get_symbol(const std::string& source, const std::string& symbol)
+{
+	ui64 key = util::stable_hash(m_Options.compiler + " " + m_Options.flags + "\n" + host_cpu_id(),
+		util::stable_hash(source));
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	void* handle;
+	auto it = m_Libraries.find(key);
+	if (it != m_Libraries.end()) {
+		++m_Hits;
+		handle = it->second;
+	}
+	else {
+		handle = open_library(source, key);
+		m_Libraries.emplace(key, handle);
+	}
+
+	void* ret = find_symbol(handle, symbol);
+	if (!ret)
+		throw std::runtime_error("Symbol " + symbol + " was not found in jit library");
+	return ret;
+}
+
+JitStats JitCompiler::get_stats() const
+{
+	return JitStats{ m_Hits.load(), m_Loads.load(), m_Compilations.load() };
+}
+
+void* JitCompiler::open_library(const std::string& source, ui64 key)
+{
+	auto base = m_Directory / util::to_hex(key);
+	auto source_path = base;
+	source_path += ".cpp";
+	auto library_path = base;
+	library_path += library_extension;
+
+	// the source is kept next to the library, it guards against hash collisions
+	std::error_code ec;
+	if (std::filesystem::exists(library_path, ec) && read_file(source_path) == source) {
+		++m_Loads;
+		return load_library(library_path);
+	}
+
+	auto tmp_source_path = source_path;
+	tmp_source_path += tmp_suffix() + ".cpp";
+	{
+		std::ofstream file(tmp_source_path, std::ios::binary | std::ios::trunc);
+		file << source;
+		if (!file)
+			throw std::runtime_error("Could not write jit source " + tmp_source_path.string());
+	}
+
+	auto tmp_library_path = library_path;
+	tmp_library_path += tmp_suffix() + library_extension;
+
+	try {
+		compile(tmp_source_path, tmp_library_path);
+	}
+	catch (...) {
+		std::filesystem::remove(tmp_source_path, ec);
+		std::filesystem::remove(tmp_library_path, ec);
+		throw;
+	}
+	++m_Compilations;
+
+	// the library is moved into place first, a library whose source is missing or different is rebuilt
+	std::filesystem::rename(tmp_library_path, library_path, ec);
+	if (ec) {
+		// another process might have it loaded, use the freshly compiled library directly
+		std::filesystem::remove(tmp_source_path, ec);
+		void* handle;
+		try {
+			handle = load_library(tmp_library_path);
+		}
+		catch (...) {
+			std::filesystem::remove(tmp_library_path, ec);
+			throw;
+		}
+#ifdef _WIN32
+		// a loaded dll can not be deleted
+		m_TmpLibraries.emplace_back(tmp_library_path);
+#else
+		// the loaded mapping stays valid after the file is unlinked
+		std::filesystem::remove(tmp_library_path, ec);
+#endif
+		return handle;
+	}
+	std::filesystem::rename(tmp_source_path, source_path, ec);
+	if (ec)
+		std::filesystem::remove(tmp_source_path, ec);
+
+	return load_library(library_path);
+}
+
+void JitCompiler::compile(const std::filesystem::path& source_path, const std::filesystem::path& library_path)
+{
+	auto log_path = library_path;
+	log_path += ".log";
+
+	std::vector<native_string> args;
+	split_arguments(m_Options.compiler, args);
+	split_arguments(m_Options.flags, args);
+	if (args.empty())
+		throw std::runtime_error("No jit compiler given");
+	args.emplace_back(source_path.native());
+#ifdef _WIN32
+	// the object file goes next to the library instead of the working directory
+	auto object_path = library_path;
+	object_path += ".obj";
+	args.emplace_back(L"/Fe:" + library_path.native());
+	args.emplace_back(L"/Fo:" + object_path.native());
+#else
+	args.emplace_back("-o");
+	args.emplace_back(library_path.native());
+#endif
+
+	bool compiled;
+	try {
+		compiled = run_process(args, log_path);
+	}
+	catch (...) {
+		std::error_code ec;
+		std::filesystem::remove(log_path, ec);
+		throw;
+	}
+
+	std::error_code ec;
+	std::string log = read_file(log_path);
+	std::filesystem::remove(log_path, ec);
+#ifdef _WIN32
+	std::filesystem::remove(object_path, ec);
+	// cl also writes an import library and export file for the dll
+	auto side_file = [&library_path](const char* ext) { auto p = library_path; return p.replace_extension(ext); };
+	std::filesystem::remove(side_file(".lib"), ec);
+	std::filesystem::remove(side_file(".exp"), ec);
+#endif
+
+	if (!compiled)
+		throw std::runtime_error("Error compiling jit source " + source_path.string() + ":\n" + log);
+}
@@ -0,0 +1,87 @@
+module;
+
+export module jit;
+
+import <string>;
+import <filesystem>;
+import <unordered_map>;
+import <vector>;
+import <mutex>;
+import <atomic>;
+
+import vc;
+
+namespace cpu {
+
+	export struct JitOptions {
+		// compiler executable and flags, split at whitespace into the arguments of the compiler
+		// process, the source and output paths are appended
+		std::string compiler;
+		std::string flags;
+	};
+
+	// the system compiler with optimization flags for the build machine, the environment
+	// variables VC_JIT_CXX and VC_JIT_FLAGS override them
+	export JitOptions default_jit_options();
+
+	// default_jit_options without fast math and floating point contraction, for results that are
+	// reproducible bit for bit. VC_JIT_CXX overrides the compiler, the flags are not overridden
+	export JitOptions exact_jit_options();
+
+	export struct JitStats {
+		// symbols of libraries that were already loaded
+		vc::ui64 hits;
+		// libraries loaded from the cache directory without compiling
+		vc::ui64 loads;
+		vc::ui64 compilations;
+	};
+
+	// Compiles C++ sources into shared libraries with the system compiler and loads them. The
+	// libraries are kept in directory under the hash of the source, the options and the host cpu, so
+	// every source is compiled once across runs and a library built for one instruction set is never
+	// loaded on a cpu without it. Loaded libraries are unloaded when the JitCompiler is destroyed,
+	// symbols obtained from it must not be used after that
+	export class JitCompiler {
+	public:
+
+		JitCompiler(const std::filesystem::path& directory, JitOptions options = default_jit_options());
+
+		~JitCompiler();
+
+		JitCompiler(const JitCompiler&) = delete;
+		JitCompiler& operator=(const JitCompiler&) = delete;
+
+		// address of symbol in the library built from source, compiles and loads it if needed
+		void* get_symbol(const std::string& source, const std::string& symbol);
+
+		template<typename F>
+		F get_function(const std::string& source, const std::string& symbol)
+		{
+			return reinterpret_cast<F>(get_symbol(source, symbol));
+		}
+
+		JitStats get_stats() const;
+
+		const std::filesystem::path& get_directory() const { return m_Directory; }
+
+	private:
+
+		void* open_library(const std::string& source, vc::ui64 key);
+
+		void compile(const std::filesystem::path& source_path, const std::filesystem::path& library_path);
+
+	private:
+		std::filesystem::path m_Directory;
+		JitOptions m_Options;
+
+		std::mutex m_Mutex;
+		std::unordered_map<vc::ui64, void*> m_Libraries;
+		// libraries loaded from their temporary path, removed once they are unloaded
+		std::vector<std::filesystem::path> m_TmpLibraries;
+
+		std::atomic<vc::ui64> m_Hits = 0;
+		std::atomic<vc::ui64> m_Loads = 0;
+		std::atomic<vc::ui64> m_Compilations = 0;
+	};
+
+}
@@ -0,0 +1,72 @@
+module;
+
+module nlsq_solver;
+
+import <vector>;
+import <string>;
+import <stdexcept>;
+import <type_traits>;
+
+import vc;
+import expr;
+import symbolic;
+import thread_pool;
+import jit;
+import cpp_kernels;
+
+using namespace vc;
+using namespace cpu;
+
+template<typename T>
+NlsqSolver<T>::NlsqSolver(const expression::Expression& expr, const glsl::SymbolicContext& context,
+	ui16 ndata, ui16 nparam, ui16 nconst, JitCompiler& jit)
+	: m_NData(ndata), m_NConst(nconst), m_Weights(ndata, T(1))
+{
+	auto kernel = nlsq_slmh_w_cpp_kernel(expr, context, ndata, nparam, nconst, std::is_same_v<T, float>);
+	m_Kernel = jit.get_function<NlsqSolverKernel<T>>(kernel.source, kernel.name);
+}
+
+template<typename T>
+void NlsqSolver<T>::set_weights(std::vector<T> weights)
+{
+	if (weights.size() != m_NData)
+		throw std::runtime_error("Expected " + std::to_string(m_NData) + " weights, got " + std::to_string(weights.size()));
+	m_Weights = std::move(weights);
+}
+
+template<typename T>
+void NlsqSolver<T>::solve(const NlsqProblems<T>& problems, ui32 iterations) const
+{
+	check_problems(problems);
+	run(problems, iterations, 0, problems.nproblems);
+}
+
+template<typename T>
+void NlsqSolver<T>::solve(const NlsqProblems<T>& problems, ui32 iterations, util::ThreadPool& pool, ui32 grain) const
+{
+	check_problems(problems);
+	util::parallel_for(pool, 0, problems.nproblems, grain, [this, &problems, iterations](ui64 first, ui64 last) {
+		run(problems, iterations, first, last);
+		});
+}
+
+template<typename T>
+void NlsqSolver<T>::check_problems(const NlsqProblems<T>& problems) const
+{
+	if (!problems.params || !problems.consts || !problems.data || !problems.lambda || !problems.step_type)
+		throw std::runtime_error("params, consts, data, lambda and step_type must be given");
+	if ((problems.lower_bound == nullptr) != (problems.upper_bound == nullptr))
+		throw std::runtime_error("Either both or none of lower_bound and upper_bound must be given");
+}
+
+template<typename T>
+void NlsqSolver<T>::run(const NlsqProblems<T>& problems, ui32 iterations, ui64 first, ui64 last) const
+{
+	i32 consts_stride = problems.shared_consts ? 0 : m_NData * m_NConst;
+	m_Kernel(static_cast<i32>(first), static_cast<i32>(last), static_cast<i32>(iterations), consts_stride,
+		problems.params, problems.consts, problems.data, m_Weights.data(), problems.lower_bound, problems.upper_bound,
+		problems.lambda, problems.step_type, T(m_Damping.mu), T(m_Damping.eta), T(m_Damping.acc), T(m_Damping.dec));
+}
+
+template class cpu::NlsqSolver<float>;
+template class cpu::NlsqSolver<double>;
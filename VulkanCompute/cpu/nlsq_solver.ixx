@@ -0,0 +1,80 @@
+module;
+
+export module nlsq_solver;
+
+import <vector>;
+
+import vc;
+import expr;
+import symbolic;
+import thread_pool;
+import jit;
+import cpp_kernels;
+
+namespace cpu {
+
+	// damping of nlsq_slmh_w_step, the defaults are the ones of the qmri shaders
+	export struct NlsqDamping {
+		float mu = 0.25f;
+		float eta = 0.75f;
+		float acc = 0.2f;
+		float dec = 5.0f;
+	};
+
+	// Problems stored one after the other like for NlsqKernel. params, lambda and step_type are updated
+	// in place. consts holds ndata*nconst values per problem, or once for all problems if shared_consts.
+	// The bounds hold nparam values per problem, without them the params are not clamped
+	export template<typename T>
+	struct NlsqProblems {
+		vc::ui32 nproblems = 0;
+		T* params = nullptr;
+		const T* consts = nullptr;
+		bool shared_consts = false;
+		const T* data = nullptr;
+		T* lambda = nullptr;
+		vc::i32* step_type = nullptr;
+		const T* lower_bound = nullptr;
+		const T* upper_bound = nullptr;
+	};
+
+	// Weighted levenberg marquardt fits on the cpu, in single precision for float and double precision for
+	// double. Every iteration is the nlsq_slmh_w_step of the shaders followed by nlsq_clamping, compiled from
+	// C++ by a JitCompiler that must outlive the solver. With exact_jit_options the results are bit identical to
+	// the CpuShader translation of a shader running the same steps
+	export template<typename T>
+	class NlsqSolver {
+	public:
+
+		NlsqSolver(const expression::Expression& expr, const glsl::SymbolicContext& context,
+			vc::ui16 ndata, vc::ui16 nparam, vc::ui16 nconst, JitCompiler& jit);
+
+		// ndata weights shared by all problems, all ones unless set
+		void set_weights(std::vector<T> weights);
+
+		void set_damping(const NlsqDamping& damping) { m_Damping = damping; }
+
+		const NlsqDamping& get_damping() const { return m_Damping; }
+
+		// all problems on the calling thread
+		void solve(const NlsqProblems<T>& problems, vc::ui32 iterations) const;
+
+		// problems split into chunks of grain, spread over the pool and the calling thread
+		void solve(const NlsqProblems<T>& problems, vc::ui32 iterations, util::ThreadPool& pool, vc::ui32 grain = 256) const;
+
+	private:
+
+		void check_problems(const NlsqProblems<T>& problems) const;
+
+		void run(const NlsqProblems<T>& problems, vc::ui32 iterations, vc::ui64 first, vc::ui64 last) const;
+
+	private:
+		vc::ui16 m_NData;
+		vc::ui16 m_NConst;
+
+		std::vector<T> m_Weights;
+		NlsqDamping m_Damping;
+
+		NlsqSolverKernel<T> m_Kernel;
+	};
+
+}
@@ -0,0 +1,65 @@
+module;
+
+export module cse;
+
+import <string>;
+import <vector>;
+import <utility>;
+
+import vc;
+import expr;
+import dag;
+import simplify;
+import symbolic;
+
+namespace expression {
+
+	export struct EliminatedSubexpressions {
+		// temporary name -> expression, every temporary only depends on earlier ones
+		std::vector<std::pair<std::string, std::string>> temporaries;
+		// code of the eliminated expressions, in the order they were given
+		std::vector<std::string> expressions;
+	};
+
+	// Common subexpression elimination over a residual and its derivatives. The expressions are
+	// added to one ExpressionDag and simplified, every non leaf node with more than one use is then
+	// hoisted into a temporary named prefix0, prefix1, ... Only structurally identical subtrees are
+	// merged. The temporaries and expressions are printed in the given syntax
+	export EliminatedSubexpressions eliminate_common_subexpressions(
+		const std::vector<const Expression*>& exprs, const glsl::SymbolicContext& symtext,
+		bool single_precision, CodeSyntax syntax = CodeSyntax::GLSL, const std::string& prefix = "cse")
+	{
+		ExpressionDag dag;
+		std::vector<ExpressionDag::NodeId> roots;
+		roots.reserve(exprs.size());
+		for (auto expr : exprs) {
+			roots.push_back(dag.add(*expr));
+		}
+		roots = simplify(dag, roots, single_precision, symtext.simplify);
+
+		auto uses = dag.count_uses(roots);
+		std::vector<std::string> names(dag.size());
+
+		auto code_str = [&](ExpressionDag::NodeId id) {
+			return syntax == CodeSyntax::GLSL ?
+				dag.glsl_str(id, symtext, names) : dag.cpp_str(id, symtext, single_precision, names);
+		};
+
+		EliminatedSubexpressions ret;
+		for (auto id : dag.topological_order(roots)) {
+			if (uses[id] < 2 || dag.is_leaf(id))
+				continue;
+			std::string code = code_str(id);
+			names[id] = prefix + std::to_string(ret.temporaries.size());
+			ret.temporaries.emplace_back(names[id], std::move(code));
+		}
+
+		ret.expressions.reserve(roots.size());
+		for (auto root : roots) {
+			ret.expressions.emplace_back(code_str(root));
+		}
+
+		return ret;
+	}
+
+}
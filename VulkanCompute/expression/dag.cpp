@@ -0,0 +1,319 @@
+module;
+
+module dag;
+
+import <string>;
+import <vector>;
+import <unordered_map>;
+import <typeindex>;
+import <functional>;
+import <stdexcept>;
+import <optional>;
+import <cstdlib>;
+import <cmath>;
+import <charconv>;
+
+import vc;
+import util;
+import expr;
+import symbolic;
+
+using namespace vc;
+using namespace expression;
+
+namespace {
+
+	const std::unordered_map<std::type_index, DagOp>& node_ops()
+	{
+		static const std::unordered_map<std::type_index, DagOp> ops = {
+			{ typeid(NegNode), DagOp::NEG },
+			{ typeid(AddNode), DagOp::ADD },
+			{ typeid(SubNode), DagOp::SUB },
+			{ typeid(MulNode), DagOp::MUL },
+			{ typeid(DivNode), DagOp::DIV },
+			{ typeid(PowNode), DagOp::POW },
+			{ typeid(SgnNode), DagOp::SGN },
+			{ typeid(AbsNode), DagOp::ABS },
+			{ typeid(SqrtNode), DagOp::SQRT },
+			{ typeid(ExpNode), DagOp::EXP },
+			{ typeid(LogNode), DagOp::LOG },
+			{ typeid(SinNode), DagOp::SIN },
+			{ typeid(CosNode), DagOp::COS },
+			{ typeid(TanNode), DagOp::TAN },
+			{ typeid(AsinNode), DagOp::ASIN },
+			{ typeid(AcosNode), DagOp::ACOS },
+			{ typeid(AtanNode), DagOp::ATAN },
+			{ typeid(SinhNode), DagOp::SINH },
+			{ typeid(CoshNode), DagOp::COSH },
+			{ typeid(TanhNode), DagOp::TANH },
+			{ typeid(AsinhNode), DagOp::ASINH },
+			{ typeid(AcoshNode), DagOp::ACOSH },
+			{ typeid(AtanhNode), DagOp::ATANH },
+		};
+		return ops;
+	}
+
+	// glsl function name of the unary ops
+	const char* glsl_function(DagOp op)
+	{
+		switch (op) {
+		case DagOp::SGN: return "sign";
+		case DagOp::ABS: return "abs";
+		case DagOp::SQRT: return "sqrt";
+		case DagOp::EXP: return "exp";
+		case DagOp::LOG: return "log";
+		case DagOp::SIN: return "sin";
+		case DagOp::COS: return "cos";
+		case DagOp::TAN: return "tan";
+		case DagOp::ASIN: return "asin";
+		case DagOp::ACOS: return "acos";
+		case DagOp::ATAN: return "atan";
+		case DagOp::SINH: return "sinh";
+		case DagOp::COSH: return "cosh";
+		case DagOp::TANH: return "tanh";
+		case DagOp::ASINH: return "asinh";
+		case DagOp::ACOSH: return "acosh";
+		case DagOp::ATANH: return "atanh";
+		default:
+			throw std::runtime_error("DagOp is not a unary function");
+		}
+	}
+
+}
+
+std::string expression::number_literal(double v, bool single_precision, CodeSyntax syntax)
+{
+	char buffer[64];
+	auto result = single_precision ?
+		std::to_chars(buffer, buffer + sizeof(buffer), static_cast<float>(v)) :
+		std::to_chars(buffer, buffer + sizeof(buffer), v);
+	std::string text(buffer, result.ptr);
+	if (text.find_first_of(".e") == std::string::npos)
+		text += ".0";
+	if (!single_precision && syntax == CodeSyntax::GLSL)
+		text += "lf";
+	if (single_precision && syntax == CodeSyntax::CPP)
+		text += "f";
+
+	// a leading minus would merge with a preceding operator, 'a--2'
+	if (v < 0.0)
+		text = "(" + text + ")";
+	return text;
+}
+
+size_t ExpressionDag::KeyHash::operator()(const Key& key) const
+{
+	size_t ret = std::hash<std::string>()(key.name);
+	ret = util::hash_combine(ret, static_cast<ui32>(key.op));
+	ret = util::hash_combine(ret, key.lhs);
+	ret = util::hash_combine(ret, key.rhs);
+	ret = util::hash_combine(ret, key.third);
+	return ret;
+}
+
+ExpressionDag::NodeId ExpressionDag::intern(DagOp op, NodeId lhs, NodeId rhs, NodeId third)
+{
+	auto [it, inserted] = m_Index.try_emplace(Key{ op, lhs, rhs, third, {} }, static_cast<NodeId>(m_Nodes.size()));
+	if (inserted)
+		m_Nodes.push_back(DagNode{ op, lhs, rhs, third, {} });
+	return it->second;
+}
+
+ExpressionDag::NodeId ExpressionDag::intern_leaf(DagOp op, const std::string& name)
+{
+	auto [it, inserted] = m_Index.try_emplace(Key{ op, NO_NODE, NO_NODE, NO_NODE, name }, static_cast<NodeId>(m_Nodes.size()));
+	if (inserted)
+		m_Nodes.push_back(DagNode{ op, NO_NODE, NO_NODE, NO_NODE, name });
+	return it->second;
+}
+
+ExpressionDag::NodeId ExpressionDag::add(const Node& node)
+{
+	std::unordered_map<const Node*, NodeId> added;
+	return add(node, added);
+}
+
+ExpressionDag::NodeId ExpressionDag::add(const Node& node, std::unordered_map<const Node*, NodeId>& added)
+{
+	// nodes that only wrap their first child
+	if (typeid(node) == typeid(Expression) || typeid(node) == typeid(DerivativeNode) || typeid(node) == typeid(SubsNode))
+		return add(*node.children[0], added);
+
+	// subtrees shared between the expression nodes are only walked once
+	auto found = added.find(&node);
+	if (found != added.end())
+		return found->second;
+
+	NodeId id;
+	if (typeid(node) == typeid(VariableNode)) {
+		id = intern_leaf(DagOp::VARIABLE, node.str());
+	}
+	else if (typeid(node) == typeid(TokenNode)) {
+		id = intern_leaf(DagOp::NUMBER, node.str());
+	}
+	else {
+		auto it = node_ops().find(typeid(node));
+		if (it == node_ops().end())
+			throw std::runtime_error("Node type can't be added to an ExpressionDag");
+
+		NodeId lhs = add(*node.children[0], added);
+		NodeId rhs = node.children.size() > 1 ? add(*node.children[1], added) : NO_NODE;
+		id = intern(it->second, lhs, rhs);
+	}
+
+	added.emplace(&node, id);
+	return id;
+}
+
+const ExpressionDag::DagNode& ExpressionDag::get_node(NodeId id) const
+{
+	return m_Nodes.at(id);
+}
+
+bool ExpressionDag::is_leaf(NodeId id) const
+{
+	return m_Nodes.at(id).lhs == NO_NODE;
+}
+
+std::optional<double> ExpressionDag::get_number(NodeId id) const
+{
+	auto& node = m_Nodes.at(id);
+	if (node.op != DagOp::NUMBER)
+		return std::nullopt;
+
+	// negative literals are parenthesized, double literals can have an lf suffix
+	std::string digits = node.name;
+	if (digits.size() > 2 && digits.front() == '(' && digits.back() == ')')
+		digits = digits.substr(1, digits.size() - 2);
+
+	char* end = nullptr;
+	double value = std::strtod(digits.c_str(), &end);
+	if (end == digits.c_str())
+		return std::nullopt;
+
+	std::string suffix(end);
+	if (!suffix.empty() && suffix != "f" && suffix != "lf")
+		return std::nullopt;
+	return value;
+}
+
+size_t ExpressionDag::size() const
+{
+	return m_Nodes.size();
+}
+
+std::vector<ExpressionDag::NodeId> ExpressionDag::topological_order(const std::vector<NodeId>& roots) const
+{
+	std::vector<NodeId> ret;
+	std::vector<bool> visited(m_Nodes.size(), false);
+
+	// iterative post order, the graphs of large hessians are deep
+	std::vector<std::pair<NodeId, bool>> stack;
+	for (auto root : roots) {
+		stack.emplace_back(root, false);
+		while (!stack.empty()) {
+			auto [id, expanded] = stack.back();
+			stack.pop_back();
+			if (expanded) {
+				ret.push_back(id);
+				continue;
+			}
+			if (visited[id])
+				continue;
+			visited[id] = true;
+
+			auto& node = m_Nodes[id];
+			stack.emplace_back(id, true);
+			if (node.third != NO_NODE)
+				stack.emplace_back(node.third, false);
+			if (node.rhs != NO_NODE)
+				stack.emplace_back(node.rhs, false);
+			if (node.lhs != NO_NODE)
+				stack.emplace_back(node.lhs, false);
+		}
+	}
+
+	return ret;
+}
+
+std::vector<ui32> ExpressionDag::count_uses(const std::vector<NodeId>& roots) const
+{
+	std::vector<ui32> uses(m_Nodes.size(), 0);
+	for (auto id : topological_order(roots)) {
+		auto& node = m_Nodes[id];
+		if (node.lhs != NO_NODE)
+			++uses[node.lhs];
+		if (node.rhs != NO_NODE)
+			++uses[node.rhs];
+		if (node.third != NO_NODE)
+			++uses[node.third];
+	}
+	for (auto root : roots) {
+		++uses[root];
+	}
+	return uses;
+}
+
+std::string ExpressionDag::glsl_str(NodeId id, const glsl::SymbolicContext& symtext,
+	const std::vector<std::string>& names) const
+{
+	return code_str(id, symtext, CodeSyntax::GLSL, false, names);
+}
+
+std::string ExpressionDag::cpp_str(NodeId id, const glsl::SymbolicContext& symtext, bool single_precision,
+	const std::vector<std::string>& names) const
+{
+	return code_str(id, symtext, CodeSyntax::CPP, single_precision, names);
+}
+
+std::string ExpressionDag::code_str(NodeId id, const glsl::SymbolicContext& symtext, CodeSyntax syntax,
+	bool single_precision, const std::vector<std::string>& names) const
+{
+	if (id < names.size() && !names[id].empty())
+		return names[id];
+
+	auto str = [&](NodeId child) { return code_str(child, symtext, syntax, single_precision, names); };
+
+	auto& node = m_Nodes.at(id);
+	switch (node.op) {
+	case DagOp::NUMBER:
+	{
+		auto value = get_number(id);
+		if (syntax == CodeSyntax::GLSL) {
+			// glsl_str has no precision, simplified literals already have theirs. Integral literals
+			// are made floats, 1/2 is an integer division
+			if (!value.has_value() || node.name.find_first_of(".eE") != std::string::npos)
+				return node.name;
+			std::string text = node.name;
+			text.insert(text.back() == ')' ? text.size() - 1 : text.size(), ".0");
+			return text;
+		}
+		return value.has_value() ? number_literal(*value, single_precision, syntax) : node.name;
+	}
+	case DagOp::VARIABLE:
+		return symtext.get_glsl_var_name(node.name);
+	case DagOp::NEG:
+		return "(-" + str(node.lhs) + ")";
+	case DagOp::ADD:
+		return "(" + str(node.lhs) + "+" + str(node.rhs) + ")";
+	case DagOp::SUB:
+		return "(" + str(node.lhs) + "-" + str(node.rhs) + ")";
+	case DagOp::MUL:
+		return "(" + str(node.lhs) + "*" + str(node.rhs) + ")";
+	case DagOp::DIV:
+		return "(" + str(node.lhs) + "/" + str(node.rhs) + ")";
+	case DagOp::POW:
+		return (syntax == CodeSyntax::GLSL ? "pow(" : "std::pow(") + str(node.lhs) + "," + str(node.rhs) + ")";
+	case DagOp::FMA:
+		// std::fma is a library call without hardware fma, the c++ compiler contracts a*b+c itself
+		if (syntax == CodeSyntax::CPP)
+			return "(" + str(node.lhs) + "*" + str(node.rhs) + "+" + str(node.third) + ")";
+		return "fma(" + str(node.lhs) + "," + str(node.rhs) + "," + str(node.third) + ")";
+	case DagOp::SGN:
+		if (syntax == CodeSyntax::CPP)
+			return "vc_sign(" + str(node.lhs) + ")";
+		[[fallthrough]];
+	default:
+		return (syntax == CodeSyntax::GLSL ? "" : "std::") + std::string(glsl_function(node.op)) + "(" + str(node.lhs) + ")";
+	}
+}
@@ -0,0 +1,132 @@
+module;
+
+export module dag;
+
+import <string>;
+import <vector>;
+import <unordered_map>;
+import <optional>;
+
+import vc;
+import expr;
+import symbolic;
+
+namespace expression {
+
+	export enum class DagOp : vc::ui8 {
+		NUMBER,
+		VARIABLE,
+		NEG,
+		ADD,
+		SUB,
+		MUL,
+		DIV,
+		POW,
+		SGN,
+		ABS,
+		SQRT,
+		EXP,
+		LOG,
+		SIN,
+		COS,
+		TAN,
+		ASIN,
+		ACOS,
+		ATAN,
+		SINH,
+		COSH,
+		TANH,
+		ASINH,
+		ACOSH,
+		ATANH,
+		// lhs * rhs + third
+		FMA,
+	};
+
+	export enum class CodeSyntax {
+		GLSL,
+		CPP,
+	};
+
+	// floating point literal for v, also for integral values so 1/0 is not an integer division.
+	// glsl double literals have an lf suffix and c++ float literals an f suffix. Negative literals
+	// are parenthesized
+	export std::string number_literal(double v, bool single_precision, CodeSyntax syntax);
+
+	// Hash-consed expression graph. Nodes are stored in one arena and referred to by index, every
+	// structurally distinct subexpression is stored once. Trees added to the same graph share their
+	// common subtrees, and node handles are plain indices that are copied in O(1)
+	export class ExpressionDag {
+	public:
+
+		using NodeId = vc::ui32;
+
+		static constexpr NodeId NO_NODE = ~NodeId(0);
+
+		struct DagNode {
+			DagOp op;
+			NodeId lhs;
+			NodeId rhs;
+			NodeId third;
+			// number text or variable name for leaves
+			std::string name;
+		};
+
+		NodeId intern(DagOp op, NodeId lhs, NodeId rhs = NO_NODE, NodeId third = NO_NODE);
+
+		NodeId intern_leaf(DagOp op, const std::string& name);
+
+		// adds the tree at node, returns the id of its root
+		NodeId add(const Node& node);
+
+		const DagNode& get_node(NodeId id) const;
+
+		bool is_leaf(NodeId id) const;
+
+		// value of a NUMBER node, nullopt for other nodes or numbers that are not plain literals
+		std::optional<double> get_number(NodeId id) const;
+
+		size_t size() const;
+
+		// nodes reachable from roots, children before their parents
+		std::vector<NodeId> topological_order(const std::vector<NodeId>& roots) const;
+
+		// number of parents of every node reachable from roots, being a root counts as one use
+		std::vector<vc::ui32> count_uses(const std::vector<NodeId>& roots) const;
+
+		// nodes that have a non empty entry in names are printed as that name
+		std::string glsl_str(NodeId id, const glsl::SymbolicContext& symtext,
+			const std::vector<std::string>& names = {}) const;
+
+		// same indexing as glsl_str, functions are called from std and numbers are printed with the
+		// given precision. sgn calls vc_sign which the including source must define
+		std::string cpp_str(NodeId id, const glsl::SymbolicContext& symtext, bool single_precision,
+			const std::vector<std::string>& names = {}) const;
+
+	private:
+
+		NodeId add(const Node& node, std::unordered_map<const Node*, NodeId>& added);
+
+		std::string code_str(NodeId id, const glsl::SymbolicContext& symtext, CodeSyntax syntax,
+			bool single_precision, const std::vector<std::string>& names) const;
+
+		struct Key {
+			DagOp op;
+			NodeId lhs;
+			NodeId rhs;
+			NodeId third;
+			std::string name;
+
+			bool operator==(const Key& other) const = default;
+		};
+
+		struct KeyHash {
+			size_t operator()(const Key& key) const;
+		};
+
+	private:
+		std::vector<DagNode> m_Nodes;
+		std::unordered_map<Key, NodeId, KeyHash> m_Index;
+	};
+
+}
@@ -0,0 +1,176 @@
+module;
+
+module derivative_cache;
+
+import <string>;
+import <memory>;
+import <filesystem>;
+import <fstream>;
+import <unordered_map>;
+import <mutex>;
+import <atomic>;
+import <thread>;
+import <functional>;
+import <cstdint>;
+
+import vc;
+import util;
+import expr;
+
+using namespace vc;
+using namespace expression;
+
+namespace {
+
+	constexpr const char* file_header = "vcdiff 1";
+
+	std::atomic<ui64> tmp_counter = 0;
+
+	std::string variable_name(const std::string& x)
+	{
+		return util::to_lower_case(util::remove_whitespace(x));
+	}
+
+	// identifies what a parse depends on, the grammar and the variables of a context
+	std::string context_key(const LexContext& context)
+	{
+		std::string key = std::to_string(reinterpret_cast<std::uintptr_t>(context.grammar.get()));
+		for (auto& var : context.variables) {
+			key += '\t';
+			key += var.name;
+		}
+		return key;
+	}
+
+}
+
+size_t DerivativeCache::KeyHash::operator()(const Key& key) const
+{
+	return static_cast<size_t>(util::stable_hash(key.variable, key.hash));
+}
+
+std::shared_ptr<const Expression> DerivativeCache::diff(const Expression& expr, const std::string& x)
+{
+	std::string expr_str = expr.str();
+	std::string ctx_key = context_key(expr.get_context());
+	Key key{ util::stable_hash(expr_str), variable_name(x) };
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto it = m_Entries.find(key);
+		if (it != m_Entries.end() && it->second.expression == expr_str) {
+			auto& parsed = it->second.parsed[ctx_key];
+			if (!parsed) {
+				parsed = std::make_shared<const Expression>(it->second.derivative, expr.get_context());
+			}
+			++m_Hits;
+			return parsed;
+		}
+	}
+
+	++m_Misses;
+	std::shared_ptr<const Expression> derivative = expr.diff(key.variable);
+
+	// if another thread got here first, or the hash collided, the existing entry is kept
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = m_Entries.try_emplace(std::move(key), Entry{ expr_str, derivative->str(), {} }).first;
+	if (it->second.expression == expr_str)
+		it->second.parsed.try_emplace(std::move(ctx_key), derivative);
+	return derivative;
+}
+
+std::shared_ptr<const Expression> DerivativeCache::diff2(const Expression& expr, const std::string& x, const std::string& y)
+{
+	std::string first = variable_name(x);
+	std::string second = variable_name(y);
+	if (second < first)
+		std::swap(first, second);
+
+	return diff(*diff(expr, first), second);
+}
+
+bool DerivativeCache::load(const std::filesystem::path& path)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	std::string line;
+	if (!std::getline(file, line) || line != file_header)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	while (std::getline(file, line)) {
+		// expression \t variable \t derivative
+		size_t first_tab = line.find('\t');
+		if (first_tab == std::string::npos)
+			continue;
+		size_t second_tab = line.find('\t', first_tab + 1);
+		if (second_tab == std::string::npos)
+			continue;
+
+		Entry entry{ line.substr(0, first_tab), line.substr(second_tab + 1), {} };
+		Key key{ util::stable_hash(entry.expression), line.substr(first_tab + 1, second_tab - first_tab - 1) };
+		m_Entries.try_emplace(std::move(key), std::move(entry));
+	}
+
+	return true;
+}
+
+bool DerivativeCache::save(const std::filesystem::path& path) const
+{
+	std::error_code ec;
+	if (path.has_parent_path())
+		std::filesystem::create_directories(path.parent_path(), ec);
+
+	auto tmp_path = path;
+	tmp_path += ".tmp" +
+		std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "_" +
+		std::to_string(tmp_counter++);
+
+	{
+		std::ofstream file(tmp_path, std::ios::trunc);
+		file << file_header << '\n';
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			for (auto& [key, entry] : m_Entries) {
+				file << entry.expression << '\t' << key.variable << '\t' << entry.derivative << '\n';
+			}
+		}
+		if (!file) {
+			file.close();
+			std::filesystem::remove(tmp_path, ec);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(tmp_path, path, ec);
+	if (ec) {
+		std::filesystem::remove(tmp_path, ec);
+		return false;
+	}
+	return true;
+}
+
+void DerivativeCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Entries.clear();
+}
+
+size_t DerivativeCache::size() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Entries.size();
+}
+
+DerivativeCacheStats DerivativeCache::get_stats() const
+{
+	return DerivativeCacheStats{ m_Hits.load(), m_Misses.load() };
+}
+
+DerivativeCache& expression::derivative_cache()
+{
+	static DerivativeCache cache;
+	return cache;
+}
@@ -0,0 +1,78 @@
+module;
+
+export module derivative_cache;
+
+import <string>;
+import <memory>;
+import <filesystem>;
+import <unordered_map>;
+import <mutex>;
+import <atomic>;
+
+import vc;
+import expr;
+
+namespace expression {
+
+	export struct DerivativeCacheStats {
+		vc::ui64 hits;
+		vc::ui64 misses;
+	};
+
+	// Memoized derivatives keyed by the structural hash of the differentiated expression and the
+	// variable. Second derivatives are taken in sorted variable order, so d2/dxdy and d2/dydx are
+	// one entry. Entries can be saved to and loaded from a text file. The derivative is kept as a
+	// string and parsed once per lexing context it is looked up with, callers never share a parse
+	// made in another context
+	export class DerivativeCache {
+	public:
+
+		// cached derivatives are immutable and shared, copy them before modifying
+		std::shared_ptr<const Expression> diff(const Expression& expr, const std::string& x);
+
+		std::shared_ptr<const Expression> diff2(const Expression& expr, const std::string& x, const std::string& y);
+
+		bool load(const std::filesystem::path& path);
+
+		bool save(const std::filesystem::path& path) const;
+
+		void clear();
+
+		size_t size() const;
+
+		DerivativeCacheStats get_stats() const;
+
+	private:
+
+		struct Key {
+			vc::ui64 hash;
+			std::string variable;
+
+			bool operator==(const Key& other) const = default;
+		};
+
+		struct KeyHash {
+			size_t operator()(const Key& key) const;
+		};
+
+		struct Entry {
+			// guards against hash collisions
+			std::string expression;
+			std::string derivative;
+			// parses of the derivative by context_key of the lexing context, empty for entries loaded
+			// from disk until they are first used
+			std::unordered_map<std::string, std::shared_ptr<const Expression>> parsed;
+		};
+
+	private:
+		mutable std::mutex m_Mutex;
+		std::unordered_map<Key, Entry, KeyHash> m_Entries;
+
+		std::atomic<vc::ui64> m_Hits = 0;
+		std::atomic<vc::ui64> m_Misses = 0;
+	};
+
+	// the process wide cache used by the symbolic shader generators
+	export DerivativeCache& derivative_cache();
+
+}
@@ -0,0 +1,226 @@
+module;
+
+module evaluator;
+
+import <string>;
+import <vector>;
+import <unordered_map>;
+import <algorithm>;
+import <cmath>;
+import <limits>;
+import <stdexcept>;
+
+import vc;
+import util;
+import expr;
+import dag;
+import simplify;
+
+using namespace vc;
+using namespace expression;
+
+namespace {
+
+	constexpr size_t LANES = BatchEvaluator::LANES;
+
+	template<typename T, typename F>
+	void unary_lanes(T* dst, const T* a, F func)
+	{
+		for (size_t k = 0; k < LANES; ++k) {
+			dst[k] = func(a[k]);
+		}
+	}
+
+	template<typename T, typename F>
+	void binary_lanes(T* dst, const T* a, const T* b, F func)
+	{
+		for (size_t k = 0; k < LANES; ++k) {
+			dst[k] = func(a[k], b[k]);
+		}
+	}
+
+}
+
+BatchEvaluator::BatchEvaluator(const std::vector<const Expression*>& exprs, const std::vector<std::string>& variables)
+	: m_NInputs(variables.size())
+{
+	ExpressionDag dag;
+	std::vector<ExpressionDag::NodeId> roots;
+	roots.reserve(exprs.size());
+	for (auto expr : exprs) {
+		roots.push_back(dag.add(*expr));
+	}
+	// literals are kept at double precision, fma is evaluated as a product and a sum
+	roots = simplify(dag, roots, false);
+
+	std::unordered_map<std::string, ui16> input_index;
+	for (size_t i = 0; i < variables.size(); ++i) {
+		input_index.emplace(util::to_lower_case(variables[i]), static_cast<ui16>(i));
+	}
+
+	auto uses = dag.count_uses(roots);
+	std::vector<bool> pinned(dag.size(), false);
+	for (auto root : roots) {
+		pinned[root] = true;
+	}
+
+	std::vector<ui32> regs(dag.size(), ExpressionDag::NO_NODE);
+	std::vector<ui16> free_regs;
+	size_t nregs = 0;
+
+	auto allocate = [&free_regs, &nregs]() -> ui16 {
+		if (!free_regs.empty()) {
+			ui16 reg = free_regs.back();
+			free_regs.pop_back();
+			return reg;
+		}
+		if (nregs > std::numeric_limits<ui16>::max())
+			throw std::runtime_error("Expression needs too many registers for the BatchEvaluator");
+		return static_cast<ui16>(nregs++);
+	};
+
+	// registers of nodes without remaining uses are reused, leaves and outputs keep theirs
+	auto release = [&](ExpressionDag::NodeId id) {
+		if (id == ExpressionDag::NO_NODE)
+			return;
+		if (--uses[id] == 0 && !pinned[id] && !dag.is_leaf(id))
+			free_regs.push_back(static_cast<ui16>(regs[id]));
+	};
+
+	auto reg_of = [&regs](ExpressionDag::NodeId id) -> ui16 {
+		return id == ExpressionDag::NO_NODE ? 0 : static_cast<ui16>(regs[id]);
+	};
+
+	auto order = dag.topological_order(roots);
+
+	// leaves are written once per batch or once per evaluation, so they get the first registers
+	// and never share them with temporaries
+	for (auto id : order) {
+		auto node = dag.get_node(id);
+		if (node.op == DagOp::VARIABLE) {
+			auto it = input_index.find(util::to_lower_case(node.name));
+			if (it == input_index.end())
+				throw std::runtime_error("Variable " + node.name + " was not given to the BatchEvaluator");
+			regs[id] = allocate();
+			m_Loads.push_back(Load{ static_cast<ui16>(regs[id]), it->second });
+		}
+		else if (node.op == DagOp::NUMBER) {
+			auto value = dag.get_number(id);
+			if (!value.has_value())
+				throw std::runtime_error("Number " + node.name + " can't be evaluated by the BatchEvaluator");
+			regs[id] = allocate();
+			m_Constants.push_back(Constant{ static_cast<ui16>(regs[id]), *value });
+		}
+	}
+
+	for (auto id : order) {
+		if (dag.is_leaf(id))
+			continue;
+
+		auto node = dag.get_node(id);
+		regs[id] = allocate();
+		m_Code.push_back(Instruction{ node.op, static_cast<ui16>(regs[id]),
+			reg_of(node.lhs), reg_of(node.rhs), reg_of(node.third) });
+
+		release(node.lhs);
+		release(node.rhs);
+		release(node.third);
+	}
+
+	m_Outputs.reserve(roots.size());
+	for (auto root : roots) {
+		m_Outputs.push_back(static_cast<ui16>(regs[root]));
+	}
+	m_NRegisters = nregs;
+}
+
+void BatchEvaluator::evaluate(const std::vector<const float*>& inputs, const std::vector<float*>& outputs, size_t npoints) const
+{
+	run(inputs, outputs, npoints);
+}
+
+void BatchEvaluator::evaluate(const std::vector<const double*>& inputs, const std::vector<double*>& outputs, size_t npoints) const
+{
+	run(inputs, outputs, npoints);
+}
+
+size_t BatchEvaluator::get_n_instructions() const
+{
+	return m_Code.size();
+}
+
+size_t BatchEvaluator::get_n_registers() const
+{
+	return m_NRegisters;
+}
+
+template<typename T>
+void BatchEvaluator::run(const std::vector<const T*>& inputs, const std::vector<T*>& outputs, size_t npoints) const
+{
+	if (inputs.size() != m_NInputs)
+		throw std::runtime_error("BatchEvaluator got the wrong number of inputs");
+	if (outputs.size() != m_Outputs.size())
+		throw std::runtime_error("BatchEvaluator got the wrong number of outputs");
+
+	std::vector<T> registers(m_NRegisters * LANES, T(0));
+	auto reg = [&registers](ui16 r) { return registers.data() + size_t(r) * LANES; };
+
+	for (auto& constant : m_Constants) {
+		std::fill_n(reg(constant.reg), LANES, static_cast<T>(constant.value));
+	}
+
+	for (size_t start = 0; start < npoints; start += LANES) {
+		// lanes past the last point hold stale values, they are computed but never stored
+		size_t n = std::min(LANES, npoints - start);
+
+		for (auto& load : m_Loads) {
+			std::copy_n(inputs[load.input] + start, n, reg(load.reg));
+		}
+
+		for (auto& ins : m_Code) {
+			T* d = reg(ins.dst);
+			const T* a = reg(ins.lhs);
+			const T* b = reg(ins.rhs);
+
+			switch (ins.op) {
+			case DagOp::NEG: unary_lanes(d, a, [](T x) { return -x; }); break;
+			case DagOp::ADD: binary_lanes(d, a, b, [](T x, T y) { return x + y; }); break;
+			case DagOp::SUB: binary_lanes(d, a, b, [](T x, T y) { return x - y; }); break;
+			case DagOp::MUL: binary_lanes(d, a, b, [](T x, T y) { return x * y; }); break;
+			case DagOp::DIV: binary_lanes(d, a, b, [](T x, T y) { return x / y; }); break;
+			case DagOp::POW: binary_lanes(d, a, b, [](T x, T y) { return std::pow(x, y); }); break;
+			case DagOp::FMA:
+			{
+				const T* c = reg(ins.third);
+				for (size_t k = 0; k < LANES; ++k) {
+					d[k] = a[k] * b[k] + c[k];
+				}
+				break;
+			}
+			case DagOp::SGN: unary_lanes(d, a, [](T x) { return static_cast<T>((T(0) < x) - (x < T(0))); }); break;
+			case DagOp::ABS: unary_lanes(d, a, [](T x) { return std::abs(x); }); break;
+			case DagOp::SQRT: unary_lanes(d, a, [](T x) { return std::sqrt(x); }); break;
+			case DagOp::EXP: unary_lanes(d, a, [](T x) { return std::exp(x); }); break;
+			case DagOp::LOG: unary_lanes(d, a, [](T x) { return std::log(x); }); break;
+			case DagOp::SIN: unary_lanes(d, a, [](T x) { return std::sin(x); }); break;
+			case DagOp::COS: unary_lanes(d, a, [](T x) { return std::cos(x); }); break;
+			case DagOp::TAN: unary_lanes(d, a, [](T x) { return std::tan(x); }); break;
+			case DagOp::ASIN: unary_lanes(d, a, [](T x) { return std::asin(x); }); break;
+			case DagOp::ACOS: unary_lanes(d, a, [](T x) { return std::acos(x); }); break;
+			case DagOp::ATAN: unary_lanes(d, a, [](T x) { return std::atan(x); }); break;
+			case DagOp::SINH: unary_lanes(d, a, [](T x) { return std::sinh(x); }); break;
+			case DagOp::COSH: unary_lanes(d, a, [](T x) { return std::cosh(x); }); break;
+			case DagOp::TANH: unary_lanes(d, a, [](T x) { return std::tanh(x); }); break;
+			case DagOp::ASINH: unary_lanes(d, a, [](T x) { return std::asinh(x); }); break;
+			case DagOp::ACOSH: unary_lanes(d, a, [](T x) { return std::acosh(x); }); break;
+			case DagOp::ATANH: unary_lanes(d, a, [](T x) { return std::atanh(x); }); break;
+			default:
+				throw std::runtime_error("Instruction can't be evaluated by the BatchEvaluator");
+			}
+		}
+
+		for (size_t i = 0; i < m_Outputs.size(); ++i) {
+			std::copy_n(reg(m_Outputs[i]), n, outputs[i] + start);
+		}
+	}
+}
@@ -0,0 +1,67 @@
+module;
+
+export module evaluator;
+
+import <string>;
+import <vector>;
+
+import vc;
+import expr;
+import dag;
+
+namespace expression {
+
+	// Expressions compiled to register bytecode for evaluation on the cpu. Every register holds
+	// LANES values and every instruction runs over all lanes at once, the lane loops are simple
+	// enough for the compiler to vectorize. Inputs and outputs are one array per variable and
+	// expression, holding npoints values each
+	export class BatchEvaluator {
+	public:
+
+		static constexpr size_t LANES = 64;
+
+		// variables gives the order of the input arrays
+		BatchEvaluator(const std::vector<const Expression*>& exprs, const std::vector<std::string>& variables);
+
+		void evaluate(const std::vector<const float*>& inputs, const std::vector<float*>& outputs, size_t npoints) const;
+
+		void evaluate(const std::vector<const double*>& inputs, const std::vector<double*>& outputs, size_t npoints) const;
+
+		size_t get_n_instructions() const;
+
+		size_t get_n_registers() const;
+
+	private:
+
+		template<typename T>
+		void run(const std::vector<const T*>& inputs, const std::vector<T*>& outputs, size_t npoints) const;
+
+		struct Instruction {
+			DagOp op;
+			vc::ui16 dst;
+			vc::ui16 lhs;
+			vc::ui16 rhs;
+			vc::ui16 third;
+		};
+
+		struct Load {
+			vc::ui16 reg;
+			vc::ui16 input;
+		};
+
+		struct Constant {
+			vc::ui16 reg;
+			double value;
+		};
+
+	private:
+		std::vector<Instruction> m_Code;
+		std::vector<Load> m_Loads;
+		std::vector<Constant> m_Constants;
+		// register holding each output
+		std::vector<vc::ui16> m_Outputs;
+		size_t m_NInputs;
+		size_t m_NRegisters;
+	};
+
+}
@@ -7,7 +7,6 @@ module;
 module expr;
 
 import <memory>;
-import <deque>;
 import <unordered_map>;
 import <initializer_list>;
 import <functional>;
@@ -18,37 +17,18 @@ import <algorithm>;
 import <set>;
 import <iterator>;
 import <optional>;
+import <cmath>;
+import <mutex>;
+import <typeindex>;
+import <string>;
 
 import symbolic;
+import lexer;
 import shunter;
 import defaultexp;
 
 using namespace expression;
 
-void symengine_get_args(const SymEngine::RCP<const SymEngine::Basic>& subexpr, std::set<std::string>& args)
-{
-	auto vec_args = subexpr->get_args();
-
-	if (vec_args.size() == 0) {
-		if (SymEngine::is_a_Number(*subexpr)) {
-			return;
-		}
-		else if (SymEngine::is_a<SymEngine::FunctionSymbol>(*subexpr)) {
-			return;
-		}
-		else if (SymEngine::is_a<SymEngine::Constant>(*subexpr)) {
-			return;
-		}
-
-		args.insert(subexpr->__str__());
-	}
-	else {
-		for (auto& varg : vec_args) {
-			symengine_get_args(varg, args);
-		}
-	}
-}
-
 std::string symengine_parse(const std::string& to_parse)
 {
 	auto p = SymEngine::parse(to_parse);
@@ -96,30 +76,267 @@ std::unique_ptr<NumberBaseToken> copy_token(const Token& tok)
 
 }
 
+namespace {
+
+	// Every node is created through the arena, which hands out the live node structurally equal to a new
+	// one in its place. Children are interned before their parents, so two nodes are structurally equal
+	// when their types, leaf text and child pointers are. Only weak references are held, a node is freed
+	// with the last expression using it
+	class NodeArena {
+	public:
+
+		NodePtr intern(NodePtr node)
+		{
+			Key key{ typeid(*node), node->grammar.get(), node->children.empty() ? node->str() : std::string(), {} };
+			key.children.reserve(node->children.size());
+			for (auto& child : node->children)
+				key.children.push_back(child.get());
+
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto [it, inserted] = m_Nodes.try_emplace(std::move(key), node);
+			if (!inserted) {
+				if (auto existing = it->second.lock())
+					return existing;
+				it->second = node;
+			}
+			else if (m_Nodes.size() >= m_SweepSize) {
+				std::erase_if(m_Nodes, [](const auto& entry) { return entry.second.expired(); });
+				m_SweepSize = std::max<size_t>(2 * m_Nodes.size(), min_sweep_size);
+			}
+			return node;
+		}
+
+	private:
+
+		static constexpr size_t min_sweep_size = 4096;
+
+		struct Key {
+			std::type_index type;
+			const LexGrammar* grammar;
+			std::string leaf;
+			std::vector<const Node*> children;
+
+			bool operator==(const Key& other) const = default;
+		};
+
+		struct KeyHash {
+			size_t operator()(const Key& key) const
+			{
+				size_t ret = util::hash_combine(key.type.hash_code(), std::hash<const void*>()(key.grammar));
+				ret = util::hash_combine(ret, std::hash<std::string>()(key.leaf));
+				for (auto child : key.children)
+					ret = util::hash_combine(ret, std::hash<const void*>()(child));
+				return ret;
+			}
+		};
+
+	private:
+		std::mutex m_Mutex;
+		std::unordered_map<Key, std::weak_ptr<const Node>, KeyHash> m_Nodes;
+		size_t m_SweepSize = min_sweep_size;
+	};
+
+	NodeArena& node_arena()
+	{
+		static NodeArena arena;
+		return arena;
+	}
+
+	template<typename T, typename... Args>
+	NodePtr make_node(Args&&... args)
+	{
+		// not make_shared, which would keep the memory of a freed node until the arena drops its weak reference
+		return node_arena().intern(NodePtr(new T(std::forward<Args>(args)...)));
+	}
+
+	// value of nodes that are real numbers
+	std::optional<float> number_value(const Node& node)
+	{
+		const TokenNode* token_node = dynamic_cast<const TokenNode*>(&node);
+		if (token_node == nullptr)
+			return std::nullopt;
+
+		switch (token_node->pToken->get_token_type()) {
+		case TokenType::ZERO_TYPE:
+			return 0.0f;
+		case TokenType::UNITY_TYPE:
+			return 1.0f;
+		case TokenType::NEG_UNITY_TYPE:
+			return -1.0f;
+		case TokenType::NUMBER_TYPE:
+		{
+			const NumberToken& ntok = static_cast<const NumberToken&>(*token_node->pToken);
+			if (ntok.is_imaginary)
+				return std::nullopt;
+			return ntok.num.real();
+		}
+		default:
+			return std::nullopt;
+		}
+	}
+
+	bool is_number(const Node& node, float value)
+	{
+		auto num = number_value(node);
+		return num.has_value() && *num == value;
+	}
+
+	bool is_neg(const Node& node)
+	{
+		return dynamic_cast<const NegNode*>(&node) != nullptr;
+	}
+
+	// only integer results are folded, they print exactly in both single and double precision
+	std::optional<int> fold(std::optional<float> result)
+	{
+		if (!result.has_value() || std::floor(*result) != *result || std::abs(*result) > 1e6f)
+			return std::nullopt;
+		return static_cast<int>(*result);
+	}
+
+	NodePtr number_node(int value, const std::shared_ptr<const LexGrammar>& grammar)
+	{
+		switch (value) {
+		case 0:
+			return make_node<TokenNode>(ZeroToken(), grammar);
+		case 1:
+			return make_node<TokenNode>(UnityToken(), grammar);
+		case -1:
+			return make_node<TokenNode>(NegUnityToken(), grammar);
+		default:
+			return make_node<TokenNode>(NumberToken(std::to_string(value), false), grammar);
+		}
+	}
+
+	// Node constructors with local simplifications, used to keep derivatives small
+
+	NodePtr make_add(NodePtr a, NodePtr b);
+	NodePtr make_sub(NodePtr a, NodePtr b);
+
+	NodePtr make_neg(NodePtr a)
+	{
+		auto na = number_value(*a);
+		if (auto folded = fold(na ? std::make_optional(-*na) : std::nullopt))
+			return number_node(*folded, a->grammar);
+		if (is_neg(*a))
+			return a->children[0];
+		return make_node<NegNode>(std::move(a));
+	}
+
+	NodePtr make_add(NodePtr a, NodePtr b)
+	{
+		auto na = number_value(*a);
+		auto nb = number_value(*b);
+		if (auto folded = fold(na && nb ? std::make_optional(*na + *nb) : std::nullopt))
+			return number_node(*folded, a->grammar);
+		if (is_number(*a, 0.0f))
+			return b;
+		if (is_number(*b, 0.0f))
+			return a;
+		if (is_neg(*b))
+			return make_sub(std::move(a), b->children[0]);
+		return make_node<AddNode>(std::move(a), std::move(b));
+	}
+
+	NodePtr make_sub(NodePtr a, NodePtr b)
+	{
+		auto na = number_value(*a);
+		auto nb = number_value(*b);
+		if (auto folded = fold(na && nb ? std::make_optional(*na - *nb) : std::nullopt))
+			return number_node(*folded, a->grammar);
+		if (is_number(*b, 0.0f))
+			return a;
+		if (is_number(*a, 0.0f))
+			return make_neg(std::move(b));
+		if (is_neg(*b))
+			return make_add(std::move(a), b->children[0]);
+		return make_node<SubNode>(std::move(a), std::move(b));
+	}
+
+	NodePtr make_mul(NodePtr a, NodePtr b)
+	{
+		auto na = number_value(*a);
+		auto nb = number_value(*b);
+		if (auto folded = fold(na && nb ? std::make_optional(*na * *nb) : std::nullopt))
+			return number_node(*folded, a->grammar);
+		if (is_number(*a, 0.0f) || is_number(*b, 0.0f))
+			return number_node(0, a->grammar);
+		if (is_number(*a, 1.0f))
+			return b;
+		if (is_number(*b, 1.0f))
+			return a;
+		if (is_number(*a, -1.0f))
+			return make_neg(std::move(b));
+		if (is_number(*b, -1.0f))
+			return make_neg(std::move(a));
+		// negations are moved outwards and numbers to the front, so equal products print equally
+		if (is_neg(*a))
+			return make_neg(make_mul(a->children[0], std::move(b)));
+		if (is_neg(*b))
+			return make_neg(make_mul(std::move(a), b->children[0]));
+		if (nb && !na)
+			return make_node<MulNode>(std::move(b), std::move(a));
+		return make_node<MulNode>(std::move(a), std::move(b));
+	}
+
+	NodePtr make_div(NodePtr a, NodePtr b)
+	{
+		auto na = number_value(*a);
+		auto nb = number_value(*b);
+		if (auto folded = fold(na && nb && *nb != 0.0f ? std::make_optional(*na / *nb) : std::nullopt))
+			return number_node(*folded, a->grammar);
+		if (is_number(*a, 0.0f))
+			return number_node(0, a->grammar);
+		if (is_number(*b, 1.0f))
+			return a;
+		if (is_number(*b, -1.0f))
+			return make_neg(std::move(a));
+		if (is_neg(*a))
+			return make_neg(make_div(a->children[0], std::move(b)));
+		return make_node<DivNode>(std::move(a), std::move(b));
+	}
+
+	NodePtr make_pow(NodePtr a, NodePtr b)
+	{
+		if (is_number(*b, 0.0f) || is_number(*a, 1.0f))
+			return number_node(1, a->grammar);
+		if (is_number(*b, 1.0f))
+			return a;
+		return make_node<PowNode>(std::move(a), std::move(b));
+	}
+
+	NodePtr make_square(NodePtr a)
+	{
+		auto two = number_node(2, a->grammar);
+		return make_pow(std::move(a), std::move(two));
+	}
+
+}
+
 // NODE
 
-Node::Node(LexContext& ctext)
-	: context(ctext)
+Node::Node(std::shared_ptr<const LexGrammar> grammar)
+	: grammar(std::move(grammar))
 {}
 
-Node::Node(std::vector<std::unique_ptr<Node>>&& childs)
-	: context(childs[0]->context)
+Node::Node(std::vector<NodePtr>&& childs)
+	: grammar(childs[0]->grammar)
 {
 	children = std::move(childs);
 	childs.clear();
 }
 
-Node::Node(std::vector<std::unique_ptr<Node>>&& childs, LexContext& ctext)
-	: children(std::move(childs)), context(ctext)
+Node::Node(std::vector<NodePtr>&& childs, std::shared_ptr<const LexGrammar> grammar)
+	: children(std::move(childs)), grammar(std::move(grammar))
 {}
 
-Node::Node(std::unique_ptr<NumberBaseToken> base_token, LexContext& ctext)
-	: pToken(std::move(base_token)), context(ctext)
+Node::Node(std::unique_ptr<NumberBaseToken> base_token, std::shared_ptr<const LexGrammar> grammar)
+	: pToken(std::move(base_token)), grammar(std::move(grammar))
 {}
 
-void Node::fill_variable_list(std::set<std::string>& vars)
+void Node::fill_variable_list(std::set<std::string>& vars) const
 {
-	VariableNode* var_node = dynamic_cast<VariableNode*>(this);
+	const VariableNode* var_node = dynamic_cast<const VariableNode*>(this);
 	if (var_node != nullptr) {
 		vars.insert(var_node->str());
 	}
@@ -129,55 +346,21 @@ void Node::fill_variable_list(std::set<std::string>& vars)
 	}
 }
 
-std::unique_ptr<Expression> Node::diff(const std::string& x) const
-{
-	std::string expr_str = util::to_lower_case(util::remove_whitespace(str()));
-
-	LexContext new_context(context);
-
-	SymEngine::Assumptions assum1(new_context.variable_assumptions);
-
-	auto parsed = SymEngine::simplify(SymEngine::parse(expr_str), &assum1);
-	auto dexpr = parsed->diff(SymEngine::symbol(
-		util::to_lower_case(
-			util::remove_whitespace(x))));
-
-	std::set<std::string> vars;
-	symengine_get_args(dexpr, vars);
-
-	new_context.variables.reserve(vars.size());
-	for (auto& var : vars) {
-		if (!util::container_contains(new_context.variables, var)) {
-			new_context.variables.emplace_back(var);
-			new_context.variable_assumptions.insert(SymEngine::contains(SymEngine::symbol(var), SymEngine::reals()));
-		}
-	}
-
-	SymEngine::Assumptions assum2(new_context.variable_assumptions);
-
-	auto sim_dexpr = SymEngine::simplify(dexpr, &assum2);
-
-	auto dexpr_str = util::to_lower_case(
-		util::remove_whitespace(sim_dexpr->__str__()));
-
-	return std::make_unique<Expression>(dexpr_str, new_context);
-}
-
 bool expression::Node::child_is_variable(int i) const
 {
 	const VariableNode* var_node = dynamic_cast<const VariableNode*>(children.at(i).get());
 	return var_node != nullptr;
 }
 
-std::unique_ptr<Node> node_from_token(const Token& tok, LexContext& context)
+NodePtr node_from_token(const Token& tok, const std::shared_ptr<const LexGrammar>& grammar)
 {
-	return std::make_unique<TokenNode>(tok, context);
+	return make_node<TokenNode>(tok, grammar);
 }
 
 // TOKEN NODE
 
-TokenNode::TokenNode(const Token& tok, LexContext& context)
-	: Node(copy_token(tok), context)
+TokenNode::TokenNode(const Token& tok, std::shared_ptr<const LexGrammar> grammar)
+	: Node(copy_token(tok), std::move(grammar))
 {}
 
 std::string TokenNode::str() const 
@@ -191,17 +374,17 @@ std::string TokenNode::str() const
 	case TokenType::UNARY_OPERATOR_TYPE:
 	{
 		auto id = pToken->get_id();
-		return context.operator_id_name_map.at(id);
+		return grammar->operator_id_name_map.at(id);
 	}
 	case TokenType::BINARY_OPERATOR_TYPE:
 	{
 		auto id = pToken->get_id();
-		return context.operator_id_name_map.at(id);
+		return grammar->operator_id_name_map.at(id);
 	}
 	case TokenType::FUNCTION_TYPE:
 	{
 		auto id = pToken->get_id();
-		return context.function_id_name_map.at(id);
+		return grammar->function_id_name_map.at(id);
 	}
 	case TokenType::VARIABLE_TYPE:
 		throw std::runtime_error("Variables should be stored in VariableNodes not TokenNodes");
@@ -234,15 +417,15 @@ std::string TokenNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return str();
 }
 
-std::unique_ptr<Node> TokenNode::copy(LexContext& context) const
+NodePtr TokenNode::derivative(const std::string& x) const
 {
-	return std::make_unique<TokenNode>(*pToken, context);
+	return number_node(0, grammar);
 }
 
 // VARIABLE NODE
 
-VariableNode::VariableNode(const VariableToken& token, LexContext& context)
-	: Node(context), m_VarToken(token)
+VariableNode::VariableNode(const VariableToken& token, std::shared_ptr<const LexGrammar> grammar)
+	: Node(std::move(grammar)), m_VarToken(token)
 {}
 
 std::string VariableNode::str() const
@@ -255,15 +438,15 @@ std::string VariableNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return symtext.get_glsl_var_name(m_VarToken.name);
 }
 
-std::unique_ptr<Node> VariableNode::copy(LexContext& context) const
+NodePtr VariableNode::derivative(const std::string& x) const
 {
-	return std::make_unique<VariableNode>(m_VarToken, context);
+	return number_node(m_VarToken.name == x ? 1 : 0, grammar);
 }
 
 // NEG NODE
 
-NegNode::NegNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+NegNode::NegNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -278,14 +461,14 @@ std::string NegNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "(-" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> NegNode::copy(LexContext& context) const
+NodePtr NegNode::derivative(const std::string& x) const
 {
-	return std::make_unique<NegNode>(children[0]->copy(context));
+	return make_neg(children[0]->derivative(x));
 }
 
 // MUL NODE
-MulNode::MulNode(std::unique_ptr<Node> left_child, std::unique_ptr<Node> right_child)
-	: Node(left_child->context)
+MulNode::MulNode(NodePtr left_child, NodePtr right_child)
+	: Node(left_child->grammar)
 {
 	children.emplace_back(std::move(left_child));
 	children.emplace_back(std::move(right_child));
@@ -301,14 +484,16 @@ std::string MulNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "(" + children[0]->glsl_str(symtext) + "*" + children[1]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> MulNode::copy(LexContext& context) const
+NodePtr MulNode::derivative(const std::string& x) const
 {
-	return std::make_unique<MulNode>(children[0]->copy(context), children[1]->copy(context));
+	return make_add(
+		make_mul(children[0]->derivative(x), children[1]),
+		make_mul(children[0], children[1]->derivative(x)));
 }
 
 // DIV NODE
-DivNode::DivNode(std::unique_ptr<Node> left_child, std::unique_ptr<Node> right_child)
-	: Node(left_child->context)
+DivNode::DivNode(NodePtr left_child, NodePtr right_child)
+	: Node(left_child->grammar)
 {
 	children.emplace_back(std::move(left_child));
 	children.emplace_back(std::move(right_child));
@@ -324,14 +509,18 @@ std::string DivNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "(" + children[0]->glsl_str(symtext) + "/" + children[1]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> DivNode::copy(LexContext& context) const
+NodePtr DivNode::derivative(const std::string& x) const
 {
-	return std::make_unique<DivNode>(children[0]->copy(context), children[1]->copy(context));
+	// du/v - u*dv/v^2, zero terms vanish in the simplifications
+	return make_sub(
+		make_div(children[0]->derivative(x), children[1]),
+		make_div(make_mul(children[0], children[1]->derivative(x)),
+			make_mul(children[1], children[1])));
 }
 
 // ADD NODE
-AddNode::AddNode(std::unique_ptr<Node> left_child, std::unique_ptr<Node> right_child)
-	: Node(left_child->context)
+AddNode::AddNode(NodePtr left_child, NodePtr right_child)
+	: Node(left_child->grammar)
 {
 	children.emplace_back(std::move(left_child));
 	children.emplace_back(std::move(right_child));
@@ -347,14 +536,14 @@ std::string AddNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "(" + children[0]->glsl_str(symtext) + "+" + children[1]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> AddNode::copy(LexContext& context) const
+NodePtr AddNode::derivative(const std::string& x) const
 {
-	return std::make_unique<AddNode>(children[0]->copy(context), children[1]->copy(context));
+	return make_add(children[0]->derivative(x), children[1]->derivative(x));
 }
 
 // SUB NODE
-SubNode::SubNode(std::unique_ptr<Node> left_child, std::unique_ptr<Node> right_child)
-	: Node(left_child->context)
+SubNode::SubNode(NodePtr left_child, NodePtr right_child)
+	: Node(left_child->grammar)
 {
 	children.emplace_back(std::move(left_child));
 	children.emplace_back(std::move(right_child));
@@ -370,14 +559,14 @@ std::string SubNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "(" + children[0]->glsl_str(symtext) + "-" + children[1]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> SubNode::copy(LexContext& context) const
+NodePtr SubNode::derivative(const std::string& x) const
 {
-	return std::make_unique<SubNode>(children[0]->copy(context), children[1]->copy(context));
+	return make_sub(children[0]->derivative(x), children[1]->derivative(x));
 }
 
 // POW NODE
-PowNode::PowNode(std::unique_ptr<Node> left_child, std::unique_ptr<Node> right_child)
-	: Node(left_child->context)
+PowNode::PowNode(NodePtr left_child, NodePtr right_child)
+	: Node(left_child->grammar)
 {
 	children.emplace_back(std::move(left_child));
 	children.emplace_back(std::move(right_child));
@@ -393,14 +582,26 @@ std::string PowNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "pow(" + children[0]->glsl_str(symtext) + "," + children[1]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> PowNode::copy(LexContext& context) const
+NodePtr PowNode::derivative(const std::string& x) const
 {
-	return std::make_unique<PowNode>(children[0]->copy(context), children[1]->copy(context));
+	auto dexponent = children[1]->derivative(x);
+	if (is_number(*dexponent, 0.0f)) {
+		return make_mul(
+			make_mul(children[1],
+				make_pow(children[0], make_sub(children[1], number_node(1, grammar)))),
+			children[0]->derivative(x));
+	}
+
+	// u^v * (dv*log(u) + v*du/u)
+	return make_mul(shared_from_this(),
+		make_add(
+			make_mul(std::move(dexponent), make_node<LogNode>(children[0])),
+			make_div(make_mul(children[1], children[0]->derivative(x)), children[0])));
 }
 
 // SGN NODE
-SgnNode::SgnNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+SgnNode::SgnNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -415,14 +616,14 @@ std::string SgnNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "sign(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> SgnNode::copy(LexContext& context) const
+NodePtr SgnNode::derivative(const std::string& x) const
 {
-	return std::make_unique<SgnNode>(children[0]->copy(context));
+	return number_node(0, grammar);
 }
 
 // ABS NODE
-AbsNode::AbsNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+AbsNode::AbsNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -437,14 +638,14 @@ std::string AbsNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "abs(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> AbsNode::copy(LexContext& context) const
+NodePtr AbsNode::derivative(const std::string& x) const
 {
-	return std::make_unique<AbsNode>(children[0]->copy(context));
+	return make_mul(children[0]->derivative(x), make_node<SgnNode>(children[0]));
 }
 
 // SQRT NODE
-SqrtNode::SqrtNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+SqrtNode::SqrtNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -459,14 +660,15 @@ std::string SqrtNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "sqrt(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> SqrtNode::copy(LexContext& context) const
+NodePtr SqrtNode::derivative(const std::string& x) const
 {
-	return std::make_unique<SqrtNode>(children[0]->copy(context));
+	return make_div(children[0]->derivative(x),
+		make_mul(number_node(2, grammar), make_node<SqrtNode>(children[0])));
 }
 
 // EXP NODE
-ExpNode::ExpNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+ExpNode::ExpNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -481,14 +683,14 @@ std::string ExpNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "exp(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> ExpNode::copy(LexContext& context) const
+NodePtr ExpNode::derivative(const std::string& x) const
 {
-	return std::make_unique<ExpNode>(children[0]->copy(context));
+	return make_mul(children[0]->derivative(x), make_node<ExpNode>(children[0]));
 }
 
 // LOG NODE
-LogNode::LogNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+LogNode::LogNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -503,14 +705,14 @@ std::string LogNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "log(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> LogNode::copy(LexContext& context) const
+NodePtr LogNode::derivative(const std::string& x) const
 {
-	return std::make_unique<LogNode>(children[0]->copy(context));
+	return make_div(children[0]->derivative(x), children[0]);
 }
 
 // SIN NODE
-SinNode::SinNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+SinNode::SinNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -525,14 +727,14 @@ std::string SinNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "sin(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> SinNode::copy(LexContext& context) const
+NodePtr SinNode::derivative(const std::string& x) const
 {
-	return std::make_unique<SinNode>(children[0]->copy(context));
+	return make_mul(children[0]->derivative(x), make_node<CosNode>(children[0]));
 }
 
 // COS NODE
-CosNode::CosNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+CosNode::CosNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -547,14 +749,14 @@ std::string CosNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "cos(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> CosNode::copy(LexContext& context) const
+NodePtr CosNode::derivative(const std::string& x) const
 {
-	return std::make_unique<CosNode>(children[0]->copy(context));
+	return make_neg(make_mul(children[0]->derivative(x), make_node<SinNode>(children[0])));
 }
 
 // TAN NODE
-TanNode::TanNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+TanNode::TanNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -569,14 +771,14 @@ std::string TanNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "tan(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> TanNode::copy(LexContext& context) const
+NodePtr TanNode::derivative(const std::string& x) const
 {
-	return std::make_unique<TanNode>(children[0]->copy(context));
+	return make_div(children[0]->derivative(x), make_square(make_node<CosNode>(children[0])));
 }
 
 // ASIN NODE
-AsinNode::AsinNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+AsinNode::AsinNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -591,14 +793,15 @@ std::string AsinNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "asin(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> AsinNode::copy(LexContext& context) const
+NodePtr AsinNode::derivative(const std::string& x) const
 {
-	return std::make_unique<AsinNode>(children[0]->copy(context));
+	return make_div(children[0]->derivative(x),
+		make_node<SqrtNode>(make_sub(number_node(1, grammar), make_square(children[0]))));
 }
 
 // ACOS NODE
-AcosNode::AcosNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+AcosNode::AcosNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -613,14 +816,15 @@ std::string AcosNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "acos(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> AcosNode::copy(LexContext& context) const
+NodePtr AcosNode::derivative(const std::string& x) const
 {
-	return std::make_unique<AcosNode>(children[0]->copy(context));
+	return make_neg(make_div(children[0]->derivative(x),
+		make_node<SqrtNode>(make_sub(number_node(1, grammar), make_square(children[0])))));
 }
 
 // ATAN NODE
-AtanNode::AtanNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+AtanNode::AtanNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -635,14 +839,14 @@ std::string AtanNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "atan(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> AtanNode::copy(LexContext& context) const
+NodePtr AtanNode::derivative(const std::string& x) const
 {
-	return std::make_unique<AtanNode>(children[0]->copy(context));
+	return make_div(children[0]->derivative(x), make_add(number_node(1, grammar), make_square(children[0])));
 }
 
 // SINH NODE
-SinhNode::SinhNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+SinhNode::SinhNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -657,14 +861,14 @@ std::string SinhNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "sinh(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> SinhNode::copy(LexContext& context) const
+NodePtr SinhNode::derivative(const std::string& x) const
 {
-	return std::make_unique<SinhNode>(children[0]->copy(context));
+	return make_mul(children[0]->derivative(x), make_node<CoshNode>(children[0]));
 }
 
 // COSH NODE
-CoshNode::CoshNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+CoshNode::CoshNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -679,14 +883,14 @@ std::string CoshNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "cosh(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> CoshNode::copy(LexContext& context) const
+NodePtr CoshNode::derivative(const std::string& x) const
 {
-	return std::make_unique<CoshNode>(children[0]->copy(context));
+	return make_mul(children[0]->derivative(x), make_node<SinhNode>(children[0]));
 }
 
 // TANH NODE
-TanhNode::TanhNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+TanhNode::TanhNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -701,14 +905,14 @@ std::string TanhNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "tanh(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> TanhNode::copy(LexContext& context) const
+NodePtr TanhNode::derivative(const std::string& x) const
 {
-	return std::make_unique<TanhNode>(children[0]->copy(context));
+	return make_div(children[0]->derivative(x), make_square(make_node<CoshNode>(children[0])));
 }
 
 // ASINH NODE
-AsinhNode::AsinhNode(std::unique_ptr<Node> child)
-: Node(child->context)
+AsinhNode::AsinhNode(NodePtr child)
+: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -723,14 +927,15 @@ std::string AsinhNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "asinh(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> AsinhNode::copy(LexContext& context) const
+NodePtr AsinhNode::derivative(const std::string& x) const
 {
-	return std::make_unique<AsinhNode>(children[0]->copy(context));
+	return make_div(children[0]->derivative(x),
+		make_node<SqrtNode>(make_add(make_square(children[0]), number_node(1, grammar))));
 }
 
 // ACOSH NODE
-AcoshNode::AcoshNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+AcoshNode::AcoshNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -745,14 +950,15 @@ std::string AcoshNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "acosh(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> AcoshNode::copy(LexContext& context) const
+NodePtr AcoshNode::derivative(const std::string& x) const
 {
-	return std::make_unique<AcoshNode>(children[0]->copy(context));
+	return make_div(children[0]->derivative(x),
+		make_node<SqrtNode>(make_sub(make_square(children[0]), number_node(1, grammar))));
 }
 
 // ATANH NODE
-AtanhNode::AtanhNode(std::unique_ptr<Node> child)
-	: Node(child->context)
+AtanhNode::AtanhNode(NodePtr child)
+	: Node(child->grammar)
 {
 	children.emplace_back(std::move(child));
 }
@@ -767,48 +973,22 @@ std::string AtanhNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return "atanh(" + children[0]->glsl_str(symtext) + ")";
 }
 
-std::unique_ptr<Node> AtanhNode::copy(LexContext& context) const
+NodePtr AtanhNode::derivative(const std::string& x) const
 {
-	return std::make_unique<AtanhNode>(children[0]->copy(context));
+	return make_div(children[0]->derivative(x), make_sub(number_node(1, grammar), make_square(children[0])));
 }
 
 // DERIVATIVE NODE
 
-expression::DerivativeNode::DerivativeNode(std::unique_ptr<Node> left_child, std::unique_ptr<Node> right_child)
-	: Node(left_child->context)
+expression::DerivativeNode::DerivativeNode(NodePtr left_child, NodePtr right_child)
+	: Node(left_child->grammar)
 {
 	const VariableNode* var_ptr = dynamic_cast<const VariableNode*>(right_child.get());
 	if (var_ptr == nullptr) {
 		throw std::runtime_error("Right argument in DerivativeNode must be a VariableNode");
 	}
 
-	auto abs_ptr = dynamic_cast<const AbsNode*>(left_child.get());
-	if (abs_ptr != nullptr) {
-		std::unique_ptr<Node> lc = std::move(left_child->children[0]);
-		std::unique_ptr<Node> rc = lc->diff(right_child->str());
-
-		std::unique_ptr<Node> schild = std::make_unique<SgnNode>(std::move(lc));
-
-		std::unique_ptr<Node> child = std::make_unique<MulNode>(std::move(schild), std::move(rc));
-
-		children.clear();
-		children.emplace_back(std::move(child));
-		return;
-	}
-
-	auto sgn_ptr = dynamic_cast<const SgnNode*>(left_child.get());
-	if (sgn_ptr != nullptr) {
-		children.clear();
-		children.emplace_back(std::make_unique<TokenNode>(ZeroToken(), context));
-		return;
-	}
-
-	// This is the derivative of something non special
-	{
-		auto child = left_child->diff(right_child->str());
-		children.clear();
-		children.emplace_back(std::move(child));
-	}
+	children.emplace_back(left_child->derivative(right_child->str()));
 }
 
 std::string DerivativeNode::str() const
@@ -821,14 +1001,14 @@ std::string DerivativeNode::glsl_str(const glsl::SymbolicContext& symtext) const
 	return children[0]->glsl_str(symtext);
 }
 
-std::unique_ptr<Node> DerivativeNode::copy(LexContext& context) const
+NodePtr DerivativeNode::derivative(const std::string& x) const
 {
-	return std::make_unique<DerivativeNode>(children[0]->copy(context), children[1]->copy(context));
+	return children[0]->derivative(x);
 }
 
 // SUBS NODE
 
-expression::SubsNode::SubsNode(std::vector<std::unique_ptr<Node>>&& childs)
+expression::SubsNode::SubsNode(std::vector<NodePtr>&& childs)
 	: Node(std::move(childs))
 {
 	//throw std::runtime_error("Not Implemented Yet!");
@@ -848,108 +1028,112 @@ std::string expression::SubsNode::glsl_str(const glsl::SymbolicContext& symtext)
 	return children[0]->glsl_str(symtext);
 }
 
-std::unique_ptr<Node> SubsNode::copy(LexContext& context) const
+NodePtr SubsNode::derivative(const std::string& x) const
 {
-	std::vector<std::unique_ptr<Node>> copied_children;
-	copied_children.reserve(children.size());
-
-	for (auto& child : children) {
-		copied_children.push_back(std::move(child->copy(context)));
-	}
-
-	return std::make_unique<SubsNode>(std::move(copied_children));
+	return children[0]->derivative(x);
 }
 
 // EXPRESSION
 
-Expression expression_creator(const std::string& expression, const LexContext& context)
-{
-	std::string expr = util::to_lower_case(util::remove_whitespace(expression));
+namespace {
 
-	Lexer lexer(context);
+	LexContext variables_context(const std::vector<std::string>& variables)
+	{
+		LexContext context = default_lex_context();
+		for (auto var : variables) {
+			var = util::to_lower_case(var);
+			context.variables.emplace_back(var);
+			context.variable_assumptions.insert(SymEngine::contains(SymEngine::symbol(var), SymEngine::reals()));
+		}
+		return context;
+	}
 
-	auto toks = lexer.lex(expr);
+	// the postfix tokens of expression, valid until the next expression is lexed on this thread
+	const std::vector<const Token*>& lex_and_shunt(const std::string& expression, const LexContext& context)
+	{
+		// the arena and the shunter stacks keep their storage between expressions
+		thread_local TokenArena arena;
+		thread_local Shunter shunter;
 
-	Shunter shunter;
-	auto shunter_toks = shunter.shunt(std::move(toks));
+		std::string expr = util::to_lower_case(util::remove_whitespace(expression));
 
-	return Expression(context, shunter_toks, Expression::default_expression_creation_map());
-}
+		Lexer lexer(context);
+		lexer.lex(expr, arena);
 
-Expression expression_creator(const std::string& expression, const std::vector<std::string>& variables)
-{
-	std::string expr = util::to_lower_case(util::remove_whitespace(expression));
-
-	LexContext context;
-	for (auto var : variables) {
-		var = util::to_lower_case(var);
-		context.variables.emplace_back(var);
-		context.variable_assumptions.insert(SymEngine::contains(SymEngine::symbol(var), SymEngine::reals()));
+		return shunter.shunt(arena.tokens);
 	}
 
-	Lexer lexer(context);
-
-	auto toks = lexer.lex(expr);
+	const ExpressionCreationMap& default_creation_map()
+	{
+		static const ExpressionCreationMap creation_map = Expression::default_expression_creation_map();
+		return creation_map;
+	}
 
-	Shunter shunter;
-	auto shunter_toks = shunter.shunt(std::move(toks));
-	return Expression(context, shunter_toks, Expression::default_expression_creation_map());
 }
 
 Expression::Expression(const Expression& other)
-	: Expression(other.children[0], other.m_Context, other.m_Expression)
-{
-	for (auto& var : m_Context.variables) {
-		std::string vname = var.name;
-		std::transform(vname.begin(), vname.end(), vname.begin(), [](unsigned char c) { return std::tolower(c); });
-		m_Variables.emplace_back(vname);
-	}
-}
+	: Node(std::vector<NodePtr>(other.children), other.grammar), m_Context(other.m_Context), m_Expression(other.m_Expression)
+{}
 
 Expression::Expression(const std::string& expression, const std::vector<std::string>& variables)
-: Expression(expression_creator(expression, variables))
+	: Expression(expression, std::make_shared<const LexContext>(variables_context(variables)))
 {}
 
 Expression::Expression(const std::string& expression, const LexContext& context)
-: Expression(expression_creator(expression, context))
+	: Expression(expression, std::make_shared<const LexContext>(context))
+{}
+
+Expression::Expression(const NodePtr& root_child, const LexContext& context)
+	: Expression(root_child, std::make_shared<const LexContext>(context), root_child->str())
+{}
+
+Expression::Expression(const NodePtr& root_child, const LexContext& context, const std::string& expr)
+	: Expression(root_child, std::make_shared<const LexContext>(context), expr)
 {}
 
-Expression::Expression(const std::unique_ptr<Node>& root_child, const LexContext& context)
-	: m_Context(context), Node(m_Context)
+Expression::Expression(const LexContext& context, const std::vector<const Token*>& postfix_tokens,
+	const ExpressionCreationMap& creation_map)
+	: Node(context.grammar), m_Context(std::make_shared<const LexContext>(context))
 {
-	children.emplace_back(root_child->copy(m_Context));
-	m_Expression = root_child->str();
+	build(postfix_tokens, creation_map);
 }
 
-Expression::Expression(const std::unique_ptr<Node>& root_child, const LexContext& context, const std::string& expr)
-	: m_Context(context), Node(m_Context), m_Expression(expr)
+Expression::Expression(const std::string& expression, std::shared_ptr<const LexContext> context)
+	: Node(context->grammar), m_Context(std::move(context))
 {
-	children.emplace_back(root_child->copy(m_Context));
+	build(lex_and_shunt(expression, *m_Context), default_creation_map());
 }
 
-Expression::Expression(const LexContext& context, const std::deque<std::unique_ptr<Token>>& tokens,
-	const ExpressionCreationMap& creation_map)
-	: m_Context(context), Node(m_Context)
+Expression::Expression(const NodePtr& root_child, std::shared_ptr<const LexContext> context, std::string expr)
+	: Node(context->grammar), m_Context(std::move(context)), m_Expression(std::move(expr))
+{
+	children.emplace_back(root_child);
+}
+
+void Expression::build(const std::vector<const Token*>& postfix_tokens, const ExpressionCreationMap& creation_map)
 {
-	std::vector<std::unique_ptr<Node>> nodes;
+	std::vector<NodePtr> nodes;
 
-	for (auto& token : tokens) {
-		auto creation_func = creation_map.at(token->get_id());
-		creation_func(m_Context, *token, nodes);
+	for (auto token : postfix_tokens) {
+		auto& creation_func = creation_map.at(token->get_id());
+		creation_func(*m_Context, *token, nodes);
 	}
 
 	if (nodes.size() != 1)
 		throw std::runtime_error("Expression construction failed, more than one node was left after creation_map usage");
 
-	for (auto& var : m_Context.variables) {
-		std::string vname = var.name;
-		std::transform(vname.begin(), vname.end(), vname.begin(), [](unsigned char c) { return std::tolower(c); });
-		m_Variables.emplace_back(vname);
-	}
-
 	children.emplace_back(std::move(nodes[0]));
 }
 
+std::unique_ptr<Expression> Expression::diff(const std::string& x) const
+{
+	auto dnode = derivative(util::to_lower_case(util::remove_whitespace(x)));
+
+	// the derivative shares the context and every unchanged subtree with this expression
+	std::string dstr = dnode->str();
+	return std::unique_ptr<Expression>(new Expression(dnode, m_Context, std::move(dstr)));
+}
+
 std::string Expression::str() const
 {
 	return children[0]->str();
@@ -963,9 +1147,9 @@ std::string Expression::glsl_str(const glsl::SymbolicContext& symtext) const
 bool Expression::is_zero() const
 {
 	auto& child = children[0];
-	TokenNode* child_node = dynamic_cast<TokenNode*>(child.get());
+	const TokenNode* child_node = dynamic_cast<const TokenNode*>(child.get());
 	if (child_node != nullptr) {
-		ZeroToken* zero_node = dynamic_cast<ZeroToken*>(child_node->pToken.get());
+		const ZeroToken* zero_node = dynamic_cast<const ZeroToken*>(child_node->pToken.get());
 		if (zero_node != nullptr) {
 			return true;
 		}
@@ -973,280 +1157,280 @@ bool Expression::is_zero() const
 	return false;
 }
 
-std::unique_ptr<Node> Expression::copy(LexContext& context) const
+NodePtr Expression::derivative(const std::string& x) const
 {
-	return std::make_unique<Expression>(children[0], context, m_Expression);
+	return children[0]->derivative(x);
 }
 
 ExpressionCreationMap Expression::default_expression_creation_map() {
 	return ExpressionCreationMap{
 		// Fixed Tokens
 		{FixedIDs::UNITY_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				nodes.push_back(node_from_token(tok, context));
+				nodes.push_back(node_from_token(tok, context.grammar));
 			}
 		},
 		{FixedIDs::NEG_UNITY_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				nodes.push_back(node_from_token(tok, context));
+				nodes.push_back(node_from_token(tok, context.grammar));
 			}
 		},
 		{FixedIDs::ZERO_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				nodes.push_back(node_from_token(tok, context));
+				nodes.push_back(node_from_token(tok, context.grammar));
 			}
 		},
 		{FixedIDs::NAN_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				nodes.push_back(node_from_token(tok, context));
+				nodes.push_back(node_from_token(tok, context.grammar));
 			}
 		},
 		{FixedIDs::NUMBER_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				nodes.push_back(node_from_token(tok, context));
+				nodes.push_back(node_from_token(tok, context.grammar));
 			}
 		},
 		{FixedIDs::VARIABLE_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
 				const VariableToken& vtok = static_cast<const VariableToken&>(tok);
-				nodes.push_back(std::make_unique<VariableNode>(vtok, context));
+				nodes.push_back(make_node<VariableNode>(vtok, context.grammar));
 			}
 		},
 		// Operators
 		{DefaultOperatorIDs::NEG_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<NegNode>(std::move(nodes.back()));
+				auto node = make_node<NegNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{DefaultOperatorIDs::POW_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
 				auto rc = std::move(nodes.back());
 				nodes.pop_back();
 				auto lc = std::move(nodes.back());
 				nodes.pop_back();
 
-				nodes.push_back(std::make_unique<PowNode>(std::move(lc), std::move(rc)));
+				nodes.push_back(make_node<PowNode>(std::move(lc), std::move(rc)));
 			}
 		},
 		{DefaultOperatorIDs::MUL_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
 				auto rc = std::move(nodes.back());
 				nodes.pop_back();
 				auto lc = std::move(nodes.back());
 				nodes.pop_back();
 
-				nodes.push_back(std::make_unique<MulNode>(std::move(lc), std::move(rc)));
+				nodes.push_back(make_node<MulNode>(std::move(lc), std::move(rc)));
 			}
 		},
 		{DefaultOperatorIDs::DIV_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
 				auto rc = std::move(nodes.back());
 				nodes.pop_back();
 				auto lc = std::move(nodes.back());
 				nodes.pop_back();
 
-				nodes.push_back(std::make_unique<DivNode>(std::move(lc), std::move(rc)));
+				nodes.push_back(make_node<DivNode>(std::move(lc), std::move(rc)));
 			}
 		},
 		{DefaultOperatorIDs::ADD_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
 				auto rc = std::move(nodes.back());
 				nodes.pop_back();
 				auto lc = std::move(nodes.back());
 				nodes.pop_back();
 
-				nodes.push_back(std::make_unique<AddNode>(std::move(lc), std::move(rc)));
+				nodes.push_back(make_node<AddNode>(std::move(lc), std::move(rc)));
 			}
 		},
 		{DefaultOperatorIDs::SUB_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
 				auto rc = std::move(nodes.back());
 				nodes.pop_back();
 				auto lc = std::move(nodes.back());
 				nodes.pop_back();
 
-				nodes.push_back(std::make_unique<SubNode>(std::move(lc), std::move(rc)));
+				nodes.push_back(make_node<SubNode>(std::move(lc), std::move(rc)));
 			}
 		},
 		// Functions
 		// Binary
 		{ DefaultFunctionIDs::POW_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
 				auto rc = std::move(nodes.back());
 				nodes.pop_back();
 				auto lc = std::move(nodes.back());
 				nodes.pop_back();
 
-				nodes.push_back(std::make_unique<PowNode>(std::move(lc), std::move(rc)));
+				nodes.push_back(make_node<PowNode>(std::move(lc), std::move(rc)));
 			}
 		},
 
 		// Unary
 		{ DefaultFunctionIDs::ABS_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<AbsNode>(std::move(nodes.back()));
+				auto node = make_node<AbsNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::SQRT_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<SqrtNode>(std::move(nodes.back()));
+				auto node = make_node<SqrtNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::EXP_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<ExpNode>(std::move(nodes.back()));
+				auto node = make_node<ExpNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::LOG_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<LogNode>(std::move(nodes.back()));
+				auto node = make_node<LogNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		// Trig
 		{DefaultFunctionIDs::SIN_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<SinNode>(std::move(nodes.back()));
+				auto node = make_node<SinNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::COS_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<CosNode>(std::move(nodes.back()));
+				auto node = make_node<CosNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::TAN_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<TanNode>(std::move(nodes.back()));
+				auto node = make_node<TanNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::ASIN_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<AsinNode>(std::move(nodes.back()));
+				auto node = make_node<AsinNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::ACOS_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<AcosNode>(std::move(nodes.back()));
+				auto node = make_node<AcosNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::ATAN_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<AtanNode>(std::move(nodes.back()));
+				auto node = make_node<AtanNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::SINH_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<SinhNode>(std::move(nodes.back()));
+				auto node = make_node<SinhNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::COSH_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<CoshNode>(std::move(nodes.back()));
+				auto node = make_node<CoshNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::TANH_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<TanhNode>(std::move(nodes.back()));
+				auto node = make_node<TanhNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::ASINH_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<AsinhNode>(std::move(nodes.back()));
+				auto node = make_node<AsinhNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::ACOSH_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<AcoshNode>(std::move(nodes.back()));
+				auto node = make_node<AcoshNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::ATANH_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<AtanhNode>(std::move(nodes.back()));
+				auto node = make_node<AtanhNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::SGN_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
-				auto node = std::make_unique<SgnNode>(std::move(nodes.back()));
+				auto node = make_node<SgnNode>(std::move(nodes.back()));
 				nodes.pop_back();
 				nodes.push_back(std::move(node));
 			}
 		},
 		{ DefaultFunctionIDs::DERIVATIVE_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
 				auto rc = std::move(nodes.back());
 				nodes.pop_back();
 				auto lc = std::move(nodes.back());
 				nodes.pop_back();
 
-				nodes.push_back(std::make_unique<DerivativeNode>(std::move(lc), std::move(rc)));
+				nodes.push_back(make_node<DerivativeNode>(std::move(lc), std::move(rc)));
 			}
 		},
 		{ DefaultFunctionIDs::SUBS_ID,
-		[](LexContext& context, const Token& tok, std::vector<std::unique_ptr<Node>>& nodes)
+		[](const LexContext& context, const Token& tok, std::vector<NodePtr>& nodes)
 			{
 				const FunctionToken* ftok = dynamic_cast<const FunctionToken*>(&tok);
 				if (ftok == nullptr) {
@@ -1256,14 +1440,14 @@ ExpressionCreationMap Expression::default_expression_creation_map() {
 				if (ftok->n_inputs % 2 != 1)
 					throw std::runtime_error("SubsNode expects an odd number of arguments");
 
-				std::vector<std::unique_ptr<Node>> children;
+				std::vector<NodePtr> children;
 				children.reserve(ftok->n_inputs);
 				for (int i = 0; i < ftok->n_inputs; ++i) {
 					children.push_back(std::move(nodes.back()));
 					nodes.pop_back();
 				}
 
-				nodes.push_back(std::make_unique<SubsNode>(std::move(children)));
+				nodes.push_back(make_node<SubsNode>(std::move(children)));
 			}
 		}
 	};
@@ -1271,7 +1455,7 @@ ExpressionCreationMap Expression::default_expression_creation_map() {
 
 const LexContext& Expression::get_context() const
 {
-	return m_Context;
+	return *m_Context;
 }
 
 const std::string& Expression::get_expression() const
@@ -2,7 +2,6 @@ module;
 
 export module expr;
 
-import <deque>;
 import <memory>;
 import <string>;
 import <functional>;
@@ -23,62 +22,71 @@ namespace expression {
 
 	export class Expression;
 
-	export class Node {
+	export class Node;
+
+	// Nodes are immutable once built and shared between every expression containing them. Nodes built by
+	// parsing and differentiation are interned, a structurally equal subtree is only stored once, so copying
+	// an expression copies a handle and derivatives reuse the subtrees of what they differentiate
+	export using NodePtr = std::shared_ptr<const Node>;
+
+	export class Node : public std::enable_shared_from_this<Node> {
 	public:
 
 		Node(Node&&) = default;
 
-		Node(LexContext& ctext);
+		virtual ~Node() = default;
+
+		Node(std::shared_ptr<const LexGrammar> grammar);
 
-		Node(std::vector<std::unique_ptr<Node>>&& childs);
+		Node(std::vector<NodePtr>&& childs);
 
-		Node(std::vector<std::unique_ptr<Node>>&& childs, LexContext& ctext);
+		Node(std::vector<NodePtr>&& childs, std::shared_ptr<const LexGrammar> grammar);
 
-		Node(std::unique_ptr<NumberBaseToken> base_token, LexContext& ctext);
+		Node(std::unique_ptr<NumberBaseToken> base_token, std::shared_ptr<const LexGrammar> grammar);
 
 		virtual std::string str() const = 0;
 
 		virtual std::string glsl_str(const glsl::SymbolicContext& symtext) const = 0;
 
-		virtual std::unique_ptr<Node> copy(LexContext& context) const = 0;
+		// derivative with respect to the variable x, differentiated on the tree and lightly simplified
+		virtual NodePtr derivative(const std::string& x) const = 0;
 
-		void fill_variable_list(std::set<std::string>& vars);
-
-		std::unique_ptr<Expression> diff(const std::string& x) const;
+		void fill_variable_list(std::set<std::string>& vars) const;
 
 		bool child_is_variable(int i) const;
 
 	public:
-		LexContext& context;
-		std::vector<std::unique_ptr<Node>> children;
+		std::vector<NodePtr> children;
 		std::unique_ptr<NumberBaseToken> pToken;
+		// names of the operators and functions of token nodes
+		std::shared_ptr<const LexGrammar> grammar;
 	};
 
-	//export std::unique_ptr<Node> node_from_token(const Token& tok, LexContext& context);
+	//export NodePtr node_from_token(const Token& tok, LexContext& context);
 
 	export class TokenNode : public Node {
 	public:
 
-		TokenNode(const Token& tok, LexContext& context);
+		TokenNode(const Token& tok, std::shared_ptr<const LexGrammar> grammar);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class VariableNode : public Node {
 	public:
 
-		VariableNode(const VariableToken& token, LexContext& context);
+		VariableNode(const VariableToken& token, std::shared_ptr<const LexGrammar> grammar);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	private:
 		VariableToken m_VarToken;
@@ -87,78 +95,78 @@ namespace expression {
 	export class NegNode : public Node {
 	public:
 
-		NegNode(std::unique_ptr<Node> child);
+		NegNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class MulNode : public Node {
 	public:
 
-		MulNode(std::unique_ptr<Node> left_child, std::unique_ptr<Node> right_child);
+		MulNode(NodePtr left_child, NodePtr right_child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class DivNode : public Node {
 	public:
 
-		DivNode(std::unique_ptr<Node> left_child, std::unique_ptr<Node> right_child);
+		DivNode(NodePtr left_child, NodePtr right_child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class AddNode : public Node {
 	public:
 
-		AddNode(std::unique_ptr<Node> left_child, std::unique_ptr<Node> right_child);
+		AddNode(NodePtr left_child, NodePtr right_child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class SubNode : public Node {
 	public:
 
-		SubNode(std::unique_ptr<Node> left_child, std::unique_ptr<Node> right_child);
+		SubNode(NodePtr left_child, NodePtr right_child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class PowNode : public Node {
 	public:
 
-		PowNode(std::unique_ptr<Node> left_child, std::unique_ptr<Node> right_child);
+		PowNode(NodePtr left_child, NodePtr right_child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
@@ -167,242 +175,234 @@ namespace expression {
 	export class SgnNode : public Node {
 	public:
 
-		SgnNode(std::unique_ptr<Node> child);
+		SgnNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class AbsNode : public Node {
 	public:
 
-		AbsNode(std::unique_ptr<Node> child);
+		AbsNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class SqrtNode : public Node {
 	public:
 
-		SqrtNode(std::unique_ptr<Node> child);
+		SqrtNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class ExpNode : public Node {
 	public:
 
-		ExpNode(std::unique_ptr<Node> child)
-			: Node(child->context)
-		{
-			children.emplace_back(std::move(child));
-		}
+		ExpNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class LogNode : public Node {
 	public:
 
-		LogNode(std::unique_ptr<Node> child);
+		LogNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class SinNode : public Node {
 	public:
 
-		SinNode(std::unique_ptr<Node> child);
+		SinNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class CosNode : public Node {
 	public:
 
-		CosNode(std::unique_ptr<Node> child);
+		CosNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class TanNode : public Node {
 	public:
 
-		TanNode(std::unique_ptr<Node> child);
+		TanNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class AsinNode : public Node {
 	public:
 
-		AsinNode(std::unique_ptr<Node> child);
+		AsinNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class AcosNode : public Node {
 	public:
 
-		AcosNode(std::unique_ptr<Node> child);
+		AcosNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class AtanNode : public Node {
 	public:
 
-		AtanNode(std::unique_ptr<Node> child);
+		AtanNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class SinhNode : public Node {
 	public:
 
-		SinhNode(std::unique_ptr<Node> child)
-			: Node(child->context)
-		{
-			children.emplace_back(std::move(child));
-		}
+		SinhNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class CoshNode : public Node {
 	public:
 
-		CoshNode(std::unique_ptr<Node> child);
+		CoshNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class TanhNode : public Node {
 	public:
 
-		TanhNode(std::unique_ptr<Node> child);
+		TanhNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class AsinhNode : public Node {
 	public:
 
-		AsinhNode(std::unique_ptr<Node> child);
+		AsinhNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class AcoshNode : public Node {
 	public:
 
-		AcoshNode(std::unique_ptr<Node> child);
+		AcoshNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class AtanhNode : public Node {
 	public:
 
-		AtanhNode(std::unique_ptr<Node> child);
+		AtanhNode(NodePtr child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	};
 
 	export class DerivativeNode : public Node {
 	public:
 
-		DerivativeNode(std::unique_ptr<Node> left_child, std::unique_ptr<Node> right_child);
+		DerivativeNode(NodePtr left_child, NodePtr right_child);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	private:
 
@@ -411,20 +411,20 @@ namespace expression {
 	export class SubsNode : public Node {
 	public:
 
-		SubsNode(std::vector<std::unique_ptr<Node>>&& childs);
+		SubsNode(std::vector<NodePtr>&& childs);
 
 		std::string str() const override;
 
 		std::string glsl_str(const glsl::SymbolicContext& symtext) const override;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		NodePtr derivative(const std::string& x) const override;
 
 	private:
 
 	};
 
 	using ExpressionCreationMap = std::unordered_map<int32_t,
-		std::function<void(LexContext&, const Token&, std::vector<std::unique_ptr<Node>>&)>>;
+		std::function<void(const LexContext&, const Token&, std::vector<NodePtr>&)>>;
 
 	export class Expression : public Node {
 	public:
@@ -437,11 +437,11 @@ namespace expression {
 
 		Expression(const std::string& expression, const LexContext& context);
 
-		Expression(const std::unique_ptr<Node>& root_child, const LexContext& context);
+		Expression(const NodePtr& root_child, const LexContext& context);
 
-		Expression(const std::unique_ptr<Node>& root_child, const LexContext& context, const std::string& expr);
+		Expression(const NodePtr& root_child, const LexContext& context, const std::string& expr);
 
-		Expression(const LexContext& context, const std::deque<std::unique_ptr<Token>>& tokens,
+		Expression(const LexContext& context, const std::vector<const Token*>& postfix_tokens,
 			const ExpressionCreationMap& creation_map);
 
 		std::string str() const override;
@@ -450,7 +450,10 @@ namespace expression {
 
 		bool is_zero() const;
 
-		std::unique_ptr<Node> copy(LexContext& context) const override;
+		// the derivative shares the context and all unchanged subtrees with this expression
+		std::unique_ptr<Expression> diff(const std::string& x) const;
+
+		NodePtr derivative(const std::string& x) const override;
 
 		static ExpressionCreationMap default_expression_creation_map();
 
@@ -458,12 +461,18 @@ namespace expression {
 
 		const std::string& get_expression() const;
 
-
 	private:
 
-		LexContext m_Context;
+		Expression(const std::string& expression, std::shared_ptr<const LexContext> context);
+
+		Expression(const NodePtr& root_child, std::shared_ptr<const LexContext> context, std::string expr);
+
+		void build(const std::vector<const Token*>& postfix_tokens, const ExpressionCreationMap& creation_map);
+
+	private:
+		// shared by copies and derivatives, never modified after construction
+		std::shared_ptr<const LexContext> m_Context;
 		std::string m_Expression;
-		std::vector<std::string> m_Variables;
 	};
 
 	//export Expression expression_creator(const std::string& expression, const LexContext& context);
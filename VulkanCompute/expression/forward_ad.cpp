@@ -0,0 +1,366 @@
+module;
+
+module forward_ad;
+
+import <string>;
+import <vector>;
+import <initializer_list>;
+import <algorithm>;
+
+import vc;
+import expr;
+import dag;
+import simplify;
+import cse;
+import symbolic;
+
+using namespace vc;
+using namespace expression;
+
+namespace {
+
+	using NodeId = ExpressionDag::NodeId;
+
+	// empty strings are zero, products and sums with zero terms are dropped
+
+	std::string prod(const std::string& a, const std::string& b)
+	{
+		if (a.empty() || b.empty())
+			return "";
+		if (a == "1")
+			return b;
+		if (b == "1")
+			return a;
+		return "(" + a + "*" + b + ")";
+	}
+
+	std::string sum(std::initializer_list<std::string> terms)
+	{
+		std::string ret;
+		int nterms = 0;
+		for (auto& term : terms) {
+			if (term.empty())
+				continue;
+			ret += (nterms++ == 0 ? "" : "+") + term;
+		}
+		return nterms > 1 ? "(" + ret + ")" : ret;
+	}
+
+	std::string negate(const std::string& a)
+	{
+		return a.empty() ? "" : "(-" + a + ")";
+	}
+
+	std::string quot(const std::string& a, const std::string& b)
+	{
+		return a.empty() ? "" : "(" + a + "/" + b + ")";
+	}
+
+	// value and derivatives of one node, hess holds (k, l), l <= k, at k*nparam + l
+	struct Dual {
+		std::string value;
+		std::vector<std::string> grad;
+		std::vector<std::string> hess;
+	};
+
+	class ForwardDifferentiator {
+	public:
+
+		ForwardDifferentiator(ExpressionDag& dag, const glsl::SymbolicContext& symtext, int order,
+			bool single_precision, CodeSyntax syntax, const std::string& prefix)
+			: m_Dag(dag), m_Symtext(symtext), m_Order(order), m_SinglePrecision(single_precision),
+			m_Syntax(syntax), m_Prefix(prefix), m_NParams(symtext.get_n_params())
+		{}
+
+		EliminatedSubexpressions run(NodeId root)
+		{
+			m_Names.assign(m_Dag.size(), "");
+			m_Duals.assign(m_Dag.size(), Dual{});
+
+			for (auto id : m_Dag.topological_order({ root })) {
+				differentiate(id);
+			}
+
+			auto& dual = m_Duals[root];
+			m_Ret.expressions.push_back(dual.value);
+			for (int k = 0; k < m_NParams; ++k) {
+				m_Ret.expressions.push_back(zero_or(dual.grad[k]));
+			}
+			if (m_Order > 1) {
+				for (int k = 0; k < m_NParams; ++k) {
+					for (int l = 0; l <= k; ++l) {
+						m_Ret.expressions.push_back(zero_or(hess(dual, k, l)));
+					}
+				}
+			}
+
+			return std::move(m_Ret);
+		}
+
+	private:
+
+		void differentiate(NodeId id)
+		{
+			auto node = m_Dag.get_node(id);
+			Dual& d = m_Duals[id];
+			d.grad.assign(m_NParams, "");
+			d.hess.assign(m_NParams * m_NParams, "");
+
+			if (node.op == DagOp::NUMBER) {
+				d.value = print(id);
+				return;
+			}
+			if (node.op == DagOp::VARIABLE) {
+				d.value = print(id);
+				if (m_Symtext.get_symtype(node.name) == glsl::SymbolicType::PARAM_TYPE)
+					d.grad[m_Symtext.get_params_index(node.name)] = "1";
+				return;
+			}
+
+			// children are printed by their temporaries
+			d.value = temp(print(id));
+			m_Names[id] = d.value;
+
+			const Dual& a = m_Duals[node.lhs];
+			const std::string& v = d.value;
+
+			switch (node.op) {
+			case DagOp::NEG:
+				for_each_derivative(d, [&](int k) { return negate(a.grad[k]); },
+					[&](int k, int l) { return negate(hess(a, k, l)); });
+				break;
+			case DagOp::ADD:
+			case DagOp::SUB:
+			{
+				const Dual& b = m_Duals[node.rhs];
+				bool sub = node.op == DagOp::SUB;
+				auto rhs = [sub](const std::string& x) { return sub ? negate(x) : x; };
+				for_each_derivative(d, [&](int k) { return sum({ a.grad[k], rhs(b.grad[k]) }); },
+					[&](int k, int l) { return sum({ hess(a, k, l), rhs(hess(b, k, l)) }); });
+				break;
+			}
+			case DagOp::MUL:
+			case DagOp::FMA:
+			{
+				const Dual& b = m_Duals[node.rhs];
+				const Dual* c = node.op == DagOp::FMA ? &m_Duals[node.third] : nullptr;
+				for_each_derivative(d,
+					[&](int k) {
+						return sum({ prod(a.grad[k], b.value), prod(a.value, b.grad[k]), c ? c->grad[k] : "" });
+					},
+					[&](int k, int l) {
+						return sum({ prod(hess(a, k, l), b.value), prod(a.grad[k], b.grad[l]), prod(a.grad[l], b.grad[k]),
+							prod(a.value, hess(b, k, l)), c ? hess(*c, k, l) : "" });
+					});
+				break;
+			}
+			case DagOp::DIV:
+			{
+				// from a = v*b
+				const Dual& b = m_Duals[node.rhs];
+				for_each_derivative(d,
+					[&](int k) { return quot(sum({ a.grad[k], negate(prod(v, b.grad[k])) }), b.value); },
+					[&](int k, int l) {
+						return quot(sum({ hess(a, k, l), negate(prod(d.grad[k], b.grad[l])), negate(prod(d.grad[l], b.grad[k])),
+							negate(prod(v, hess(b, k, l))) }), b.value);
+					});
+				break;
+			}
+			case DagOp::POW:
+				if (auto exponent = m_Dag.get_number(node.rhs)) {
+					double e = *exponent;
+					std::string f1 = temp(prod(literal(e), power(a.value, e - 1.0)));
+					std::string f2 = e * (e - 1.0) == 0.0 ? "" : prod(literal(e * (e - 1.0)), power(a.value, e - 2.0));
+					chain(d, a, f1, f2);
+				}
+				else {
+					general_pow(d, a, m_Duals[node.rhs]);
+				}
+				break;
+			case DagOp::SGN:
+				break;
+			default:
+				unary(node.op, d, a);
+				break;
+			}
+		}
+
+		// f(u) with f1 = f'(u) and f2 = f''(u)
+		void unary(DagOp op, Dual& d, const Dual& a)
+		{
+			const std::string& u = a.value;
+			const std::string& v = d.value;
+
+			std::string f1;
+			switch (op) {
+			case DagOp::ABS: f1 = call("sign", u); break;
+			case DagOp::SQRT: f1 = "(1/(2*" + v + "))"; break;
+			case DagOp::EXP: f1 = v; break;
+			case DagOp::LOG: f1 = "(1/" + u + ")"; break;
+			case DagOp::SIN: f1 = call("cos", u); break;
+			case DagOp::COS: f1 = "(-" + call("sin", u) + ")"; break;
+			case DagOp::TAN: f1 = "(1+" + v + "*" + v + ")"; break;
+			case DagOp::ASIN: f1 = "(1/" + call("sqrt", "1-" + u + "*" + u) + ")"; break;
+			case DagOp::ACOS: f1 = "(-1/" + call("sqrt", "1-" + u + "*" + u) + ")"; break;
+			case DagOp::ATAN: f1 = "(1/(1+" + u + "*" + u + "))"; break;
+			case DagOp::SINH: f1 = call("cosh", u); break;
+			case DagOp::COSH: f1 = call("sinh", u); break;
+			case DagOp::TANH: f1 = "(1-" + v + "*" + v + ")"; break;
+			case DagOp::ASINH: f1 = "(1/" + call("sqrt", u + "*" + u + "+1") + ")"; break;
+			case DagOp::ACOSH: f1 = "(1/" + call("sqrt", u + "*" + u + "-1") + ")"; break;
+			case DagOp::ATANH: f1 = "(1/(1-" + u + "*" + u + "))"; break;
+			default:
+				throw std::runtime_error("Unary DagOp has no forward mode rule");
+			}
+			f1 = temp(f1);
+
+			std::string f2;
+			switch (op) {
+			case DagOp::ABS: break;
+			case DagOp::SQRT: f2 = "(-" + f1 + "/(2*" + u + "))"; break;
+			case DagOp::EXP: f2 = v; break;
+			case DagOp::LOG: f2 = "(-" + f1 + "*" + f1 + ")"; break;
+			case DagOp::SIN: f2 = "(-" + v + ")"; break;
+			case DagOp::COS: f2 = "(-" + v + ")"; break;
+			case DagOp::TAN: f2 = "(2*" + v + "*" + f1 + ")"; break;
+			case DagOp::ASIN: f2 = "(" + u + "*" + f1 + "*" + f1 + "*" + f1 + ")"; break;
+			case DagOp::ACOS: f2 = "(" + u + "*" + f1 + "*" + f1 + "*" + f1 + ")"; break;
+			case DagOp::ATAN: f2 = "(-2*" + u + "*" + f1 + "*" + f1 + ")"; break;
+			case DagOp::SINH: f2 = v; break;
+			case DagOp::COSH: f2 = v; break;
+			case DagOp::TANH: f2 = "(-2*" + v + "*" + f1 + ")"; break;
+			case DagOp::ASINH: f2 = "(-" + u + "*" + f1 + "*" + f1 + "*" + f1 + ")"; break;
+			case DagOp::ACOSH: f2 = "(-" + u + "*" + f1 + "*" + f1 + "*" + f1 + ")"; break;
+			case DagOp::ATANH: f2 = "(2*" + u + "*" + f1 + "*" + f1 + ")"; break;
+			default: break;
+			}
+
+			chain(d, a, f1, f2);
+		}
+
+		// d = f(a), f2 is only given a temporary if a second derivative uses it
+		void chain(Dual& d, const Dual& a, const std::string& f1, const std::string& f2)
+		{
+			std::string f2_name;
+			for_each_derivative(d,
+				[&](int k) { return prod(f1, a.grad[k]); },
+				[&](int k, int l) {
+					std::string grads = prod(a.grad[k], a.grad[l]);
+					if (!grads.empty() && !f2.empty() && f2_name.empty())
+						f2_name = temp(f2);
+					return sum({ prod(f2_name.empty() ? "" : f2_name, grads), prod(f1, hess(a, k, l)) });
+				});
+		}
+
+		// a^b = exp(b*log(a)) when b is not a number
+		void general_pow(Dual& d, const Dual& a, const Dual& b)
+		{
+			const std::string& v = d.value;
+
+			std::string log_a = temp(call("log", a.value));
+			Dual log_dual{ log_a, std::vector<std::string>(m_NParams), std::vector<std::string>(m_NParams * m_NParams) };
+			for_each_derivative(log_dual,
+				[&](int k) { return quot(a.grad[k], a.value); },
+				[&](int k, int l) {
+					return quot(sum({ hess(a, k, l), negate(quot(prod(a.grad[k], a.grad[l]), a.value)) }), a.value);
+				});
+
+			Dual w{ "", std::vector<std::string>(m_NParams), std::vector<std::string>(m_NParams * m_NParams) };
+			for_each_derivative(w,
+				[&](int k) { return sum({ prod(b.grad[k], log_a), prod(b.value, log_dual.grad[k]) }); },
+				[&](int k, int l) {
+					return sum({ prod(hess(b, k, l), log_a), prod(b.grad[k], log_dual.grad[l]),
+						prod(b.grad[l], log_dual.grad[k]), prod(b.value, hess(log_dual, k, l)) });
+				});
+
+			for_each_derivative(d,
+				[&](int k) { return prod(v, w.grad[k]); },
+				[&](int k, int l) { return prod(v, sum({ prod(w.grad[k], w.grad[l]), hess(w, k, l) })); });
+		}
+
+		// fills the first derivatives of d, then the second if order > 1, every nonzero one in a temporary
+		template<typename G, typename H>
+		void for_each_derivative(Dual& d, G&& grad, H&& second)
+		{
+			for (int k = 0; k < m_NParams; ++k) {
+				d.grad[k] = temp(grad(k));
+			}
+			if (m_Order < 2)
+				return;
+			for (int k = 0; k < m_NParams; ++k) {
+				for (int l = 0; l <= k; ++l) {
+					d.hess[k * m_NParams + l] = temp(second(k, l));
+				}
+			}
+		}
+
+		const std::string& hess(const Dual& d, int k, int l) const
+		{
+			return k >= l ? d.hess[k * m_NParams + l] : d.hess[l * m_NParams + k];
+		}
+
+		std::string zero_or(const std::string& s) const
+		{
+			return s.empty() ? "0" : s;
+		}
+
+		std::string print(NodeId id) const
+		{
+			return m_Syntax == CodeSyntax::GLSL ? m_Dag.glsl_str(id, m_Symtext, m_Names) :
+				m_Dag.cpp_str(id, m_Symtext, m_SinglePrecision, m_Names);
+		}
+
+		std::string call(const std::string& func, const std::string& arg) const
+		{
+			if (m_Syntax == CodeSyntax::GLSL)
+				return func + "(" + arg + ")";
+			return (func == "sign" ? "vc_sign" : "std::" + func) + "(" + arg + ")";
+		}
+
+		std::string literal(double v) const
+		{
+			return number_literal(v, m_SinglePrecision, m_Syntax);
+		}
+
+		std::string power(const std::string& base, double e) const
+		{
+			if (e == 0.0)
+				return "1";
+			if (e == 1.0)
+				return base;
+			return (m_Syntax == CodeSyntax::GLSL ? "pow(" : "std::pow(") + base + "," + literal(e) + ")";
+		}
+
+		// names and literals are used as they are, everything else gets a temporary
+		std::string temp(const std::string& code)
+		{
+			if (code.find('(') == std::string::npos)
+				return code;
+			std::string name = m_Prefix + std::to_string(m_Ret.temporaries.size());
+			m_Ret.temporaries.emplace_back(name, code);
+			return name;
+		}
+
+	private:
+		ExpressionDag& m_Dag;
+		const glsl::SymbolicContext& m_Symtext;
+		int m_Order;
+		bool m_SinglePrecision;
+		CodeSyntax m_Syntax;
+		std::string m_Prefix;
+		int m_NParams;
+
+		std::vector<std::string> m_Names;
+		std::vector<Dual> m_Duals;
+		EliminatedSubexpressions m_Ret;
+	};
+
+}
+
+EliminatedSubexpressions expression::forward_mode_derivatives(const Expression& expr, const glsl::SymbolicContext& symtext,
+	int order, bool single_precision, CodeSyntax syntax, const std::string& prefix)
+{
+	ExpressionDag dag;
+	auto roots = simplify(dag, { dag.add(expr) }, single_precision, symtext.simplify);
+	return ForwardDifferentiator(dag, symtext, order, single_precision, syntax, prefix).run(roots[0]);
+}
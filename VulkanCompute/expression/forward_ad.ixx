@@ -0,0 +1,23 @@
+module;
+
+export module forward_ad;
+
+import <string>;
+
+import vc;
+import expr;
+import dag;
+import cse;
+import symbolic;
+
+namespace expression {
+
+	// Forward mode derivatives of expr with respect to the params of symtext. Every node of the simplified
+	// residual gets a temporary for its value, its nonzero first derivatives and, if order > 1, its nonzero
+	// second derivatives, each computed from those of its children, so the residual is differentiated in one
+	// pass instead of once per parameter. The expressions are the residual, the nparam first derivatives and
+	// if order > 1 the second derivatives (i, j), j <= i, in row order. Zero derivatives are printed as "0"
+	export EliminatedSubexpressions forward_mode_derivatives(const Expression& expr, const glsl::SymbolicContext& symtext,
+		int order, bool single_precision, CodeSyntax syntax = CodeSyntax::GLSL, const std::string& prefix = "ad");
+
+}
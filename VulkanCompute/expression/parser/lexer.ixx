@@ -12,7 +12,10 @@ import <memory>;
 import <optional>;
 import <stdexcept>;
 import <string>;
-import <regex>;
+import <string_view>;
+import <deque>;
+import <charconv>;
+import <cctype>;
 
 import vc;
 import token;
@@ -21,20 +24,22 @@ import util;
 
 namespace expression {
 
-	export struct LexContext {
+	// The operators and functions of a LexContext. They are never modified after construction, so copies of
+	// a context share them
+	export struct LexGrammar {
 
-		LexContext()
+		LexGrammar()
 		{
-			auto no_token = std::make_shared<NoToken>();
-			auto left_paren = std::make_shared<LeftParenToken>();
-			auto comma = std::make_shared<CommaToken>();
+			// the tokens are only compared by id
+			std::vector<std::shared_ptr<Token>> left_tokens{
+				std::make_shared<NoToken>(), std::make_shared<LeftParenToken>(), std::make_shared<CommaToken>() };
 
 			// 0
 			unary_operators.emplace_back(
 				DefaultOperatorIDs::NEG_ID,												// id
 				DefaultOperatorPrecedence::NEG_PRECEDENCE,								// precedence
 				false,																	// is_left_associative
-				std::vector<std::shared_ptr<Token>>{no_token, left_paren, comma});		// allowed_tokens
+				left_tokens);															// allowed_tokens
 
 
 
@@ -45,7 +50,7 @@ namespace expression {
 				false,																	// is_left_associative
 				false,																	// commutative
 				false,																	// anti_commutative
-				std::vector<std::shared_ptr<Token>>{no_token, left_paren, comma});				// disallowed_tokens
+				left_tokens);															// disallowed_tokens
 			// 1
 			binary_operators.emplace_back(
 				DefaultOperatorIDs::MUL_ID,												// id
@@ -53,7 +58,7 @@ namespace expression {
 				true,																	// is_left_associative
 				true,																	// commutative
 				false,																	// anti_commutative
-				std::vector<std::shared_ptr<Token>>{no_token, left_paren, comma});				// disallowed_tokens
+				left_tokens);															// disallowed_tokens
 			// 2
 			binary_operators.emplace_back(
 				DefaultOperatorIDs::DIV_ID,												// id
@@ -61,7 +66,7 @@ namespace expression {
 				true,																	// is_left_associative
 				false,																	// commutative
 				false,																	// anti_commutative
-				std::vector<std::shared_ptr<Token>>{no_token, left_paren, comma});				// disallowed_tokens
+				left_tokens);															// disallowed_tokens
 			// 3
 			binary_operators.emplace_back(
 				DefaultOperatorIDs::ADD_ID,												// id
@@ -69,7 +74,7 @@ namespace expression {
 				true,																	// is_left_associative
 				true,																	// commutative
 				false,																	// anti_commutative
-				std::vector<std::shared_ptr<Token>>{no_token, left_paren, comma});				// disallowed_tokens
+				left_tokens);															// disallowed_tokens
 			// 4
 			binary_operators.emplace_back(
 				DefaultOperatorIDs::SUB_ID,												// id
@@ -77,7 +82,7 @@ namespace expression {
 				true,																	// is_left_associative
 				false,																	// commutative
 				true,																	// anti_commutative
-				std::vector<std::shared_ptr<Token>>{no_token, left_paren, comma});				// disallowed_tokens
+				left_tokens);															// disallowed_tokens
 
 
 			functions.emplace_back(DefaultFunctionIDs::POW_ID, 2);
@@ -108,33 +113,32 @@ namespace expression {
 
 		}
 
+		std::vector<UnaryOperatorToken>		unary_operators;
+		std::vector<BinaryOperatorToken>	binary_operators;
+		std::vector<FunctionToken>			functions;
+
+		std::unordered_map<int32_t, std::string> operator_id_name_map;
+		std::unordered_map<int32_t, std::string> function_id_name_map;
+
+	};
+
+	export struct LexContext {
+
+		LexContext()
+			: grammar(default_grammar())
+		{
+		}
+
 		LexContext(const LexContext& other)
-			: unary_operators(other.unary_operators),
-			binary_operators(other.binary_operators),
-			functions(other.functions),
+			: grammar(other.grammar),
 			variables(other.variables),
-			variable_assumptions(other.variable_assumptions),
-			operator_id_name_map(other.operator_id_name_map),
-			function_id_name_map(other.function_id_name_map)
+			variable_assumptions(other.variable_assumptions)
 		{
 		}
 
 		LexContext& operator=(const LexContext& other)
 		{
-			{
-				std::vector<UnaryOperatorToken> uot(other.unary_operators.begin(), other.unary_operators.end());
-				unary_operators.swap(uot);
-			}
-
-			{
-				std::vector<BinaryOperatorToken> bot(other.binary_operators.begin(), other.binary_operators.end());
-				binary_operators.swap(bot);
-			}
-
-			{
-				std::vector<FunctionToken> fot(other.functions.begin(), other.functions.end());
-				functions.swap(fot);
-			}
+			grammar = other.grammar;
 
 			{
 				std::vector<VariableToken> vot(other.variables.begin(), other.variables.end());
@@ -143,38 +147,21 @@ namespace expression {
 
 			variable_assumptions = other.variable_assumptions;
 
-			operator_id_name_map = other.operator_id_name_map;
-			function_id_name_map = other.operator_id_name_map;
-
 			return *this;
 		}
 
 		LexContext(LexContext&&) = default;
 
-		// Fixed tokens
-		/*
-		NoToken				no_token;
-		LeftParenToken		left_paren;
-		RightParenToken		right_paren;
-		CommaToken			comma;
-		UnityToken			unity;
-		NegUnityToken		neg_unity_token;
-		ZeroToken			zero;
-		NanToken			nan_token;
-		NumberToken			number;
-		VariableToken		variable;
-		*/
-
+		static std::shared_ptr<const LexGrammar> default_grammar()
+		{
+			static const std::shared_ptr<const LexGrammar> grammar = std::make_shared<const LexGrammar>();
+			return grammar;
+		}
 
-		std::vector<UnaryOperatorToken>		unary_operators;
-		std::vector<BinaryOperatorToken>	binary_operators;
-		std::vector<FunctionToken>			functions;
+		std::shared_ptr<const LexGrammar>	grammar;
 		std::vector<VariableToken>			variables;
 		SymEngine::set_basic				variable_assumptions;
 
-		std::unordered_map<int32_t, std::string> operator_id_name_map;
-		std::unordered_map<int32_t, std::string> function_id_name_map;
-
 	};
 
 	export LexContext combine_contexts(const LexContext& c1, const LexContext& c2)
@@ -194,46 +181,82 @@ namespace expression {
 		return ret;
 	}
 
+	// The default operators and functions without any variables. It is built once and never modified,
+	// contexts with variables start out as copies of it
+	export const LexContext& default_lex_context()
+	{
+		static const LexContext context;
+		return context;
+	}
+
+	// Tokens of one lexed expression. Operators, functions and variables point into the LexContext and
+	// parenthesis, commas, zeros and ones into static tokens, only other numbers and functions with a
+	// variable number of inputs are stored in the arena. clear() keeps the storage for the next expression
+	export struct TokenArena {
+		std::vector<const Token*> tokens;
+		std::deque<NumberToken> numbers;
+		std::deque<FunctionToken> functions;
+
+		void clear()
+		{
+			tokens.clear();
+			numbers.clear();
+			functions.clear();
+		}
+	};
+
 	namespace {
-		static std::regex scientific_regex("^([\\d]+(.\\d+)?(?:e-?\\d+)?)?(i?)", std::regex_constants::ECMAScript | std::regex_constants::icase);
+		const LeftParenToken left_paren_token;
+		const RightParenToken right_paren_token;
+		const CommaToken comma_token;
+		const ZeroToken zero_token;
+		const UnityToken unity_token;
+
+		bool is_digit(char c)
+		{
+			return std::isdigit(static_cast<unsigned char>(c));
+		}
 	}
 
+	// Splits an expression into tokens without allocating per token. The names of the operators, functions
+	// and variables are looked up once at construction, so lex_context must outlive the Lexer unchanged.
+	// When several names match the longest one is taken, tanh is not read as tan followed by h
 	export class Lexer {
 	public:
 
 		Lexer(const LexContext& lex_context) 
 			: m_LexContext(lex_context)
 		{
+			for (auto& uop : m_LexContext.grammar->unary_operators) {
+				m_UnaryOperators.push_back({ m_LexContext.grammar->operator_id_name_map.at(uop.get_id()), &uop });
+			}
+			for (auto& bop : m_LexContext.grammar->binary_operators) {
+				m_BinaryOperators.push_back({ m_LexContext.grammar->operator_id_name_map.at(bop.get_id()), &bop });
+			}
+			for (auto& func : m_LexContext.grammar->functions) {
+				m_Functions.push_back({ m_LexContext.grammar->function_id_name_map.at(func.get_id()), &func });
+			}
+			for (auto& var : m_LexContext.variables) {
+				m_Variables.push_back({ var.name, &var });
+			}
 		}
 
-		std::vector<std::unique_ptr<Token>> lex(std::string expression) const
+		// the tokens of expression in arena, numbers and names point into arena and the context
+		void lex(std::string_view expression, TokenArena& arena) const
 		{
-			std::vector<std::unique_ptr<Token>> lexed_tokens;
-			lexed_tokens.reserve((expression.length() / 3 + 2));
-			lexed_tokens.push_back(std::make_unique<NoToken>());
-
-			std::string_view exprview = expression;
-			std::unique_ptr<Token> rettok;
-
-			int iter = 0;
-			while (exprview.length() != 0) {
-				std::tie(exprview, rettok) = lex_token(exprview, lexed_tokens);
+			arena.clear();
+			arena.tokens.reserve(expression.length() / 2 + 1);
 
-				if (!rettok)
-					throw std::runtime_error("Lexer found no correct token but expression was not empty: " + std::string(exprview));
+			std::int32_t previous_token_id = FixedIDs::NO_TOKEN_ID;
+			while (expression.length() != 0) {
+				const Token* tok = lex_token(expression, previous_token_id, arena);
 
-				lexed_tokens.push_back(std::move(rettok));
+				if (!tok)
+					throw std::runtime_error("Lexer found no correct token but expression was not empty: " + std::string(expression));
 
-				if (exprview.length() == 0)
-					break;
-
-				if (iter > expression.size())
-					throw std::runtime_error("Lexer ran more iterations than available charecters in expression, something wen't wrong");
+				arena.tokens.push_back(tok);
+				previous_token_id = tok->get_id();
 			}
-
-			lexed_tokens.erase(lexed_tokens.begin());
-
-			return lexed_tokens;
 		}
 
 		const LexContext& context() const {
@@ -242,219 +265,173 @@ namespace expression {
 
 	private:
 
-		std::pair<std::string_view, std::unique_ptr<Token>> lex_token(std::string_view expr,
-			const std::vector<std::unique_ptr<Token>>& lexed_tokens) const
-		{
-			auto lp_pair = begins_with_left_paren(expr);
-			if (lp_pair.second.has_value()) {
-				return std::make_pair(lp_pair.first, std::make_unique<LeftParenToken>(std::move(lp_pair.second.value())));
-			}
-
-			auto rp_pair = begins_with_right_paren(expr);
-			if (rp_pair.second.has_value()) {
-				return std::make_pair(rp_pair.first, std::make_unique<RightParenToken>(std::move(rp_pair.second.value())));
-			}
-
-			auto comma_pair = begins_with_comma(expr);
-			if (comma_pair.second.has_value()) {
-				return std::make_pair(comma_pair.first, std::make_unique<CommaToken>(std::move(comma_pair.second.value())));
-			}
-
-			auto unop_pair = begins_with_unary_operator(expr, lexed_tokens);
-			if (unop_pair.second.has_value()) {
-				return std::make_pair(unop_pair.first, std::make_unique<UnaryOperatorToken>(std::move(unop_pair.second.value())));
-			}
-
-			auto biop_pair = begins_with_binary_operator(expr, lexed_tokens);
-			if (biop_pair.second.has_value()) {
-				return std::make_pair(biop_pair.first, std::make_unique<BinaryOperatorToken>(std::move(biop_pair.second.value())));
-			}
-
-			auto func_pair = begins_with_function(expr);
-			if (func_pair.second.has_value()) {
-				return std::make_pair(func_pair.first, std::make_unique<FunctionToken>(std::move(func_pair.second.value())));
-			}
-
-			auto var_pair = begins_with_variable(expr);
-			if (var_pair.second.has_value()) {
-				return std::make_pair(var_pair.first, std::make_unique<VariableToken>(std::move(var_pair.second.value())));
-			}
-
-			auto num_pair = begins_with_numberstr(expr);
-			if (num_pair.second.has_value()) {
-				auto unity = begins_with_unity(num_pair.second.value());
-				if (unity.has_value()) {
-					return std::make_pair(num_pair.first, std::make_unique<UnityToken>(std::move(unity.value())));
-				}
-
-				auto zero = begins_with_zero(num_pair.second.value());
-				if (zero.has_value()) {
-					return std::make_pair(num_pair.first, std::make_unique<ZeroToken>(std::move(zero.value())));
-				}
-
-				return std::make_pair(num_pair.first, std::make_unique<NumberToken>(std::move(num_pair.second.value())));
-			}
-
-			return std::make_pair(expr, nullptr);
-
-		}
-
-		std::pair<std::string_view, std::optional<LeftParenToken>> begins_with_left_paren(std::string_view expr) const
-		{
-			if (expr.at(0) == FixedTokens::LEFT_PAREN_CHAR)
-				return std::make_pair(expr.substr(1), LeftParenToken());
-			return std::make_pair(expr, std::nullopt);
-		}
+		template<typename T>
+		struct NamedToken {
+			std::string_view name;
+			const T* token;
+		};
 
-		std::pair<std::string_view, std::optional<RightParenToken>> begins_with_right_paren(std::string_view expr) const
+		template<typename T>
+		static const NamedToken<T>* longest_match(const std::vector<NamedToken<T>>& named, std::string_view expr)
 		{
-			if (expr.at(0) == FixedTokens::RIGHT_PAREN_CHAR)
-				return std::make_pair(expr.substr(1), RightParenToken());
-			return std::make_pair(expr, std::nullopt);
+			const NamedToken<T>* ret = nullptr;
+			for (auto& nt : named) {
+				if (expr.starts_with(nt.name) && (!ret || nt.name.length() > ret->name.length()))
+					ret = &nt;
+			}
+			return ret;
 		}
 
-		std::pair<std::string_view, std::optional<CommaToken>> begins_with_comma(std::string_view expr) const
+		// consumes the token at the start of expr
+		const Token* lex_token(std::string_view& expr, std::int32_t previous_token_id, TokenArena& arena) const
 		{
-			if (expr.at(0) == FixedTokens::COMMA_CHAR)
-				return std::make_pair(expr.substr(1), CommaToken());
-			return std::make_pair(expr, std::nullopt);
-		}
+			switch (expr.front()) {
+			case FixedTokens::LEFT_PAREN_CHAR:
+				expr.remove_prefix(1);
+				return &left_paren_token;
+			case FixedTokens::RIGHT_PAREN_CHAR:
+				expr.remove_prefix(1);
+				return &right_paren_token;
+			case FixedTokens::COMMA_CHAR:
+				expr.remove_prefix(1);
+				return &comma_token;
+			default:
+				break;
+			}
 
-		std::pair<std::string_view, std::optional<UnaryOperatorToken>> begins_with_unary_operator(std::string_view expr,
-			const std::vector<std::unique_ptr<Token>>& lexed_tokens) const
-		{
-			for (auto& uop : m_LexContext.unary_operators) {
-				std::string opstr = m_LexContext.operator_id_name_map.at(uop.get_id());
-				if (expr.rfind(opstr, 0) == 0) {
-					int32_t previous_token_id = lexed_tokens.back()->get_id();
-					for (auto& allowed_op : uop.allowed_left_tokens) {
+			for (auto& uop : m_UnaryOperators) {
+				if (expr.starts_with(uop.name)) {
+					for (auto& allowed_op : uop.token->allowed_left_tokens) {
 						if (allowed_op->get_id() == previous_token_id) {
-							return std::make_pair(expr.substr(opstr.length()), uop);
+							expr.remove_prefix(uop.name.length());
+							return uop.token;
 						}
 					}
-					// The tokens id matched but previous token did not match any left allowed token, might for instance be another unary operator
-					return std::make_pair(expr, std::nullopt);
+					// The tokens id matched but previous token did not match any left allowed token, might for instance be a binary operator
+					break;
 				}
 			}
-			// No match
-			return std::make_pair(expr, std::nullopt);
-		}
 
-		std::pair<std::string_view, std::optional<BinaryOperatorToken>> begins_with_binary_operator(std::string_view expr,
-			const std::vector<std::unique_ptr<Token>>& lexed_tokens) const
-		{
-			for (auto& bop : m_LexContext.binary_operators) {
-				std::string opstr = m_LexContext.operator_id_name_map.at(bop.get_id());
-				if (expr.rfind(opstr, 0) == 0) {
-					int32_t previous_token_id = lexed_tokens.back()->get_id();
-					for (auto& disallowed_op : bop.disallowed_left_tokens) {
-						if (disallowed_op->get_id() == previous_token_id) {
-							throw std::runtime_error("token with token-id: " + std::to_string(previous_token_id) + " is disallowed before binary operator with token-id: " + std::to_string(bop.get_id()));
-						}
+			if (auto bop = longest_match(m_BinaryOperators, expr)) {
+				for (auto& disallowed_op : bop->token->disallowed_left_tokens) {
+					if (disallowed_op->get_id() == previous_token_id) {
+						throw std::runtime_error("token with token-id: " + std::to_string(previous_token_id) + " is disallowed before binary operator with token-id: " + std::to_string(bop->token->get_id()));
 					}
-
-					return std::make_pair(expr.substr(opstr.length()), bop);
 				}
+				expr.remove_prefix(bop->name.length());
+				return bop->token;
 			}
-			// No match
-			return std::make_pair(expr, std::nullopt);
-		}
 
-		std::pair<std::string_view, std::optional<FunctionToken>> begins_with_function(std::string_view expr) const
-		{
-			for (auto& func : m_LexContext.functions) {
-				std::string funcstr = m_LexContext.function_id_name_map.at(func.get_id());
-				if (expr.rfind(funcstr, 0) == 0) {
-					int name_length = funcstr.length();
-					if (expr.at(name_length) != '(')
-						throw std::runtime_error("A function must always be followed by a left parenthasis '('");
-
-					// Check if parenthasis are matched
-					int32_t parenthasis_diff = 1;
-					int32_t number_of_commas = 0;
-					for (int i = name_length + 1; parenthasis_diff != 0 && i < expr.length(); ++i) {
-						if (expr.at(i) == FixedTokens::LEFT_PAREN_CHAR) {
-							parenthasis_diff += 1;
-						}
-						else if (expr.at(i) == FixedTokens::RIGHT_PAREN_CHAR) {
-							parenthasis_diff -= 1;
-						}
-						else if (expr.at(i) == FixedTokens::COMMA_CHAR) {
-							if (parenthasis_diff == 1) {
-								number_of_commas += 1;
-							}
-						}
-					}
-
-					if (parenthasis_diff != 0)
-						throw std::runtime_error("Parenthasis after function: " + funcstr + ", did not match");
-
-					// This is a variable input function recreate that token with determined number of inputs
-					if (func.n_inputs == -1) {
-						return std::make_pair(expr.substr(name_length), FunctionToken(
-							func.id,
-							number_of_commas + 1,
-							func.commutative,
-							func.commutative_inputs,
-							func.anti_commutative_inputs
-						));
-					}
-
-					if (number_of_commas != (func.n_inputs - 1))
-						throw std::runtime_error("Number of commas used in function: " + funcstr + ", was not consistent with expected number of inputs");
-
-					return std::make_pair(expr.substr(name_length), func);
-				}
+			auto func = longest_match(m_Functions, expr);
+			auto var = longest_match(m_Variables, expr);
+			if (func && (!var || func->name.length() >= var->name.length()))
+				return lex_function(expr, *func, arena);
+			if (var) {
+				expr.remove_prefix(var->name.length());
+				return var->token;
 			}
-			return std::make_pair(expr, std::nullopt);
+
+			return lex_number(expr, arena);
 		}
 
-		std::pair<std::string_view, std::optional<VariableToken>> begins_with_variable(std::string_view expr) const
+		const Token* lex_function(std::string_view& expr, const NamedToken<FunctionToken>& func, TokenArena& arena) const
 		{
-			for (auto& var : m_LexContext.variables) {
-				if (expr.rfind(var.name, 0) == 0) {
-					return std::make_pair(expr.substr(var.name.length()), var);
+			std::size_t name_length = func.name.length();
+			if (expr.length() == name_length || expr[name_length] != FixedTokens::LEFT_PAREN_CHAR)
+				throw std::runtime_error("A function must always be followed by a left parenthasis '('");
+
+			// Check if parenthasis are matched
+			int32_t parenthasis_diff = 1;
+			int32_t number_of_commas = 0;
+			for (std::size_t i = name_length + 1; parenthasis_diff != 0 && i < expr.length(); ++i) {
+				if (expr[i] == FixedTokens::LEFT_PAREN_CHAR) {
+					parenthasis_diff += 1;
+				}
+				else if (expr[i] == FixedTokens::RIGHT_PAREN_CHAR) {
+					parenthasis_diff -= 1;
+				}
+				else if (expr[i] == FixedTokens::COMMA_CHAR) {
+					if (parenthasis_diff == 1) {
+						number_of_commas += 1;
+					}
 				}
 			}
-			return std::make_pair(expr, std::nullopt);
-		}
 
-		std::pair<std::string_view, std::optional<NumberToken>> begins_with_numberstr(std::string_view expr) const
-		{
-			std::cmatch m;
-			std::string exprstr(expr);
-			if (std::regex_search(exprstr.c_str(), m, scientific_regex, std::regex_constants::match_not_null)) {
-				bool is_imaginary = m[3].str().length();
-				return std::make_pair(expr.substr(m[0].str().length()), NumberToken(m[1].str(), is_imaginary));
+			if (parenthasis_diff != 0)
+				throw std::runtime_error("Parenthasis after function: " + std::string(func.name) + ", did not match");
+
+			expr.remove_prefix(name_length);
+
+			// This is a variable input function recreate that token with determined number of inputs
+			const FunctionToken& ftok = *func.token;
+			if (ftok.n_inputs == -1) {
+				return &arena.functions.emplace_back(
+					ftok.id,
+					number_of_commas + 1,
+					ftok.commutative,
+					ftok.commutative_inputs,
+					ftok.anti_commutative_inputs
+				);
 			}
-			return std::make_pair(expr, std::nullopt);
-		}
 
-		std::optional<ZeroToken> begins_with_zero(const NumberToken& num) const
-		{
-			if (num.is_imaginary)
-				return std::nullopt;
+			if (number_of_commas != (ftok.n_inputs - 1))
+				throw std::runtime_error("Number of commas used in function: " + std::string(func.name) + ", was not consistent with expected number of inputs");
 
-			if (num.num.real() == 0.0f)
-				return ZeroToken();
-
-			return std::nullopt;
+			return func.token;
 		}
 
-		std::optional<UnityToken> begins_with_unity(const NumberToken& num) const
+		// digits with an optional fraction, exponent and trailing i for imaginary numbers
+		const Token* lex_number(std::string_view& expr, TokenArena& arena) const
 		{
-			if (num.is_imaginary)
-				return std::nullopt;
+			std::size_t length = 0;
+			auto skip_digits = [&expr, &length]() {
+				while (length < expr.length() && is_digit(expr[length]))
+					++length;
+			};
+
+			skip_digits();
+			if (length == 0)
+				return nullptr;
+
+			if (length + 1 < expr.length() && expr[length] == '.' && is_digit(expr[length + 1])) {
+				++length;
+				skip_digits();
+			}
 
-			if (num.num.real() == 1.0f)
-				return UnityToken();
+			if (length < expr.length() && (expr[length] == 'e' || expr[length] == 'E')) {
+				std::size_t exponent = length + 1;
+				if (exponent < expr.length() && expr[exponent] == '-')
+					++exponent;
+				if (exponent < expr.length() && is_digit(expr[exponent])) {
+					length = exponent;
+					skip_digits();
+				}
+			}
 
-			return std::nullopt;
+			std::string_view numstr = expr.substr(0, length);
+			bool is_imaginary = length < expr.length() && (expr[length] == 'i' || expr[length] == 'I');
+			expr.remove_prefix(length + (is_imaginary ? 1 : 0));
+
+			if (!is_imaginary) {
+				double value = 0.0;
+				std::from_chars(numstr.data(), numstr.data() + numstr.length(), value);
+				if (static_cast<float>(value) == 0.0f)
+					return &zero_token;
+				if (static_cast<float>(value) == 1.0f)
+					return &unity_token;
+			}
+
+			return &arena.numbers.emplace_back(std::string(numstr), is_imaginary);
 		}
 
 	private:
 
-		LexContext m_LexContext;
+		const LexContext& m_LexContext;
+
+		std::vector<NamedToken<UnaryOperatorToken>> m_UnaryOperators;
+		std::vector<NamedToken<BinaryOperatorToken>> m_BinaryOperators;
+		std::vector<NamedToken<FunctionToken>> m_Functions;
+		std::vector<NamedToken<VariableToken>> m_Variables;
 
 	};
 
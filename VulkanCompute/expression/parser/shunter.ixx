@@ -2,20 +2,22 @@ module;
 
 export module shunter;
 
-import <deque>;
-import <memory>;
 import <vector>;
 import <stdexcept>;
 import <string>;
 
 import token;
+import defaultexp;
 
 namespace expression {
 
+	// Reorders lexed tokens into postfix order. The tokens are not copied, the output points to the same
+	// tokens as the input. The stacks keep their storage so one Shunter can be reused for many expressions
 	export class Shunter {
 	public:
 
-		std::deque<std::unique_ptr<Token>> shunt(std::vector<std::unique_ptr<Token>>&& tokens);
+		// the postfix tokens, valid until the next call to shunt
+		const std::vector<const Token*>& shunt(const std::vector<const Token*>& tokens);
 
 	private:
 
@@ -23,41 +25,43 @@ namespace expression {
 
 		void handle_rparen();
 
-		bool shift_until(const Token& stop);
+		bool shift_until(std::int32_t stop_id);
 
 	private:
 
-		std::deque<std::unique_ptr<Token>> m_Output;
-		std::deque<std::unique_ptr<Token>> m_OperatorStack;
+		std::vector<const Token*> m_Output;
+		std::vector<const Token*> m_OperatorStack;
 
 	};
 
 
 
-	export std::deque<std::unique_ptr<Token>> Shunter::shunt(std::vector<std::unique_ptr<Token>>&& tokens)
+	export const std::vector<const Token*>& Shunter::shunt(const std::vector<const Token*>& tokens)
 	{
-		auto toks = std::move(tokens);
+		m_Output.clear();
+		m_OperatorStack.clear();
+		m_Output.reserve(tokens.size());
 
-		for (auto& tok : toks) {
+		for (auto tok : tokens) {
 
 			switch (tok->get_token_type()) {
 			case TokenType::UNITY_TYPE:
 			case TokenType::ZERO_TYPE:
 			case TokenType::NUMBER_TYPE:
-				m_Output.emplace_back(std::move(tok));
+				m_Output.push_back(tok);
 				break;
 			case TokenType::VARIABLE_TYPE:
-				m_Output.emplace_back(std::move(tok));
+				m_Output.push_back(tok);
 				break;
 			case TokenType::FUNCTION_TYPE:
-				m_OperatorStack.emplace_back(std::move(tok));
+				m_OperatorStack.push_back(tok);
 				break;
 			case TokenType::OPERATOR_TYPE:
-				handle_operator(dynamic_cast<OperatorToken&>(*tok));
-				m_OperatorStack.emplace_back(std::move(tok));
+				handle_operator(static_cast<const OperatorToken&>(*tok));
+				m_OperatorStack.push_back(tok);
 				break;
 			case TokenType::LEFT_PAREN_TYPE:
-				m_OperatorStack.emplace_back(std::move(tok));
+				m_OperatorStack.push_back(tok);
 				break;
 			case TokenType::RIGHT_PAREN_TYPE:
 				handle_rparen();
@@ -66,38 +70,34 @@ namespace expression {
 				break;
 			default:
 				throw std::runtime_error("This token type should not be in list of lexed tokens to be shunted, type: " +
-					tok->get_token_type() + std::string("  id: ") + std::to_string(tok->get_id()));
+					std::to_string(tok->get_token_type()) + std::string("  id: ") + std::to_string(tok->get_id()));
 			}
 		}
 
-		if (shift_until(LeftParenToken()))
+		if (shift_until(FixedIDs::LEFT_PAREN_ID))
 			throw std::runtime_error("missmatched parenthesis");
 
 		if (!m_OperatorStack.empty())
 			throw std::runtime_error("operator stack should be empty after shunt");
 
-		auto ret = std::move(m_Output);
-		m_Output.clear();
-		m_OperatorStack.clear();
-
-		return ret;
+		return m_Output;
 	}
 
 	export void Shunter::handle_operator(const OperatorToken& op)
 	{
 		while (!m_OperatorStack.empty()) {
-			auto& ptok_back = m_OperatorStack.back();
+			auto ptok_back = m_OperatorStack.back();
 			switch (ptok_back->get_token_type()) {
 			case TokenType::LEFT_PAREN_TYPE:
 				return;
 				break;
 			case TokenType::OPERATOR_TYPE:
 			{
-				OperatorToken& top_op = dynamic_cast<OperatorToken&>(*ptok_back);
+				const OperatorToken& top_op = static_cast<const OperatorToken&>(*ptok_back);
 				auto p = top_op.precedence;
 				auto q = op.precedence;
 				if ((p > q) || (p == q && op.is_left_associative)) {
-					m_Output.emplace_back(std::move(ptok_back));
+					m_Output.push_back(ptok_back);
 					m_OperatorStack.pop_back();
 					continue;
 				}
@@ -105,40 +105,39 @@ namespace expression {
 			}
 			break;
 			default:
-				throw std::runtime_error(ptok_back->get_id() + " must not be on operator stack");
+				throw std::runtime_error(std::to_string(ptok_back->get_id()) + " must not be on operator stack");
 			}
 		}
 	}
 
 	export void Shunter::handle_rparen()
 	{
-		if (!shift_until(LeftParenToken())) {
+		if (!shift_until(FixedIDs::LEFT_PAREN_ID)) {
 			throw std::runtime_error("missmatched parenthesis");
 		}
 
 		if (!m_OperatorStack.empty()) {
-			auto& ptok_back = m_OperatorStack.back();
+			auto ptok_back = m_OperatorStack.back();
 			if (ptok_back->get_token_type() == TokenType::FUNCTION_TYPE) {
-				m_Output.emplace_back(std::move(ptok_back));
+				m_Output.push_back(ptok_back);
 				m_OperatorStack.pop_back();
 			}
 		}
 	}
 
-	export bool Shunter::shift_until(const Token& stop)
+	export bool Shunter::shift_until(std::int32_t stop_id)
 	{
-		int32_t stacksize = m_OperatorStack.size();
-		for (int32_t i = 0; i < stacksize; ++i) {
-			std::unique_ptr<Token> ptok = std::move(m_OperatorStack.back());
+		while (!m_OperatorStack.empty()) {
+			auto ptok = m_OperatorStack.back();
 			m_OperatorStack.pop_back();
 
-			if (ptok->get_id() == stop.get_id()) {
+			if (ptok->get_id() == stop_id) {
 				return true;
 			}
 
-			m_Output.emplace_back(std::move(ptok));
+			m_Output.push_back(ptok);
 		}
 		return false;
 	}
 
-}
\ No newline at end of file
+}
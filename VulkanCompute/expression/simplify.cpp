@@ -0,0 +1,365 @@
+module;
+
+module simplify;
+
+import <string>;
+import <vector>;
+import <optional>;
+import <cmath>;
+
+import vc;
+import dag;
+
+using namespace vc;
+using namespace expression;
+
+namespace {
+
+	using NodeId = ExpressionDag::NodeId;
+	constexpr NodeId NO_NODE = ExpressionDag::NO_NODE;
+
+	// pow(x, n) with |n| up to this is expanded into multiplications
+	constexpr int max_pow_expansion = 8;
+
+	class Simplifier {
+	public:
+
+		Simplifier(ExpressionDag& dag, bool single_precision)
+			: m_Dag(dag), m_SinglePrecision(single_precision), m_Rewritten(dag.size(), NO_NODE)
+		{}
+
+		std::vector<NodeId> run(const std::vector<NodeId>& roots)
+		{
+			m_Uses = m_Dag.count_uses(roots);
+
+			// children come before their parents, so every rewrite sees rewritten children
+			for (auto id : m_Dag.topological_order(roots)) {
+				m_Rewritten[id] = rewrite(id);
+			}
+
+			std::vector<NodeId> simplified;
+			simplified.reserve(roots.size());
+			for (auto root : roots) {
+				simplified.push_back(m_Rewritten[root]);
+			}
+			return fuse(simplified);
+		}
+
+	private:
+
+		NodeId rewrite(NodeId id)
+		{
+			auto node = m_Dag.get_node(id);
+
+			if (node.op == DagOp::VARIABLE)
+				return id;
+			if (node.op == DagOp::NUMBER) {
+				// reprinted so every literal has the precision of the shader
+				auto val = value(id);
+				return val.has_value() ? number(*val) : id;
+			}
+
+			NodeId lhs = m_Rewritten[node.lhs];
+			NodeId rhs = node.rhs != NO_NODE ? m_Rewritten[node.rhs] : NO_NODE;
+
+			switch (node.op) {
+			case DagOp::NEG:
+				return neg(lhs);
+			case DagOp::ADD:
+				return add(lhs, rhs);
+			case DagOp::SUB:
+				return sub(lhs, rhs);
+			case DagOp::MUL:
+				if (mergeable_exp(node.lhs, lhs) && mergeable_exp(node.rhs, rhs))
+					return unary(DagOp::EXP, add(m_Dag.get_node(lhs).lhs, m_Dag.get_node(rhs).lhs));
+				return mul(lhs, rhs);
+			case DagOp::DIV:
+				if (mergeable_exp(node.lhs, lhs) && mergeable_exp(node.rhs, rhs))
+					return unary(DagOp::EXP, sub(m_Dag.get_node(lhs).lhs, m_Dag.get_node(rhs).lhs));
+				return div(lhs, rhs);
+			case DagOp::POW:
+				return pow(lhs, rhs);
+			case DagOp::FMA:
+				return add(mul(lhs, rhs), m_Rewritten[node.third]);
+			default:
+				return unary(node.op, lhs);
+			}
+		}
+
+		// an exp that is only used by the product being rewritten
+		bool mergeable_exp(NodeId original, NodeId rewritten) const
+		{
+			return m_Uses[original] == 1 && m_Dag.get_node(rewritten).op == DagOp::EXP;
+		}
+
+		std::optional<double> value(NodeId id) const
+		{
+			return m_Dag.get_number(id);
+		}
+
+		NodeId number(double v)
+		{
+			if (v == 0.0)
+				v = 0.0; // no negative zero
+			return m_Dag.intern_leaf(DagOp::NUMBER, number_literal(v, m_SinglePrecision, CodeSyntax::GLSL));
+		}
+
+		// folds to a number if the result is finite
+		std::optional<NodeId> fold(double v)
+		{
+			if (!std::isfinite(v))
+				return std::nullopt;
+			return number(v);
+		}
+
+		// a constant expression that was kept since it has no finite value, 1/0 times 0 is not 0
+		bool unfolded(NodeId id)
+		{
+			if (id >= m_Unfolded.size())
+				m_Unfolded.resize(m_Dag.size(), -1);
+			if (m_Unfolded[id] < 0) {
+				auto node = m_Dag.get_node(id);
+				bool constant = node.op != DagOp::VARIABLE && node.op != DagOp::NUMBER &&
+					operand_constant(node.lhs) && operand_constant(node.rhs) && operand_constant(node.third);
+				m_Unfolded[id] = constant ? 1 : 0;
+			}
+			return m_Unfolded[id] == 1;
+		}
+
+		bool operand_constant(NodeId id)
+		{
+			return id == NO_NODE || m_Dag.get_node(id).op == DagOp::NUMBER || unfolded(id);
+		}
+
+		NodeId neg(NodeId a)
+		{
+			if (auto va = value(a))
+				return number(-*va);
+			auto& node = m_Dag.get_node(a);
+			if (node.op == DagOp::NEG)
+				return node.lhs;
+			return m_Dag.intern(DagOp::NEG, a);
+		}
+
+		NodeId add(NodeId a, NodeId b)
+		{
+			auto va = value(a);
+			auto vb = value(b);
+			if (va && vb) {
+				if (auto folded = fold(*va + *vb))
+					return *folded;
+			}
+			if (va == 0.0)
+				return b;
+			if (vb == 0.0)
+				return a;
+			if (m_Dag.get_node(b).op == DagOp::NEG)
+				return sub(a, m_Dag.get_node(b).lhs);
+			if (m_Dag.get_node(a).op == DagOp::NEG)
+				return sub(b, m_Dag.get_node(a).lhs);
+			return m_Dag.intern(DagOp::ADD, a, b);
+		}
+
+		NodeId sub(NodeId a, NodeId b)
+		{
+			auto va = value(a);
+			auto vb = value(b);
+			if (va && vb) {
+				if (auto folded = fold(*va - *vb))
+					return *folded;
+			}
+			if (a == b && !unfolded(a))
+				return number(0.0);
+			if (vb == 0.0)
+				return a;
+			if (va == 0.0)
+				return neg(b);
+			if (m_Dag.get_node(b).op == DagOp::NEG)
+				return add(a, m_Dag.get_node(b).lhs);
+			return m_Dag.intern(DagOp::SUB, a, b);
+		}
+
+		NodeId mul(NodeId a, NodeId b)
+		{
+			auto va = value(a);
+			auto vb = value(b);
+			if (va && vb) {
+				if (auto folded = fold(*va * *vb))
+					return *folded;
+			}
+			if ((va == 0.0 && !unfolded(b)) || (vb == 0.0 && !unfolded(a)))
+				return number(0.0);
+			if (va == 1.0)
+				return b;
+			if (vb == 1.0)
+				return a;
+			if (va == -1.0)
+				return neg(b);
+			if (vb == -1.0)
+				return neg(a);
+			return m_Dag.intern(DagOp::MUL, a, b);
+		}
+
+		NodeId div(NodeId a, NodeId b)
+		{
+			auto va = value(a);
+			auto vb = value(b);
+			if (va && vb) {
+				if (auto folded = fold(*va / *vb))
+					return *folded;
+			}
+			if (vb == 1.0)
+				return a;
+			if (vb == -1.0)
+				return neg(a);
+			if (va == 0.0 && vb != 0.0 && !unfolded(b))
+				return number(0.0);
+			if (vb && *vb != 0.0) {
+				if (auto reciprocal = fold(1.0 / *vb))
+					return mul(a, *reciprocal);
+			}
+			return m_Dag.intern(DagOp::DIV, a, b);
+		}
+
+		NodeId pow(NodeId a, NodeId b)
+		{
+			auto va = value(a);
+			auto vb = value(b);
+			if (va && vb) {
+				if (auto folded = fold(std::pow(*va, *vb)))
+					return *folded;
+			}
+			if (va == 1.0)
+				return a;
+			if (!vb)
+				return m_Dag.intern(DagOp::POW, a, b);
+
+			double exponent = *vb;
+			if (exponent == 0.0)
+				return number(1.0);
+			if (exponent == 0.5)
+				return unary(DagOp::SQRT, a);
+			if (exponent == -0.5)
+				return div(number(1.0), unary(DagOp::SQRT, a));
+
+			if (exponent == std::trunc(exponent) && std::abs(exponent) <= max_pow_expansion) {
+				int n = static_cast<int>(std::abs(exponent));
+				// square and multiply, the squares are interned so x^4 = (x*x)*(x*x) is two products
+				NodeId result = NO_NODE;
+				NodeId square = a;
+				while (n > 0) {
+					if (n & 1)
+						result = result == NO_NODE ? square : mul(result, square);
+					n >>= 1;
+					if (n > 0)
+						square = mul(square, square);
+				}
+				return exponent < 0.0 ? div(number(1.0), result) : result;
+			}
+
+			return m_Dag.intern(DagOp::POW, a, b);
+		}
+
+		NodeId unary(DagOp op, NodeId a)
+		{
+			if (auto va = value(a)) {
+				if (auto folded = fold(evaluate(op, *va)))
+					return *folded;
+			}
+			return m_Dag.intern(op, a);
+		}
+
+		double evaluate(DagOp op, double x) const
+		{
+			switch (op) {
+			case DagOp::SGN: return static_cast<double>((0.0 < x) - (x < 0.0));
+			case DagOp::ABS: return std::abs(x);
+			case DagOp::SQRT: return std::sqrt(x);
+			case DagOp::EXP: return std::exp(x);
+			case DagOp::LOG: return std::log(x);
+			case DagOp::SIN: return std::sin(x);
+			case DagOp::COS: return std::cos(x);
+			case DagOp::TAN: return std::tan(x);
+			case DagOp::ASIN: return std::asin(x);
+			case DagOp::ACOS: return std::acos(x);
+			case DagOp::ATAN: return std::atan(x);
+			case DagOp::SINH: return std::sinh(x);
+			case DagOp::COSH: return std::cosh(x);
+			case DagOp::TANH: return std::tanh(x);
+			case DagOp::ASINH: return std::asinh(x);
+			case DagOp::ACOSH: return std::acosh(x);
+			case DagOp::ATANH: return std::atanh(x);
+			default:
+				return NAN;
+			}
+		}
+
+		// a*b+c and a*b-c with a numeric c become fma when the product has no other use, products
+		// used elsewhere are hoisted by cse and fusing them would compute them twice
+		std::vector<NodeId> fuse(const std::vector<NodeId>& roots)
+		{
+			auto uses = m_Dag.count_uses(roots);
+			std::vector<NodeId> fused(m_Dag.size(), NO_NODE);
+
+			auto single_use_product = [this, &uses](NodeId id) {
+				return m_Dag.get_node(id).op == DagOp::MUL && uses[id] == 1;
+			};
+
+			for (auto id : m_Dag.topological_order(roots)) {
+				auto node = m_Dag.get_node(id);
+				if (node.lhs == NO_NODE) {
+					fused[id] = id;
+					continue;
+				}
+
+				NodeId lhs = fused[node.lhs];
+				NodeId rhs = node.rhs != NO_NODE ? fused[node.rhs] : NO_NODE;
+				NodeId third = node.third != NO_NODE ? fused[node.third] : NO_NODE;
+
+				// copied, interning can move the nodes
+				if (node.op == DagOp::ADD && single_use_product(node.lhs)) {
+					auto product = m_Dag.get_node(lhs);
+					fused[id] = m_Dag.intern(DagOp::FMA, product.lhs, product.rhs, rhs);
+				}
+				else if (node.op == DagOp::ADD && single_use_product(node.rhs)) {
+					auto product = m_Dag.get_node(rhs);
+					fused[id] = m_Dag.intern(DagOp::FMA, product.lhs, product.rhs, lhs);
+				}
+				else if (node.op == DagOp::SUB && single_use_product(node.lhs) && value(rhs)) {
+					auto product = m_Dag.get_node(lhs);
+					NodeId addend = neg(rhs);
+					fused[id] = m_Dag.intern(DagOp::FMA, product.lhs, product.rhs, addend);
+				}
+				else {
+					fused[id] = m_Dag.intern(node.op, lhs, rhs, third);
+				}
+			}
+
+			std::vector<NodeId> ret;
+			ret.reserve(roots.size());
+			for (auto root : roots) {
+				ret.push_back(fused[root]);
+			}
+			return ret;
+		}
+
+	private:
+		ExpressionDag& m_Dag;
+		bool m_SinglePrecision;
+
+		// original node -> simplified node
+		std::vector<NodeId> m_Rewritten;
+		std::vector<ui32> m_Uses;
+		// -1 not yet known, by node id
+		std::vector<i8> m_Unfolded;
+	};
+
+}
+
+std::vector<ExpressionDag::NodeId> expression::simplify(ExpressionDag& dag,
+	const std::vector<ExpressionDag::NodeId>& roots, bool single_precision, bool rewrite)
+{
+	if (!rewrite)
+		return roots;
+	return Simplifier(dag, single_precision).run(roots);
+}
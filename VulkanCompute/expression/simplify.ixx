@@ -0,0 +1,23 @@
+module;
+
+export module simplify;
+
+import <vector>;
+
+import vc;
+import dag;
+
+namespace expression {
+
+	// Algebraic simplification and strength reduction of the graphs reachable from roots, run before
+	// glsl emission. Constants are folded, pow with small integer exponents becomes multiplications,
+	// x/c becomes x*(1/c), exp(a)*exp(b) of otherwise unused exps becomes exp(a+b) and a product that
+	// is only used in a sum is fused into an fma. The rewritten nodes are added to the same dag, the
+	// returned roots are in the order of roots. Folded constants are printed as float or double
+	// literals depending on single_precision. Constants that do not fold to a finite value are kept
+	// as expressions, variables are assumed to be finite so x*0 becomes 0. With rewrite false the
+	// roots are returned unchanged, used to compare the generated code with and without the rewrites
+	export std::vector<ExpressionDag::NodeId> simplify(ExpressionDag& dag,
+		const std::vector<ExpressionDag::NodeId>& roots, bool single_precision, bool rewrite = true);
+
+}
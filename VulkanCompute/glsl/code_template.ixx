@@ -0,0 +1,226 @@
+module;
+
+export module code_template;
+
+import <string>;
+import <string_view>;
+import <vector>;
+import <array>;
+import <utility>;
+import <mutex>;
+import <stdexcept>;
+import <algorithm>;
+
+namespace glsl {
+
+	// placeholder -> text it is replaced with
+	export using TemplateValues = std::vector<std::pair<std::string_view, std::string>>;
+
+	// the "float" placeholder of a template
+	export std::string precision_type(bool single_precision)
+	{
+		return single_precision ? "float" : "double";
+	}
+
+	// A GLSL template with placeholders such as UNIQUEID or ndata. The template is split into
+	// literal and placeholder segments on the first render, later renders only concatenate the
+	// segments. Placeholders are matched as substrings, longest first, and the substituted
+	// values are not scanned again. All renders must use the same set of placeholders
+	//
+	// A placeholder name[] stands for every subscript name[k] of the array name. Its value is
+	// the text the subscript is replaced with, where # is the rendered k, so "name[#]" keeps
+	// the subscript as it is
+	export class CodeTemplate {
+	public:
+
+		CodeTemplate(const char* text)
+			: m_Text(text) {}
+
+		CodeTemplate(std::string text)
+			: m_Text(std::move(text)) {}
+
+		std::string render(const TemplateValues& values) const
+		{
+			std::call_once(m_ParseOnce, [this, &values]() { parse(values); });
+
+			if (values.size() != m_Keys.size())
+				throw std::runtime_error("CodeTemplate rendered with a different set of placeholders");
+
+			std::vector<const std::string*> resolved(m_Keys.size());
+			size_t size = m_LiteralSize;
+			for (int i = 0; i < m_Keys.size(); ++i) {
+				// the values are almost always given in the same order as when parsed
+				auto it = values[i].first == m_Keys[i] ? values.begin() + i :
+					std::find_if(values.begin(), values.end(), [this, i](const auto& v) { return v.first == m_Keys[i]; });
+				if (it == values.end())
+					throw std::runtime_error("CodeTemplate placeholder " + m_Keys[i] + " has no value");
+				resolved[i] = &it->second;
+				size += m_KeyCounts[i] * it->second.size();
+			}
+
+			std::string ret;
+			ret.reserve(size);
+			render_segments(0, m_Segments.size(), resolved, ret);
+			return ret;
+		}
+
+		const std::string& getText() const
+		{
+			return m_Text;
+		}
+
+	private:
+
+		struct Segment {
+			size_t offset;
+			size_t length;
+			int key;
+			// a name[] placeholder, followed by the nsubscript segments of its subscript
+			bool subscript = false;
+			size_t nsubscript = 0;
+		};
+
+		static bool is_identifier_char(char c)
+		{
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+		}
+
+		static bool is_subscript_key(const std::string& key)
+		{
+			return key.size() > 2 && key.ends_with("[]");
+		}
+
+		void render_segments(size_t first, size_t last, const std::vector<const std::string*>& resolved,
+			std::string& ret) const
+		{
+			for (size_t i = first; i < last; ++i) {
+				auto& seg = m_Segments[i];
+				if (seg.key < 0) {
+					ret.append(m_Text, seg.offset, seg.length);
+				}
+				else if (!seg.subscript) {
+					ret += *resolved[seg.key];
+				}
+				else {
+					std::string subscript;
+					render_segments(i + 1, i + 1 + seg.nsubscript, resolved, subscript);
+					for (char c : *resolved[seg.key]) {
+						if (c == '#')
+							ret += subscript;
+						else
+							ret += c;
+					}
+					i += seg.nsubscript;
+				}
+			}
+		}
+
+		// position of the ] closing the [ at open
+		size_t find_closing(size_t open, size_t end) const
+		{
+			int depth = 0;
+			for (size_t i = open; i < end; ++i) {
+				if (m_Text[i] == '[')
+					++depth;
+				else if (m_Text[i] == ']' && --depth == 0)
+					return i;
+			}
+			throw std::runtime_error("CodeTemplate has an unclosed subscript");
+		}
+
+		void parse_range(size_t begin, size_t end, const std::array<std::vector<int>, 256>& by_first) const
+		{
+			std::string_view text = m_Text;
+			size_t literal_start = begin;
+			size_t pos = begin;
+			while (pos < end) {
+				int match = -1;
+				size_t match_length = 0;
+				for (int k : by_first[static_cast<unsigned char>(text[pos])]) {
+					const std::string& key = m_Keys[k];
+					if (is_subscript_key(key)) {
+						// name[ as a whole identifier, not the tail of a longer one
+						size_t length = key.size() - 1;
+						if (pos + length <= end && text.compare(pos, length, key, 0, length) == 0 &&
+							(pos == 0 || !is_identifier_char(text[pos - 1])))
+						{
+							match = k;
+							match_length = length;
+							break;
+						}
+					}
+					else if (pos + key.size() <= end && text.compare(pos, key.size(), key) == 0) {
+						match = k;
+						match_length = key.size();
+						break;
+					}
+				}
+				if (match < 0) {
+					++pos;
+					continue;
+				}
+
+				if (pos > literal_start)
+					m_Segments.push_back(Segment{ literal_start, pos - literal_start, -1 });
+				++m_KeyCounts[match];
+
+				if (is_subscript_key(m_Keys[match])) {
+					size_t open = pos + match_length - 1;
+					size_t close = find_closing(open, end);
+					size_t seg_index = m_Segments.size();
+					m_Segments.push_back(Segment{ pos, close + 1 - pos, match, true });
+					parse_range(open + 1, close, by_first);
+					m_Segments[seg_index].nsubscript = m_Segments.size() - seg_index - 1;
+					pos = close + 1;
+				}
+				else {
+					m_Segments.push_back(Segment{ pos, match_length, match });
+					pos += match_length;
+				}
+				literal_start = pos;
+			}
+			if (end > literal_start)
+				m_Segments.push_back(Segment{ literal_start, end - literal_start, -1 });
+		}
+
+		void parse(const TemplateValues& values) const
+		{
+			m_Keys.reserve(values.size());
+			for (auto& v : values) {
+				if (v.first.empty())
+					throw std::runtime_error("CodeTemplate placeholders can't be empty");
+				m_Keys.emplace_back(v.first);
+			}
+			m_KeyCounts.assign(m_Keys.size(), 0);
+
+			// candidate keys by first character, longest first
+			std::array<std::vector<int>, 256> by_first;
+			for (int i = 0; i < m_Keys.size(); ++i) {
+				by_first[static_cast<unsigned char>(m_Keys[i][0])].push_back(i);
+			}
+			for (auto& candidates : by_first) {
+				std::sort(candidates.begin(), candidates.end(), [this](int a, int b) {
+					return m_Keys[a].size() > m_Keys[b].size();
+					});
+			}
+
+			parse_range(0, m_Text.size(), by_first);
+
+			m_LiteralSize = 0;
+			for (auto& seg : m_Segments) {
+				if (seg.key < 0)
+					m_LiteralSize += seg.length;
+			}
+		}
+
+	private:
+		std::string m_Text;
+
+		mutable std::once_flag m_ParseOnce;
+		mutable std::vector<std::string> m_Keys;
+		mutable std::vector<size_t> m_KeyCounts;
+		mutable std::vector<Segment> m_Segments;
+		mutable size_t m_LiteralSize = 0;
+	};
+
+}
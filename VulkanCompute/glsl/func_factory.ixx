@@ -18,6 +18,7 @@ import util;
 
 import variable;
 import function;
+import global_view;
 
 namespace glsl {
 
@@ -28,6 +29,8 @@ namespace glsl {
 
 		FunctionScope() = default;
 
+		virtual ~FunctionScope() = default;
+
 		virtual vc::ui16 scope_level() const = 0;
 
 		virtual vc::ui16 addVariable(const std::shared_ptr<ShaderVariable>& var) = 0;
@@ -38,6 +41,12 @@ namespace glsl {
 
 		virtual std::string build() const = 0;
 
+		// The global buffer view var is accessed through, if it has no private copy
+		virtual std::optional<GlobalView> getGlobalView(const std::shared_ptr<ShaderVariable>& var) const
+		{
+			return std::nullopt;
+		}
+
 	protected:
 		vc::raw_ptr<ScopeBase> m_Parent;
 
@@ -131,6 +140,10 @@ namespace glsl {
 			return m_Parent->getFunction(index);
 		}
 
+		virtual std::optional<GlobalView> getGlobalView(const std::shared_ptr<ShaderVariable>& var) const override {
+			return m_Parent->getGlobalView(var);
+		}
+
 		virtual std::string build() const override {
 
 			on_build();
@@ -379,13 +392,17 @@ namespace glsl {
 		}
 
 		virtual vc::ui16 addFunction(const std::shared_ptr<Function>& func) override {
-			return Function::add_function(m_Functions, func);
+			return m_Functions.add(func);
 		}
 
 		virtual const std::shared_ptr<Function>& getFunction(vc::ui16 index) const override {
 			return m_Functions[index];
 		}
 
+		virtual std::optional<GlobalView> getGlobalView(const std::shared_ptr<ShaderVariable>& var) const override {
+			return std::nullopt;
+		}
+
 		void addMatrix(const std::shared_ptr<MatrixVariable>& mat, const std::optional<FunctionFactory::InputType>& input)
 		{
 			auto varidx = ShaderVariable::add_variable(m_Variables, mat);
@@ -420,7 +437,7 @@ namespace glsl {
 			std::vector<std::shared_ptr<Function>> dependencies;
 
 			// dependencies
-			for (auto& func : m_Functions) {
+			for (auto& func : m_Functions.getFunctions()) {
 				dependencies.emplace_back(func);
 			}
 
@@ -501,7 +518,7 @@ namespace glsl {
 			dependencies.reserve(m_Functions.size());
 
 			// dependencies
-			for (auto& func : m_Functions) {
+			for (auto& func : m_Functions.getFunctions()) {
 				dependencies.emplace_back(func);
 			}
 
@@ -589,7 +606,7 @@ namespace glsl {
 		std::vector<std::pair<vc::ui16, FunctionFactory::InputType>> m_Inputs;
 		std::vector<std::shared_ptr<ShaderVariable>> m_Variables;
 
-		std::vector<std::shared_ptr<Function>> m_Functions;
+		FunctionRegistry m_Functions;
 	};
 
 	// IMPLEMENTATIONS
@@ -600,23 +617,33 @@ namespace glsl {
 		{
 			on_apply();
 
-			vc::ui16 func_pos = addFunction(func);
-
 			vc::i16 ret_pos = -1;
 			if (ret) {
 				ret_pos = addVariable(ret);
 			}
 
+			// arguments living in global buffers are not passed, the function is
+			// specialized to access the buffers directly
 			std::vector<vc::ui16> input_pos;
+			FunctionViews views;
 			if (args_it.has_value()) {
 				auto& its = args_it.value();
 				size_t ninputs = std::distance(its.first, its.second);
 				input_pos.reserve(ninputs);
-				for (auto it = its.first; it != its.second; ++it) {
-					input_pos.emplace_back(addVariable(*it));
+				vc::ui16 i = 0;
+				for (auto it = its.first; it != its.second; ++it, ++i) {
+					auto view = getGlobalView(*it);
+					if (view.has_value()) {
+						views.emplace_back(i, view.value());
+					}
+					else {
+						input_pos.emplace_back(addVariable(*it));
+					}
 				}
 			}
 
+			vc::ui16 func_pos = addFunction(views.empty() ? func : func->specialize(views));
+
 			auto call = CallScope::make(std::make_tuple(func_pos, ret_pos, std::move(input_pos)));
 			call->m_Parent = *this;
 
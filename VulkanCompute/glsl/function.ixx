@@ -6,11 +6,16 @@ import <string>;
 import <vector>;
 import <functional>;
 import <optional>;
+import <memory>;
+import <mutex>;
+import <unordered_map>;
+import <stdexcept>;
 
 import vc;
 import util;
 
 import variable;
+import global_view;
 
 namespace glsl {
 
@@ -19,6 +24,10 @@ namespace glsl {
 	using vecptrfunc = std::vector<std::shared_ptr<Function>>;
 	using refvecptrfunc = vc::refw<std::vector<std::shared_ptr<Function>>>;
 
+	// creates the variant of a function that accesses the arguments at the given positions
+	// through their global views
+	export using ViewSpecializer = std::function<std::shared_ptr<Function>(const FunctionViews&)>;
+
 	export class Function {
 	public:
 
@@ -26,22 +35,34 @@ namespace glsl {
 			const std::string& function_name,
 			const std::vector<size_t>& argument_hashes,
 			const std::function<std::string()>& code_func,
-			const std::optional<std::vector<std::shared_ptr<Function>>>& dependencies)
+			const std::optional<std::vector<std::shared_ptr<Function>>>& dependencies,
+			const ViewSpecializer& specializer = nullptr)
 			:
 			m_FunctionName(function_name),
 			m_ArgumentHashes(argument_hashes),
 			m_CodeFunc(code_func),
-			m_Dependencies(dependencies.has_value() ? dependencies.value() : vecptrfunc())
-		{}
+			m_Dependencies(dependencies.has_value() ? dependencies.value() : vecptrfunc()),
+			m_Specializer(specializer)
+		{
+			m_Hash = std::hash<std::string>()(m_FunctionName);
+			for (auto hash : m_ArgumentHashes) {
+				m_Hash = util::hash_combine(m_Hash, hash);
+			}
+		}
+
+		Function(const Function&) = delete;
+		Function& operator=(const Function&) = delete;
 
 		const std::vector<std::shared_ptr<Function>>& getDependencies() const
 		{
 			return m_Dependencies;
 		}
 
-		std::string getCode() const
+		// the code is generated on first use, shared functions are only generated once
+		const std::string& getCode() const
 		{
-			return m_CodeFunc();
+			std::call_once(m_CodeOnce, [this]() { m_Code = m_CodeFunc(); });
+			return m_Code;
 		}
 
 		std::string getName() const
@@ -49,43 +70,94 @@ namespace glsl {
 			return m_FunctionName;
 		}
 
+		std::shared_ptr<Function> specialize(const FunctionViews& views) const
+		{
+			if (!m_Specializer)
+				throw std::runtime_error(m_FunctionName + " can't take global views");
+			return m_Specializer(views);
+		}
+
 		friend bool operator==(const Function& lhs, const Function& rhs)
 		{
-			return lhs.m_FunctionName == rhs.m_FunctionName &&
+			return lhs.m_Hash == rhs.m_Hash &&
+				lhs.m_FunctionName == rhs.m_FunctionName &&
 				lhs.m_ArgumentHashes == rhs.m_ArgumentHashes;
 		}
 
 		struct HashFunction {
 			std::size_t operator()(const Function& func) const {
-				std::size_t hash = util::hash_combine(func.m_ArgumentHashes);
-				return util::hash_combine(hash, func.m_FunctionName);
+				return func.m_Hash;
 			}
 		};
 
-		static size_t add_function(std::vector<std::shared_ptr<Function>>& funcs, const std::shared_ptr<Function>& func)
+	private:
+
+		std::string m_FunctionName;
+		std::vector<std::size_t> m_ArgumentHashes;
+		std::function<std::string()> m_CodeFunc;
+		std::vector<std::shared_ptr<Function>> m_Dependencies;
+		ViewSpecializer m_Specializer;
+
+		std::size_t m_Hash;
+
+		mutable std::once_flag m_CodeOnce;
+		mutable std::string m_Code;
+	};
+
+	// The set of functions a shader or function needs, every function is stored after its
+	// dependencies so the registry can be emitted front to back
+	export class FunctionRegistry {
+	public:
+
+		// index of func, func and all of its dependencies are added if not already present
+		vc::ui16 add(const std::shared_ptr<Function>& func)
 		{
-			for (auto& f : func->m_Dependencies) {
-				add_function(funcs, f);
-			}
+			auto it = m_Indices.find(func);
+			if (it != m_Indices.end())
+				return it->second;
 
-			auto it = std::find_if(funcs.begin(), funcs.end(), [&func](const std::shared_ptr<Function>& f) {
-				return *func == *f;
-				});
-			size_t pos = it - funcs.begin();
-			if (it == funcs.end()) {
-				funcs.push_back(func);
+			// a registered dependency already has all of its own dependencies registered
+			for (auto& dep : func->getDependencies()) {
+				add(dep);
 			}
+
+			vc::ui16 pos = m_Functions.size();
+			m_Functions.push_back(func);
+			m_Indices.emplace(func, pos);
 			return pos;
 		}
 
+		const std::shared_ptr<Function>& operator[](vc::ui16 index) const
+		{
+			return m_Functions[index];
+		}
+
+		const std::vector<std::shared_ptr<Function>>& getFunctions() const
+		{
+			return m_Functions;
+		}
+
+		size_t size() const
+		{
+			return m_Functions.size();
+		}
+
 	private:
 
-		std::string m_FunctionName;
-		std::vector<std::size_t> m_ArgumentHashes;
-		std::function<std::string()> m_CodeFunc;
-		std::vector<std::shared_ptr<Function>> m_Dependencies;
+		struct PtrHash {
+			std::size_t operator()(const std::shared_ptr<Function>& func) const {
+				return Function::HashFunction()(*func);
+			}
+		};
+
+		struct PtrEqual {
+			bool operator()(const std::shared_ptr<Function>& lhs, const std::shared_ptr<Function>& rhs) const {
+				return *lhs == *rhs;
+			}
+		};
 
-		std::string m_HashName;
+		std::vector<std::shared_ptr<Function>> m_Functions;
+		std::unordered_map<std::shared_ptr<Function>, vc::ui16, PtrHash, PtrEqual> m_Indices;
 	};
 
 	export struct FunctionApplier {
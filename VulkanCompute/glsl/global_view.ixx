@@ -0,0 +1,160 @@
+module;
+
+export module global_view;
+
+import <string>;
+import <vector>;
+import <optional>;
+import <stdexcept>;
+import <functional>;
+import <utility>;
+
+import vc;
+import util;
+
+import variable;
+
+namespace glsl {
+
+	// A variable that is accessed straight from its global buffer instead of through a
+	// private copy. Element k of the variable of the current invocation is buffer[index(k)]
+	export struct GlobalView {
+		std::string buffer_name;
+		vc::ui32 ndim;
+		BufferLayout layout;
+		// false for pure inputs, the buffer may be shared with other dispatches
+		bool writable = true;
+
+		std::string index(const std::string& k) const
+		{
+			if (layout == BufferLayout::SOA)
+				return "(" + k + ")*nelem + gl_GlobalInvocationID.x";
+			return std::to_string(ndim) + "*gl_GlobalInvocationID.x + (" + k + ")";
+		}
+
+		std::string access(const std::string& k) const
+		{
+			return buffer_name + "[" + index(k) + "]";
+		}
+
+		std::string str() const
+		{
+			return buffer_name + "_" + std::to_string(ndim) + "_" + std::to_string(static_cast<int>(layout));
+		}
+	};
+
+	// argument position -> the view the argument is accessed through
+	export using FunctionViews = std::vector<std::pair<vc::ui16, GlobalView>>;
+
+	// appended to the name of the variant of a function that takes views, empty without views
+	export std::string views_suffix(const FunctionViews& views)
+	{
+		if (views.empty())
+			return "";
+
+		std::string views_id;
+		for (auto& v : views) {
+			views_id += std::to_string(v.first) + v.second.str();
+		}
+		return "_gv" + util::stupid_compress(std::hash<std::string>()(views_id));
+	}
+
+	// The parameter list of a function whose array parameters may be global views. A parameter
+	// that is a view is left out of the declarations, the function subscripts it through the
+	// name[] placeholder of its template and passes it on to the functions it calls as a view
+	export class ViewParameters {
+	public:
+
+		struct Parameter {
+			std::string declaration;
+			std::string name;
+			// only arrays the function subscripts, writes only if out or inout, or passes on
+			// to parameters that may be views themselves
+			bool allow_view = false;
+		};
+
+		struct Call {
+			FunctionViews views;
+			std::string arguments;
+		};
+
+		ViewParameters(const std::string& function_name, std::vector<Parameter> params, const FunctionViews& views)
+			: m_Params(std::move(params)), m_Views(m_Params.size())
+		{
+			for (auto& v : views) {
+				if (v.first >= m_Params.size())
+					throw std::runtime_error("View argument position out of range for " + function_name);
+
+				auto& param = m_Params[v.first];
+				if (!param.allow_view)
+					throw std::runtime_error("Parameter " + param.name + " of " + function_name + " can't be a global view");
+				if (!v.second.writable && !param.declaration.starts_with("in "))
+					throw std::runtime_error("Parameter " + param.name + " of " + function_name + " writes to an input only view");
+
+				m_Views[v.first] = v.second;
+			}
+		}
+
+		// the declarations of the parameters that aren't views
+		std::string declarations() const
+		{
+			std::string ret;
+			for (int i = 0; i < m_Params.size(); ++i) {
+				if (m_Views[i].has_value())
+					continue;
+				if (!ret.empty())
+					ret += ", ";
+				ret += m_Params[i].declaration;
+			}
+			return ret;
+		}
+
+		// value of the name[] placeholder of the array parameter name
+		std::string subscript(const std::string& name) const
+		{
+			auto view = find(name);
+			return view ? view->access("#") : name + "[#]";
+		}
+
+		// a call passing args, names of parameters or of other variables, the views among them
+		// are left out of the arguments and passed on
+		Call call(const std::vector<std::string>& args) const
+		{
+			Call ret;
+			for (int i = 0; i < args.size(); ++i) {
+				auto view = find(args[i]);
+				if (view) {
+					ret.views.emplace_back(i, *view);
+					continue;
+				}
+				if (!ret.arguments.empty())
+					ret.arguments += ", ";
+				ret.arguments += args[i];
+			}
+			return ret;
+		}
+
+	private:
+
+		const GlobalView* find(const std::string& name) const
+		{
+			for (int i = 0; i < m_Params.size(); ++i) {
+				if (m_Params[i].name == name)
+					return m_Views[i].has_value() ? &m_Views[i].value() : nullptr;
+			}
+			return nullptr;
+		}
+
+	private:
+		std::vector<Parameter> m_Params;
+		std::vector<std::optional<GlobalView>> m_Views;
+	};
+
+	// the array parameter qualifier type name[size]
+	export ViewParameters::Parameter array_parameter(const std::string& qualifier, const std::string& type,
+		const std::string& name, size_t size, bool allow_view = true)
+	{
+		return ViewParameters::Parameter{ qualifier + " " + type + " " + name + "[" + std::to_string(size) + "]", name, allow_view };
+	}
+
+}
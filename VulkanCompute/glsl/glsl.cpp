@@ -1,5 +1,11 @@
 module;
 
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/Public/ResourceLimits.h>
+#include <glslang/SPIRV/GlslangToSpv.h>
+#include <glslang/SPIRV/SPVRemapper.h>
+#include <spirv-tools/optimizer.hpp>
+
 module glsl;
 
 import <string>;
@@ -8,6 +14,12 @@ import <stdexcept>;
 import <fstream>;
 import <ostream>;
 import <optional>;
+import <mutex>;
+import <cstdlib>;
+import <memory>;
+import <thread>;
+import <functional>;
+import <filesystem>;
 
 import vc;
 
@@ -15,78 +27,203 @@ using namespace vc;
 using namespace glsl;
 
 namespace {
-	static std::string last_shader_name;
-}
+	// the last shader compiled on this thread, kept around for decompileSPIRV
+	thread_local std::vector<ui32> last_shader;
 
-std::vector<ui32> glsl::compileSource(const std::string& source, OptimizationType opt_type)
-{
-	int opt_type_int = static_cast<int>(opt_type);
+	// temporary file names must not collide between threads compiling at the same time
+	std::string thread_file_suffix()
+	{
+		return std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	}
+
+	std::mutex shader_cache_mutex;
+	std::shared_ptr<SpirvCache> shader_cache;
 
-	std::ofstream fileOut("tmpshader.comp");
-	fileOut << source;
-	fileOut.close();
-	std::ifstream fileStream;
-	if (system(std::string("glslangValidator -V tmpshader.comp -o tmpshader.comp.spv").c_str()))
+	std::once_flag glslang_init_flag;
+
+	void init_glslang()
 	{
-		throw std::runtime_error("Error running glslangValidator command");
+		std::call_once(glslang_init_flag, []() {
+			glslang::InitializeProcess();
+			std::atexit([]() { glslang::FinalizeProcess(); });
+		});
 	}
 
-	if (opt_type_int & static_cast<int>(OptimizationType::OPTIMIZE_FOR_SPEED))
+	std::vector<ui32> glsl_to_spirv(const std::string& source)
 	{
-		if (system(std::string("spirv-opt -O tmpshader.comp.spv -o tmpshader.comp.spv").c_str()))
-		{
-			throw std::runtime_error("Error running spirv-opt command");
+		init_glslang();
+
+		const char* source_ptr = source.c_str();
+		const EShMessages messages = static_cast<EShMessages>(EShMsgSpvRules | EShMsgVulkanRules);
+
+		glslang::TShader shader(EShLangCompute);
+		shader.setStrings(&source_ptr, 1);
+		shader.setEnvInput(glslang::EShSourceGlsl, EShLangCompute, glslang::EShClientVulkan, 100);
+		shader.setEnvClient(glslang::EShClientVulkan, glslang::EShTargetVulkan_1_0);
+		shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_0);
+
+		if (!shader.parse(GetDefaultResources(), 450, false, messages)) {
+			throw std::runtime_error("Error compiling shader: " + std::string(shader.getInfoLog()));
 		}
-	}
-	
-	if (opt_type_int & static_cast<int>(OptimizationType::OPTIMIZE_FOR_SIZE)) {
-		if (system(std::string("spirv-opt -Os tmpshader.comp.spv -o tmpshader.comp.spv").c_str()))
-		{
-			throw std::runtime_error("Error running spirv-opt command");
+
+		glslang::TProgram program;
+		program.addShader(&shader);
+		if (!program.link(messages)) {
+			throw std::runtime_error("Error linking shader: " + std::string(program.getInfoLog()));
+		}
+
+		std::vector<ui32> spirv;
+		spv::SpvBuildLogger logger;
+		glslang::SpvOptions spv_options;
+		spv_options.validate = true;
+		glslang::GlslangToSpv(*program.getIntermediate(EShLangCompute), spirv, &logger, &spv_options);
+
+		// unsupported or missing functionality and failed validation only show up in the logger
+		std::string spv_messages = logger.getAllMessages();
+		if (!spv_messages.empty() || spirv.empty()) {
+			throw std::runtime_error("Error generating SPIR-V: " + spv_messages);
 		}
+
+		return spirv;
 	}
 
-	if (opt_type_int & static_cast<int>(OptimizationType::REMAP)) {
+	std::vector<ui32> optimize_spirv(const std::vector<ui32>& spirv, bool for_size)
+	{
+		spvtools::Optimizer optimizer(SPV_ENV_VULKAN_1_0);
+		std::string messages;
+		optimizer.SetMessageConsumer(
+			[&messages](spv_message_level_t, const char*, const spv_position_t&, const char* message) {
+				messages += message;
+				messages += "\n";
+			});
+
+		if (for_size) {
+			optimizer.RegisterSizePasses();
+		}
+		else {
+			optimizer.RegisterPerformancePasses();
+		}
 
-		try {
-			system(std::string("mkdir tmp").c_str());
+		std::vector<ui32> optimized;
+		if (!optimizer.Run(spirv.data(), spirv.size(), &optimized)) {
+			throw std::runtime_error("Error optimizing shader: " + messages);
 		}
-		catch (...) {}
+		return optimized;
+	}
 
-		if (system(std::string("spirv-remap --do-everything --input tmpshader.comp.spv --output tmp").c_str())) 
-		{
-			throw std::runtime_error("Error running spirv-opt command");
+}
+
+std::vector<ui32> glsl::compileSource(const std::string& source, OptimizationType opt_type)
+{
+	int opt_type_int = static_cast<int>(opt_type);
+
+	auto cache = getShaderCache();
+	if (cache) {
+		auto cached = cache->load(source, opt_type_int);
+		if (cached.has_value()) {
+			last_shader = *cached;
+			return std::move(*cached);
 		}
+	}
+
+	std::vector<ui32> spirv = glsl_to_spirv(source);
+
+	if (opt_type_int & static_cast<int>(OptimizationType::OPTIMIZE_FOR_SPEED)) {
+		spirv = optimize_spirv(spirv, false);
+	}
+
+	if (opt_type_int & static_cast<int>(OptimizationType::OPTIMIZE_FOR_SIZE)) {
+		spirv = optimize_spirv(spirv, true);
+	}
 
-		last_shader_name = "tmp/tmpshader.comp.spv";
-		fileStream = std::ifstream(last_shader_name, std::ios::binary);
+	if (opt_type_int & static_cast<int>(OptimizationType::REMAP)) {
+		spv::spirvbin_t remapper;
+		remapper.remap(spirv, spv::spirvbin_t::DO_EVERYTHING);
 	}
-	else {
-		last_shader_name = "tmpshader.comp.spv";
-		fileStream = std::ifstream(last_shader_name, std::ios::binary);
+
+	if (cache) {
+		cache->store(source, opt_type_int, spirv);
 	}
 
-	std::vector<char> buffer;
-	buffer.insert(
-		buffer.begin(), std::istreambuf_iterator<char>(fileStream), {});
-	return { (uint32_t*)buffer.data(),
-			 (uint32_t*)(buffer.data() + buffer.size()) };
+	last_shader = spirv;
+
+	return spirv;
+}
+
+void glsl::setShaderCache(std::shared_ptr<SpirvCache> cache)
+{
+	std::lock_guard<std::mutex> lock(shader_cache_mutex);
+	shader_cache = std::move(cache);
+}
+
+std::shared_ptr<glsl::SpirvCache> glsl::getShaderCache()
+{
+	std::lock_guard<std::mutex> lock(shader_cache_mutex);
+	return shader_cache;
+}
+
+size_t glsl::countSpirvInstructions(const std::vector<ui32>& spirv)
+{
+	constexpr size_t header_words = 5;
+	constexpr ui32 op_function = 54;
+	constexpr ui32 op_function_end = 56;
+
+	if (spirv.size() < header_words)
+		throw std::runtime_error("SPIR-V module is smaller than its header");
+
+	size_t count = 0;
+	bool in_function = false;
+	for (size_t i = header_words; i < spirv.size();) {
+		// high half word is the instruction length, low half word the opcode
+		ui32 word_count = spirv[i] >> 16;
+		ui32 opcode = spirv[i] & 0xFFFF;
+		if (word_count == 0)
+			throw std::runtime_error("Invalid SPIR-V instruction length");
+
+		if (opcode == op_function)
+			in_function = true;
+		else if (opcode == op_function_end)
+			in_function = false;
+		else if (in_function)
+			++count;
+
+		i += word_count;
+	}
+	return count;
 }
 
 std::optional<std::string> glsl::decompileSPIRV(bool return_string)
 {
-	std::string cmd = "spirv-cross \"" + last_shader_name + "\" -V --output" + " \"tmpshader_built.comp\"";
-	if (system(cmd.c_str()))
+	if (last_shader.empty()) {
+		throw std::runtime_error("No shader has been compiled on this thread");
+	}
+
+	std::string suffix = thread_file_suffix();
+	std::string spirv_name = "tmpshader_" + suffix + ".comp.spv";
+	std::string built_name = "tmpshader_built_" + suffix + ".comp";
+
+	{
+		std::ofstream fileOut(spirv_name, std::ios::binary);
+		fileOut.write(reinterpret_cast<const char*>(last_shader.data()), last_shader.size() * sizeof(ui32));
+	}
+
+	std::string cmd = "spirv-cross \"" + spirv_name + "\" -V --output \"" + built_name + "\"";
+	int cmd_ret = system(cmd.c_str());
+	std::filesystem::remove(spirv_name);
+	if (cmd_ret)
 	{
 		throw std::runtime_error("Error running spirv-cross command");
 	}
 
 	if (return_string) {
-		std::ifstream fileStream("tmpshader_built.comp", std::ios::binary);
 		std::vector<char> buffer;
-		buffer.insert(buffer.begin(), std::istreambuf_iterator<char>(fileStream), {});
+		{
+			std::ifstream fileStream(built_name, std::ios::binary);
+			buffer.insert(buffer.begin(), std::istreambuf_iterator<char>(fileStream), {});
+		}
+		std::filesystem::remove(built_name);
 		return std::make_optional<std::string>(std::string(buffer.begin(), buffer.end()));
 	}
 
 	return std::nullopt;
-}
\ No newline at end of file
+}
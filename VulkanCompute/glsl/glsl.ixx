@@ -8,10 +8,13 @@ export module glsl;
 import <string>;
 import <vector>;
 import <optional>;
+import <memory>;
 
 import util;
 import vc;
 import variable;
+export import spirv_cache;
+export import code_template;
 
 using namespace vc;
 
@@ -26,15 +29,26 @@ namespace glsl {
 		REMAP = 8
 	};
 
-	export std::vector<ui32> compileSource(const std::string& source, OptimizationType opt_type = 
+	export constexpr OptimizationType DEFAULT_OPTIMIZATION_TYPE =
 		static_cast<OptimizationType>
 			(
 			static_cast<int>(OptimizationType::OPTIMIZE_FOR_SPEED) | 
 			static_cast<int>(OptimizationType::REMAP)
-			)
-		);
+			);
+
+	// safe to call concurrently from several threads
+	export std::vector<ui32> compileSource(const std::string& source, OptimizationType opt_type = DEFAULT_OPTIMIZATION_TYPE);
 
 	export std::optional<std::string> decompileSPIRV(bool return_string = false);
 
+	// Number of instructions inside the function bodies of a SPIR-V module, a rough measure of
+	// the work done per invocation when comparing generated shaders
+	export size_t countSpirvInstructions(const std::vector<ui32>& spirv);
+
+	// When set, compileSource looks up and stores compiled shaders in this cache
+	export void setShaderCache(std::shared_ptr<SpirvCache> cache);
+
+	export std::shared_ptr<SpirvCache> getShaderCache();
+
 }
 
@@ -30,7 +30,7 @@ namespace linalg {
 
 	export std::shared_ptr<::glsl::Function> swap(bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void swap_UNIQUEID(inout float v1, inout float v2) {
 	float temp = v1;
@@ -43,12 +43,10 @@ void swap_UNIQUEID(inout float v1, inout float v2) {
 
 		std::function<std::string()> code_func = [single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -66,7 +64,7 @@ void swap_UNIQUEID(inout float v1, inout float v2) {
 
 	export std::shared_ptr<::glsl::Function> copy_mat(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void copy_mat_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*ncol]) {
 	for (int i = 0; i < nrow*ncol; ++i) {
@@ -79,14 +77,12 @@ void copy_mat_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*ncol]) {
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -141,7 +137,7 @@ void copy_mat_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*ncol]) {
 
 	export std::shared_ptr<::glsl::Function> copy_mat_ostart(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void copy_mat_ostart_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*ncol], uint start_index) {
 	for (int i = 0; i < nrow*ncol; ++i) {
@@ -154,14 +150,12 @@ void copy_mat_ostart_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*ncol
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -179,7 +173,7 @@ void copy_mat_ostart_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*ncol
 
 	export std::shared_ptr<::glsl::Function> copy_mat_ostarted(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void copy_mat_ostarted_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*ncol]) {
 	uint start_index = nrow*ncol*gl_GlobalInvocationID.x;
@@ -193,14 +187,12 @@ void copy_mat_ostarted_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*nc
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -218,7 +210,7 @@ void copy_mat_ostarted_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*nc
 
 	export std::shared_ptr<::glsl::Function> copy_mat_istart(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void copy_mat_istart_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*ncol], uint start_index) {
 	for (int i = 0; i < nrow*ncol; ++i) {
@@ -231,14 +223,12 @@ void copy_mat_istart_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*ncol
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -256,7 +246,7 @@ void copy_mat_istart_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*ncol
 
 	export std::shared_ptr<::glsl::Function> copy_mat_istarted(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void copy_mat_istarted_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*ncol]) {
 	uint start_index = nrow*ncol*gl_GlobalInvocationID.x;
@@ -270,14 +260,12 @@ void copy_mat_istarted_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*nc
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -295,7 +283,7 @@ void copy_mat_istarted_UNIQUEID(in float imat[nrow*ncol], out float omat[nrow*nc
 
 	export std::shared_ptr<::glsl::Function> copy_vec(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void copy_vec_UNIQUEID(in float ivec[ndim], out float ovec[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -308,13 +296,11 @@ void copy_vec_UNIQUEID(in float ivec[ndim], out float ovec[ndim]) {
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -365,7 +351,7 @@ void copy_vec_UNIQUEID(in float ivec[ndim], out float ovec[ndim]) {
 
 	export std::shared_ptr<::glsl::Function> copy_vec_ostart(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void copy_vec_ostart_UNIQUEID(in float ivec[ndim], out float ovec[ndim], uint start_index) {
 	for (int i = 0; i < ndim; ++i) {
@@ -378,13 +364,11 @@ void copy_vec_ostart_UNIQUEID(in float ivec[ndim], out float ovec[ndim], uint st
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -402,7 +386,7 @@ void copy_vec_ostart_UNIQUEID(in float ivec[ndim], out float ovec[ndim], uint st
 
 	export std::shared_ptr<::glsl::Function> copy_vec_ostarted(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void copy_vec_ostarted_UNIQUEID(in float ivec[ndim], out float ovec[ndim]) {
 	uint start_index = ndim*gl_GlobalInvocationID.x;
@@ -416,13 +400,11 @@ void copy_vec_ostarted_UNIQUEID(in float ivec[ndim], out float ovec[ndim]) {
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -440,7 +422,7 @@ void copy_vec_ostarted_UNIQUEID(in float ivec[ndim], out float ovec[ndim]) {
 
 	export std::shared_ptr<::glsl::Function> copy_vec_istart(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void copy_vec_istart_UNIQUEID(in float ivec[ndim], out float ovec[ndim], uint start_index) {
 	for (int i = 0; i < ndim; ++i) {
@@ -453,13 +435,11 @@ void copy_vec_istart_UNIQUEID(in float ivec[ndim], out float ovec[ndim], uint st
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -477,7 +457,7 @@ void copy_vec_istart_UNIQUEID(in float ivec[ndim], out float ovec[ndim], uint st
 
 	export std::shared_ptr<::glsl::Function> copy_vec_istarted(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void copy_vec_istarted_UNIQUEID(in float ivec[ndim], out float ovec[ndim]) {
 	uint start_index = ndim*gl_GlobalInvocationID.x;
@@ -491,13 +471,11 @@ void copy_vec_istarted_UNIQUEID(in float ivec[ndim], out float ovec[ndim]) {
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -15,6 +15,7 @@ import util;
 
 export import variable;
 export import function;
+import global_view;
 
 export import copy;
 export import permute;
@@ -35,7 +36,7 @@ namespace linalg {
 
 	export std::shared_ptr<::glsl::Function> mat_neg(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mag_neg_UNIQUEID(inout float mat[nrow*ncol]) {
 	for (int i = 0; i < nrow*ncol; ++i) {
@@ -48,14 +49,12 @@ void mag_neg_UNIQUEID(inout float mat[nrow*ncol]) {
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -97,7 +96,7 @@ void mag_neg_UNIQUEID(inout float mat[nrow*ncol]) {
 
 	export std::shared_ptr<::glsl::Function> vec_neg(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void vec_neg_UNIQUEID(inout float vec[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -110,13 +109,11 @@ void vec_neg_UNIQUEID(inout float vec[ndim]) {
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -157,7 +154,7 @@ void vec_neg_UNIQUEID(inout float vec[ndim]) {
 
 	export std::shared_ptr<::glsl::Function> inner_prod(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 float inner_prod_UNIQUEID(in float v1[ndim], in float v2[ndim]) {
 	float ret = 0;
@@ -172,13 +169,11 @@ float inner_prod_UNIQUEID(in float v1[ndim], in float v2[ndim]) {
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -197,7 +192,7 @@ float inner_prod_UNIQUEID(in float v1[ndim], in float v2[ndim]) {
 
 	export std::shared_ptr<::glsl::Function> weighted_inner_prod(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 float weighted_inner_prod_UNIQUEID(in float mat[ndim*ndim], in float v1[ndim], in float v2[ndim]) {
 	float ret = 0;
@@ -216,13 +211,11 @@ float weighted_inner_prod_UNIQUEID(in float mat[ndim*ndim], in float v1[ndim], i
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -241,7 +234,7 @@ float weighted_inner_prod_UNIQUEID(in float mat[ndim*ndim], in float v1[ndim], i
 
 	export std::shared_ptr<::glsl::Function> diag_weighted_inner_prod(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 float diag_weighted_inner_prod_UNIQUEID(in float diag[ndim], in float v1[ndim], in float v2[ndim]) {
 	float ret = 0;
@@ -256,13 +249,11 @@ float diag_weighted_inner_prod_UNIQUEID(in float diag[ndim], in float v1[ndim],
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -282,7 +273,7 @@ float diag_weighted_inner_prod_UNIQUEID(in float diag[ndim], in float v1[ndim],
 
 	export std::shared_ptr<::glsl::Function> weighted_vec_norm(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 float weighted_inner_prod_UNIQUEID(in float mat[ndim*ndim], in float vec[ndim]) {
 	float ret = 0;
@@ -301,13 +292,11 @@ float weighted_inner_prod_UNIQUEID(in float mat[ndim*ndim], in float vec[ndim])
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -326,7 +315,7 @@ float weighted_inner_prod_UNIQUEID(in float mat[ndim*ndim], in float vec[ndim])
 
 	export std::shared_ptr<::glsl::Function> diag_weighted_vec_norm(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 float diag_weighted_inner_prod_UNIQUEID(in float diag[ndim], in float vec[ndim]) {
 	float ret = 0;
@@ -341,13 +330,11 @@ float diag_weighted_inner_prod_UNIQUEID(in float diag[ndim], in float vec[ndim])
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -364,11 +351,12 @@ float diag_weighted_inner_prod_UNIQUEID(in float diag[ndim], in float vec[ndim])
 		return std::to_string(ndim) + "_" + (single_precision ? "S" : "D");
 	}
 
-	export std::shared_ptr<::glsl::Function> weighted_vec_norm2(ui16 ndim, bool single_precision)
+	export std::shared_ptr<::glsl::Function> weighted_vec_norm2(ui16 ndim, bool single_precision,
+		const FunctionViews& views = {})
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
-float weighted_vec_norm2_UNIQUEID(in float mat[ndim*ndim], in float vec[ndim]) {
+float weighted_vec_norm2_UNIQUEID(PARAMETERS) {
 	float ret = 0;
 	for (int i = 0; i < ndim; ++i) {
 		float temp = 0;
@@ -381,24 +369,32 @@ float weighted_vec_norm2_UNIQUEID(in float mat[ndim*ndim], in float vec[ndim]) {
 }
 )glsl";
 
-		std::string uniqueid = weighted_vec_norm2_uniqueid(ndim, single_precision);
+		std::string uniqueid = weighted_vec_norm2_uniqueid(ndim, single_precision) + views_suffix(views);
 
-		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
+		ViewParameters params("weighted_vec_norm2", {
+			array_parameter("in", precision_type(single_precision), "mat", ndim*ndim),
+			array_parameter("in", precision_type(single_precision), "vec", ndim) }, views);
+
+		std::function<std::string()> code_func = [ndim, single_precision, uniqueid, params]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "PARAMETERS", params.declarations() },
+				{ "mat[]", params.subscript("mat") },
+				{ "vec[]", params.subscript("vec") },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
 			"weighted_vec_norm2_" + uniqueid,
 			std::vector<size_t>{ size_t(ndim), size_t(single_precision) },
 			code_func,
-			std::nullopt
+			std::nullopt,
+			views.empty() ? ViewSpecializer([ndim, single_precision](const FunctionViews& views) {
+				return weighted_vec_norm2(ndim, single_precision, views);
+				}) : nullptr
 		);
 	}
 
@@ -408,11 +404,12 @@ float weighted_vec_norm2_UNIQUEID(in float mat[ndim*ndim], in float vec[ndim]) {
 		return std::to_string(ndim) + "_" + (single_precision ? "S" : "D");
 	}
 
-	export std::shared_ptr<::glsl::Function> diag_weighted_vec_norm2(ui16 ndim, bool single_precision)
+	export std::shared_ptr<::glsl::Function> diag_weighted_vec_norm2(ui16 ndim, bool single_precision,
+		const FunctionViews& views = {})
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 			R"glsl(
-float diag_weighted_vec_norm2_UNIQUEID(in float diag[ndim], in float vec[ndim]) {
+float diag_weighted_vec_norm2_UNIQUEID(PARAMETERS) {
 	float ret = 0;
 	for (int i = 0; i < ndim; ++i) {
 		ret += vec[i] * diag[i] * vec[i];
@@ -421,24 +418,32 @@ float diag_weighted_vec_norm2_UNIQUEID(in float diag[ndim], in float vec[ndim])
 }
 )glsl";
 
-		std::string uniqueid = diag_weighted_vec_norm2_uniqueid(ndim, single_precision);
+		std::string uniqueid = diag_weighted_vec_norm2_uniqueid(ndim, single_precision) + views_suffix(views);
 
-		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
+		ViewParameters params("diag_weighted_vec_norm2", {
+			array_parameter("in", precision_type(single_precision), "diag", ndim),
+			array_parameter("in", precision_type(single_precision), "vec", ndim) }, views);
+
+		std::function<std::string()> code_func = [ndim, single_precision, uniqueid, params]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "PARAMETERS", params.declarations() },
+				{ "diag[]", params.subscript("diag") },
+				{ "vec[]", params.subscript("vec") },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
 			"diag_weighted_vec_norm2_" + uniqueid,
 			std::vector<size_t>{ size_t(ndim), size_t(single_precision) },
 			code_func,
-			std::nullopt
+			std::nullopt,
+			views.empty() ? ViewSpecializer([ndim, single_precision](const FunctionViews& views) {
+				return diag_weighted_vec_norm2(ndim, single_precision, views);
+				}) : nullptr
 			);
 	}
 
@@ -450,7 +455,7 @@ float diag_weighted_vec_norm2_UNIQUEID(in float diag[ndim], in float vec[ndim])
 
 	export std::shared_ptr<::glsl::Function> vec_norm(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 float vec_norm_UNIQUEID(in float vec[ndim]) {
 	float ret = 0;
@@ -465,13 +470,11 @@ float vec_norm_UNIQUEID(in float vec[ndim]) {
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -490,7 +493,7 @@ float vec_norm_UNIQUEID(in float vec[ndim]) {
 
 	export std::shared_ptr<::glsl::Function> vec_norm2(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 float vec_norm2_UNIQUEID(in float vec[ndim]) {
 	float ret = 0;
@@ -505,13 +508,11 @@ float vec_norm2_UNIQUEID(in float vec[ndim]) {
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -530,7 +531,7 @@ float vec_norm2_UNIQUEID(in float vec[ndim]) {
 
 	export std::shared_ptr<::glsl::Function> mul_mat_mat(ui16 lnrow, ui16 mid_dim, ui16 rncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_mat_mat_UNIQUEID(in float lmat[lnrow*mid_dim], in float rmat[mid_dim*rncol], out float omat[lnrow*rncol]) {
 	float entry;
@@ -550,15 +551,13 @@ void mul_mat_mat_UNIQUEID(in float lmat[lnrow*mid_dim], in float rmat[mid_dim*rn
 
 		std::function<std::string()> code_func = [lnrow, mid_dim, rncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "lnrow", std::to_string(lnrow));
-			util::replace_all(temp, "mid_dim", std::to_string(mid_dim));
-			util::replace_all(temp, "rncol", std::to_string(rncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "lnrow", std::to_string(lnrow) },
+				{ "mid_dim", std::to_string(mid_dim) },
+				{ "rncol", std::to_string(rncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -577,7 +576,7 @@ void mul_mat_mat_UNIQUEID(in float lmat[lnrow*mid_dim], in float rmat[mid_dim*rn
 	
 	export std::shared_ptr<::glsl::Function> mul_mat_vec(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_mat_vec_UNIQUEID(in float mat[nrow*ncol], in float vec[ncol], out float ovec[nrow]) {
 	for (int i = 0; i < nrow; ++i) {
@@ -593,14 +592,12 @@ void mul_mat_vec_UNIQUEID(in float mat[nrow*ncol], in float vec[ncol], out float
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -619,7 +616,7 @@ void mul_mat_vec_UNIQUEID(in float mat[nrow*ncol], in float vec[ncol], out float
 
 	export std::shared_ptr<::glsl::Function> mul_transpose_vec(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_transpose_vec_UNIQUEID(in float mat[nrow*ncol], in float vec[nrow], out float ovec[ncol]) {
 	for (int i = 0; i < ncol; ++i) {
@@ -635,14 +632,12 @@ void mul_transpose_vec_UNIQUEID(in float mat[nrow*ncol], in float vec[nrow], out
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -697,11 +692,12 @@ void mul_transpose_vec_UNIQUEID(in float mat[nrow*ncol], in float vec[nrow], out
 		return std::to_string(nrow) + "_" + std::to_string(ncol) + "_" + (single_precision ? "S" : "D");
 	}
 
-	export std::shared_ptr<::glsl::Function> mul_transpose_diag_vec(ui16 nrow, ui16 ncol, bool single_precision)
+	export std::shared_ptr<::glsl::Function> mul_transpose_diag_vec(ui16 nrow, ui16 ncol, bool single_precision,
+		const FunctionViews& views = {})
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
-void mul_transpose_diag_vec_UNIQUEID(in float mat[nrow*ncol], in float diag[nrow], in float vec[nrow], out float ovec[ncol]) {
+void mul_transpose_diag_vec_UNIQUEID(PARAMETERS) {
 	for (int i = 0; i < ncol; ++i) {
 		ovec[i] = 0;
 		for (int j = 0; j < nrow; ++j) {
@@ -711,25 +707,37 @@ void mul_transpose_diag_vec_UNIQUEID(in float mat[nrow*ncol], in float diag[nrow
 }
 )glsl";
 
-		std::string uniqueid = mul_transpose_diag_vec_uniqueid(nrow, ncol, single_precision);
+		std::string uniqueid = mul_transpose_diag_vec_uniqueid(nrow, ncol, single_precision) + views_suffix(views);
 
-		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
+		ViewParameters params("mul_transpose_diag_vec", {
+			array_parameter("in", precision_type(single_precision), "mat", nrow*ncol),
+			array_parameter("in", precision_type(single_precision), "diag", nrow),
+			array_parameter("in", precision_type(single_precision), "vec", nrow),
+			array_parameter("out", precision_type(single_precision), "ovec", ncol) }, views);
+
+		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid, params]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "PARAMETERS", params.declarations() },
+				{ "mat[]", params.subscript("mat") },
+				{ "diag[]", params.subscript("diag") },
+				{ "vec[]", params.subscript("vec") },
+				{ "ovec[]", params.subscript("ovec") },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
-			"mul_transpose_vec_" + uniqueid,
+			"mul_transpose_diag_vec_" + uniqueid,
 			std::vector<size_t>{ size_t(nrow), size_t(ncol), size_t(single_precision) },
 			code_func,
-			std::nullopt
+			std::nullopt,
+			views.empty() ? ViewSpecializer([nrow, ncol, single_precision](const FunctionViews& views) {
+				return mul_transpose_diag_vec(nrow, ncol, single_precision, views);
+				}) : nullptr
 			);
 	}
 
@@ -771,8 +779,8 @@ void mul_transpose_diag_vec_UNIQUEID(in float mat[nrow*ncol], in float diag[nrow
 		if (mat->getType() == ShaderVariableType::DOUBLE)
 			single_precision = false;
 
-		auto func = mul_transpose_vec(nrow, ncol, single_precision);
-		auto uniqueid = mul_transpose_vec_uniqueid(nrow, ncol, single_precision);
+		auto func = mul_transpose_diag_vec(nrow, ncol, single_precision);
+		auto uniqueid = mul_transpose_diag_vec_uniqueid(nrow, ncol, single_precision);
 
 		return FunctionApplier{ func, nullptr, {mat, diag, vec, out}, uniqueid };
 	}
@@ -785,7 +793,7 @@ void mul_transpose_diag_vec_UNIQUEID(in float mat[nrow*ncol], in float diag[nrow
 
 	export std::shared_ptr<::glsl::Function> add_mat_mat(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void add_mat_mat_UNIQUEID(in float lmat[nrow*ncol], in float rmat[nrow*ncol], out float omat[nrow*ncol]) {
 	for (int i = 0; i < nrow*ncol; ++i) {
@@ -798,14 +806,12 @@ void add_mat_mat_UNIQUEID(in float lmat[nrow*ncol], in float rmat[nrow*ncol], ou
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -824,7 +830,7 @@ void add_mat_mat_UNIQUEID(in float lmat[nrow*ncol], in float rmat[nrow*ncol], ou
 
 	export std::shared_ptr<Function> add_vec_vec(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void add_vec_vec_UNIQUEID(in float lvec[ndim], in float rvec[ndim], out float ovec[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -837,13 +843,11 @@ void add_vec_vec_UNIQUEID(in float lvec[ndim], in float rvec[ndim], out float ov
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -901,7 +905,7 @@ void add_vec_vec_UNIQUEID(in float lvec[ndim], in float rvec[ndim], out float ov
 
 	export std::shared_ptr<::glsl::Function> add_mat_lmat(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void add_mat_lmat_UNIQUEID(in float lmat[nrow*ncol], in float rmat[nrow*ncol], float lambda, out float omat[nrow*ncol]) {
 	for (int i = 0; i < nrow*ncol; ++i) {
@@ -914,14 +918,12 @@ void add_mat_lmat_UNIQUEID(in float lmat[nrow*ncol], in float rmat[nrow*ncol], f
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -938,11 +940,12 @@ void add_mat_lmat_UNIQUEID(in float lmat[nrow*ncol], in float rmat[nrow*ncol], f
 		return std::to_string(ndim) + "_" + (single_precision ? "S" : "D");
 	}
 
-	export std::shared_ptr<Function> add_mat_mat_ldiag(ui16 ndim, bool single_precision)
+	export std::shared_ptr<Function> add_mat_mat_ldiag(ui16 ndim, bool single_precision,
+		const FunctionViews& views = {})
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
-void add_mat_mat_ldiag_UNIQUEID(inout float mat[ndim*ndim], float lambda, inout float lmat[ndim*ndim]) {
+void add_mat_mat_ldiag_UNIQUEID(PARAMETERS) {
 	float entry1;	
 	float entry2;
 	for (int i = 0; i < ndim; ++i) {
@@ -959,24 +962,33 @@ void add_mat_mat_ldiag_UNIQUEID(inout float mat[ndim*ndim], float lambda, inout
 }
 )glsl";
 
-		std::string uniqueid = add_mat_mat_ldiag_uniqueid(ndim, single_precision);
+		std::string uniqueid = add_mat_mat_ldiag_uniqueid(ndim, single_precision) + views_suffix(views);
 
-		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
+		ViewParameters params("add_mat_mat_ldiag", {
+			array_parameter("inout", precision_type(single_precision), "mat", ndim*ndim),
+			{ precision_type(single_precision) + " lambda", "lambda" },
+			array_parameter("inout", precision_type(single_precision), "lmat", ndim*ndim) }, views);
+
+		std::function<std::string()> code_func = [ndim, single_precision, uniqueid, params]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "PARAMETERS", params.declarations() },
+				{ "mat[]", params.subscript("mat") },
+				{ "lmat[]", params.subscript("lmat") },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
 			"add_mat_mat_ldiag_" + uniqueid,
 			std::vector<size_t>{ size_t(ndim), size_t(single_precision) },
 			code_func,
-			std::nullopt
+			std::nullopt,
+			views.empty() ? ViewSpecializer([ndim, single_precision](const FunctionViews& views) {
+				return add_mat_mat_ldiag(ndim, single_precision, views);
+				}) : nullptr
 			);
 	}
 
@@ -1026,7 +1038,7 @@ void add_mat_mat_ldiag_UNIQUEID(inout float mat[ndim*ndim], float lambda, inout
 
 	export std::shared_ptr<::glsl::Function> sub_mat_mat(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void sub_mat_mat_UNIQUEID(in float lmat[nrow*ncol], in float rmat[nrow*ncol], out float omat[nrow*ncol]) {
 	for (int i = 0; i < nrow*ncol; ++i) {
@@ -1039,18 +1051,16 @@ void sub_mat_mat_UNIQUEID(in float lmat[nrow*ncol], in float rmat[nrow*ncol], ou
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
-			"sub_mat_lmat_" + uniqueid,
+			"sub_mat_mat_" + uniqueid,
 			std::vector<size_t>{ size_t(nrow), size_t(ncol), size_t(single_precision) },
 			code_func,
 			std::nullopt
@@ -1065,7 +1075,7 @@ void sub_mat_mat_UNIQUEID(in float lmat[nrow*ncol], in float rmat[nrow*ncol], ou
 
 	export std::shared_ptr<::glsl::Function> sub_mat_lmat(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void sub_mat_lmat_UNIQUEID(in float lmat[nrow*ncol], in float rmat[nrow*ncol], float lambda, out float omat[nrow*ncol]) {
 	for (int i = 0; i < nrow*ncol; ++i) {
@@ -1078,14 +1088,12 @@ void sub_mat_lmat_UNIQUEID(in float lmat[nrow*ncol], in float rmat[nrow*ncol], f
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1104,7 +1112,7 @@ void sub_mat_lmat_UNIQUEID(in float lmat[nrow*ncol], in float rmat[nrow*ncol], f
 
 	export std::shared_ptr<::glsl::Function> mat_add_ldiag(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mat_add_ldiag_UNIQUEID(inout float mat[ndim*ndim], float lambda) {
 	for (int i = 0; i < ndim; ++i) {
@@ -1117,13 +1125,11 @@ void mat_add_ldiag_UNIQUEID(inout float mat[ndim*ndim], float lambda) {
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1175,7 +1181,7 @@ void mat_add_ldiag_UNIQUEID(inout float mat[ndim*ndim], float lambda) {
 
 	export std::shared_ptr<::glsl::Function> mat_add_ldiag_out(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mat_add_ldiag_out_UNIQUEID(in float mat[ndim*ndim], float lambda, out float omat[ndim*ndim]) {
 	for (int i = 0; i < ndim*ndim; ++i) {
@@ -1191,13 +1197,11 @@ void mat_add_ldiag_out_UNIQUEID(in float mat[ndim*ndim], float lambda, out float
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1256,7 +1260,7 @@ void mat_add_ldiag_out_UNIQUEID(in float mat[ndim*ndim], float lambda, out float
 
 	export std::shared_ptr<::glsl::Function> mul_mat_transpose(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_mat_transpose_UNIQUEID(in float mat[nrow*ncol], out float omat[nrow*nrow]) {
 	float entry;
@@ -1280,14 +1284,12 @@ void mul_mat_transpose_UNIQUEID(in float mat[nrow*ncol], out float omat[nrow*nro
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1306,7 +1308,7 @@ void mul_mat_transpose_UNIQUEID(in float mat[nrow*ncol], out float omat[nrow*nro
 
 	export std::shared_ptr<::glsl::Function> mul_mat_transpose_ldiag(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_mat_transpose_ldiag_UNIQUEID(in float mat[nrow*ncol], float lambda, out float omat[nrow*nrow]) {
 	float entry;
@@ -1333,14 +1335,12 @@ void mul_mat_transpose_ldiag_UNIQUEID(in float mat[nrow*ncol], float lambda, out
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1359,7 +1359,7 @@ void mul_mat_transpose_ldiag_UNIQUEID(in float mat[nrow*ncol], float lambda, out
 
 	export std::shared_ptr<::glsl::Function> mul_mat_transpose_add(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_mat_transpose_add_UNIQUEID(in float mat[nrow*ncol], inout float omat[nrow*nrow]) {
 	float entry;
@@ -1382,14 +1382,12 @@ void mul_mat_transpose_add_UNIQUEID(in float mat[nrow*ncol], inout float omat[nr
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1408,7 +1406,7 @@ void mul_mat_transpose_add_UNIQUEID(in float mat[nrow*ncol], inout float omat[nr
 
 	export std::shared_ptr<::glsl::Function> mul_mat_transpose_add_ldiag(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_mat_transpose_add_ldiag_UNIQUEID(in float mat[nrow*ncol], float lambda, inout float omat[nrow*nrow]) {
 	float entry;
@@ -1434,14 +1432,12 @@ void mul_mat_transpose_add_ldiag_UNIQUEID(in float mat[nrow*ncol], float lambda,
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1460,7 +1456,7 @@ void mul_mat_transpose_add_ldiag_UNIQUEID(in float mat[nrow*ncol], float lambda,
 
 	export std::shared_ptr<::glsl::Function> mul_transpose_mat(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_transpose_mat_UNIQUEID(in float mat[nrow*ncol], out float omat[ncol*ncol]) {
 	float entry;
@@ -1483,14 +1479,12 @@ void mul_transpose_mat_UNIQUEID(in float mat[nrow*ncol], out float omat[ncol*nco
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1544,11 +1538,12 @@ void mul_transpose_mat_UNIQUEID(in float mat[nrow*ncol], out float omat[ncol*nco
 		return std::to_string(nrow) + "_" + std::to_string(ncol) + "_" + (single_precision ? "S" : "D");
 	}
 
-	export std::shared_ptr<::glsl::Function> mul_transpose_diag_mat(ui16 nrow, ui16 ncol, bool single_precision)
+	export std::shared_ptr<::glsl::Function> mul_transpose_diag_mat(ui16 nrow, ui16 ncol, bool single_precision,
+		const FunctionViews& views = {})
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
-void mul_transpose_diag_mat_UNIQUEID(in float mat[nrow*ncol], in float diag[nrow], out float omat[ncol*ncol]) {
+void mul_transpose_diag_mat_UNIQUEID(PARAMETERS) {
 	float entry;
 	for (int i = 0; i < ncol; ++i) {
 		for (int j = 0; j <= i; ++j) {
@@ -1565,25 +1560,35 @@ void mul_transpose_diag_mat_UNIQUEID(in float mat[nrow*ncol], in float diag[nrow
 }
 )glsl";
 
-		std::string uniqueid = mul_transpose_mat_uniqueid(nrow, ncol, single_precision);
+		std::string uniqueid = mul_transpose_mat_uniqueid(nrow, ncol, single_precision) + views_suffix(views);
 
-		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
+		ViewParameters params("mul_transpose_diag_mat", {
+			array_parameter("in", precision_type(single_precision), "mat", nrow*ncol),
+			array_parameter("in", precision_type(single_precision), "diag", nrow),
+			array_parameter("out", precision_type(single_precision), "omat", ncol*ncol) }, views);
+
+		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid, params]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "PARAMETERS", params.declarations() },
+				{ "mat[]", params.subscript("mat") },
+				{ "diag[]", params.subscript("diag") },
+				{ "omat[]", params.subscript("omat") },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
 			"mul_transpose_diag_mat_" + uniqueid,
 			std::vector<size_t>{ size_t(nrow), size_t(ncol), size_t(single_precision) },
 			code_func,
-			std::nullopt
+			std::nullopt,
+			views.empty() ? ViewSpecializer([nrow, ncol, single_precision](const FunctionViews& views) {
+				return mul_transpose_diag_mat(nrow, ncol, single_precision, views);
+				}) : nullptr
 			);
 	}
 
@@ -1638,7 +1643,7 @@ void mul_transpose_diag_mat_UNIQUEID(in float mat[nrow*ncol], in float diag[nrow
 
 	export std::shared_ptr<::glsl::Function> mul_transpose_mat_ldiag(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_transpose_mat_ldiag_UNIQUEID(in float mat[nrow*ncol], float lambda, out float omat[ncol*ncol]) {
 	float entry;
@@ -1664,14 +1669,12 @@ void mul_transpose_mat_ldiag_UNIQUEID(in float mat[nrow*ncol], float lambda, out
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1690,7 +1693,7 @@ void mul_transpose_mat_ldiag_UNIQUEID(in float mat[nrow*ncol], float lambda, out
 
 	export std::shared_ptr<::glsl::Function> mul_transpose_mat_add(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_transpose_mat_add_UNIQUEID(in float mat[nrow*ncol], inout float omat[ncol*ncol]) {
 	float entry;
@@ -1713,14 +1716,12 @@ void mul_transpose_mat_add_UNIQUEID(in float mat[nrow*ncol], inout float omat[nc
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1739,7 +1740,7 @@ void mul_transpose_mat_add_UNIQUEID(in float mat[nrow*ncol], inout float omat[nc
 
 	export std::shared_ptr<::glsl::Function> mul_transpose_mat_add_ldiag(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_transpose_mat_add_ldiag_UNIQUEID(in float mat[nrow*ncol], float lambda, inout float omat[ncol*ncol]) {
 	float entry;
@@ -1765,14 +1766,12 @@ void mul_transpose_mat_add_ldiag_UNIQUEID(in float mat[nrow*ncol], float lambda,
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1789,36 +1788,43 @@ void mul_transpose_mat_add_ldiag_UNIQUEID(in float mat[nrow*ncol], float lambda,
 		return std::to_string(nrow) + "_" + std::to_string(ncol) + "_" + (single_precision ? "S" : "D");
 	}
 
-	export std::shared_ptr<::glsl::Function> mat_set_zero(ui16 nrow, ui16 ncol, bool single_precision)
+	export std::shared_ptr<::glsl::Function> mat_set_zero(ui16 nrow, ui16 ncol, bool single_precision,
+		const FunctionViews& views = {})
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
-void mat_set_zero_UNIQUEID(inout float mat[nrow*ncol]) {
+void mat_set_zero_UNIQUEID(PARAMETERS) {
 	for (int i = 0; i < nrow*ncol; ++i) {
 		mat[i] = 0;
 	}
 }
 )glsl";
 
-		std::string uniqueid = mat_set_zero_uniqueid(nrow, ncol, single_precision);
+		std::string uniqueid = mat_set_zero_uniqueid(nrow, ncol, single_precision) + views_suffix(views);
 
-		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
+		ViewParameters params("mat_set_zero", {
+			array_parameter("inout", precision_type(single_precision), "mat", nrow*ncol) }, views);
+
+		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid, params]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "PARAMETERS", params.declarations() },
+				{ "mat[]", params.subscript("mat") },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
 			"mat_set_zero_" + uniqueid,
 			std::vector<size_t>{ size_t(nrow), size_t(ncol), size_t(single_precision) },
 			code_func,
-			std::nullopt
+			std::nullopt,
+			views.empty() ? ViewSpecializer([nrow, ncol, single_precision](const FunctionViews& views) {
+				return mat_set_zero(nrow, ncol, single_precision, views);
+				}) : nullptr
 		);
 	}
 
@@ -1829,7 +1835,7 @@ void mat_set_zero_UNIQUEID(inout float mat[nrow*ncol]) {
 	}
 
 	export std::shared_ptr<::glsl::Function> mat_set_ones(ui16 nrow, ui16 ncol, bool single_precision) {
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mat_set_ones_UNIQUEID(inout float mat[nrow*ncol]) {
 	for (int i = 0; i < nrow*ncol; ++i) {
@@ -1842,14 +1848,12 @@ void mat_set_ones_UNIQUEID(inout float mat[nrow*ncol]) {
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1868,7 +1872,7 @@ void mat_set_ones_UNIQUEID(inout float mat[nrow*ncol]) {
 
 	export std::shared_ptr<::glsl::Function> transpose_square_i(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void transpose_square_i_UNIQUEID(inout float mat[ndim*ndim]) {
 	for (int i = 1; i < ndim; ++i) {
@@ -1883,13 +1887,12 @@ void transpose_square_i_UNIQUEID(inout float mat[ndim*ndim]) {
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, "SWAPID", swap_uniqueid(single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-				util::replace_all(temp, "ndim", std::to_string(ndim));
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "SWAPID", swap_uniqueid(single_precision) },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1909,7 +1912,7 @@ void transpose_square_i_UNIQUEID(inout float mat[ndim*ndim]) {
 
 	export std::shared_ptr<::glsl::Function> mul_diag_vec_square_i(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_diag_vec_square_i_UNIQUEID(in float mat[ndim*ndim], inout float vec[ndim]) {
 	for (int k = 0; k < ndim; ++k) {
@@ -1922,13 +1925,11 @@ void mul_diag_vec_square_i_UNIQUEID(in float mat[ndim*ndim], inout float vec[ndi
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			if (!single_precision) {
-				util::replace_all(temp, UNIQUE_ID, uniqueid);
-				util::replace_all(temp, "float", "double");
-				util::replace_all(temp, "ndim", std::to_string(ndim));
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -1947,7 +1948,7 @@ void mul_diag_vec_square_i_UNIQUEID(in float mat[ndim*ndim], inout float vec[ndi
 
 	export std::shared_ptr<::glsl::Function> mul_inv_diag_vec_square_i(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_inv_diag_vec_square_i_UNIQUEID(in float mat[ndim*ndim], inout float vec[ndim]) {
 	for (int k = 0; k < ndim; ++k) {
@@ -1960,13 +1961,11 @@ void mul_inv_diag_vec_square_i_UNIQUEID(in float mat[ndim*ndim], inout float vec
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 		
 		return std::make_shared<::glsl::Function>(
@@ -1985,7 +1984,7 @@ void mul_inv_diag_vec_square_i_UNIQUEID(in float mat[ndim*ndim], inout float vec
 
 	export std::shared_ptr<::glsl::Function> mul_mat_mat_square(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_mat_mat_square_UNIQUEID(in float lmat[ndim*ndim], in float rmat[ndim*ndim], inout float omat[ndim*ndim]) {
 	float entry;
@@ -2005,13 +2004,11 @@ void mul_mat_mat_square_UNIQUEID(in float lmat[ndim*ndim], in float rmat[ndim*nd
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -2030,7 +2027,7 @@ void mul_mat_mat_square_UNIQUEID(in float lmat[ndim*ndim], in float rmat[ndim*nd
 
 	export std::shared_ptr<::glsl::Function> mul_unit_lower_upper_square(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_unit_lower_upper_square_UNIQUEID(in float lmat[ndim*ndim], in float rmat[ndim*ndim], inout float omat[ndim*ndim]) {
 	float entry;
@@ -2052,13 +2049,11 @@ void mul_unit_lower_upper_square_UNIQUEID(in float lmat[ndim*ndim], in float rma
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -2077,7 +2072,7 @@ void mul_unit_lower_upper_square_UNIQUEID(in float lmat[ndim*ndim], in float rma
 
 	export std::shared_ptr<::glsl::Function> mul_mat_vec_square(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void mul_mat_vec_square_UNIQUEID(in float lmat[ndim*ndim], in float rvec[ndim], inout float ovec[ndim]) {
 	float entry;
@@ -2095,13 +2090,11 @@ void mul_mat_vec_square_UNIQUEID(in float lmat[ndim*ndim], in float rvec[ndim],
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<::glsl::Function>(
@@ -31,7 +31,7 @@ namespace linalg {
 
 	export std::shared_ptr<::glsl::Function> max_mag(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void max_mag_UNIQUEID(in float mat[nrow*ncol], out int max_row_idx, out int max_col_idx, out float max) {
 	max_row_idx = 0;
@@ -55,14 +55,12 @@ void max_mag_UNIQUEID(in float mat[nrow*ncol], out int max_row_idx, out int max_
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -79,7 +77,7 @@ void max_mag_UNIQUEID(in float mat[nrow*ncol], out int max_row_idx, out int max_
 
 	export std::shared_ptr<::glsl::Function> max_diagonal_abs(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 int max_diagonal_abs_UNIQUEID(in float mat[ndim*ndim], int offset) {
 	float max_abs = -1.0;
@@ -97,13 +95,11 @@ int max_diagonal_abs_UNIQUEID(in float mat[ndim*ndim], int offset) {
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -121,7 +117,7 @@ int max_diagonal_abs_UNIQUEID(in float mat[ndim*ndim], int offset) {
 
 	export std::shared_ptr<::glsl::Function> max_mag_subrow(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void max_mag_subrow_UNIQUEID(in float mat[nrow*ncol], int row, int start_col, out int max_idx, out float max) {
 	max_idx = 0;
@@ -141,14 +137,12 @@ void max_mag_subrow_UNIQUEID(in float mat[nrow*ncol], int row, int start_col, ou
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -166,7 +160,7 @@ void max_mag_subrow_UNIQUEID(in float mat[nrow*ncol], int row, int start_col, ou
 
 	export std::shared_ptr<::glsl::Function> max_mag_subcol(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void max_mag_subcol_UNIQUEID(in float mat[nrow*ncol], int col, int start_row, out int max_idx, out float max) {
 	max_idx = 0;
@@ -186,14 +180,12 @@ void max_mag_subcol_UNIQUEID(in float mat[nrow*ncol], int col, int start_row, ou
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nrow", std::to_string(nrow) },
+				{ "ncol", std::to_string(ncol) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -211,7 +203,7 @@ void max_mag_subcol_UNIQUEID(in float mat[nrow*ncol], int col, int start_row, ou
 
 	export std::shared_ptr<::glsl::Function> row_interchange_i(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void row_interchange_i_UNIQUEID(inout float mat[nrow*ncol], int ii, int jj) {
 	for (int k = 0; k < ncol; ++k) {
@@ -224,15 +216,13 @@ void row_interchange_i_UNIQUEID(inout float mat[nrow*ncol], int ii, int jj) {
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "SWAPID", swap_uniqueid(single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ncol", std::to_string(ncol) },
+				{ "nrow", std::to_string(nrow) },
+				{ "SWAPID", swap_uniqueid(single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -253,7 +243,7 @@ void row_interchange_i_UNIQUEID(inout float mat[nrow*ncol], int ii, int jj) {
 
 	export std::shared_ptr<::glsl::Function> subrow_interchange_i(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 			R"glsl(
 void subrow_interchange_i_UNIQUEID(inout float mat[nrow*ncol], int start_col, int ii, int jj) {
 	for (int k = start_col; k < ncol; ++k) {
@@ -266,15 +256,13 @@ void subrow_interchange_i_UNIQUEID(inout float mat[nrow*ncol], int start_col, in
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "SWAPID", swap_uniqueid(single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ncol", std::to_string(ncol) },
+				{ "nrow", std::to_string(nrow) },
+				{ "SWAPID", swap_uniqueid(single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -293,7 +281,7 @@ void subrow_interchange_i_UNIQUEID(inout float mat[nrow*ncol], int start_col, in
 
 	export std::shared_ptr<::glsl::Function> col_interchange_i(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void col_interchange_i_UNIQUEID(inout float mat[nrow*ncol], int ii, int jj) {
 	for (int k = 0; k < nrow; ++k) {
@@ -306,15 +294,13 @@ void col_interchange_i_UNIQUEID(inout float mat[nrow*ncol], int ii, int jj) {
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "SWAPID", swap_uniqueid(single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ncol", std::to_string(ncol) },
+				{ "nrow", std::to_string(nrow) },
+				{ "SWAPID", swap_uniqueid(single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -333,7 +319,7 @@ void col_interchange_i_UNIQUEID(inout float mat[nrow*ncol], int ii, int jj) {
 
 	export std::shared_ptr<::glsl::Function> subcol_interchange_i(ui16 nrow, ui16 ncol, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void col_interchange_i_UNIQUEID(inout float mat[nrow*ncol], int start_row, int ii, int jj) {
 	for (int k = start_row; k < nrow; ++k) {
@@ -346,15 +332,13 @@ void col_interchange_i_UNIQUEID(inout float mat[nrow*ncol], int start_row, int i
 
 		std::function<std::string()> code_func = [nrow, ncol, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ncol", std::to_string(ncol));
-			util::replace_all(temp, "nrow", std::to_string(nrow));
-			util::replace_all(temp, "SWAPID", swap_uniqueid(single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ncol", std::to_string(ncol) },
+				{ "nrow", std::to_string(nrow) },
+				{ "SWAPID", swap_uniqueid(single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -372,7 +356,7 @@ void col_interchange_i_UNIQUEID(inout float mat[nrow*ncol], int start_row, int i
 	}
 
 	export std::shared_ptr<::glsl::Function> diagonal_pivoting(ui16 ndim, bool single_precision) {
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void diagonal_pivoting_UNIQUEID(inout float mat[ndim*ndim], inout int perm[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -393,16 +377,14 @@ void diagonal_pivoting_UNIQUEID(inout float mat[ndim*ndim], inout int perm[ndim]
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			util::replace_all(temp, "MDAID", linalg::max_diagonal_abs_uniqueid(ndim, single_precision));
-			util::replace_all(temp, "RIIID", linalg::row_interchange_i_uniqueid(ndim, ndim, single_precision));
-			util::replace_all(temp, "CIIID", linalg::col_interchange_i_uniqueid(ndim, ndim, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "MDAID", linalg::max_diagonal_abs_uniqueid(ndim, single_precision) },
+				{ "RIIID", linalg::row_interchange_i_uniqueid(ndim, ndim, single_precision) },
+				{ "CIIID", linalg::col_interchange_i_uniqueid(ndim, ndim, single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -424,7 +406,7 @@ void diagonal_pivoting_UNIQUEID(inout float mat[ndim*ndim], inout int perm[ndim]
 	}
 
 	export std::shared_ptr<::glsl::Function> permute_vec(ui16 ndim, bool single_precision) {
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void permute_vec_UNIQUEID(in float vec[ndim], in int perm[ndim], out float ovec[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -437,13 +419,11 @@ void permute_vec_UNIQUEID(in float vec[ndim], in int perm[ndim], out float ovec[
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -461,7 +441,7 @@ void permute_vec_UNIQUEID(in float vec[ndim], in int perm[ndim], out float ovec[
 	}
 
 	export std::shared_ptr<::glsl::Function> permute_o_vec(ui16 ndim, bool single_precision) {
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void permute_o_vec_UNIQUEID(in float vec[ndim], in int perm[ndim], out float ovec[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -474,13 +454,11 @@ void permute_o_vec_UNIQUEID(in float vec[ndim], in int perm[ndim], out float ove
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
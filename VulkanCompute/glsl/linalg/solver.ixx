@@ -29,7 +29,7 @@ namespace linalg {
 
 	export std::shared_ptr<::glsl::Function> forward_subs(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void forward_subs_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out float solution[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -46,13 +46,11 @@ void forward_subs_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out floa
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -71,7 +69,7 @@ void forward_subs_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out floa
 
 	export std::shared_ptr<::glsl::Function> forward_subs_t(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void forward_subs_t_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out float solution[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -88,13 +86,11 @@ void forward_subs_t_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out fl
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -113,7 +109,7 @@ void forward_subs_t_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out fl
 
 	export std::shared_ptr<::glsl::Function> forward_subs_unit(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void forward_subs_unit_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out float solution[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -129,13 +125,11 @@ void forward_subs_unit_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -154,7 +148,7 @@ void forward_subs_unit_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out
 
 	export std::shared_ptr<::glsl::Function> forward_subs_unit_t(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void forward_subs_unit_t_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out float solution[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -170,13 +164,11 @@ void forward_subs_unit_t_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], o
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -196,7 +188,7 @@ void forward_subs_unit_t_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], o
 
 	export std::shared_ptr<::glsl::Function> forward_subs_diag(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void forward_subs_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim] in float diag[ndim], out float solution[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -213,13 +205,11 @@ void forward_subs_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim] in f
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -238,7 +228,7 @@ void forward_subs_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim] in f
 
 	export std::shared_ptr<::glsl::Function> forward_subs_t_diag(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void forward_subs_t_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], in float diag[ndim], out float solution[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -255,13 +245,11 @@ void forward_subs_t_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], i
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -280,7 +268,7 @@ void forward_subs_t_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], i
 
 	export std::shared_ptr<::glsl::Function> forward_subs_unit_diag(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void forward_subs_unit_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], in float diag[ndim], out float solution[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -297,13 +285,11 @@ void forward_subs_unit_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim]
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -322,7 +308,7 @@ void forward_subs_unit_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim]
 
 	export std::shared_ptr<::glsl::Function> forward_subs_unit_t_diag(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void forward_subs_unit_t_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], in float diag[ndim], out float solution[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -339,13 +325,11 @@ void forward_subs_unit_t_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndi
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -365,7 +349,7 @@ void forward_subs_unit_t_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndi
 
 	export std::shared_ptr<::glsl::Function> forward_subs_unit_diaged(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void forward_subs_unit_diaged_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out float solution[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -382,13 +366,11 @@ void forward_subs_unit_diaged_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndi
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -407,7 +389,7 @@ void forward_subs_unit_diaged_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndi
 
 	export std::shared_ptr<::glsl::Function> forward_subs_unit_t_diaged(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void forward_subs_unit_t_diaged_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out float solution[ndim]) {
 	for (int i = 0; i < ndim; ++i) {
@@ -424,13 +406,11 @@ void forward_subs_unit_t_diaged_UNIQUEID(in float mat[ndim*ndim], in float rhs[n
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -451,7 +431,7 @@ void forward_subs_unit_t_diaged_UNIQUEID(in float mat[ndim*ndim], in float rhs[n
 
 	export std::shared_ptr<::glsl::Function> backward_subs(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void backward_subs_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out float solution[ndim]) {
 	for (int i = ndim - 1; i >= 0; --i) {
@@ -468,13 +448,11 @@ void backward_subs_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out flo
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -493,7 +471,7 @@ void backward_subs_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out flo
 
 	export std::shared_ptr<::glsl::Function> backward_subs_t(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void backward_subs_t_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out float solution[ndim]) {
 	for (int i = ndim - 1; i >= 0; --i) {
@@ -510,13 +488,11 @@ void backward_subs_t_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out f
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -535,7 +511,7 @@ void backward_subs_t_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out f
 
 	export std::shared_ptr<::glsl::Function> backward_subs_unit(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void backward_subs_unit_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out float solution[ndim]) {
 	for (int i = ndim - 1; i >= 0; --i) {
@@ -551,13 +527,11 @@ void backward_subs_unit_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], ou
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -576,7 +550,7 @@ void backward_subs_unit_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], ou
 
 	export std::shared_ptr<::glsl::Function> backward_subs_unit_t(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void backward_subs_unit_t_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out float solution[ndim]) {
 	for (int i = ndim - 1; i >= 0; --i) {
@@ -592,13 +566,11 @@ void backward_subs_unit_t_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim],
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -618,7 +590,7 @@ void backward_subs_unit_t_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim],
 
 	export std::shared_ptr<::glsl::Function> backward_subs_diag(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void backward_subs_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], in float diag[ndim], out float solution[ndim]) {
 	for (int i = ndim - 1; i >= 0; --i) {
@@ -635,13 +607,11 @@ void backward_subs_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], in
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -660,7 +630,7 @@ void backward_subs_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], in
 
 	export std::shared_ptr<::glsl::Function> backward_subs_t_diag(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void backward_subs_t_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], in float diag[ndim], out float solution[ndim]) {
 	for (int i = ndim - 1; i >= 0; --i) {
@@ -677,13 +647,11 @@ void backward_subs_t_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim],
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -702,7 +670,7 @@ void backward_subs_t_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim],
 
 	export std::shared_ptr<::glsl::Function> backward_subs_unit_diag(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void backward_subs_unit_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], in float diag[ndim], out float solution[ndim]) {
 	for (int i = ndim - 1; i >= 0; --i) {
@@ -719,13 +687,11 @@ void backward_subs_unit_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -744,7 +710,7 @@ void backward_subs_unit_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim
 
 	export std::shared_ptr<::glsl::Function> backward_subs_unit_t_diag(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void backward_subs_unit_t_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], in float diag[ndim], out float solution[ndim]) {
 	for (int i = ndim - 1; i >= 0; --i) {
@@ -761,13 +727,11 @@ void backward_subs_unit_t_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[nd
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -787,7 +751,7 @@ void backward_subs_unit_t_diag_UNIQUEID(in float mat[ndim*ndim], in float rhs[nd
 
 	export std::shared_ptr<::glsl::Function> backward_subs_unit_diaged(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void backward_subs_unit_diaged_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out float solution[ndim]) {
 	for (int i = ndim - 1; i >= 0; --i) {
@@ -804,13 +768,11 @@ void backward_subs_unit_diaged_UNIQUEID(in float mat[ndim*ndim], in float rhs[nd
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -829,7 +791,7 @@ void backward_subs_unit_diaged_UNIQUEID(in float mat[ndim*ndim], in float rhs[nd
 
 	export std::shared_ptr<::glsl::Function> backward_subs_unit_t_diaged(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void backward_subs_unit_t_diaged_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], out float solution[ndim]) {
 	for (int i = ndim - 1; i >= 0; --i) {
@@ -846,13 +808,11 @@ void backward_subs_unit_t_diaged_UNIQUEID(in float mat[ndim*ndim], in float rhs[
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -872,7 +832,7 @@ void backward_subs_unit_t_diaged_UNIQUEID(in float mat[ndim*ndim], in float rhs[
 
 	export std::shared_ptr<::glsl::Function> lu(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void lu_UNIQUEID(inout float mat[ndim*ndim], out int pivot[ndim]) {
 	float val;
@@ -903,19 +863,14 @@ void lu_UNIQUEID(inout float mat[ndim*ndim], out int pivot[ndim]) {
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			util::replace_all(temp, "MMSID", max_mag_subrow_uniqueid(ndim, ndim, single_precision));
-			util::replace_all(temp, "RIIID", row_interchange_i_uniqueid(ndim, ndim, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-				util::replace_all(temp, "machine_eps", "1e-15");
-			}
-			else {
-				util::replace_all(temp, "machine_eps", "1e-6");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "MMSID", max_mag_subrow_uniqueid(ndim, ndim, single_precision) },
+				{ "RIIID", row_interchange_i_uniqueid(ndim, ndim, single_precision) },
+				{ "machine_eps", single_precision ? "1e-6" : "1e-15" },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
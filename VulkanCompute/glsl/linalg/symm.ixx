@@ -34,7 +34,7 @@ namespace linalg {
 
 	export std::shared_ptr<Function> ldl(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void ldl_UNIQUEID(inout float mat[ndim*ndim]) {
 	float arr[ndim];
@@ -62,13 +62,11 @@ void ldl_UNIQUEID(inout float mat[ndim*ndim]) {
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -115,7 +113,7 @@ void ldl_UNIQUEID(inout float mat[ndim*ndim]) {
 
 	export std::shared_ptr<Function> gmw81(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void gmw81_UNIQUEID(inout float mat[ndim*ndim]) {
 	float m1 = 0.0;
@@ -187,13 +185,11 @@ void gmw81_UNIQUEID(inout float mat[ndim*ndim]) {
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -238,7 +234,7 @@ void gmw81_UNIQUEID(inout float mat[ndim*ndim]) {
 
 	export std::shared_ptr<Function> ldl_solve(ui16 ndim, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void ldl_solve_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], inout float sol[ndim]) {
 	float arr[ndim];
@@ -252,15 +248,13 @@ void ldl_solve_UNIQUEID(in float mat[ndim*ndim], in float rhs[ndim], inout float
 
 		std::function<std::string()> code_func = [ndim, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndim", std::to_string(ndim));
-			util::replace_all(temp, "FSUDID", linalg::forward_subs_unit_diaged_uniqueid(ndim, single_precision));
-			util::replace_all(temp, "BSUTID", linalg::backward_subs_unit_t_uniqueid(ndim, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndim", std::to_string(ndim) },
+				{ "FSUDID", linalg::forward_subs_unit_diaged_uniqueid(ndim, single_precision) },
+				{ "BSUTID", linalg::backward_subs_unit_t_uniqueid(ndim, single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
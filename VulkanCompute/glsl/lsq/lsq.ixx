@@ -30,7 +30,7 @@ namespace lsq {
 
 	export std::shared_ptr<::glsl::Function> lsq_linear2_lower(vc::ui16 ndata, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void lsq_linear2_lower_UNIQUEID(in float x[ndata], in float y[ndata], int upper_bound, out float param[2]) {
 	float mat[2*2];
@@ -62,15 +62,13 @@ void lsq_linear2_lower_UNIQUEID(in float x[ndata], in float y[ndata], int upper_
 
 		std::function<std::string()> code_func = [ndata, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndata", std::to_string(ndata));
-			util::replace_all(temp, "LID", linalg::ldl_uniqueid(2, single_precision));
-			util::replace_all(temp, "LSID", linalg::ldl_solve_uniqueid(2, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndata", std::to_string(ndata) },
+				{ "LID", linalg::ldl_uniqueid(2, single_precision) },
+				{ "LSID", linalg::ldl_solve_uniqueid(2, single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -92,7 +90,7 @@ void lsq_linear2_lower_UNIQUEID(in float x[ndata], in float y[ndata], int upper_
 
 	export std::shared_ptr<::glsl::Function> lsq_linear2_upper(vc::ui16 ndata, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void lsq_linear2_upper_UNIQUEID(in float x[ndata], in float y[ndata], int lower_bound, out float param[2]) {
 	float mat[2*2];
@@ -124,15 +122,13 @@ void lsq_linear2_upper_UNIQUEID(in float x[ndata], in float y[ndata], int lower_
 
 		std::function<std::string()> code_func = [ndata, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndata", std::to_string(ndata));
-			util::replace_all(temp, "LID", linalg::ldl_uniqueid(2, single_precision));
-			util::replace_all(temp, "LSID", linalg::ldl_solve_uniqueid(2, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndata", std::to_string(ndata) },
+				{ "LID", linalg::ldl_uniqueid(2, single_precision) },
+				{ "LSID", linalg::ldl_solve_uniqueid(2, single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
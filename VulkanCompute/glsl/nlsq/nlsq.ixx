@@ -22,6 +22,7 @@ import permute;
 import variable;
 import function;
 import func_factory;
+import global_view;
 
 export import symbolic;
 export import nlsq_symbolic;
@@ -39,28 +40,39 @@ namespace nlsq {
 		return std::to_string(nparam) + "_" + (single_precision ? "S" : "D");
 	}
 
-	export std::shared_ptr<::glsl::Function> nlsq_gain_ratio(ui16 nparam, bool single_precision)
+	export std::shared_ptr<::glsl::Function> nlsq_gain_ratio(ui16 nparam, bool single_precision,
+		const FunctionViews& views = {})
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
-float nlsq_gain_ratio_UNIQUEID(in float nlstep[nparam], in float neg_gradient[nparam], in float hessian[nparam*nparam], float obj_err, float new_obj_err) {
-	return (obj_err - new_obj_err) / (inner_prod_IPID(nlstep, neg_gradient) - weighted_vec_norm2_WVN2ID(hessian, nlstep));
+float nlsq_gain_ratio_UNIQUEID(PARAMETERS) {
+	return (obj_err - new_obj_err) / (inner_prod_IPID(nlstep, neg_gradient) - weighted_vec_norm2_WVN2ID(WVN2ARGS));
 }
 )glsl";
 
-		std::string uniqueid = nlsq_gain_ratio_uniqueid(nparam, single_precision);
+		std::string uniqueid = nlsq_gain_ratio_uniqueid(nparam, single_precision) + views_suffix(views);
 
-		std::function<std::string()> code_func = [nparam, single_precision, uniqueid]() -> std::string
+		std::string type = precision_type(single_precision);
+		ViewParameters params("nlsq_gain_ratio", {
+			array_parameter("in", type, "nlstep", nparam, false),
+			array_parameter("in", type, "neg_gradient", nparam, false),
+			array_parameter("in", type, "hessian", nparam*nparam),
+			{ type + " obj_err", "obj_err" },
+			{ type + " new_obj_err", "new_obj_err" } }, views);
+
+		auto wvn2_call = params.call({ "hessian", "nlstep" });
+
+		std::function<std::string()> code_func = [nparam, single_precision, uniqueid, params, wvn2_call]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nparam", std::to_string(nparam));
-			util::replace_all(temp, "IPID", linalg::inner_prod_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "WVN2ID", linalg::weighted_vec_norm2_uniqueid(nparam, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "PARAMETERS", params.declarations() },
+				{ "nparam", std::to_string(nparam) },
+				{ "IPID", linalg::inner_prod_uniqueid(nparam, single_precision) },
+				{ "WVN2ID", linalg::weighted_vec_norm2_uniqueid(nparam, single_precision) + views_suffix(wvn2_call.views) },
+				{ "WVN2ARGS", wvn2_call.arguments },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -69,8 +81,11 @@ float nlsq_gain_ratio_UNIQUEID(in float nlstep[nparam], in float neg_gradient[np
 			code_func,
 			std::make_optional<vecptrfunc>({
 				linalg::inner_prod(nparam, single_precision),
-				linalg::weighted_vec_norm2(nparam, single_precision)
-				})
+				linalg::weighted_vec_norm2(nparam, single_precision, wvn2_call.views)
+				}),
+			views.empty() ? ViewSpecializer([nparam, single_precision](const FunctionViews& views) {
+				return nlsq_gain_ratio(nparam, single_precision, views);
+				}) : nullptr
 		);
 	}
 
@@ -132,7 +147,7 @@ float nlsq_gain_ratio_UNIQUEID(in float nlstep[nparam], in float neg_gradient[np
 
 	export std::shared_ptr<::glsl::Function> nlsq_error(ui16 ndata, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 float nlsq_error_UNIQUEID(in float res[ndata]) {
 	return 0.5 * vec_norm2_VN2ID(res);
@@ -143,14 +158,12 @@ float nlsq_error_UNIQUEID(in float res[ndata]) {
 
 		std::function<std::string()> code_func = [ndata, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndata", std::to_string(ndata));
-			util::replace_all(temp, "VN2ID", linalg::vec_norm2_uniqueid(ndata, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndata", std::to_string(ndata) },
+				{ "VN2ID", linalg::vec_norm2_uniqueid(ndata, single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -193,36 +206,46 @@ float nlsq_error_UNIQUEID(in float res[ndata]) {
 		return std::to_string(ndata) + "_" + (single_precision ? "S" : "D");
 	}
 
-	export std::shared_ptr<::glsl::Function> nlsq_weighted_error(ui16 ndata, bool single_precision)
+	export std::shared_ptr<::glsl::Function> nlsq_weighted_error(ui16 ndata, bool single_precision,
+		const FunctionViews& views = {})
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
-float nlsq_weighted_error_UNIQUEID(in float res[ndata], in float weights[ndata]) {
-	return 0.5 * diag_weighted_vec_norm2_VN2ID(weights, res);
+float nlsq_weighted_error_UNIQUEID(PARAMETERS) {
+	return 0.5 * diag_weighted_vec_norm2_VN2ID(VN2ARGS);
 }
 )glsl";
 
-		std::string uniqueid = nlsq_weighted_error_uniqueid(ndata, single_precision);
+		std::string uniqueid = nlsq_weighted_error_uniqueid(ndata, single_precision) + views_suffix(views);
 
-		std::function<std::string()> code_func = [ndata, single_precision, uniqueid]() -> std::string
+		ViewParameters params("nlsq_weighted_error", {
+			array_parameter("in", precision_type(single_precision), "res", ndata),
+			array_parameter("in", precision_type(single_precision), "weights", ndata) }, views);
+
+		auto vn2_call = params.call({ "weights", "res" });
+
+		std::function<std::string()> code_func = [ndata, single_precision, uniqueid, params, vn2_call]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndata", std::to_string(ndata));
-			util::replace_all(temp, "VN2ID", linalg::diag_weighted_vec_norm2_uniqueid(ndata, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "PARAMETERS", params.declarations() },
+				{ "ndata", std::to_string(ndata) },
+				{ "VN2ID", linalg::diag_weighted_vec_norm2_uniqueid(ndata, single_precision) + views_suffix(vn2_call.views) },
+				{ "VN2ARGS", vn2_call.arguments },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
-			"nlsq_error_" + uniqueid,
+			"nlsq_weighted_error_" + uniqueid,
 			std::vector<size_t>{ size_t(ndata), size_t(single_precision) },
 			code_func,
 			std::make_optional<vecptrfunc>({
-				linalg::diag_weighted_vec_norm2(ndata, single_precision)
-				})
+				linalg::diag_weighted_vec_norm2(ndata, single_precision, vn2_call.views)
+				}),
+			views.empty() ? ViewSpecializer([ndata, single_precision](const FunctionViews& views) {
+				return nlsq_weighted_error(ndata, single_precision, views);
+				}) : nullptr
 			);
 	}
 
@@ -269,7 +292,7 @@ float nlsq_weighted_error_UNIQUEID(in float res[ndata], in float weights[ndata])
 
 	export std::shared_ptr<::glsl::Function> nlsq_clamping(ui16 nparam, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 int nlsq_clamping_UNIQUEID(inout float params[nparam], 
 	in float upper_bound[nparam], in float lower_bound[nparam]) 
@@ -293,13 +316,11 @@ int nlsq_clamping_UNIQUEID(inout float params[nparam],
 
 		std::function<std::string()> code_func = [nparam, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "nparam", std::to_string(nparam));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "nparam", std::to_string(nparam) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -358,7 +379,7 @@ int nlsq_clamping_UNIQUEID(inout float params[nparam],
 
 	export std::shared_ptr<::glsl::Function> nlsq_error_convergence(bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 bool nlsq_error_convergence_UNIQUEID(in float error, in float new_error, in float tol) 
 {
@@ -373,12 +394,10 @@ bool nlsq_error_convergence_UNIQUEID(in float error, in float new_error, in floa
 
 		std::function<std::string()> code_func = [single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -408,7 +427,7 @@ bool nlsq_error_convergence_UNIQUEID(in float error, in float new_error, in floa
 		const expression::Expression& expr, const glsl::SymbolicContext& context,
 		vc::ui16 ndata, vc::ui16 nparam, vc::ui16 nconst, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void nlsq_slmj_step_UNIQUEID(
 	inout float params[nparam], in float consts[ndata*nconst], in float data[ndata],
@@ -480,40 +499,41 @@ void nlsq_slmj_step_UNIQUEID(
 
 		size_t hashed_expr = std::hash<std::string>()(expr.get_expression());
 
+		// the function code is rendered lazily, the lambda only holds a handle to the expression
+		auto shared_expr = std::make_shared<const expression::Expression>(expr);
+
 		std::function<std::string()> code_func =
-			[expr, context, ndata, nparam, nconst, single_precision, uniqueid]() -> std::string
+			[shared_expr, context, ndata, nparam, nconst, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndata", std::to_string(ndata));
-			util::replace_all(temp, "nparam", std::to_string(nparam));
-			util::replace_all(temp, "nconst", std::to_string(nconst));
-
-			util::replace_all(temp, "STEP_TYPE_STEP", std::to_string(static_cast<int>(StepType::STEP)));
-			util::replace_all(temp, "STEP_TYPE_DECREASED", std::to_string(static_cast<int>(StepType::DAMPING_DECREASED)));
-			util::replace_all(temp, "STEP_TYPE_NOSTEP", std::to_string(static_cast<int>(StepType::NO_STEP)));
-			util::replace_all(temp, "STEP_TYPE_INCREASED", std::to_string(static_cast<int>(StepType::DAMPING_INCREASED)));
-
-			util::replace_all(temp, "NRJID", nlsq_residuals_jacobian_uniqueid(expr,
-				context, ndata, nparam, nconst, single_precision));
-			util::replace_all(temp, "MTMID", mul_transpose_mat_uniqueid(ndata, nparam, single_precision));
-			util::replace_all(temp, "MALID", mat_add_ldiag_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "DPID", diagonal_pivoting_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "G81ID", gmw81_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "MTVID", mul_transpose_vec_uniqueid(ndata, nparam, single_precision));
-			util::replace_all(temp, "VNID", vec_neg_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "PVID", permute_vec_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "LSID", ldl_solve_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "POVID", permute_o_vec_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "AVVID", add_vec_vec_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "NEID", nlsq_error_uniqueid(ndata, single_precision));
-			util::replace_all(temp, "NRID", nlsq_residuals_uniqueid(expr,
-				context, ndata, nparam, nconst, single_precision));
-			util::replace_all(temp, "NGRID", nlsq_gain_ratio_uniqueid(nparam, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndata", std::to_string(ndata) },
+				{ "nparam", std::to_string(nparam) },
+				{ "nconst", std::to_string(nconst) },
+
+				{ "STEP_TYPE_STEP", std::to_string(static_cast<int>(StepType::STEP)) },
+				{ "STEP_TYPE_DECREASED", std::to_string(static_cast<int>(StepType::DAMPING_DECREASED)) },
+				{ "STEP_TYPE_NOSTEP", std::to_string(static_cast<int>(StepType::NO_STEP)) },
+				{ "STEP_TYPE_INCREASED", std::to_string(static_cast<int>(StepType::DAMPING_INCREASED)) },
+
+				{ "NRJID", nlsq_residuals_jacobian_uniqueid(*shared_expr,
+					context, ndata, nparam, nconst, single_precision) },
+				{ "MTMID", mul_transpose_mat_uniqueid(ndata, nparam, single_precision) },
+				{ "MALID", mat_add_ldiag_uniqueid(nparam, single_precision) },
+				{ "DPID", diagonal_pivoting_uniqueid(nparam, single_precision) },
+				{ "G81ID", gmw81_uniqueid(nparam, single_precision) },
+				{ "MTVID", mul_transpose_vec_uniqueid(ndata, nparam, single_precision) },
+				{ "VNID", vec_neg_uniqueid(nparam, single_precision) },
+				{ "PVID", permute_vec_uniqueid(nparam, single_precision) },
+				{ "LSID", ldl_solve_uniqueid(nparam, single_precision) },
+				{ "POVID", permute_o_vec_uniqueid(nparam, single_precision) },
+				{ "AVVID", add_vec_vec_uniqueid(nparam, single_precision) },
+				{ "NEID", nlsq_error_uniqueid(ndata, single_precision) },
+				{ "NRID", nlsq_residuals_uniqueid(*shared_expr,
+					context, ndata, nparam, nconst, single_precision) },
+				{ "NGRID", nlsq_gain_ratio_uniqueid(nparam, single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -633,7 +653,7 @@ void nlsq_slmj_step_UNIQUEID(
 		const expression::Expression& expr, const glsl::SymbolicContext& context,
 		vc::ui16 ndata, vc::ui16 nparam, vc::ui16 nconst, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 float nlsq_slmh_step_UNIQUEID(
 	inout float params[nparam], in float consts[ndata*nconst], in float data[ndata],
@@ -699,38 +719,38 @@ float nlsq_slmh_step_UNIQUEID(
 
 		size_t hashed_expr = std::hash<std::string>()(expr.get_expression());
 
+		auto shared_expr = std::make_shared<const expression::Expression>(expr);
+
 		std::function<std::string()> code_func =
-			[expr, context, ndata, nparam, nconst, single_precision, uniqueid]() -> std::string
+			[shared_expr, context, ndata, nparam, nconst, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndata", std::to_string(ndata));
-			util::replace_all(temp, "nparam", std::to_string(nparam));
-			util::replace_all(temp, "nconst", std::to_string(nconst));
-
-			util::replace_all(temp, "STEP_TYPE_STEP", std::to_string(static_cast<int>(StepType::STEP)));
-			util::replace_all(temp, "STEP_TYPE_DECREASED", std::to_string(static_cast<int>(StepType::DAMPING_DECREASED)));
-			util::replace_all(temp, "STEP_TYPE_NOSTEP", std::to_string(static_cast<int>(StepType::NO_STEP)));
-			util::replace_all(temp, "STEP_TYPE_INCREASED", std::to_string(static_cast<int>(StepType::DAMPING_INCREASED)));
-
-			util::replace_all(temp, "NRJHLID", nlsq_residuals_jacobian_hessian_l_uniqueid(expr, 
-				context, ndata, nparam, nconst, single_precision));
-			util::replace_all(temp, "DPID", diagonal_pivoting_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "G81ID", gmw81_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "MTVID", mul_transpose_vec_uniqueid(ndata, nparam, single_precision));
-			util::replace_all(temp, "VNID", vec_neg_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "PVID", permute_vec_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "LSID", ldl_solve_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "POVID", permute_o_vec_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "AVVID", add_vec_vec_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "NEID", nlsq_error_uniqueid(ndata, single_precision));
-			util::replace_all(temp, "NRID", nlsq_residuals_uniqueid(expr,
-				context, ndata, nparam, nconst, single_precision));
-			util::replace_all(temp, "NGRID", nlsq_gain_ratio_uniqueid(nparam, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndata", std::to_string(ndata) },
+				{ "nparam", std::to_string(nparam) },
+				{ "nconst", std::to_string(nconst) },
+
+				{ "STEP_TYPE_STEP", std::to_string(static_cast<int>(StepType::STEP)) },
+				{ "STEP_TYPE_DECREASED", std::to_string(static_cast<int>(StepType::DAMPING_DECREASED)) },
+				{ "STEP_TYPE_NOSTEP", std::to_string(static_cast<int>(StepType::NO_STEP)) },
+				{ "STEP_TYPE_INCREASED", std::to_string(static_cast<int>(StepType::DAMPING_INCREASED)) },
+
+				{ "NRJHLID", nlsq_residuals_jacobian_hessian_l_uniqueid(*shared_expr, 
+					context, ndata, nparam, nconst, single_precision) },
+				{ "DPID", diagonal_pivoting_uniqueid(nparam, single_precision) },
+				{ "G81ID", gmw81_uniqueid(nparam, single_precision) },
+				{ "MTVID", mul_transpose_vec_uniqueid(ndata, nparam, single_precision) },
+				{ "VNID", vec_neg_uniqueid(nparam, single_precision) },
+				{ "PVID", permute_vec_uniqueid(nparam, single_precision) },
+				{ "LSID", ldl_solve_uniqueid(nparam, single_precision) },
+				{ "POVID", permute_o_vec_uniqueid(nparam, single_precision) },
+				{ "AVVID", add_vec_vec_uniqueid(nparam, single_precision) },
+				{ "NEID", nlsq_error_uniqueid(ndata, single_precision) },
+				{ "NRID", nlsq_residuals_uniqueid(*shared_expr,
+					context, ndata, nparam, nconst, single_precision) },
+				{ "NGRID", nlsq_gain_ratio_uniqueid(nparam, single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -853,24 +873,20 @@ float nlsq_slmh_step_UNIQUEID(
 
 	export std::shared_ptr<::glsl::Function> nlsq_slmh_w_step(
 		const expression::Expression& expr, const glsl::SymbolicContext& context,
-		vc::ui16 ndata, vc::ui16 nparam, vc::ui16 nconst, bool single_precision)
+		vc::ui16 ndata, vc::ui16 nparam, vc::ui16 nconst, bool single_precision,
+		const FunctionViews& views = {})
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
-float nlsq_slmh_w_step_UNIQUEID(
-	inout float params[nparam], in float consts[ndata*nconst], in float data[ndata], in float weights[ndata],
-	inout float lambda, inout int step_type, float mu, float eta, float acc, float dec,
-	inout float nlstep[nparam], inout float error, inout float new_error,
-	inout float residuals[ndata], inout float jacobian[ndata*nparam], 
-	inout float hessian[nparam*nparam], inout float lambda_hessian[nparam*nparam]) 
+float nlsq_slmh_w_step_UNIQUEID(PARAMETERS) 
 {
-	nlsq_residuals_jacobian_hessian_lw_NRJHLID(params, consts, data, weights, lambda, residuals, jacobian, hessian, lambda_hessian);
+	nlsq_residuals_jacobian_hessian_lw_NRJHLID(NRJHLARGS);
 	int perm[nparam];
 	diagonal_pivoting_DPID(lambda_hessian, perm);
 	gmw81_G81ID(lambda_hessian);
 	
 	float gradient[nparam];
-	mul_transpose_diag_vec_MTVID(jacobian, weights, residuals, gradient);
+	mul_transpose_diag_vec_MTVID(MTVARGS);
 	vec_neg_VNID(gradient);
 	
 	float steplike[nparam];
@@ -882,14 +898,14 @@ float nlsq_slmh_w_step_UNIQUEID(
 
 	add_vec_vec_AVVID(params, nlstep, steplike);
 	
-	error = nlsq_weighted_error_NWEID(residuals, weights);
+	error = nlsq_weighted_error_NWERID(NWERARGS);
 
 	float new_residuals[ndata];
 	nlsq_residuals_NRID(steplike, consts, data, new_residuals);
 
 	new_error = nlsq_weighted_error_NWEID(new_residuals, weights);
 
-	float gain_ratio = nlsq_gain_ratio_NGRID(nlstep, gradient, hessian, error, new_error);
+	float gain_ratio = nlsq_gain_ratio_NGRID(NGRARGS);
 	
 	step_type = 0;
 	if (new_error < error && gain_ratio > mu) {
@@ -917,42 +933,77 @@ float nlsq_slmh_w_step_UNIQUEID(
 		using namespace glsl::linalg;
 		using namespace glsl::nlsq;
 
-		std::string uniqueid = nlsq_slmh_w_step_uniqueid(expr, context, ndata, nparam, nconst, single_precision);
+		std::string uniqueid = nlsq_slmh_w_step_uniqueid(expr, context, ndata, nparam, nconst, single_precision) +
+			views_suffix(views);
 
 		size_t hashed_expr = std::hash<std::string>()(expr.get_expression());
 
+		auto shared_expr = std::make_shared<const expression::Expression>(expr);
+
+		// the residuals, jacobian and hessian are only passed on, so they may be views
+		std::string type = precision_type(single_precision);
+		ViewParameters params("nlsq_slmh_w_step", {
+			array_parameter("inout", type, "params", nparam, false),
+			array_parameter("in", type, "consts", ndata*nconst, false),
+			array_parameter("in", type, "data", ndata, false),
+			array_parameter("in", type, "weights", ndata, false),
+			{ "inout " + type + " lambda", "lambda" },
+			{ "inout int step_type", "step_type" },
+			{ type + " mu", "mu" },
+			{ type + " eta", "eta" },
+			{ type + " acc", "acc" },
+			{ type + " dec", "dec" },
+			array_parameter("inout", type, "nlstep", nparam, false),
+			{ "inout " + type + " error", "error" },
+			{ "inout " + type + " new_error", "new_error" },
+			array_parameter("inout", type, "residuals", ndata),
+			array_parameter("inout", type, "jacobian", ndata*nparam),
+			array_parameter("inout", type, "hessian", nparam*nparam),
+			array_parameter("inout", type, "lambda_hessian", nparam*nparam, false) }, views);
+
+		auto nrjhl_call = params.call({ "params", "consts", "data", "weights", "lambda",
+			"residuals", "jacobian", "hessian", "lambda_hessian" });
+		auto mtv_call = params.call({ "jacobian", "weights", "residuals", "gradient" });
+		auto nwer_call = params.call({ "residuals", "weights" });
+		auto ngr_call = params.call({ "nlstep", "gradient", "hessian", "error", "new_error" });
+
 		std::function<std::string()> code_func =
-			[expr, context, ndata, nparam, nconst, single_precision, uniqueid]() -> std::string
+			[shared_expr, context, ndata, nparam, nconst, single_precision, uniqueid, params,
+			nrjhl_call, mtv_call, nwer_call, ngr_call]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndata", std::to_string(ndata));
-			util::replace_all(temp, "nparam", std::to_string(nparam));
-			util::replace_all(temp, "nconst", std::to_string(nconst));
-
-			util::replace_all(temp, "STEP_TYPE_STEP", std::to_string(static_cast<int>(StepType::STEP)));
-			util::replace_all(temp, "STEP_TYPE_DECREASED", std::to_string(static_cast<int>(StepType::DAMPING_DECREASED)));
-			util::replace_all(temp, "STEP_TYPE_NOSTEP", std::to_string(static_cast<int>(StepType::NO_STEP)));
-			util::replace_all(temp, "STEP_TYPE_INCREASED", std::to_string(static_cast<int>(StepType::DAMPING_INCREASED)));
-
-			util::replace_all(temp, "NRJHLID", nlsq_residuals_jacobian_hessian_lw_uniqueid(expr,
-				context, ndata, nparam, nconst, single_precision));
-			util::replace_all(temp, "DPID", diagonal_pivoting_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "G81ID", gmw81_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "MTVID", mul_transpose_diag_vec_uniqueid(ndata, nparam, single_precision));
-			util::replace_all(temp, "VNID", vec_neg_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "PVID", permute_vec_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "LSID", ldl_solve_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "POVID", permute_o_vec_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "AVVID", add_vec_vec_uniqueid(nparam, single_precision));
-			util::replace_all(temp, "NWEID", nlsq_weighted_error_uniqueid(ndata, single_precision));
-			util::replace_all(temp, "NRID", nlsq_residuals_uniqueid(expr,
-				context, ndata, nparam, nconst, single_precision));
-			util::replace_all(temp, "NGRID", nlsq_gain_ratio_uniqueid(nparam, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "PARAMETERS", params.declarations() },
+				{ "ndata", std::to_string(ndata) },
+				{ "nparam", std::to_string(nparam) },
+				{ "nconst", std::to_string(nconst) },
+
+				{ "STEP_TYPE_STEP", std::to_string(static_cast<int>(StepType::STEP)) },
+				{ "STEP_TYPE_DECREASED", std::to_string(static_cast<int>(StepType::DAMPING_DECREASED)) },
+				{ "STEP_TYPE_NOSTEP", std::to_string(static_cast<int>(StepType::NO_STEP)) },
+				{ "STEP_TYPE_INCREASED", std::to_string(static_cast<int>(StepType::DAMPING_INCREASED)) },
+
+				{ "NRJHLID", nlsq_residuals_jacobian_hessian_lw_uniqueid(*shared_expr,
+					context, ndata, nparam, nconst, single_precision) + views_suffix(nrjhl_call.views) },
+				{ "NRJHLARGS", nrjhl_call.arguments },
+				{ "DPID", diagonal_pivoting_uniqueid(nparam, single_precision) },
+				{ "G81ID", gmw81_uniqueid(nparam, single_precision) },
+				{ "MTVID", mul_transpose_diag_vec_uniqueid(ndata, nparam, single_precision) + views_suffix(mtv_call.views) },
+				{ "MTVARGS", mtv_call.arguments },
+				{ "VNID", vec_neg_uniqueid(nparam, single_precision) },
+				{ "PVID", permute_vec_uniqueid(nparam, single_precision) },
+				{ "LSID", ldl_solve_uniqueid(nparam, single_precision) },
+				{ "POVID", permute_o_vec_uniqueid(nparam, single_precision) },
+				{ "AVVID", add_vec_vec_uniqueid(nparam, single_precision) },
+				{ "NWEID", nlsq_weighted_error_uniqueid(ndata, single_precision) },
+				{ "NWERID", nlsq_weighted_error_uniqueid(ndata, single_precision) + views_suffix(nwer_call.views) },
+				{ "NWERARGS", nwer_call.arguments },
+				{ "NRID", nlsq_residuals_uniqueid(*shared_expr,
+					context, ndata, nparam, nconst, single_precision) },
+				{ "NGRID", nlsq_gain_ratio_uniqueid(nparam, single_precision) + views_suffix(ngr_call.views) },
+				{ "NGRARGS", ngr_call.arguments },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -961,20 +1012,24 @@ float nlsq_slmh_w_step_UNIQUEID(
 			code_func,
 			std::make_optional<vecptrfunc>({
 				nlsq_residuals_jacobian_hessian_lw(expr, context,
-					ndata, nparam, nconst, single_precision),
+					ndata, nparam, nconst, single_precision, nrjhl_call.views),
 				diagonal_pivoting(nparam, single_precision),
 				gmw81(nparam, single_precision),
-				mul_transpose_diag_vec(ndata, nparam, single_precision),
+				mul_transpose_diag_vec(ndata, nparam, single_precision, mtv_call.views),
 				vec_neg(nparam, single_precision),
 				permute_vec(nparam, single_precision),
 				ldl_solve(nparam, single_precision),
 				permute_o_vec(nparam, single_precision),
 				add_vec_vec(nparam, single_precision),
+				nlsq_weighted_error(ndata, single_precision, nwer_call.views),
 				nlsq_weighted_error(ndata, single_precision),
 				nlsq_residuals(expr, context,
 					ndata, nparam, nconst, single_precision),
-				nlsq_gain_ratio(nparam, single_precision)
-				})
+				nlsq_gain_ratio(nparam, single_precision, ngr_call.views)
+				}),
+			views.empty() ? ViewSpecializer([shared_expr, context, ndata, nparam, nconst, single_precision](const FunctionViews& views) {
+				return nlsq_slmh_w_step(*shared_expr, context, ndata, nparam, nconst, single_precision, views);
+				}) : nullptr
 			);
 	}
 
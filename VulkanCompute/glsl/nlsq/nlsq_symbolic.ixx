@@ -12,15 +12,21 @@ import <string>;
 import <functional>;
 import <vector>;
 import <memory>;
+import <utility>;
 
 import vc;
 import util;
 import linalg;
 import symbolic;
+import cse;
+import dag;
+import derivative_cache;
+import forward_ad;
 export import expr;
 export import glsl;
 export import variable;
 export import function;
+import global_view;
 
 namespace glsl {
 namespace nlsq {
@@ -30,6 +36,109 @@ namespace nlsq {
 	using vecptrfunc = std::vector<std::shared_ptr<Function>>;
 	using refvecptrfunc = refw<std::vector<std::shared_ptr<Function>>>;
 
+	// statements of the per data point loop of the symbolic generators
+	export struct SymbolicStatements {
+		std::string subexpressions;
+		std::string residuals;
+		std::string jacobian;
+		std::string hessian;
+	};
+
+	// The residual, its first derivatives if order > 0 and its second derivatives if order > 1. Subexpressions
+	// shared between them, such as the exponentials of a multi-exponential model, are hoisted into temporaries
+	// that are evaluated once per data point. hessian_weight is put in front of the second order terms. The
+	// statements are valid GLSL or C++ depending on syntax, the cpu kernels reuse them
+	export SymbolicStatements symbolic_statements(const expression::Expression& expr, const glsl::SymbolicContext& context,
+		ui16 nparam, ui16 nconst, bool single_precision, int order, const std::string& hessian_weight = "",
+		expression::CodeSyntax syntax = expression::CodeSyntax::GLSL)
+	{
+		// the template does not rescan the inserted expressions, so they index consts with the value of nconst
+		SymbolicContext sized_context = context;
+		sized_context.nconst_name = std::to_string(nconst);
+
+		// row and column of the nonzero second derivatives
+		std::vector<std::pair<int, int>> hessian_entries;
+		expression::EliminatedSubexpressions eliminated;
+
+		if (context.derivative_mode == DerivativeMode::FORWARD_AD && order > 0) {
+			// every second derivative is produced, the ones that vanish are printed as 0
+			if (order > 1) {
+				for (int i = 0; i < nparam; ++i) {
+					for (int j = 0; j <= i; ++j) {
+						hessian_entries.emplace_back(i, j);
+					}
+				}
+			}
+			eliminated = expression::forward_mode_derivatives(expr, sized_context, order, single_precision, syntax);
+		}
+		else {
+			auto& derivatives = expression::derivative_cache();
+
+			// the cache owns the derivatives, they are shared rather than copied
+			std::vector<std::shared_ptr<const expression::Expression>> derivs;
+			std::vector<const expression::Expression*> exprs = { &expr };
+
+			if (order > 0) {
+				for (int i = 0; i < nparam; ++i) {
+					derivs.emplace_back(derivatives.diff(expr, context.get_params_name(i)));
+					exprs.push_back(derivs.back().get());
+				}
+			}
+
+			if (order > 1) {
+				for (int i = 0; i < nparam; ++i) {
+					for (int j = 0; j <= i; ++j) {
+						auto diff2 = derivatives.diff2(expr, context.get_params_name(i), context.get_params_name(j));
+						if (diff2->is_zero())
+							continue;
+						hessian_entries.emplace_back(i, j);
+						exprs.push_back(diff2.get());
+						derivs.emplace_back(std::move(diff2));
+					}
+				}
+			}
+
+			eliminated = expression::eliminate_common_subexpressions(exprs, sized_context, single_precision, syntax);
+		}
+
+		SymbolicStatements ret;
+
+		std::string type = precision_type(single_precision);
+		for (auto& temp : eliminated.temporaries) {
+			ret.subexpressions += "\t\t" + type + " " + temp.first + " = " + temp.second + ";\n";
+		}
+
+		ret.residuals = "\t\tresiduals[i] = " + eliminated.expressions[0] + " - data[i];\n";
+
+		if (order > 0) {
+			for (int i = 0; i < nparam; ++i) {
+				ret.jacobian += "\t\tjacobian[i*" + std::to_string(nparam) + "+" + std::to_string(i) +
+					"] = " + eliminated.expressions[1 + i] + ";\n";
+			}
+		}
+
+		// forward mode prints vanishing derivatives as 0, the simplifier prints a zero literal
+		std::string zero_literal = expression::number_literal(0.0, single_precision, syntax);
+		for (int k = 0; k < hessian_entries.size(); ++k) {
+			auto [i, j] = hessian_entries[k];
+			// the simplifier can cancel terms the symbolic zero test did not
+			auto& code = eliminated.expressions[1 + nparam + k];
+			if (code == "0" || code == zero_literal)
+				continue;
+			ret.hessian += "\t\thessian[" + std::to_string(i) + "*" + std::to_string(nparam) + "+" +
+				std::to_string(j) + "] += residuals[i] * " + hessian_weight + eliminated.expressions[1 + nparam + k] + ";\n";
+		}
+
+		return ret;
+	}
+
+	// the forward mode generators and the unsimplified expressions are different code for the same expression
+	std::string codegen_suffix(const glsl::SymbolicContext& context)
+	{
+		return std::string(context.derivative_mode == DerivativeMode::FORWARD_AD ? "_ad" : "") +
+			(context.simplify ? "" : "_nosimp");
+	}
+
 	// residuals
 	export std::string nlsq_residuals_uniqueid(
 		const expression::Expression& expr, const glsl::SymbolicContext& context,
@@ -43,10 +152,13 @@ namespace nlsq {
 		const expression::Expression& expr, const glsl::SymbolicContext& context, 
 		ui16 ndata, ui16 nparam, ui16 nconst, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void nlsq_residuals_UNIQUEID(in float params[nparam], in float consts[ndata*nconst], in float data[ndata], out float residuals[ndata]) {
 	for (int i = 0; i < ndata; ++i) {
+		// shared subexpressions
+SUBEXPRESSIONS
+		// eval
 RESIDUAL_EXPRESSION
 	}
 }
@@ -54,23 +166,22 @@ RESIDUAL_EXPRESSION
 
 		size_t hashed_expr = std::hash<std::string>()(expr.get_expression());
 
-		std::string uniqueid = nlsq_residuals_uniqueid(expr, context, ndata, nparam, nconst, single_precision);
+		auto statements = symbolic_statements(expr, context, nparam, nconst, single_precision, 0);
 
-		std::string resexpr = "\t\tresiduals[i] = " + expr.glsl_str(context) + " - data[i];\n";
+		std::string uniqueid = nlsq_residuals_uniqueid(expr, context, ndata, nparam, nconst, single_precision);
 
-		std::function<std::string()> code_func = 
-			[ndata, nparam, nconst, resexpr, single_precision, uniqueid]() -> std::string
+		std::function<std::string()> code_func =
+			[ndata, nparam, nconst, statements, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "RESIDUAL_EXPRESSION", resexpr);
-			util::replace_all(temp, "ndata", std::to_string(ndata));
-			util::replace_all(temp, "nparam", std::to_string(nparam));
-			util::replace_all(temp, "nconst", std::to_string(nconst));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "SUBEXPRESSIONS", statements.subexpressions },
+				{ "RESIDUAL_EXPRESSION", statements.residuals },
+				{ "ndata", std::to_string(ndata) },
+				{ "nparam", std::to_string(nparam) },
+				{ "nconst", std::to_string(nconst) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -135,14 +246,15 @@ RESIDUAL_EXPRESSION
 		ui16 ndata, ui16 nparam, ui16 nconst, bool single_precision)
 	{
 		size_t hashed_expr = std::hash<std::string>()(expr.get_expression());
-		return std::to_string(ndata) + "_" + std::to_string(nparam) + "_" + std::to_string(nconst) + "_" + util::stupid_compress(hashed_expr);
+		return std::to_string(ndata) + "_" + std::to_string(nparam) + "_" + std::to_string(nconst) + "_" + util::stupid_compress(hashed_expr) +
+			codegen_suffix(context);
 	}
 
 	export std::shared_ptr<::glsl::Function> nlsq_residuals_jacobian(
 		const expression::Expression& expr, const glsl::SymbolicContext& context,
 		ui16 ndata, ui16 nparam, ui16 nconst, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void nlsq_residuals_jacobian_UNIQUEID(
 	in float params[nparam],
@@ -152,6 +264,8 @@ void nlsq_residuals_jacobian_UNIQUEID(
 	out float jacobian[ndata*nparam]) {
 	
 	for (int i = 0; i < ndata; ++i) {
+		// shared subexpressions
+SUBEXPRESSIONS
 		// eval
 RESIDUAL_EXPRESSIONS
 		// jacobian
@@ -163,36 +277,23 @@ JACOBIAN_EXPRESSIONS
 
 		size_t hashed_expr = std::hash<std::string>()(expr.get_expression());
 
-		// residuals
-		std::string resexpr = "\t\tresiduals[i] = " + expr.glsl_str(context) + " - data[i];\n";
+		auto statements = symbolic_statements(expr, context, nparam, nconst, single_precision, 1);
 
-		// jacobian
-		std::string jacexpr = "";
-		for (int i = 0; i < nparam; ++i) {
-			std::string diff_symbol = context.get_params_name(i);
-			auto diff1 = expr.diff(diff_symbol);
-			std::string jexpr = diff1->glsl_str(context);
-			std::string partj = "\t\tjacobian[i*" + std::to_string(nparam) + "+" + std::to_string(i) +
-				"] = " + jexpr + ";\n";
-			jacexpr += partj;
-		}
-	
 		std::string uniqueid = nlsq_residuals_jacobian_uniqueid(expr, context, ndata, nparam, nconst, single_precision);
 
 		std::function<std::string()> code_func =
-			[ndata, nparam, nconst, resexpr, jacexpr, single_precision, uniqueid]() -> std::string
+			[ndata, nparam, nconst, statements, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "RESIDUAL_EXPRESSIONS", resexpr);
-			util::replace_all(temp, "JACOBIAN_EXPRESSIONS", jacexpr);
-			util::replace_all(temp, "ndata", std::to_string(ndata));
-			util::replace_all(temp, "nparam", std::to_string(nparam));
-			util::replace_all(temp, "nconst", std::to_string(nconst));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "SUBEXPRESSIONS", statements.subexpressions },
+				{ "RESIDUAL_EXPRESSIONS", statements.residuals },
+				{ "JACOBIAN_EXPRESSIONS", statements.jacobian },
+				{ "ndata", std::to_string(ndata) },
+				{ "nparam", std::to_string(nparam) },
+				{ "nconst", std::to_string(nconst) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -263,14 +364,15 @@ JACOBIAN_EXPRESSIONS
 		ui16 ndata, ui16 nparam, ui16 nconst, bool single_precision)
 	{
 		size_t hashed_expr = std::hash<std::string>()(expr.get_expression());
-		return std::to_string(ndata) + "_" + std::to_string(nparam) + "_" + std::to_string(nconst) + "_" + util::stupid_compress(hashed_expr);
+		return std::to_string(ndata) + "_" + std::to_string(nparam) + "_" + std::to_string(nconst) + "_" + util::stupid_compress(hashed_expr) +
+			codegen_suffix(context);
 	}
 
 	export std::shared_ptr<::glsl::Function> nlsq_residuals_jacobian_hessian(
 		const expression::Expression& expr, const glsl::SymbolicContext& context, 
 		ui16 ndata, ui16 nparam, ui16 nconst, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void nlsq_residuals_jacobian_hessian_UNIQUEID(
 	in float params[nparam],
@@ -281,6 +383,8 @@ void nlsq_residuals_jacobian_hessian_UNIQUEID(
 	out float hessian[nparam*nparam]) {
 	
 	for (int i = 0; i < ndata; ++i) {
+		// shared subexpressions
+SUBEXPRESSIONS
 		// eval
 RESIDUAL_EXPRESSIONS
 		// jacobian
@@ -304,58 +408,25 @@ HESSIAN_EXPRESSIONS
 
 		size_t hashed_expr = std::hash<std::string>()(expr.get_expression());
 
-		// residuals
-		std::string resexpr = "\t\tresiduals[i] = " + expr.glsl_str(context) + " - data[i];\n";
-
-		// jacobian
-		std::string jacexpr = "";
-		for (int i = 0; i < nparam; ++i) {
-			std::string diff_symbol = context.get_params_name(i);
-			auto diff1 = expr.diff(diff_symbol);
-			std::string jexpr = diff1->glsl_str(context);
-			std::string partj = "\t\tjacobian[i*" + std::to_string(nparam) + "+" + std::to_string(i) + 
-				"] = " + jexpr + ";\n";
-			jacexpr += partj;
-		}
-
-		// hessian
-		std::string hesexpr = "";
-		int k = 0;
-		for (int i = 0; i < nparam; ++i) {
-			auto diff_symbol1 = context.get_params_name(i);
-			auto diff1 = expr.diff(diff_symbol1);
-			for (int j = 0; j <= i; ++j) {
-				std::string diff_symbol2 = context.get_params_name(j);
-				auto diff2 = diff1->diff(diff_symbol2);
-				if (diff2->is_zero())
-					continue;
-				std::string hexpr = diff2->glsl_str(context);
-				std::string parth = "\t\thessian[" + std::to_string(i) + "*" + std::to_string(nparam) + "+" + 
-					std::to_string(j) + "] += residuals[i] * " + hexpr + ";\n";
-				hesexpr += parth;
-
-				++k;
-			}
-		}
+		auto statements = symbolic_statements(expr, context, nparam, nconst, single_precision, 2);
 
 		std::string uniqueid = nlsq_residuals_jacobian_hessian_uniqueid(expr, context, ndata, nparam, nconst, single_precision);
 
 		std::function<std::string()> code_func =
-			[ndata, nparam, nconst, resexpr, jacexpr, hesexpr, single_precision, uniqueid]() -> std::string
+			[ndata, nparam, nconst, statements, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "RESIDUAL_EXPRESSIONS", resexpr);
-			util::replace_all(temp, "JACOBIAN_EXPRESSIONS", jacexpr);
-			util::replace_all(temp, "HESSIAN_EXPRESSIONS", hesexpr);
-			util::replace_all(temp, "ndata", std::to_string(ndata));
-			util::replace_all(temp, "nparam", std::to_string(nparam));
-			util::replace_all(temp, "nconst", std::to_string(nconst));
-			util::replace_all(temp, "MTMAID", linalg::mul_transpose_mat_add_uniqueid(ndata, nparam, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "SUBEXPRESSIONS", statements.subexpressions },
+				{ "RESIDUAL_EXPRESSIONS", statements.residuals },
+				{ "JACOBIAN_EXPRESSIONS", statements.jacobian },
+				{ "HESSIAN_EXPRESSIONS", statements.hessian },
+				{ "ndata", std::to_string(ndata) },
+				{ "nparam", std::to_string(nparam) },
+				{ "nconst", std::to_string(nconst) },
+				{ "MTMAID", linalg::mul_transpose_mat_add_uniqueid(ndata, nparam, single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 		
 		return std::make_shared<Function>(
@@ -438,14 +509,15 @@ HESSIAN_EXPRESSIONS
 		ui16 ndata, ui16 nparam, ui16 nconst, bool single_precision)
 	{
 		size_t hashed_expr = std::hash<std::string>()(expr.get_expression());
-		return std::to_string(ndata) + "_" + std::to_string(nparam) + "_" + std::to_string(nconst) + "_" + util::stupid_compress(hashed_expr);
+		return std::to_string(ndata) + "_" + std::to_string(nparam) + "_" + std::to_string(nconst) + "_" + util::stupid_compress(hashed_expr) +
+			codegen_suffix(context);
 	}
 
 	export std::shared_ptr<::glsl::Function> nlsq_residuals_jacobian_hessian_l(
 		const expression::Expression& expr, const glsl::SymbolicContext& context,
 		ui16 ndata, ui16 nparam, ui16 nconst, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void nlsq_residuals_jacobian_hessian_l_UNIQUEID(
 	in float params[nparam],
@@ -460,6 +532,8 @@ void nlsq_residuals_jacobian_hessian_l_UNIQUEID(
 	mat_set_zero_MSZ(hessian);
 
 	for (int i = 0; i < ndata; ++i) {
+		// shared subexpressions
+SUBEXPRESSIONS
 		// eval
 RESIDUAL_EXPRESSIONS
 		// jacobian
@@ -483,60 +557,27 @@ HESSIAN_EXPRESSIONS
 
 		size_t hashed_expr = std::hash<std::string>()(expr.get_expression());
 
-		// residuals
-		std::string resexpr = "\t\tresiduals[i] = " + expr.glsl_str(context) + " - data[i];\n";
-
-		// jacobian
-		std::string jacexpr = "";
-		for (int i = 0; i < nparam; ++i) {
-			std::string diff_symbol = context.get_params_name(i);
-			auto diff1 = expr.diff(diff_symbol);
-			std::string jexpr = diff1->glsl_str(context);
-			std::string partj = "\t\tjacobian[i*" + std::to_string(nparam) + "+" + std::to_string(i) +
-				"] = " + jexpr + ";\n";
-			jacexpr += partj;
-		}
-
-		// hessian
-		std::string hesexpr = "";
-		int k = 0;
-		for (int i = 0; i < nparam; ++i) {
-			auto diff_symbol1 = context.get_params_name(i);
-			auto diff1 = expr.diff(diff_symbol1);
-			for (int j = 0; j <= i; ++j) {
-				std::string diff_symbol2 = context.get_params_name(j);
-				auto diff2 = diff1->diff(diff_symbol2);
-				if (diff2->is_zero())
-					continue;
-				std::string hexpr = diff2->glsl_str(context);
-				std::string parth = "\t\thessian[" + std::to_string(i) + "*" + std::to_string(nparam) + "+" +
-					std::to_string(j) + "] += residuals[i] * " + hexpr + ";\n";
-				hesexpr += parth;
-
-				++k;
-			}
-		}
+		auto statements = symbolic_statements(expr, context, nparam, nconst, single_precision, 2);
 
 		std::string uniqueid = nlsq_residuals_jacobian_hessian_l_uniqueid(expr, context, ndata, nparam, nconst, single_precision);
 
 		std::function<std::string()> code_func =
-			[ndata, nparam, nconst, resexpr, jacexpr, hesexpr, single_precision, uniqueid]() -> std::string
+			[ndata, nparam, nconst, statements, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "RESIDUAL_EXPRESSIONS", resexpr);
-			util::replace_all(temp, "JACOBIAN_EXPRESSIONS", jacexpr);
-			util::replace_all(temp, "HESSIAN_EXPRESSIONS", hesexpr);
-			util::replace_all(temp, "ndata", std::to_string(ndata));
-			util::replace_all(temp, "nparam", std::to_string(nparam));
-			util::replace_all(temp, "nconst", std::to_string(nconst));
-			util::replace_all(temp, "MSZ", linalg::mat_set_zero_uniqueid(nparam, nparam, single_precision));
-			util::replace_all(temp, "MTMID", linalg::mul_transpose_mat_uniqueid(ndata, nparam, single_precision));
-			util::replace_all(temp, "AMML", linalg::add_mat_mat_ldiag_uniqueid(nparam, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "SUBEXPRESSIONS", statements.subexpressions },
+				{ "RESIDUAL_EXPRESSIONS", statements.residuals },
+				{ "JACOBIAN_EXPRESSIONS", statements.jacobian },
+				{ "HESSIAN_EXPRESSIONS", statements.hessian },
+				{ "ndata", std::to_string(ndata) },
+				{ "nparam", std::to_string(nparam) },
+				{ "nconst", std::to_string(nconst) },
+				{ "MSZ", linalg::mat_set_zero_uniqueid(nparam, nparam, single_precision) },
+				{ "MTMID", linalg::mul_transpose_mat_uniqueid(ndata, nparam, single_precision) },
+				{ "AMML", linalg::add_mat_mat_ldiag_uniqueid(nparam, single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -631,29 +672,24 @@ HESSIAN_EXPRESSIONS
 		ui16 ndata, ui16 nparam, ui16 nconst, bool single_precision)
 	{
 		size_t hashed_expr = std::hash<std::string>()(expr.get_expression());
-		return std::to_string(ndata) + "_" + std::to_string(nparam) + "_" + std::to_string(nconst) + "_" + util::stupid_compress(hashed_expr);
+		return std::to_string(ndata) + "_" + std::to_string(nparam) + "_" + std::to_string(nconst) + "_" + util::stupid_compress(hashed_expr) +
+			codegen_suffix(context);
 	}
 
 	export std::shared_ptr<::glsl::Function> nlsq_residuals_jacobian_hessian_lw(
 		const expression::Expression& expr, const glsl::SymbolicContext& context,
-		ui16 ndata, ui16 nparam, ui16 nconst, bool single_precision)
+		ui16 ndata, ui16 nparam, ui16 nconst, bool single_precision,
+		const FunctionViews& views = {})
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
-void nlsq_residuals_jacobian_hessian_lw_UNIQUEID(
-	in float params[nparam],
-	in float consts[ndata*nconst],
-	in float data[ndata],
-	in float weights[ndata],
-	float lambda,
-	out float residuals[ndata],
-	out float jacobian[ndata*nparam], 
-	out float hessian[nparam*nparam],
-	out float lambda_hessian[nparam*nparam]) {
+void nlsq_residuals_jacobian_hessian_lw_UNIQUEID(PARAMETERS) {
 	
-	mat_set_zero_MSZ(hessian);
+	mat_set_zero_MSZ(MSZARGS);
 
 	for (int i = 0; i < ndata; ++i) {
+		// shared subexpressions
+SUBEXPRESSIONS
 		// eval
 RESIDUAL_EXPRESSIONS
 		// jacobian
@@ -670,67 +706,71 @@ HESSIAN_EXPRESSIONS
 	}
 
 	// store J^T @ J inside lambda_hessian, second order terms are in hessian
-	mul_transpose_diag_mat_MTDMID(jacobian, weights, lambda_hessian);
-	add_mat_mat_ldiag_AMML(hessian, lambda, lambda_hessian);
+	mul_transpose_diag_mat_MTDMID(MTDMARGS);
+	add_mat_mat_ldiag_AMML(AMMLARGS);
 }
 )glsl";
 
 		size_t hashed_expr = std::hash<std::string>()(expr.get_expression());
 
-		// residuals
-		std::string resexpr = "\t\tresiduals[i] = " + expr.glsl_str(context) + " - data[i];\n";
-
-		// jacobian
-		std::string jacexpr = "";
-		for (int i = 0; i < nparam; ++i) {
-			std::string diff_symbol = context.get_params_name(i);
-			auto diff1 = expr.diff(diff_symbol);
-			std::string jexpr = diff1->glsl_str(context);
-			std::string partj = "\t\tjacobian[i*" + std::to_string(nparam) + "+" + std::to_string(i) +
-				"] = " + jexpr + ";\n";
-			jacexpr += partj;
-		}
-
-		// hessian
-		std::string hesexpr = "";
-		int k = 0;
-		for (int i = 0; i < nparam; ++i) {
-			auto diff_symbol1 = context.get_params_name(i);
-			auto diff1 = expr.diff(diff_symbol1);
-			for (int j = 0; j <= i; ++j) {
-				std::string diff_symbol2 = context.get_params_name(j);
-				auto diff2 = diff1->diff(diff_symbol2);
-				if (diff2->is_zero())
-					continue;
-				std::string hexpr = diff2->glsl_str(context);
-				std::string parth = "\t\thessian[" + std::to_string(i) + "*" + std::to_string(nparam) + "+" +
-					std::to_string(j) + "] += residuals[i] * weights[i] * " + hexpr + ";\n";
-				hesexpr += parth;
-
-				++k;
-			}
+		auto statements = symbolic_statements(expr, context, nparam, nconst, single_precision, 2, "weights[i] * ");
+
+		std::string uniqueid = nlsq_residuals_jacobian_hessian_lw_uniqueid(expr, context, ndata, nparam, nconst, single_precision) +
+			views_suffix(views);
+
+		// the outputs are only subscripted and passed on, so they may be views
+		std::string type = precision_type(single_precision);
+		ViewParameters params("nlsq_residuals_jacobian_hessian_lw", {
+			array_parameter("in", type, "params", nparam, false),
+			array_parameter("in", type, "consts", ndata*nconst, false),
+			array_parameter("in", type, "data", ndata, false),
+			array_parameter("in", type, "weights", ndata, false),
+			{ type + " lambda", "lambda" },
+			array_parameter("out", type, "residuals", ndata),
+			array_parameter("out", type, "jacobian", ndata*nparam),
+			array_parameter("out", type, "hessian", nparam*nparam),
+			array_parameter("out", type, "lambda_hessian", nparam*nparam, false) }, views);
+
+		// the generated statements subscript the outputs too
+		if (!views.empty()) {
+			auto subscript_outputs = [&params](std::string& statement) {
+				statement = CodeTemplate(statement).render({
+					{ "residuals[]", params.subscript("residuals") },
+					{ "jacobian[]", params.subscript("jacobian") },
+					{ "hessian[]", params.subscript("hessian") }
+					});
+			};
+			subscript_outputs(statements.residuals);
+			subscript_outputs(statements.jacobian);
+			subscript_outputs(statements.hessian);
 		}
 
-		std::string uniqueid = nlsq_residuals_jacobian_hessian_lw_uniqueid(expr, context, ndata, nparam, nconst, single_precision);
+		auto msz_call = params.call({ "hessian" });
+		auto mtdm_call = params.call({ "jacobian", "weights", "lambda_hessian" });
+		auto amml_call = params.call({ "hessian", "lambda", "lambda_hessian" });
 
 		std::function<std::string()> code_func =
-			[ndata, nparam, nconst, resexpr, jacexpr, hesexpr, single_precision, uniqueid]() -> std::string
+			[ndata, nparam, nconst, statements, single_precision, uniqueid, params, msz_call, mtdm_call, amml_call]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "RESIDUAL_EXPRESSIONS", resexpr);
-			util::replace_all(temp, "JACOBIAN_EXPRESSIONS", jacexpr);
-			util::replace_all(temp, "HESSIAN_EXPRESSIONS", hesexpr);
-			util::replace_all(temp, "ndata", std::to_string(ndata));
-			util::replace_all(temp, "nparam", std::to_string(nparam));
-			util::replace_all(temp, "nconst", std::to_string(nconst));
-			util::replace_all(temp, "MSZ", linalg::mat_set_zero_uniqueid(nparam, nparam, single_precision));
-			util::replace_all(temp, "MTDMID", linalg::mul_transpose_diag_mat_uniqueid(ndata, nparam, single_precision));
-			util::replace_all(temp, "AMML", linalg::add_mat_mat_ldiag_uniqueid(nparam, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "PARAMETERS", params.declarations() },
+				{ "hessian[]", params.subscript("hessian") },
+				{ "SUBEXPRESSIONS", statements.subexpressions },
+				{ "RESIDUAL_EXPRESSIONS", statements.residuals },
+				{ "JACOBIAN_EXPRESSIONS", statements.jacobian },
+				{ "HESSIAN_EXPRESSIONS", statements.hessian },
+				{ "ndata", std::to_string(ndata) },
+				{ "nparam", std::to_string(nparam) },
+				{ "nconst", std::to_string(nconst) },
+				{ "MSZ", linalg::mat_set_zero_uniqueid(nparam, nparam, single_precision) + views_suffix(msz_call.views) },
+				{ "MSZARGS", msz_call.arguments },
+				{ "MTDMID", linalg::mul_transpose_diag_mat_uniqueid(ndata, nparam, single_precision) + views_suffix(mtdm_call.views) },
+				{ "MTDMARGS", mtdm_call.arguments },
+				{ "AMML", linalg::add_mat_mat_ldiag_uniqueid(nparam, single_precision) + views_suffix(amml_call.views) },
+				{ "AMMLARGS", amml_call.arguments },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -738,10 +778,14 @@ HESSIAN_EXPRESSIONS
 			std::vector<size_t>{ hashed_expr, size_t(ndata), size_t(nparam), size_t(nconst), size_t(single_precision) },
 			code_func,
 			std::make_optional<vecptrfunc>({
-				linalg::mat_set_zero(nparam, nparam, single_precision),
-				linalg::mul_transpose_diag_mat(ndata, nparam, single_precision),
-				linalg::add_mat_mat_ldiag(nparam, single_precision)
-				})
+				linalg::mat_set_zero(nparam, nparam, single_precision, msz_call.views),
+				linalg::mul_transpose_diag_mat(ndata, nparam, single_precision, mtdm_call.views),
+				linalg::add_mat_mat_ldiag(nparam, single_precision, amml_call.views)
+				}),
+			views.empty() ? ViewSpecializer([shared_expr = std::make_shared<const expression::Expression>(expr), context,
+				ndata, nparam, nconst, single_precision](const FunctionViews& views) {
+				return nlsq_residuals_jacobian_hessian_lw(*shared_expr, context, ndata, nparam, nconst, single_precision, views);
+				}) : nullptr
 			);
 
 	}
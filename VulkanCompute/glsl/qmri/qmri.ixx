@@ -41,7 +41,7 @@ namespace qmri {
 
 	export std::shared_ptr<glsl::Function> ivim_guess(vc::ui16 ndata, bool single_precision)
 	{
-		static const std::string code = // compute shader
+		static const CodeTemplate code = // compute shader
 R"glsl(
 void ivim_guess_UNIQUEID(inout float params[4], in float bvals[ndata], in float data[ndata], in int bsplit[2])
 {
@@ -73,15 +73,13 @@ void ivim_guess_UNIQUEID(inout float params[4], in float bvals[ndata], in float
 
 		std::function<std::string()> code_func = [ndata, single_precision, uniqueid]() -> std::string
 		{
-			std::string temp = code;
-			util::replace_all(temp, UNIQUE_ID, uniqueid);
-			util::replace_all(temp, "ndata", std::to_string(ndata));
-			util::replace_all(temp, "LL2UID", lsq::lsq_linear2_upper_uniqueid(ndata, single_precision));
-			util::replace_all(temp, "LL2LID", lsq::lsq_linear2_lower_uniqueid(ndata, single_precision));
-			if (!single_precision) {
-				util::replace_all(temp, "float", "double");
-			}
-			return temp;
+			return code.render({
+				{ UNIQUE_ID, uniqueid },
+				{ "ndata", std::to_string(ndata) },
+				{ "LL2UID", lsq::lsq_linear2_upper_uniqueid(ndata, single_precision) },
+				{ "LL2LID", lsq::lsq_linear2_lower_uniqueid(ndata, single_precision) },
+				{ "float", precision_type(single_precision) }
+				});
 		};
 
 		return std::make_shared<Function>(
@@ -140,7 +138,8 @@ void ivim_guess_UNIQUEID(inout float params[4], in float bvals[ndata], in float
 	
 
 
-	export std::shared_ptr<glsl::AutogenShader> ivim_guess_shader(vc::ui16 ndata, bool single_precision)
+	export std::shared_ptr<glsl::AutogenShader> ivim_guess_shader(vc::ui16 ndata, bool single_precision,
+		BufferLayout layout = BufferLayout::AOS)
 	{
 		std::shared_ptr<AutogenShader> pShader = std::make_shared<AutogenShader>();
 
@@ -149,9 +148,9 @@ void ivim_guess_UNIQUEID(inout float params[4], in float bvals[ndata], in float
 		auto data = std::make_shared<glsl::VectorVariable>("data", ndata, ShaderVariableType::FLOAT);
 		auto bsplit = std::make_shared<glsl::VectorVariable>("bsplit", 2, ShaderVariableType::INT);
 
-		pShader->addVector(params, 0, IOShaderVariableType::INPUT_OUTPUT_TYPE);
+		pShader->addVector(params, 0, IOShaderVariableType::INPUT_OUTPUT_TYPE, layout);
 		pShader->addMatrix(consts, 1, IOShaderVariableType::CONST_TYPE);
-		pShader->addVector(data, 2, IOShaderVariableType::INPUT_TYPE);
+		pShader->addVector(data, 2, IOShaderVariableType::INPUT_TYPE, layout);
 		pShader->addVector(bsplit, 3, IOShaderVariableType::CONST_TYPE);
 
 		pShader->apply(ivim_guess(params, consts, data, bsplit));
@@ -159,7 +158,8 @@ void ivim_guess_UNIQUEID(inout float params[4], in float bvals[ndata], in float
 		return std::move(pShader);
 	}
 	
-	export std::shared_ptr<glsl::AutogenShader> ivim_partial_nlsq_shader(vc::ui16 ndata, bool single_precision)
+	export std::shared_ptr<glsl::AutogenShader> ivim_partial_nlsq_shader(vc::ui16 ndata, bool single_precision,
+		BufferLayout layout = BufferLayout::AOS)
 	{
 		using namespace nlsq;
 
@@ -189,9 +189,9 @@ void ivim_guess_UNIQUEID(inout float params[4], in float bvals[ndata], in float
 		auto upper_bound = std::make_shared<glsl::VectorVariable>("upper_bound", 2, ShaderVariableType::FLOAT);
 		auto lower_bound = std::make_shared<glsl::VectorVariable>("lower_bound", 2, ShaderVariableType::FLOAT);
 
-		pShader->addVector(params, 0, IOShaderVariableType::INPUT_OUTPUT_TYPE);
+		pShader->addVector(params, 0, IOShaderVariableType::INPUT_OUTPUT_TYPE, layout);
 		pShader->addMatrix(consts, 1, IOShaderVariableType::CONST_TYPE);
-		pShader->addVector(data, 2, IOShaderVariableType::INPUT_TYPE);
+		pShader->addVector(data, 2, IOShaderVariableType::INPUT_TYPE, layout);
 		pShader->addVector(weights, 4, IOShaderVariableType::CONST_TYPE);
 
 		std::vector<std::string> vars = { "s0","f","d1","d2","b" };
@@ -258,7 +258,9 @@ params[2] = local_params[1];
 		return pShader;
 	}
 
-	export std::shared_ptr<glsl::AutogenShader> ivim_full_nlsq_shader(vc::ui16 ndata, bool single_precision)
+	export std::shared_ptr<glsl::AutogenShader> ivim_full_nlsq_shader(vc::ui16 ndata, bool single_precision,
+		BufferLayout layout = BufferLayout::AOS, DerivativeMode derivative_mode = DerivativeMode::SYMBOLIC,
+		bool simplify = true)
 	{
 		using namespace nlsq;
 
@@ -286,18 +288,20 @@ params[2] = local_params[1];
 		auto upper_bound = std::make_shared<glsl::VectorVariable>("upper_bound", 4, ShaderVariableType::FLOAT);
 		auto lower_bound = std::make_shared<glsl::VectorVariable>("lower_bound", 4, ShaderVariableType::FLOAT);
 
-		pShader->addVector(params, 0, IOShaderVariableType::INPUT_OUTPUT_TYPE);
+		pShader->addVector(params, 0, IOShaderVariableType::INPUT_OUTPUT_TYPE, layout);
 		pShader->addMatrix(consts, 1, IOShaderVariableType::CONST_TYPE);
-		pShader->addVector(data, 2, IOShaderVariableType::INPUT_TYPE);
+		pShader->addVector(data, 2, IOShaderVariableType::INPUT_TYPE, layout);
 		pShader->addVector(weights, 4, IOShaderVariableType::CONST_TYPE);
-		pShader->addSingle(lambda, 5, IOShaderVariableType::INPUT_OUTPUT_TYPE);
-		pShader->addSingle(step_type, 6, IOShaderVariableType::OUTPUT_TYPE);
-		pShader->addVector(nlstep, 7, IOShaderVariableType::OUTPUT_TYPE);
-		pShader->addSingle(error, 8, IOShaderVariableType::OUTPUT_TYPE);
-		pShader->addSingle(new_error, 9, IOShaderVariableType::OUTPUT_TYPE);
-		pShader->addVector(residuals, 10, IOShaderVariableType::OUTPUT_TYPE);
-		pShader->addMatrix(jacobian, 11, IOShaderVariableType::OUTPUT_TYPE);
-		pShader->addMatrix(hessian, 12, IOShaderVariableType::OUTPUT_TYPE);
+		pShader->addSingle(lambda, 5, IOShaderVariableType::INPUT_OUTPUT_TYPE, layout);
+		pShader->addSingle(step_type, 6, IOShaderVariableType::OUTPUT_TYPE, layout);
+		pShader->addVector(nlstep, 7, IOShaderVariableType::OUTPUT_TYPE, layout);
+		pShader->addSingle(error, 8, IOShaderVariableType::OUTPUT_TYPE, layout);
+		pShader->addSingle(new_error, 9, IOShaderVariableType::OUTPUT_TYPE, layout);
+		// the residuals, jacobian and hessian are only ever subscripted, keeping them in their
+		// buffers saves 5*ndata + 16 floats of private memory per invocation
+		pShader->addVector(residuals, 10, IOShaderVariableType::OUTPUT_TYPE, layout, VariableStorage::GLOBAL_VIEW);
+		pShader->addMatrix(jacobian, 11, IOShaderVariableType::OUTPUT_TYPE, layout, VariableStorage::GLOBAL_VIEW);
+		pShader->addMatrix(hessian, 12, IOShaderVariableType::OUTPUT_TYPE, layout, VariableStorage::GLOBAL_VIEW);
 		pShader->addMatrix(lambda_hessian, std::nullopt, IOShaderVariableType::LOCAL_TYPE);
 		pShader->addVector(upper_bound, std::nullopt, IOShaderVariableType::LOCAL_TYPE);
 		pShader->addVector(lower_bound, std::nullopt, IOShaderVariableType::LOCAL_TYPE);
@@ -306,6 +310,8 @@ params[2] = local_params[1];
 		std::string expresh = "s0*(f*exp(-b*d1)+(1-f)*exp(-b*d2))";
 		expression::Expression expr(expresh, vars);
 		SymbolicContext context;
+		context.derivative_mode = derivative_mode;
+		context.simplify = simplify;
 
 		context.insert_const(std::make_pair("b", 0));
 		context.insert_param(std::make_pair("s0", 0));
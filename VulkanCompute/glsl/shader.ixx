@@ -6,15 +6,20 @@ import <string>;
 import <memory>;
 import <optional>;
 import <stdexcept>;
+import <vector>;
+import <array>;
+import <future>;
 
 import vc;
 import util;
 import glsl;
+import thread_pool;
 
 import variable;
 import function;
 
 import func_factory;
+import global_view;
 
 namespace {
 	// most shaders are smaller than 30 kB
@@ -23,20 +28,31 @@ namespace {
 
 namespace glsl {
 
-	std::string copying_from(const std::shared_ptr<glsl::ShaderVariable>& v1, const std::shared_ptr<glsl::ShaderVariable>& v2)
+	std::string copying_from(const std::shared_ptr<glsl::ShaderVariable>& v1, const std::shared_ptr<glsl::ShaderVariable>& v2,
+		BufferLayout layout)
 	{
 		std::string copy_str;
 		{
 			auto i1m = dynamic_cast<const MatrixVariable*>(v1.get());
 			auto i2m = dynamic_cast<const MatrixVariable*>(v2.get());
 			if (i1m != nullptr && i2m != nullptr) {
-				copy_str +=
+				if (layout == BufferLayout::SOA) {
+					copy_str +=
+R"glsl(
+	for (int i = 0; i < nrow*ncol; ++i) {
+		OUTPUT_NAME[i] = INPUT_NAME[i*nelem + gl_GlobalInvocationID.x];
+	}
+)glsl";
+				}
+				else {
+					copy_str +=
 R"glsl(
 	start_index = nrow*ncol*gl_GlobalInvocationID.x;
 	for (int i = 0; i < nrow*ncol; ++i) {
 		OUTPUT_NAME[i] = INPUT_NAME[start_index + i];
 	}
 )glsl";
+				}
 				util::replace_all(copy_str, "nrow", std::to_string(i1m->getNDim1()));
 				util::replace_all(copy_str, "ncol", std::to_string(i1m->getNDim2()));
 				util::replace_all(copy_str, "INPUT_NAME", i1m->getName());
@@ -49,13 +65,23 @@ R"glsl(
 			auto i1v = dynamic_cast<const VectorVariable*>(v1.get());
 			auto i2v = dynamic_cast<const VectorVariable*>(v2.get());
 			if (i1v != nullptr && i2v != nullptr) {
-				copy_str +=
+				if (layout == BufferLayout::SOA) {
+					copy_str +=
+R"glsl(
+	for (int i = 0; i < ndim; ++i) {
+		OUTPUT_NAME[i] = INPUT_NAME[i*nelem + gl_GlobalInvocationID.x];
+	}
+)glsl";
+				}
+				else {
+					copy_str +=
 R"glsl(
 	start_index = ndim*gl_GlobalInvocationID.x;
 	for (int i = 0; i < ndim; ++i) {
 		OUTPUT_NAME[i] = INPUT_NAME[start_index + i];
 	}
 )glsl";
+				}
 				util::replace_all(copy_str, "ndim", std::to_string(i1v->getNDim()));
 				util::replace_all(copy_str, "INPUT_NAME", i1v->getName());
 				util::replace_all(copy_str, "OUTPUT_NAME", i2v->getName());
@@ -80,20 +106,31 @@ R"glsl(
 		throw std::runtime_error("Both variables must be either Vectors and Matrices");
 	}
 
-	std::string copying_to(const std::shared_ptr<glsl::ShaderVariable>& v1, const std::shared_ptr<glsl::ShaderVariable>& v2)
+	std::string copying_to(const std::shared_ptr<glsl::ShaderVariable>& v1, const std::shared_ptr<glsl::ShaderVariable>& v2,
+		BufferLayout layout)
 	{
 		std::string copy_str;
 		{
 			auto i1m = dynamic_cast<const MatrixVariable*>(v1.get());
 			auto i2m = dynamic_cast<const MatrixVariable*>(v2.get());
 			if (i1m != nullptr && i2m != nullptr) {
-				copy_str +=
+				if (layout == BufferLayout::SOA) {
+					copy_str +=
+R"glsl(
+	for (int i = 0; i < nrow*ncol; ++i) {
+		OUTPUT_NAME[i*nelem + gl_GlobalInvocationID.x] = INPUT_NAME[i];
+	}
+)glsl";
+				}
+				else {
+					copy_str +=
 R"glsl(
 	start_index = nrow*ncol*gl_GlobalInvocationID.x;
 	for (int i = 0; i < nrow*ncol; ++i) {
 		OUTPUT_NAME[start_index + i] = INPUT_NAME[i];
 	}
 )glsl";
+				}
 				util::replace_all(copy_str, "nrow", std::to_string(i1m->getNDim1()));
 				util::replace_all(copy_str, "ncol", std::to_string(i1m->getNDim2()));
 				util::replace_all(copy_str, "INPUT_NAME", i1m->getName());
@@ -106,13 +143,23 @@ R"glsl(
 			auto i1v = dynamic_cast<const VectorVariable*>(v1.get());
 			auto i2v = dynamic_cast<const VectorVariable*>(v2.get());
 			if (i1v != nullptr && i2v != nullptr) {
-				copy_str +=
+				if (layout == BufferLayout::SOA) {
+					copy_str +=
+R"glsl(
+	for (int i = 0; i < ndim; ++i) {
+		OUTPUT_NAME[i*nelem + gl_GlobalInvocationID.x] = INPUT_NAME[i];
+	}
+)glsl";
+				}
+				else {
+					copy_str +=
 R"glsl(
 	start_index = ndim*gl_GlobalInvocationID.x;
 	for (int i = 0; i < ndim; ++i) {
 		OUTPUT_NAME[start_index + i] = INPUT_NAME[i];
 	}
 )glsl";
+				}
 				util::replace_all(copy_str, "ndim", std::to_string(i1v->getNDim()));
 				util::replace_all(copy_str, "INPUT_NAME", i1v->getName());
 				util::replace_all(copy_str, "OUTPUT_NAME", i2v->getName());
@@ -170,30 +217,72 @@ R"glsl(
 		LOCAL_TYPE = 8
 	};
 
+	// LOCAL_COPY copies the variable into private memory before the function calls and back
+	// after them. GLOBAL_VIEW accesses the global buffer directly, which avoids the copies and
+	// the register pressure of large arrays, but the variable can only be passed to function
+	// parameters that take views
+	export enum class VariableStorage
+	{
+		LOCAL_COPY = 1,
+		GLOBAL_VIEW = 2
+	};
+
+	// number of workgroups needed to cover nelem invocations
+	export vc::ui32 group_count(vc::ui32 nelem, vc::ui32 local_size)
+	{
+		// in 64 bits, nelem + local_size - 1 wraps around for nelem near UINT32_MAX
+		return static_cast<vc::ui32>((static_cast<vc::ui64>(nelem) + local_size - 1) / local_size);
+	}
+
+	// One invocation per element along x, elements are indexed by gl_GlobalInvocationID.x.
+	// The number of elements is passed as a uint push constant (nelem) at dispatch, invocations
+	// beyond it return immediately, so nelem need not be a multiple of the workgroup size
 	export class AutogenShader : public ShaderBase, public ScopeBase {
 	public:
 
+		// workgroups are one dimensional, elements are only indexed along x
+		void setLocalSize(vc::ui32 x)
+		{
+			if (x == 0)
+				throw std::runtime_error("Local size must be greater than zero");
+			m_LocalSize = { x, 1, 1 };
+		}
+
+		const std::array<vc::ui32, 3>& getLocalSize() const
+		{
+			return m_LocalSize;
+		}
+
+		// workgroup counts to dispatch for nelem elements, same layout as kp::Workgroup
+		std::array<vc::ui32, 3> getWorkgroup(vc::ui32 nelem) const
+		{
+			return { group_count(nelem, m_LocalSize[0]), 1, 1 };
+		}
+
 		void addBinding(std::unique_ptr<Binding> binding)
 		{
 			_addBinding(std::move(binding));
 		}
 
 		// MATRIX
-		void addMatrix(const std::shared_ptr<MatrixVariable>& mat, const std::optional<vc::ui16>& binding, const IOShaderVariableType& type)
+		void addMatrix(const std::shared_ptr<MatrixVariable>& mat, const std::optional<vc::ui16>& binding, const IOShaderVariableType& type,
+			BufferLayout layout = BufferLayout::AOS, VariableStorage storage = VariableStorage::LOCAL_COPY)
 		{
-			_addMatrix(mat, binding, type);
+			_addMatrix(mat, binding, type, layout, storage);
 		}
 
 		// VECTOR
-		void addVector(const std::shared_ptr<VectorVariable>& vec, const std::optional<vc::ui16>& binding, const IOShaderVariableType& type)
+		void addVector(const std::shared_ptr<VectorVariable>& vec, const std::optional<vc::ui16>& binding, const IOShaderVariableType& type,
+			BufferLayout layout = BufferLayout::AOS, VariableStorage storage = VariableStorage::LOCAL_COPY)
 		{
-			_addVector(vec, binding, type);
+			_addVector(vec, binding, type, layout, storage);
 		}
 
 		// SINGLE
-		void addSingle(const std::shared_ptr<SingleVariable>& var, const std::optional<vc::ui16>& binding, const IOShaderVariableType& type)
+		void addSingle(const std::shared_ptr<SingleVariable>& var, const std::optional<vc::ui16>& binding, const IOShaderVariableType& type,
+			BufferLayout layout = BufferLayout::AOS)
 		{
-			_addSingle(var, binding, type);
+			_addSingle(var, binding, type, layout);
 		}
 
 		vc::ui16 scope_level() const override {
@@ -216,6 +305,15 @@ R"glsl(
 			return m_Functions[index];
 		}
 
+		std::optional<GlobalView> getGlobalView(const std::shared_ptr<ShaderVariable>& var) const override {
+			auto it = std::find_if(m_Views.begin(), m_Views.end(), [&var](const auto& view) {
+				return *view.first == *var;
+				});
+			if (it == m_Views.end())
+				return std::nullopt;
+			return it->second;
+		}
+
 		void setBeforeCopyingFrom(const std::string& mi)
 		{
 			m_BeforeCopyingFrom = mi;
@@ -241,13 +339,21 @@ R"glsl(
 			std::string ret;
 			ret.reserve(DEFAULT_SHADER_SIZE);
 
-			ret +=
+			std::string header =
 R"glsl(
 #version 450
 
-layout (local_size_x = 1) in;
+layout (local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y, local_size_z = LOCAL_SIZE_Z) in;
+
+layout (push_constant) uniform PushConstants {
+	uint nelem;
+};
 
 )glsl";
+			util::replace_all(header, "LOCAL_SIZE_X", std::to_string(m_LocalSize[0]));
+			util::replace_all(header, "LOCAL_SIZE_Y", std::to_string(m_LocalSize[1]));
+			util::replace_all(header, "LOCAL_SIZE_Z", std::to_string(m_LocalSize[2]));
+			ret += header;
 
 			for (auto& bind : m_Bindings) {
 				ret += bind->operator()() + "\n";
@@ -255,60 +361,66 @@ layout (local_size_x = 1) in;
 			if (m_Bindings.size() > 0)
 				ret += "\n";
 
-			for (auto& func : m_Functions) {
+			for (auto& func : m_Functions.getFunctions()) {
 				ret += func->getCode() + "\n";
 			}
 			if (m_Functions.size() > 0)
 				ret += "\n";
 
-			// open main
-			ret += "void main() {\n";
+			std::string main_body;
+
+			// the last workgroup may be partially outside the data
+			main_body += "\tif (gl_GlobalInvocationID.x >= nelem)\n\t\treturn;\n\n";
 
 			// declare variables
 			for (int i = 0; i < m_Variables.size(); ++i) {
 				if (m_VariableTypes[i] == IOShaderVariableType::LOCAL_TYPE)
-					ret += "\t" + m_Variables[i]->getDeclaration();
+					main_body += "\t" + m_Variables[i]->getDeclaration();
 			}
 			if (m_Variables.size() > 0)
-				ret += "\n";
+				main_body += "\n";
 
 			// manual insertions before copy from
 			if (m_BeforeCopyingFrom != "")
-				ret += m_BeforeCopyingFrom + "\n";
+				main_body += m_BeforeCopyingFrom + "\n";
 
 			// copy globals to locals
 			if (m_Inputs.size() != 0 || m_Outputs.size() != 0)
-				ret += "\tuint start_index;\n";
+				main_body += "\tuint start_index;\n";
 			for (auto& input : m_Inputs) {
-				ret += copying_from(m_Variables[input.first], m_Variables[input.second]);
+				main_body += copying_from(m_Variables[input.from], m_Variables[input.to], input.layout);
 			}
-			ret += "\n";
+			main_body += "\n";
 
 			// manual insertions after copy from
 			if (m_AfterCopyingFrom != "")
-				ret += m_AfterCopyingFrom + "\n";
+				main_body += m_AfterCopyingFrom + "\n";
 
 			// add in function calls
 			for (auto& child : m_Children) {
-				ret += child->build();
+				main_body += child->build();
 			}
 			if (m_Children.size() > 0)
-				ret += "\n";
+				main_body += "\n";
 
 			// manual insertions before copying back
 			if (m_BeforeCopyingBack != "")
-				ret += m_BeforeCopyingBack + "\n";
+				main_body += m_BeforeCopyingBack + "\n";
 
 			// copy locals back to globals
 			for (auto& output : m_Outputs) {
-				ret += copying_to(m_Variables[output.first], m_Variables[output.second]);
+				main_body += copying_to(m_Variables[output.from], m_Variables[output.to], output.layout);
 			}
 			if (m_Outputs.size() > 0)
-				ret += "\n";
+				main_body += "\n";
 
 			// manual insertions after copying back
 			if (m_AfterCopyingBack != "")
-				ret += m_AfterCopyingBack + "\n";
+				main_body += m_AfterCopyingBack + "\n";
+
+			// open main
+			ret += "void main() {\n";
+			ret += main_body;
 
 			// close main
 			ret += "}\n";
@@ -334,7 +446,7 @@ layout (local_size_x = 1) in;
 
 		vc::ui16 _addFunction(const std::shared_ptr<Function>& func)
 		{
-			return Function::add_function(m_Functions, func);
+			return m_Functions.add(func);
 		}
 
 		bool _addBinding(std::unique_ptr<Binding> binding)
@@ -355,7 +467,8 @@ layout (local_size_x = 1) in;
 			return pos;
 		}
 
-		void _addMatrix(const std::shared_ptr<MatrixVariable>& mat, const std::optional<vc::ui16>& binding, const IOShaderVariableType& type)
+		void _addMatrix(const std::shared_ptr<MatrixVariable>& mat, const std::optional<vc::ui16>& binding, const IOShaderVariableType& type,
+			BufferLayout layout, VariableStorage storage)
 		{
 			auto ndim1 = mat->getNDim1();
 			auto ndim2 = mat->getNDim2();
@@ -369,6 +482,11 @@ layout (local_size_x = 1) in;
 				return;
 			}
 
+			if (storage == VariableStorage::GLOBAL_VIEW) {
+				_addView(mat, global_var, binding, type, layout, ndim1 * ndim2);
+				return;
+			}
+
 			bool added_global_var = false;
 			vc::ui16 var_index = _addVariable(mat, IOShaderVariableType::LOCAL_TYPE);
 			vc::ui16 global_var_index;
@@ -377,7 +495,7 @@ layout (local_size_x = 1) in;
 				global_var_index = _addVariable(global_var, type);
 				added_global_var = true;
 				_addBinding(std::make_unique<BufferBinding>(binding.value(), global_var->getType(), global_var->getName()));
-				m_Inputs.emplace_back(global_var_index, var_index);
+				m_Inputs.push_back(CopyPair{ global_var_index, var_index, layout });
 			}
 
 			if (static_cast<int>(type) & static_cast<int>(IOShaderVariableType::OUTPUT_TYPE)) {
@@ -386,12 +504,13 @@ layout (local_size_x = 1) in;
 					added_global_var = true;
 					_addBinding(std::make_unique<BufferBinding>(binding.value(), global_var->getType(), global_var->getName()));
 				}
-				m_Outputs.emplace_back(var_index, global_var_index);
+				m_Outputs.push_back(CopyPair{ var_index, global_var_index, layout });
 			}
 
 		}
 
-		void _addVector(const std::shared_ptr<VectorVariable>& vec, const std::optional<vc::ui16>& binding, const IOShaderVariableType& type)
+		void _addVector(const std::shared_ptr<VectorVariable>& vec, const std::optional<vc::ui16>& binding, const IOShaderVariableType& type,
+			BufferLayout layout, VariableStorage storage)
 		{
 			auto ndim = vec->getNDim();
 
@@ -404,6 +523,11 @@ layout (local_size_x = 1) in;
 				return;
 			}
 
+			if (storage == VariableStorage::GLOBAL_VIEW) {
+				_addView(vec, global_var, binding, type, layout, ndim);
+				return;
+			}
+
 			bool added_global_var = false;
 			vc::ui16 var_index = _addVariable(vec, IOShaderVariableType::LOCAL_TYPE);
 			vc::ui16 global_var_index;
@@ -412,7 +536,7 @@ layout (local_size_x = 1) in;
 				global_var_index = _addVariable(global_var, type);
 				added_global_var = true;
 				_addBinding(std::make_unique<BufferBinding>(binding.value(), global_var->getType(), global_var->getName()));
-				m_Inputs.emplace_back(global_var_index, var_index);
+				m_Inputs.push_back(CopyPair{ global_var_index, var_index, layout });
 			}
 
 			if (static_cast<int>(type) & static_cast<int>(IOShaderVariableType::OUTPUT_TYPE)) {
@@ -421,11 +545,32 @@ layout (local_size_x = 1) in;
 					added_global_var = true;
 					_addBinding(std::make_unique<BufferBinding>(binding.value(), global_var->getType(), global_var->getName()));
 				}
-				m_Outputs.emplace_back(var_index, global_var_index);
+				m_Outputs.push_back(CopyPair{ var_index, global_var_index, layout });
+			}
+		}
+
+		template<typename VariableT>
+		void _addView(const std::shared_ptr<VariableT>& var, const std::shared_ptr<VariableT>& global_var,
+			const std::optional<vc::ui16>& binding, const IOShaderVariableType& type, BufferLayout layout, vc::ui32 ndim)
+		{
+			if (!binding.has_value())
+				throw std::runtime_error("Global views must have a binding");
+			if (type != IOShaderVariableType::INPUT_TYPE && type != IOShaderVariableType::OUTPUT_TYPE &&
+				type != IOShaderVariableType::INPUT_OUTPUT_TYPE)
+			{
+				throw std::runtime_error("Only input and output variables can be global views");
 			}
+
+			_addVariable(global_var, type);
+			_addBinding(std::make_unique<BufferBinding>(binding.value(), global_var->getType(), global_var->getName()));
+
+			// pure inputs are not written to, the buffer may be shared with other dispatches
+			bool writable = static_cast<int>(type) & static_cast<int>(IOShaderVariableType::OUTPUT_TYPE);
+			m_Views.emplace_back(var, GlobalView{ global_var->getName(), ndim, layout, writable });
 		}
 
-		void _addSingle(const std::shared_ptr<SingleVariable>& var, const std::optional<vc::ui16>& binding, const IOShaderVariableType& type)
+		void _addSingle(const std::shared_ptr<SingleVariable>& var, const std::optional<vc::ui16>& binding, const IOShaderVariableType& type,
+			BufferLayout layout)
 		{
 			std::shared_ptr<SingleVariable> global_var = std::make_shared<SingleVariable>(
 				"global_" + var->getName(), var->getType(), var->getValue());
@@ -444,7 +589,7 @@ layout (local_size_x = 1) in;
 				global_var_index = _addVariable(global_var, type);
 				added_global_var = true;
 				_addBinding(std::make_unique<BufferBinding>(binding.value(), global_var->getType(), global_var->getName()));
-				m_Inputs.emplace_back(global_var_index, var_index);
+				m_Inputs.push_back(CopyPair{ global_var_index, var_index, layout });
 			}
 
 			if (static_cast<int>(type) & static_cast<int>(IOShaderVariableType::OUTPUT_TYPE)) {
@@ -453,7 +598,7 @@ layout (local_size_x = 1) in;
 					added_global_var = true;
 					_addBinding(std::make_unique<BufferBinding>(binding.value(), global_var->getType(), global_var->getName()));
 				}
-				m_Outputs.emplace_back(var_index, global_var_index);
+				m_Outputs.push_back(CopyPair{ var_index, global_var_index, layout });
 			}
 
 		}
@@ -461,7 +606,7 @@ layout (local_size_x = 1) in;
 	private:
 
 		std::vector<std::unique_ptr<Binding>> m_Bindings;
-		std::vector<std::shared_ptr<Function>> m_Functions;
+		FunctionRegistry m_Functions;
 
 		std::vector<IOShaderVariableType> m_VariableTypes;
 		std::vector<std::shared_ptr<ShaderVariable>> m_Variables;
@@ -471,11 +616,37 @@ layout (local_size_x = 1) in;
 		std::string m_BeforeCopyingBack;
 		std::string m_AfterCopyingBack;
 
-		std::vector<std::pair<vc::ui16, vc::ui16>> m_Inputs;
-		std::vector<std::pair<vc::ui16, vc::ui16>> m_Outputs;
+		struct CopyPair {
+			vc::ui16 from;
+			vc::ui16 to;
+			BufferLayout layout;
+		};
+
+		std::vector<CopyPair> m_Inputs;
+		std::vector<CopyPair> m_Outputs;
+
+		std::vector<std::pair<std::shared_ptr<ShaderVariable>, GlobalView>> m_Views;
+
+		std::array<vc::ui32, 3> m_LocalSize = { 1, 1, 1 };
 
 	};
 
+	// Generates and compiles all shaders concurrently on the pool, futures are returned in the order of shaders.
+	// The shaders must not be modified until their futures are ready
+	export std::vector<std::future<std::vector<vc::ui32>>> compileShaders(
+		const std::vector<std::shared_ptr<ShaderBase>>& shaders, util::ThreadPool& pool,
+		OptimizationType opt_type = DEFAULT_OPTIMIZATION_TYPE)
+	{
+		std::vector<std::future<std::vector<vc::ui32>>> ret;
+		ret.reserve(shaders.size());
+		for (auto& shader : shaders) {
+			ret.emplace_back(pool.submit([shader, opt_type]() {
+				return compileSource(shader->compile(), opt_type);
+			}));
+		}
+		return ret;
+	}
+
 
 
 }
\ No newline at end of file
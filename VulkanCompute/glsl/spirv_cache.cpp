@@ -0,0 +1,204 @@
+module;
+
+module spirv_cache;
+
+import <string>;
+import <vector>;
+import <optional>;
+import <filesystem>;
+import <fstream>;
+import <mutex>;
+import <atomic>;
+import <thread>;
+import <algorithm>;
+import <functional>;
+
+import vc;
+import util;
+
+using namespace vc;
+
+namespace {
+
+	constexpr ui32 cache_magic = 0x43534356; // "VCSC"
+	constexpr ui32 cache_version = 1;
+
+	// the file name is the hash of the source, this second hash guards against collisions
+	constexpr ui64 source_check_seed = 0x84222325cbf29ce4ull;
+
+	struct CacheEntryHeader {
+		ui32 magic;
+		ui32 version;
+		ui32 opt_flags;
+		ui32 padding;
+		ui64 source_size;
+		ui64 source_check;
+		ui64 nwords;
+	};
+
+	std::atomic<ui64> tmp_counter = 0;
+
+}
+
+glsl::SpirvCache::SpirvCache(const std::filesystem::path& directory, ui64 max_size_bytes)
+	: m_Directory(directory), m_MaxSize(max_size_bytes)
+{
+	std::filesystem::create_directories(m_Directory);
+}
+
+std::optional<std::vector<ui32>> glsl::SpirvCache::load(const std::string& source, int opt_flags)
+{
+	auto path = entry_path(source, opt_flags);
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		++m_Misses;
+		return std::nullopt;
+	}
+
+	std::error_code ec;
+	ui64 file_size = std::filesystem::file_size(path, ec);
+
+	CacheEntryHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	// nwords is read from the file, a truncated or corrupt entry must not size the read
+	bool valid = file && !ec &&
+		header.magic == cache_magic &&
+		header.version == cache_version &&
+		header.opt_flags == static_cast<ui32>(opt_flags) &&
+		header.source_size == source.size() &&
+		header.source_check == util::stable_hash(source, source_check_seed) &&
+		file_size >= sizeof(header) &&
+		header.nwords == (file_size - sizeof(header)) / sizeof(ui32);
+
+	std::vector<ui32> spirv;
+	if (valid) {
+		spirv.resize(header.nwords);
+		file.read(reinterpret_cast<char*>(spirv.data()), header.nwords * sizeof(ui32));
+		valid = file && static_cast<ui64>(file.gcount()) == header.nwords * sizeof(ui32);
+	}
+	file.close();
+
+	if (!valid) {
+		++m_Misses;
+		return std::nullopt;
+	}
+
+	// the modification time doubles as the access time for the LRU eviction
+	std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+	++m_Hits;
+	return spirv;
+}
+
+void glsl::SpirvCache::store(const std::string& source, int opt_flags, const std::vector<ui32>& spirv)
+{
+	auto path = entry_path(source, opt_flags);
+
+	auto tmp_path = path;
+	tmp_path += ".tmp" +
+		std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "_" +
+		std::to_string(tmp_counter++);
+
+	CacheEntryHeader header;
+	header.magic = cache_magic;
+	header.version = cache_version;
+	header.opt_flags = static_cast<ui32>(opt_flags);
+	header.padding = 0;
+	header.source_size = source.size();
+	header.source_check = util::stable_hash(source, source_check_seed);
+	header.nwords = spirv.size();
+
+	std::error_code ec;
+	{
+		std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(spirv.data()), spirv.size() * sizeof(ui32));
+		if (!file) {
+			file.close();
+			std::filesystem::remove(tmp_path, ec);
+			return;
+		}
+	}
+
+	std::filesystem::rename(tmp_path, path, ec);
+	if (ec) {
+		std::filesystem::remove(tmp_path, ec);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	evict();
+}
+
+void glsl::SpirvCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	std::error_code ec;
+	for (auto& entry : std::filesystem::directory_iterator(m_Directory, ec)) {
+		if (entry.path().extension() == ".spv") {
+			std::filesystem::remove(entry.path(), ec);
+		}
+	}
+}
+
+glsl::SpirvCacheStats glsl::SpirvCache::getStats() const
+{
+	return SpirvCacheStats{ m_Hits.load(), m_Misses.load(), m_Evictions.load() };
+}
+
+void glsl::SpirvCache::setMaxSize(ui64 max_size_bytes)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_MaxSize = max_size_bytes;
+	evict();
+}
+
+std::filesystem::path glsl::SpirvCache::entry_path(const std::string& source, int opt_flags) const
+{
+	ui64 key = util::stable_hash(std::to_string(opt_flags), util::stable_hash(source));
+	return m_Directory / (util::to_hex(key) + ".spv");
+}
+
+void glsl::SpirvCache::evict()
+{
+	struct Entry {
+		std::filesystem::file_time_type time;
+		ui64 size;
+		std::filesystem::path path;
+	};
+
+	std::error_code ec;
+	std::vector<Entry> entries;
+	ui64 total_size = 0;
+	for (auto& entry : std::filesystem::directory_iterator(m_Directory, ec)) {
+		if (entry.path().extension() != ".spv")
+			continue;
+		auto time = entry.last_write_time(ec);
+		if (ec)
+			continue;
+		auto size = entry.file_size(ec);
+		if (ec)
+			continue;
+		entries.push_back(Entry{ time, size, entry.path() });
+		total_size += size;
+	}
+
+	if (total_size <= m_MaxSize)
+		return;
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		return a.time < b.time;
+	});
+
+	for (auto& entry : entries) {
+		if (total_size <= m_MaxSize)
+			break;
+		if (std::filesystem::remove(entry.path, ec)) {
+			total_size -= entry.size;
+			++m_Evictions;
+		}
+	}
+}
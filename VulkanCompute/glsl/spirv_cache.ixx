@@ -0,0 +1,65 @@
+module;
+
+export module spirv_cache;
+
+import <string>;
+import <vector>;
+import <optional>;
+import <filesystem>;
+import <mutex>;
+import <atomic>;
+
+import vc;
+
+namespace glsl {
+
+	export struct SpirvCacheStats {
+		vc::ui64 hits;
+		vc::ui64 misses;
+		vc::ui64 evictions;
+	};
+
+	// On disk cache of compiled shaders, one file per (source, optimization flags) pair.
+	// Files are written to a temporary and renamed into place so concurrent processes
+	// sharing a cache directory never see half written entries. Access times are tracked
+	// through the file modification time, the least recently used entries are evicted
+	// when the directory grows beyond max_size_bytes.
+	export class SpirvCache {
+	public:
+
+		static constexpr vc::ui64 DEFAULT_MAX_SIZE = 256ull * 1024ull * 1024ull;
+
+		SpirvCache(const std::filesystem::path& directory, vc::ui64 max_size_bytes = DEFAULT_MAX_SIZE);
+
+		std::optional<std::vector<vc::ui32>> load(const std::string& source, int opt_flags);
+
+		void store(const std::string& source, int opt_flags, const std::vector<vc::ui32>& spirv);
+
+		void clear();
+
+		SpirvCacheStats getStats() const;
+
+		const std::filesystem::path& getDirectory() const { return m_Directory; }
+
+		vc::ui64 getMaxSize() const { return m_MaxSize; }
+
+		void setMaxSize(vc::ui64 max_size_bytes);
+
+	private:
+
+		std::filesystem::path entry_path(const std::string& source, int opt_flags) const;
+
+		void evict();
+
+	private:
+		std::filesystem::path m_Directory;
+		vc::ui64 m_MaxSize;
+
+		std::mutex m_Mutex;
+
+		std::atomic<vc::ui64> m_Hits = 0;
+		std::atomic<vc::ui64> m_Misses = 0;
+		std::atomic<vc::ui64> m_Evictions = 0;
+	};
+
+}
@@ -0,0 +1,374 @@
+module;
+
+#define KOMPUTE_LOG_LEVEL KOMPUTE_LOG_LEVEL_CRITICAL
+#include <kompute/Kompute.hpp>
+
+module stream_executor;
+
+import <vector>;
+import <memory>;
+import <string>;
+import <chrono>;
+import <algorithm>;
+import <cstring>;
+import <stdexcept>;
+
+import vc;
+import glsl;
+import variable;
+import shader;
+import tensor_var;
+import cpu_shader;
+import voxel_scheduler;
+
+using namespace vc;
+
+namespace {
+
+	ui32 type_size(glsl::ShaderVariableType type)
+	{
+		switch (type) {
+		case glsl::ShaderVariableType::INT:
+			return sizeof(int32_t);
+		case glsl::ShaderVariableType::FLOAT:
+			return sizeof(float);
+		case glsl::ShaderVariableType::DOUBLE:
+			return sizeof(double);
+		default:
+			throw std::runtime_error("Unsupported type - stream_executor");
+		}
+	}
+
+	kp::Tensor::TensorDataTypes tensor_type(glsl::ShaderVariableType type)
+	{
+		switch (type) {
+		case glsl::ShaderVariableType::INT:
+			return kp::Tensor::TensorDataTypes::eInt;
+		case glsl::ShaderVariableType::FLOAT:
+			return kp::Tensor::TensorDataTypes::eFloat;
+		case glsl::ShaderVariableType::DOUBLE:
+			return kp::Tensor::TensorDataTypes::eDouble;
+		default:
+			throw std::runtime_error("Unsupported type - stream_executor");
+		}
+	}
+
+	ui64 stride(const glsl::VoxelBuffer& buffer)
+	{
+		return ui64(buffer.components) * type_size(buffer.type);
+	}
+
+	bool has_transfer(glsl::StreamTransfer transfer, glsl::StreamTransfer flag)
+	{
+		return (static_cast<int>(transfer) & static_cast<int>(flag)) != 0;
+	}
+
+	struct SlotTensor {
+		size_t buffer;
+		std::shared_ptr<kp::Tensor> tensor;
+	};
+
+	// the per voxel tensors of one chunk with the sequences moving it through the pipeline
+	struct Slot {
+		std::vector<std::shared_ptr<kp::Tensor>> tensors;
+		std::vector<std::shared_ptr<kp::Tensor>> voxel_tensors;
+		std::vector<SlotTensor> uploads;
+		std::vector<SlotTensor> downloads;
+
+		std::vector<std::shared_ptr<kp::Algorithm>> algorithms;
+
+		std::shared_ptr<kp::Sequence> upload;
+		std::shared_ptr<kp::Sequence> compute;
+		std::shared_ptr<kp::Sequence> download;
+		// nelem the compute sequence was recorded with
+		ui32 count = 0;
+	};
+
+	std::vector<std::shared_ptr<kp::Tensor>> slot_tensors(const std::vector<SlotTensor>& tensors)
+	{
+		std::vector<std::shared_ptr<kp::Tensor>> ret;
+		for (auto& t : tensors) {
+			ret.push_back(t.tensor);
+		}
+		return ret;
+	}
+
+	// device time from the first to the last timestamp of a finished sequence, period is in ns per tick
+	double sequence_seconds(kp::Sequence& seq, double period)
+	{
+		auto stamps = seq.getTimestamps();
+		if (stamps.size() < 2)
+			return 0.0;
+		return double(stamps.back() - stamps.front()) * period * 1e-9;
+	}
+
+}
+
+std::shared_ptr<kp::Manager> glsl::create_stream_manager(ui32 device, StreamExecutorOptions& options)
+{
+	std::vector<vk::QueueFamilyProperties> families;
+	{
+		kp::Manager probe(device);
+		families = probe.listDevices().at(device).getQueueFamilyProperties();
+	}
+
+	auto family = std::find_if(families.begin(), families.end(), [](const vk::QueueFamilyProperties& f) {
+		return bool(f.queueFlags & vk::QueueFlagBits::eCompute);
+	});
+	if (family == families.end())
+		throw std::runtime_error("Device " + std::to_string(device) + " has no compute queue family");
+
+	ui32 nqueues = std::min<ui32>(family->queueCount, 3);
+	std::vector<ui32> queue_families(nqueues, static_cast<ui32>(family - families.begin()));
+
+	options.upload_queue = 0;
+	options.compute_queue = nqueues > 1 ? 1 : 0;
+	options.download_queue = nqueues > 2 ? 2 : 0;
+
+	return std::make_shared<kp::Manager>(device, queue_families);
+}
+
+glsl::StreamExecutor::StreamExecutor(const std::vector<std::shared_ptr<AutogenShader>>& pipeline,
+	const std::shared_ptr<kp::Manager>& mgr, const StreamExecutorOptions& options)
+	: m_Pipeline(pipeline), m_Manager(mgr), m_Options(options)
+{
+	if (m_Pipeline.empty())
+		throw std::runtime_error("StreamExecutor needs at least one shader");
+	if (!m_Manager)
+		throw std::runtime_error("StreamExecutor was given no manager");
+
+	for (auto& shader : m_Pipeline) {
+		std::string source = shader->compile();
+		m_Spirv.push_back(compileSource(source));
+		m_Bindings.push_back(cpu::glsl_to_cpp(source).bindings);
+	}
+}
+
+vc::ui32 glsl::StreamExecutor::chunkSize(ui32 nvoxels, const std::vector<StreamBuffer>& buffers) const
+{
+	ui64 voxel_bytes = 0;
+	for (auto& b : buffers) {
+		if (b.buffer.per_voxel)
+			voxel_bytes += stride(b.buffer);
+	}
+
+	ui32 local_size = 1;
+	for (auto& shader : m_Pipeline) {
+		local_size = std::max(local_size, shader->getLocalSize()[0]);
+	}
+
+	ui64 chunk = m_Options.max_chunk;
+	if (voxel_bytes > 0)
+		chunk = std::min<ui64>(chunk, m_Options.memory_budget / (NSLOTS * voxel_bytes));
+	chunk -= chunk % local_size;
+	if (chunk == 0) {
+		throw std::runtime_error("A memory budget of " + std::to_string(m_Options.memory_budget) + " bytes does not fit " +
+			std::to_string(NSLOTS) + " slots of " + std::to_string(local_size) + " voxels at " + std::to_string(voxel_bytes) +
+			" bytes each");
+	}
+
+	return static_cast<ui32>(std::min<ui64>(chunk, nvoxels));
+}
+
+glsl::StreamStats glsl::StreamExecutor::run(ui32 nvoxels, const std::vector<StreamBuffer>& buffers)
+{
+	check_buffers(buffers);
+
+	auto run_start = std::chrono::steady_clock::now();
+
+	StreamStats stats;
+	if (nvoxels == 0)
+		return stats;
+
+	ui32 chunk = chunkSize(nvoxels, buffers);
+	ui32 nchunks = static_cast<ui32>((ui64(nvoxels) + chunk - 1) / chunk);
+	stats.chunk_size = chunk;
+	stats.nchunks = nchunks;
+
+	auto& mgr = m_Manager;
+
+	std::vector<std::shared_ptr<kp::Tensor>> shared_tensors;
+	std::vector<std::shared_ptr<kp::Tensor>> shared_by_binding(buffers.size());
+	ui64 max_stride = 0;
+	for (size_t b = 0; b < buffers.size(); ++b) {
+		auto& buffer = buffers[b].buffer;
+		if (buffer.per_voxel) {
+			max_stride = std::max(max_stride, stride(buffer));
+			continue;
+		}
+		shared_by_binding[b] = mgr->tensor(buffer.data, buffer.components, type_size(buffer.type), tensor_type(buffer.type));
+		shared_tensors.push_back(shared_by_binding[b]);
+	}
+	if (!shared_tensors.empty())
+		mgr->sequence(m_Options.upload_queue)->eval<kp::OpTensorSyncDevice>(shared_tensors);
+
+	// initial contents of the per voxel tensors, scratch tensors have no staging memory to fill
+	std::vector<std::byte> zeros(chunk * max_stride);
+
+	// an upload, a barrier and a dispatch per shader, a barrier and a download, and the timestamp at the start
+	ui32 ntimestamps = m_Options.timestamps ? static_cast<ui32>(2 * m_Pipeline.size() + 2) : 0;
+	double period = m_Options.timestamps ? mgr->getDeviceProperties().limits.timestampPeriod : 0.0;
+
+	std::vector<Slot> slots(NSLOTS);
+	for (auto& slot : slots) {
+		for (size_t b = 0; b < buffers.size(); ++b) {
+			auto& buffer = buffers[b].buffer;
+			if (!buffer.per_voxel) {
+				slot.tensors.push_back(shared_by_binding[b]);
+				continue;
+			}
+
+			auto transfer = buffers[b].transfer;
+			auto tensor = mgr->tensor(zeros.data(), chunk * buffer.components, type_size(buffer.type), tensor_type(buffer.type),
+				transfer == StreamTransfer::NONE ? kp::Tensor::TensorTypes::eStorage : kp::Tensor::TensorTypes::eDevice);
+			slot.tensors.push_back(tensor);
+			slot.voxel_tensors.push_back(tensor);
+			stats.device_bytes += chunk * stride(buffer);
+
+			if (has_transfer(transfer, StreamTransfer::UPLOAD))
+				slot.uploads.push_back(SlotTensor{ b, tensor });
+			if (has_transfer(transfer, StreamTransfer::DOWNLOAD))
+				slot.downloads.push_back(SlotTensor{ b, tensor });
+		}
+
+		// invocations beyond the nelem push constant return, so the last chunk dispatches the same workgroups
+		for (size_t i = 0; i < m_Pipeline.size(); ++i) {
+			slot.algorithms.push_back(mgr->algorithm<float, ui32>(slot.tensors, m_Spirv[i],
+				m_Pipeline[i]->getWorkgroup(chunk), {}, { chunk }));
+		}
+
+		slot.upload = mgr->sequence(m_Options.upload_queue, ntimestamps);
+		if (!slot.uploads.empty())
+			slot.upload->record<kp::OpTensorSyncDevice>(slot_tensors(slot.uploads));
+
+		slot.compute = mgr->sequence(m_Options.compute_queue, ntimestamps);
+
+		// a slot is only used by the next stage once the host has waited for the previous one, which orders the
+		// stages across queues. kp::Sequence submits without semaphores, so they can't be chained on the device. The barriers order the copies of the staging buffers against the dispatches
+		// where stages share a queue
+		slot.download = mgr->sequence(m_Options.download_queue, ntimestamps);
+		if (!slot.downloads.empty()) {
+			auto downloads = slot_tensors(slot.downloads);
+			slot.download->record<kp::OpMemoryBarrier>(downloads, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead,
+				vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer);
+			slot.download->record<kp::OpTensorSyncLocal>(downloads);
+		}
+	}
+
+	auto record_compute = [](Slot& slot, ui32 count) {
+		slot.compute->clear();
+		if (!slot.uploads.empty()) {
+			slot.compute->record<kp::OpMemoryBarrier>(slot_tensors(slot.uploads), vk::AccessFlagBits::eTransferWrite,
+				vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader);
+		}
+		for (size_t i = 0; i < slot.algorithms.size(); ++i) {
+			if (i > 0) {
+				slot.compute->record<kp::OpMemoryBarrier>(slot.voxel_tensors, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead,
+					vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader);
+			}
+			slot.compute->record<kp::OpAlgoDispatch>(slot.algorithms[i], std::vector<ui32>{ count });
+		}
+		slot.count = count;
+	};
+
+	// the offset of the last chunks doesn't fit in ui32 for volumes near 2^32 voxels
+	auto chunk_count = [chunk, nvoxels](ui32 c) -> ui32 {
+		ui64 begin = ui64(c) * chunk;
+		if (begin >= nvoxels)
+			return 0;
+		return static_cast<ui32>(std::min<ui64>(chunk, nvoxels - begin));
+	};
+
+	auto fill = [&](ui32 c) {
+		auto& slot = slots[c % NSLOTS];
+		for (auto& t : slot.uploads) {
+			auto& buffer = buffers[t.buffer].buffer;
+			std::memcpy(t.tensor->rawData(), static_cast<const std::byte*>(buffer.data) + ui64(c) * chunk * stride(buffer),
+				chunk_count(c) * stride(buffer));
+		}
+	};
+
+	auto drain = [&](ui32 c) {
+		auto& slot = slots[c % NSLOTS];
+		for (auto& t : slot.downloads) {
+			auto& buffer = buffers[t.buffer].buffer;
+			std::memcpy(static_cast<std::byte*>(buffer.data) + ui64(c) * chunk * stride(buffer), t.tensor->rawData(),
+				chunk_count(c) * stride(buffer));
+		}
+	};
+
+	// step s uploads chunk s, computes s-1 and downloads s-2, the fourth slot is free for the host
+	std::vector<std::shared_ptr<kp::Sequence>> running;
+	// the stage time each running sequence adds to
+	std::vector<double*> running_stats;
+	auto stream_start = std::chrono::steady_clock::now();
+	try {
+		fill(0);
+		for (i64 s = 0; s < i64(nchunks) + 2; ++s) {
+			running.clear();
+			running_stats.clear();
+
+			if (s < nchunks && !slots[s % NSLOTS].uploads.empty()) {
+				running.push_back(slots[s % NSLOTS].upload->evalAsync());
+				running_stats.push_back(&stats.upload_seconds);
+			}
+
+			if (s >= 1 && s - 1 < nchunks) {
+				auto& slot = slots[(s - 1) % NSLOTS];
+				ui32 count = chunk_count(s - 1);
+				if (slot.count != count)
+					record_compute(slot, count);
+				running.push_back(slot.compute->evalAsync());
+				running_stats.push_back(&stats.compute_seconds);
+			}
+
+			if (s >= 2 && s - 2 < nchunks && !slots[(s - 2) % NSLOTS].downloads.empty()) {
+				running.push_back(slots[(s - 2) % NSLOTS].download->evalAsync());
+				running_stats.push_back(&stats.download_seconds);
+			}
+
+			if (s >= 3 && s - 3 < nchunks)
+				drain(s - 3);
+			if (s + 1 < nchunks)
+				fill(s + 1);
+
+			for (size_t i = 0; i < running.size(); ++i) {
+				running[i]->evalAwait();
+				if (m_Options.timestamps)
+					*running_stats[i] += sequence_seconds(*running[i], period);
+			}
+		}
+		running.clear();
+		drain(nchunks - 1);
+	}
+	catch (...) {
+		// tensors must outlive the submissions using them
+		for (auto& seq : running) {
+			if (seq->isRunning())
+				seq->evalAwait();
+		}
+		throw;
+	}
+
+	auto run_end = std::chrono::steady_clock::now();
+	stats.stream_seconds = std::chrono::duration<double>(run_end - stream_start).count();
+	stats.seconds = std::chrono::duration<double>(run_end - run_start).count();
+	return stats;
+}
+
+void glsl::StreamExecutor::check_buffers(const std::vector<StreamBuffer>& buffers) const
+{
+	std::vector<VoxelBuffer> voxel_buffers;
+	for (auto& b : buffers) {
+		voxel_buffers.push_back(b.buffer);
+	}
+	for (auto& shader_bindings : m_Bindings) {
+		check_voxel_buffers(shader_bindings, voxel_buffers);
+	}
+
+	for (size_t b = 0; b < buffers.size(); ++b) {
+		bool needs_data = !buffers[b].buffer.per_voxel || buffers[b].transfer != StreamTransfer::NONE;
+		if (needs_data && buffers[b].buffer.data == nullptr)
+			throw std::runtime_error("No data given for the buffer of binding " + std::to_string(b));
+	}
+}
@@ -0,0 +1,100 @@
+module;
+
+export module stream_executor;
+
+import <vector>;
+import <memory>;
+
+import vc;
+import variable;
+import shader;
+import tensor_var;
+import cpu_shader;
+import voxel_scheduler;
+
+namespace glsl {
+
+	// How the per voxel values of a streamed buffer move between the host and the device. NONE
+	// buffers are scratch space that only lives on the device and needs no host data
+	export enum class StreamTransfer {
+		NONE = 0,
+		UPLOAD = 1,
+		DOWNLOAD = 2,
+		UPLOAD_DOWNLOAD = UPLOAD | DOWNLOAD
+	};
+
+	export struct StreamBuffer {
+		VoxelBuffer buffer;
+		StreamTransfer transfer;
+	};
+
+	export struct StreamExecutorOptions {
+		// device memory for the per voxel buffers of all slots, shared buffers come on top
+		vc::ui64 memory_budget = 256ull * 1024ull * 1024ull;
+		vc::ui32 max_chunk = 1u << 20;
+		// queues of the manager the transfers and dispatches are submitted to, by default the three queues
+		// of create_stream_manager. They must belong to the same queue family, kompute does no ownership
+		// transfers between families. Stages sharing a queue do not overlap, the barriers ordering the
+		// transfers of a slot against its dispatches also wait for the work of the other slots on that queue
+		vc::ui32 upload_queue = 0;
+		vc::ui32 compute_queue = 1;
+		vc::ui32 download_queue = 2;
+		// writes timestamps around the submissions to measure the device time of every stage, the queue
+		// family must support timestamps
+		bool timestamps = false;
+	};
+
+	export struct StreamStats {
+		vc::ui32 chunk_size = 0;
+		vc::ui32 nchunks = 0;
+		// per voxel buffers of all slots
+		vc::ui64 device_bytes = 0;
+		double seconds = 0.0;
+		// the chunks moving through the slots, without the setup
+		double stream_seconds = 0.0;
+		// with timestamps, device time of the submissions of every stage summed over the chunks. When the
+		// stages overlap their sum exceeds stream_seconds
+		double upload_seconds = 0.0;
+		double compute_seconds = 0.0;
+		double download_seconds = 0.0;
+	};
+
+	// A manager on device with up to three queues of its first compute queue family, which options is set
+	// to upload, compute and download on. With two queues the transfers share one, with a single queue the
+	// stages only overlap with the host copies
+	export std::shared_ptr<kp::Manager> create_stream_manager(vc::ui32 device, StreamExecutorOptions& options);
+
+	// Runs a pipeline of shaders over a volume that need not fit on the device, in fixed size chunks.
+	// Every slot holds the per voxel tensors of one chunk, while chunk k+1 is uploaded, k computed and
+	// k-1 downloaded the host copies chunk k-2 out of the fourth slot and chunk k+2 into it. Shared buffers
+	// are uploaded once and bound in every slot. Buffers are given in binding order and per voxel ones must
+	// be in AoS layout, only those transferred need host data
+	export class StreamExecutor {
+	public:
+
+		static constexpr vc::ui32 NSLOTS = 4;
+
+		StreamExecutor(const std::vector<std::shared_ptr<AutogenShader>>& pipeline, const std::shared_ptr<kp::Manager>& mgr,
+			const StreamExecutorOptions& options = {});
+
+		// largest multiple of the workgroup size whose per voxel buffers fit the memory budget in every slot
+		vc::ui32 chunkSize(vc::ui32 nvoxels, const std::vector<StreamBuffer>& buffers) const;
+
+		StreamStats run(vc::ui32 nvoxels, const std::vector<StreamBuffer>& buffers);
+
+		const StreamExecutorOptions& getOptions() const { return m_Options; }
+
+	private:
+
+		void check_buffers(const std::vector<StreamBuffer>& buffers) const;
+
+	private:
+		std::vector<std::shared_ptr<AutogenShader>> m_Pipeline;
+		std::shared_ptr<kp::Manager> m_Manager;
+		StreamExecutorOptions m_Options;
+
+		std::vector<std::vector<cpu::CpuBinding>> m_Bindings;
+		std::vector<std::vector<vc::ui32>> m_Spirv;
+	};
+
+}
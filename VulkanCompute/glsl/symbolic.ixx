@@ -17,6 +17,13 @@ namespace glsl {
 		PARAM_TYPE,
 	};
 
+	// how the nlsq generators get the derivatives of the residual. SYMBOLIC differentiates the
+	// expression once per parameter (pair), FORWARD_AD propagates dual numbers through the residual
+	export enum class DerivativeMode {
+		SYMBOLIC,
+		FORWARD_AD,
+	};
+
 	export class SymbolicContext {
 	public:
 
@@ -152,6 +159,10 @@ namespace glsl {
 
 		std::string ndata_name = "ndata";
 		std::string nconst_name = "nconst";
+
+		DerivativeMode derivative_mode = DerivativeMode::SYMBOLIC;
+		// run the algebraic rewrites of expression::simplify on the generated expressions
+		bool simplify = true;
 	};
 
 }
\ No newline at end of file
@@ -8,15 +8,164 @@ module tensor_var;
 import <ostream>;
 import <fstream>;
 import <filesystem>;
+import <vector>;
+import <algorithm>;
 
 import vc;
 import glsl;
 import variable;
 import util;
+import mapped_file;
+import vcdat;
 
 namespace {
 	constexpr int max_number_length = 15;
 	const char* whitespace_characters = "  ";
+
+	// writes the size values of src to dst reordered from one layout to the other
+	template<typename T>
+	void transpose_copy(const T* src, T* dst, vc::ui64 size, vc::ui32 ndim, glsl::BufferLayout from, glsl::BufferLayout to)
+	{
+		if (from == to || ndim == 1) {
+			std::copy(src, src + size, dst);
+			return;
+		}
+
+		if (size % ndim != 0)
+			throw std::runtime_error("Buffer size was not divisible by the number of components");
+
+		vc::ui64 nelem = size / ndim;
+
+		if (to == glsl::BufferLayout::SOA) {
+			for (vc::ui64 e = 0; e < nelem; ++e) {
+				for (vc::ui32 i = 0; i < ndim; ++i) {
+					dst[i * nelem + e] = src[e * ndim + i];
+				}
+			}
+		}
+		else {
+			for (vc::ui32 i = 0; i < ndim; ++i) {
+				for (vc::ui64 e = 0; e < nelem; ++e) {
+					dst[e * ndim + i] = src[i * nelem + e];
+				}
+			}
+		}
+	}
+
+	template<typename T>
+	void transpose_elements(T* data, vc::ui64 size, vc::ui32 ndim, glsl::BufferLayout from, glsl::BufferLayout to)
+	{
+		if (from == to || ndim == 1)
+			return;
+
+		std::vector<T> copy(data, data + size);
+		transpose_copy(copy.data(), data, size, ndim, from, to);
+	}
+
+	// The file is mapped and kompute copies it straight into the mapped staging memory of the new
+	// tensor, so the values are only held once on the host. A layout change is written from the
+	// mapping over the initial copy instead of going through a temporary
+	template<typename T>
+	std::shared_ptr<kp::Tensor> tensor_from_mapped(const std::shared_ptr<kp::Manager>& mgr, const util::MappedFile& file,
+		kp::Tensor::TensorDataTypes data_type, vc::ui32 ndim, glsl::BufferLayout layout, glsl::BufferLayout file_layout)
+	{
+		auto num_elem = file.size() / sizeof(T);
+		const T* values = reinterpret_cast<const T*>(file.data());
+
+		auto tensor = mgr->tensor(const_cast<T*>(values), num_elem, sizeof(T), data_type);
+		if (file_layout != layout && ndim != 1)
+			transpose_copy(values, tensor->template data<T>(), num_elem, ndim, file_layout, layout);
+		return tensor;
+	}
+
+	// files are read in file_layout order and uploaded in layout order
+	// The checksum of every chunk is verified first. kompute copies the file range of the values of a v2
+	// file into the staging memory of the new tensor, which is all when the chunks lie back to back and their
+	// order is already the layout asked for. Otherwise the elements are read chunk by chunk in layout order
+	// over that copy. The chunks are in order and do not overlap, so the range never passes the end of the file
+	template<typename T>
+	std::shared_ptr<kp::Tensor> tensor_from_vcdat(const std::shared_ptr<kp::Manager>& mgr, const glsl::VcdatFile& file,
+		kp::Tensor::TensorDataTypes data_type, glsl::BufferLayout layout)
+	{
+		const auto& info = file.info();
+		auto num_elem = info.nelem * info.components();
+
+		for (vc::ui64 c = 0; c < info.chunks.size(); ++c) {
+			if (!file.verifyChunk(c))
+				throw std::runtime_error("Chunk " + std::to_string(c) + " of " + file.path().string() +
+					" does not match its checksum");
+		}
+
+		bool in_place = info.components() == 1 || (info.layout == layout &&
+			(layout == glsl::BufferLayout::AOS || info.chunks.size() <= 1));
+
+		vc::ui64 bytes = num_elem * sizeof(T);
+		vc::ui64 first_offset = info.chunks.empty() ? 0 : info.chunks.front().offset;
+		bool back_to_back = info.chunks.empty() || info.chunks.back().offset + info.chunks.back().size == first_offset + bytes;
+
+		util::MappedFile values(file.path(), first_offset, bytes);
+		auto tensor = mgr->tensor(const_cast<std::byte*>(values.data()), num_elem, sizeof(T), data_type);
+		if (in_place && back_to_back)
+			return tensor;
+
+		file.read(0, info.nelem, tensor->template data<T>(), layout);
+		return tensor;
+	}
+
+	// ndim 0 accepts v2 files of any shape
+	std::shared_ptr<kp::Tensor> tensor_from_mapped_file(const std::shared_ptr<kp::Manager>& mgr,
+		glsl::ShaderVariableType type, const std::filesystem::path& filepath, vc::ui32 ndim,
+		glsl::BufferLayout layout, glsl::BufferLayout file_layout)
+	{
+		if (glsl::is_vcdat_v2(filepath)) {
+			glsl::VcdatFile file(filepath);
+			if (file.info().type != type)
+				throw std::runtime_error(filepath.string() + " holds " + glsl::shader_variable_type_to_str(file.info().type) +
+					" values, not " + glsl::shader_variable_type_to_str(type));
+			if (ndim != 0 && file.info().components() != ndim)
+				throw std::runtime_error(filepath.string() + " holds " + std::to_string(file.info().components()) +
+					" components per element, not " + std::to_string(ndim));
+
+			switch (type) {
+			case glsl::ShaderVariableType::INT:
+				return tensor_from_vcdat<int32_t>(mgr, file, kp::Tensor::TensorDataTypes::eInt, layout);
+			case glsl::ShaderVariableType::FLOAT:
+				return tensor_from_vcdat<float>(mgr, file, kp::Tensor::TensorDataTypes::eFloat, layout);
+			case glsl::ShaderVariableType::DOUBLE:
+				return tensor_from_vcdat<double>(mgr, file, kp::Tensor::TensorDataTypes::eDouble, layout);
+			default:
+				throw std::runtime_error("Unsupported type - tensor_from_file");
+			}
+		}
+
+		// v1, the raw values
+		ndim = std::max(ndim, 1u);
+		util::MappedFile file(filepath);
+
+		switch (type) {
+		case glsl::ShaderVariableType::INT:
+			if (file.size() % sizeof(int32_t) != 0)
+				throw std::runtime_error("File contents was not divisible by sizeof(int)");
+			return tensor_from_mapped<int32_t>(mgr, file, kp::Tensor::TensorDataTypes::eInt, ndim, layout, file_layout);
+		case glsl::ShaderVariableType::FLOAT:
+			if (file.size() % sizeof(float) != 0)
+				throw std::runtime_error("File contents was not divisible by sizeof(float)");
+			return tensor_from_mapped<float>(mgr, file, kp::Tensor::TensorDataTypes::eFloat, ndim, layout, file_layout);
+		case glsl::ShaderVariableType::DOUBLE:
+			if (file.size() % sizeof(double) != 0)
+				throw std::runtime_error("File contents was not divisible by sizeof(double)");
+			return tensor_from_mapped<double>(mgr, file, kp::Tensor::TensorDataTypes::eDouble, ndim, layout, file_layout);
+		default:
+			throw std::runtime_error("Unsupported type - tensor_from_file");
+		}
+	}
+
+	vc::ui64 element_offset(vc::ui64 size, vc::ui32 ndim, vc::ui32 index, vc::ui32 component, glsl::BufferLayout layout)
+	{
+		if (layout == glsl::BufferLayout::SOA)
+			return component * (size / ndim) + index;
+		return index * ndim + component;
+	}
 }
 
 std::shared_ptr<kp::Tensor> glsl::tensor_from_matrix(const std::shared_ptr<kp::Manager>& mgr,
@@ -112,253 +261,93 @@ std::shared_ptr<kp::Tensor> glsl::tensor_from_single(const std::shared_ptr<kp::M
 
 
 std::shared_ptr<kp::Tensor> glsl::tensor_from_matrix_file(const std::shared_ptr<kp::Manager>& mgr,
-	const std::shared_ptr<glsl::MatrixVariable>& mat, const std::filesystem::path& filepath)
+	const std::shared_ptr<glsl::MatrixVariable>& mat, const std::filesystem::path& filepath,
+	BufferLayout layout, BufferLayout file_layout)
 {
-	auto file_size = std::filesystem::file_size(filepath);
-	std::ifstream infile(filepath.string(), std::fstream::binary);
-
-	switch (mat->getType()) {
-	case glsl::ShaderVariableType::INT:
-	{
-		if (file_size % sizeof(int32_t) != 0)
-			throw std::runtime_error("File contents was not divisible by sizeof(int)");
-		auto num_elem = file_size / sizeof(int32_t);
-
-		std::vector<int32_t> v(num_elem);
-		infile.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(int32_t));
-
-		return mgr->tensor(v.data(), v.size(), sizeof(int32_t),
-			kp::Tensor::TensorDataTypes::eInt);
-	}
-	break;
-	case glsl::ShaderVariableType::FLOAT:
-	{
-		if (file_size % sizeof(float) != 0)
-			throw std::runtime_error("File contents was not divisible by sizeof(float)");
-		auto num_elem = file_size / sizeof(float);
-
-		std::vector<float> v(num_elem);
-		infile.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(float));
-
-		return mgr->tensor(v.data(), v.size(), sizeof(float),
-			kp::Tensor::TensorDataTypes::eFloat);
-	}
-	break;
-	case glsl::ShaderVariableType::DOUBLE:
-	{
-		if (file_size % sizeof(double) != 0)
-			throw std::runtime_error("File contents was not divisible by sizeof(double)");
-		auto num_elem = file_size / sizeof(double);
-
-		std::vector<double> v(num_elem);
-		infile.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(double));
-
-		return mgr->tensor(v.data(), v.size(), sizeof(double),
-			kp::Tensor::TensorDataTypes::eDouble);
-	}
-	break;
-	default:
-		throw std::runtime_error("Unsupported type - tensor_from_variable");
-	}
+	return tensor_from_mapped_file(mgr, mat->getType(), filepath, mat->getNDim1() * mat->getNDim2(), layout, file_layout);
 }
 
 std::shared_ptr<kp::Tensor> glsl::tensor_from_vector_file(const std::shared_ptr<kp::Manager>& mgr,
-	const std::shared_ptr<glsl::VectorVariable>& vec, const std::filesystem::path& filepath)
+	const std::shared_ptr<glsl::VectorVariable>& vec, const std::filesystem::path& filepath,
+	BufferLayout layout, BufferLayout file_layout)
 {
-	auto file_size = std::filesystem::file_size(filepath);
-	std::ifstream infile(filepath.string(), std::fstream::binary);
-
-	switch (vec->getType()) {
-	case glsl::ShaderVariableType::INT:
-	{
-		if (file_size % sizeof(int32_t) != 0)
-			throw std::runtime_error("File contents was not divisible by sizeof(int)");
-		auto num_elem = file_size / sizeof(int32_t);
-
-		std::vector<int32_t> v(num_elem);
-		infile.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(int32_t));
-
-		return mgr->tensor(v.data(), v.size(), sizeof(int32_t),
-			kp::Tensor::TensorDataTypes::eInt);
-	}
-	break;
-	case glsl::ShaderVariableType::FLOAT:
-	{
-		if (file_size % sizeof(float) != 0)
-			throw std::runtime_error("File contents was not divisible by sizeof(float)");
-		auto num_elem = file_size / sizeof(float);
-
-		std::vector<float> v(num_elem);
-		infile.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(float));
-
-		return mgr->tensor(v.data(), v.size(), sizeof(float),
-			kp::Tensor::TensorDataTypes::eFloat);
-	}
-	break;
-	case glsl::ShaderVariableType::DOUBLE:
-	{
-		if (file_size % sizeof(double) != 0)
-			throw std::runtime_error("File contents was not divisible by sizeof(double)");
-		auto num_elem = file_size / sizeof(double);
-
-		std::vector<double> v(num_elem);
-		infile.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(double));
-
-		return mgr->tensor(v.data(), v.size(), sizeof(double),
-			kp::Tensor::TensorDataTypes::eDouble);
-	}
-	break;
-	default:
-		throw std::runtime_error("Unsupported type - tensor_from_variable");
-	}
+	return tensor_from_mapped_file(mgr, vec->getType(), filepath, vec->getNDim(), layout, file_layout);
 }
 
 std::shared_ptr<kp::Tensor> glsl::tensor_from_single_file(const std::shared_ptr<kp::Manager>& mgr,
 	const std::shared_ptr<glsl::SingleVariable>& var, const std::filesystem::path& filepath)
 {
-	auto file_size = std::filesystem::file_size(filepath);
-	std::ifstream infile(filepath.string(), std::fstream::binary);
-
-	switch (var->getType()) {
-	case glsl::ShaderVariableType::INT:
-	{
-		if (file_size % sizeof(int32_t) != 0)
-			throw std::runtime_error("File contents was not divisible by sizeof(int)");
-		auto num_elem = file_size / sizeof(int32_t);
-
-		std::vector<int32_t> v(num_elem);
-		infile.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(int32_t));
-
-		return mgr->tensor(v.data(), v.size(), sizeof(int32_t),
-			kp::Tensor::TensorDataTypes::eInt);
-	}
-	break;
-	case glsl::ShaderVariableType::FLOAT:
-	{
-		if (file_size % sizeof(float) != 0)
-			throw std::runtime_error("File contents was not divisible by sizeof(float)");
-		auto num_elem = file_size / sizeof(float);
-
-		std::vector<float> v(num_elem);
-		infile.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(float));
-
-		return mgr->tensor(v.data(), v.size(), sizeof(float),
-			kp::Tensor::TensorDataTypes::eFloat);
-	}
-	break;
-	case glsl::ShaderVariableType::DOUBLE:
-	{
-		if (file_size % sizeof(double) != 0)
-			throw std::runtime_error("File contents was not divisible by sizeof(double)");
-		auto num_elem = file_size / sizeof(double);
-
-		std::vector<double> v(num_elem);
-		infile.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(double));
-
-		return mgr->tensor(v.data(), v.size(), sizeof(double),
-			kp::Tensor::TensorDataTypes::eDouble);
-	}
-	break;
-	default:
-		throw std::runtime_error("Unsupported type - tensor_from_variable");
-	}
+	return tensor_from_mapped_file(mgr, var->getType(), filepath, 1, BufferLayout::AOS, BufferLayout::AOS);
 }
 
-
 std::shared_ptr<kp::Tensor> glsl::tensor_from_file(const std::shared_ptr<kp::Manager>& mgr,
 	const glsl::ShaderVariableType& type, const std::filesystem::path& filepath)
 {
-	auto file_size = std::filesystem::file_size(filepath);
-	std::ifstream infile(filepath.string(), std::fstream::binary);
-
-	switch (type) {
-	case glsl::ShaderVariableType::INT:
-	{
-		if (file_size % sizeof(int32_t) != 0)
-			throw std::runtime_error("File contents was not divisible by sizeof(int)");
-		auto num_elem = file_size / sizeof(int32_t);
-
-		std::vector<int32_t> v(num_elem);
-		infile.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(int32_t));
-
-		return mgr->tensor(v.data(), v.size(), sizeof(int32_t),
-			kp::Tensor::TensorDataTypes::eInt);
-	}
-	break;
-	case glsl::ShaderVariableType::FLOAT:
-	{
-		if (file_size % sizeof(float) != 0)
-			throw std::runtime_error("File contents was not divisible by sizeof(float)");
-		auto num_elem = file_size / sizeof(float);
-
-		std::vector<float> v(num_elem);
-		infile.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(float));
-
-		return mgr->tensor(v.data(), v.size(), sizeof(float),
-			kp::Tensor::TensorDataTypes::eFloat);
-	}
-	break;
-	case glsl::ShaderVariableType::DOUBLE:
-	{
-		if (file_size % sizeof(double) != 0)
-			throw std::runtime_error("File contents was not divisible by sizeof(double)");
-		auto num_elem = file_size / sizeof(double);
-
-		std::vector<double> v(num_elem);
-		infile.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(double));
-
-		return mgr->tensor(v.data(), v.size(), sizeof(double),
-			kp::Tensor::TensorDataTypes::eDouble);
-	}
-	break;
-	default:
-		throw std::runtime_error("Unsupported type - tensor_from_variable");
-	}
+	return tensor_from_mapped_file(mgr, type, filepath, 0, BufferLayout::AOS, BufferLayout::AOS);
 }
 
 void glsl::tensor_to_file(const std::shared_ptr<kp::Tensor>& tensor,
 	const glsl::ShaderVariableType& type, const std::filesystem::path& filepath)
 {
-	std::ofstream outfile(filepath.string(), std::ios::out | std::ios::binary);
-
 	switch (type) {
 	case glsl::ShaderVariableType::INT:
-	{
-		outfile.write(reinterpret_cast<char*>(tensor->data<int32_t>()), tensor->size() * sizeof(int32_t));
-		outfile.close();
-	}
-	break;
+		if (tensor->dataType() != kp::Tensor::TensorDataTypes::eInt)
+			throw std::runtime_error("Tensor does not hold ints - tensor_to_file");
+		break;
 	case glsl::ShaderVariableType::FLOAT:
-	{
-		outfile.write(reinterpret_cast<char*>(tensor->data<float>()), tensor->size() * sizeof(float));
-		outfile.close();
-	}
-	break;
+		if (tensor->dataType() != kp::Tensor::TensorDataTypes::eFloat)
+			throw std::runtime_error("Tensor does not hold floats - tensor_to_file");
+		break;
 	case glsl::ShaderVariableType::DOUBLE:
-	{
-		outfile.write(reinterpret_cast<char*>(tensor->data<double>()), tensor->size() * sizeof(double));
-		outfile.close();
+		if (tensor->dataType() != kp::Tensor::TensorDataTypes::eDouble)
+			throw std::runtime_error("Tensor does not hold doubles - tensor_to_file");
+		break;
+	default:
+		throw std::runtime_error("Unsupported type - tensor_to_file");
 	}
-	break;
+
+	// written straight from the mapped host memory of the tensor
+	std::ofstream outfile(filepath.string(), std::ios::out | std::ios::binary);
+	outfile.write(static_cast<const char*>(tensor->rawData()), tensor->memorySize());
+	outfile.close();
+	if (!outfile)
+		throw std::runtime_error("Could not write " + filepath.string());
+}
+
+
+
+void glsl::transpose_layout(const std::shared_ptr<kp::Tensor>& tensor, vc::ui32 ndim,
+	BufferLayout from, BufferLayout to)
+{
+	switch (tensor->dataType()) {
+	case kp::Tensor::TensorDataTypes::eInt:
+		transpose_elements(tensor->data<int32_t>(), tensor->size(), ndim, from, to);
+		break;
+	case kp::Tensor::TensorDataTypes::eFloat:
+		transpose_elements(tensor->data<float>(), tensor->size(), ndim, from, to);
+		break;
+	case kp::Tensor::TensorDataTypes::eDouble:
+		transpose_elements(tensor->data<double>(), tensor->size(), ndim, from, to);
+		break;
 	default:
-		throw std::runtime_error("Unsupported type - tensor_from_variable");
+		throw std::runtime_error("Unsupported TensorDataType");
 	}
 }
 
 
 
 std::string glsl::print_shader_variable(const std::shared_ptr<kp::Tensor>& tensor, 
-	const std::shared_ptr<glsl::MatrixVariable>& mat, vc::ui32 index)
+	const std::shared_ptr<glsl::MatrixVariable>& mat, vc::ui32 index, BufferLayout layout)
 {
-	auto printer_lambda = [&mat, &index]<typename T>(T * data) -> std::string {
+	auto printer_lambda = [&mat, &index, &tensor, layout]<typename T>(T * data) -> std::string {
 		std::string ret;
 		vc::ui32 ndim1 = mat->getNDim1();
 		vc::ui32 ndim2 = mat->getNDim2();
-		vc::ui32 start_index = ndim1 * ndim2 * index;
 		for (int i = 0; i < ndim1; ++i) {
 			for (int j = 0; j < ndim2; ++j) {
+				auto offset = element_offset(tensor->size(), ndim1 * ndim2, index, i * ndim2 + j, layout);
 				ret += util::add_whitespace_until(
-					std::to_string(data[start_index + i * ndim2 + j]), max_number_length) + whitespace_characters;
+					std::to_string(data[offset]), max_number_length) + whitespace_characters;
 			}
 			ret += "\n";
 		}
@@ -396,15 +385,15 @@ std::string glsl::print_shader_variable(const std::shared_ptr<kp::Tensor>& tenso
 }
 
 std::string glsl::print_shader_variable(const std::shared_ptr<kp::Tensor>& tensor, 
-	const std::shared_ptr<glsl::VectorVariable>& vec, vc::ui32 index)
+	const std::shared_ptr<glsl::VectorVariable>& vec, vc::ui32 index, BufferLayout layout)
 {
-	auto printer_lambda = [&vec, &index]<typename T>(T * data) -> std::string {
+	auto printer_lambda = [&vec, &index, &tensor, layout]<typename T>(T * data) -> std::string {
 		std::string ret;
 		vc::ui32 ndim = vec->getNDim();
-		vc::ui32 start_index = ndim * index;
 		for (int i = 0; i < ndim; ++i) {
+			auto offset = element_offset(tensor->size(), ndim, index, i, layout);
 			ret += util::add_whitespace_until(
-				std::to_string(data[start_index + i]), max_number_length) + whitespace_characters;
+				std::to_string(data[offset]), max_number_length) + whitespace_characters;
 		}
 		return ret + "\n";
 	};
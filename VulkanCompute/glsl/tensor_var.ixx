@@ -33,11 +33,15 @@ namespace glsl {
 		const std::shared_ptr<glsl::SingleVariable>& var, vc::ui32 nelem);
 
 
+	// files are read in file_layout order and uploaded in layout order. The layout, type and shape of
+	// .vcdat v2 files are taken from their header, file_layout only applies to v1 raw files
 	export std::shared_ptr<kp::Tensor> tensor_from_matrix_file(const std::shared_ptr<kp::Manager>& mgr,
-		const std::shared_ptr<glsl::MatrixVariable>& mat, const std::filesystem::path& filepath);
+		const std::shared_ptr<glsl::MatrixVariable>& mat, const std::filesystem::path& filepath,
+		BufferLayout layout = BufferLayout::AOS, BufferLayout file_layout = BufferLayout::AOS);
 	
 	export std::shared_ptr<kp::Tensor> tensor_from_vector_file(const std::shared_ptr<kp::Manager>& mgr,
-		const std::shared_ptr<glsl::VectorVariable>& mat, const std::filesystem::path& filepath);
+		const std::shared_ptr<glsl::VectorVariable>& mat, const std::filesystem::path& filepath,
+		BufferLayout layout = BufferLayout::AOS, BufferLayout file_layout = BufferLayout::AOS);
 	
 	export std::shared_ptr<kp::Tensor> tensor_from_single_file(const std::shared_ptr<kp::Manager>& mgr,
 		const std::shared_ptr<glsl::SingleVariable>& mat, const std::filesystem::path& filepath);
@@ -49,11 +53,15 @@ namespace glsl {
 	export void tensor_to_file(const std::shared_ptr<kp::Tensor>& mgr,
 		const glsl::ShaderVariableType& type, const std::filesystem::path& filepath);
 
+	// reorders the host side data of a tensor holding ndim components per element, sync the tensor afterwards
+	export void transpose_layout(const std::shared_ptr<kp::Tensor>& tensor, vc::ui32 ndim,
+		BufferLayout from, BufferLayout to);
+
 	export std::string print_shader_variable(const std::shared_ptr<kp::Tensor>& tensor,
-		const std::shared_ptr<glsl::MatrixVariable>& mat, vc::ui32 index);
+		const std::shared_ptr<glsl::MatrixVariable>& mat, vc::ui32 index, BufferLayout layout = BufferLayout::AOS);
 
 	export std::string print_shader_variable(const std::shared_ptr<kp::Tensor>& tensor,
-		const std::shared_ptr<glsl::VectorVariable>& vec, vc::ui32 index);
+		const std::shared_ptr<glsl::VectorVariable>& vec, vc::ui32 index, BufferLayout layout = BufferLayout::AOS);
 
 	export std::string print_shader_variable(const std::shared_ptr<kp::Tensor>& tensor,
 		const std::shared_ptr<glsl::SingleVariable>& var, vc::ui32 index);
@@ -24,6 +24,14 @@ namespace glsl {
 		VOID = 8,
 	};
 
+	// How the per element values of a variable are laid out in its global buffer.
+	// AOS: element gid occupies [gid*ndim, (gid+1)*ndim), this is the .vcdat file order
+	// SOA: component i of element gid is found at i*nelem + gid, which coalesces accesses of neighbouring invocations
+	export enum class BufferLayout {
+		AOS = 1,
+		SOA = 2,
+	};
+
 	export std::string shader_variable_type_to_str(const ShaderVariableType& type)
 	{
 		switch (type) {
@@ -43,6 +51,8 @@ namespace glsl {
 	export class Binding {
 	public:
 
+		virtual ~Binding() = default;
+
 		virtual std::string operator()() const = 0;
 
 		virtual bool operator==(const Binding* other) const = 0;
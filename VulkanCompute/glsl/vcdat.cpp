@@ -0,0 +1,320 @@
+module;
+
+module vcdat;
+
+import <vector>;
+import <filesystem>;
+import <optional>;
+import <fstream>;
+import <string>;
+import <string_view>;
+import <cstring>;
+import <cstddef>;
+import <algorithm>;
+import <stdexcept>;
+import <bit>;
+
+import vc;
+import util;
+import variable;
+import mapped_file;
+
+using namespace vc;
+
+namespace {
+
+	static_assert(std::endian::native == std::endian::little, ".vcdat files are read and written in host byte order");
+
+	ui32 type_size(glsl::ShaderVariableType type)
+	{
+		switch (type) {
+		case glsl::ShaderVariableType::INT:
+			return sizeof(int32_t);
+		case glsl::ShaderVariableType::FLOAT:
+			return sizeof(float);
+		case glsl::ShaderVariableType::DOUBLE:
+			return sizeof(double);
+		default:
+			throw std::runtime_error("Unsupported type - vcdat");
+		}
+	}
+
+	bool valid_type(ui32 type)
+	{
+		return type == static_cast<ui32>(glsl::ShaderVariableType::INT) ||
+			type == static_cast<ui32>(glsl::ShaderVariableType::FLOAT) ||
+			type == static_cast<ui32>(glsl::ShaderVariableType::DOUBLE);
+	}
+
+	bool valid_layout(ui32 layout)
+	{
+		return layout == static_cast<ui32>(glsl::BufferLayout::AOS) ||
+			layout == static_cast<ui32>(glsl::BufferLayout::SOA);
+	}
+
+	ui64 checksum(const std::byte* data, ui64 size)
+	{
+		return util::stable_hash(std::string_view(reinterpret_cast<const char*>(data), size));
+	}
+
+	// reads and validates the header and chunk index, nullopt for files that do not start with the v2 magic.
+	// Files that do but are not consistent throw instead of being taken for v1 files
+	std::optional<glsl::VcdatInfo> read_v2_info(const std::filesystem::path& path)
+	{
+		std::error_code ec;
+		ui64 file_size = std::filesystem::file_size(path, ec);
+		if (ec || file_size < sizeof(ui32))
+			return std::nullopt;
+
+		std::ifstream infile(path, std::ios::binary);
+		ui32 magic = 0;
+		if (!infile.read(reinterpret_cast<char*>(&magic), sizeof(magic)) || magic != glsl::VCDAT_MAGIC)
+			return std::nullopt;
+
+		auto invalid = [&path](const std::string& what) {
+			return std::runtime_error(path.string() + " starts with the vcdat v2 magic but " + what);
+		};
+
+		glsl::VcdatHeader header;
+		infile.seekg(0);
+		if (file_size < sizeof(header) || !infile.read(reinterpret_cast<char*>(&header), sizeof(header)))
+			throw invalid("is too short for its header");
+
+		if (header.version != glsl::VCDAT_VERSION)
+			throw invalid("has version " + std::to_string(header.version));
+		if (!valid_type(header.type) || !valid_layout(header.layout))
+			throw invalid("has an unknown type or layout");
+		if (header.ndim1 == 0 || header.ndim2 == 0 || header.chunk_size == 0)
+			throw invalid("has empty elements or chunks");
+		if (header.nchunks != (header.nelem + header.chunk_size - 1) / header.chunk_size)
+			throw invalid("has " + std::to_string(header.nchunks) + " chunks for " + std::to_string(header.nelem) + " elements");
+		if (header.index_offset < sizeof(glsl::VcdatHeader) || header.index_offset > file_size ||
+			header.nchunks > (file_size - header.index_offset) / sizeof(glsl::VcdatChunk))
+			throw invalid("has a chunk index outside of the file");
+		ui64 index_end = header.index_offset + header.nchunks * sizeof(glsl::VcdatChunk);
+		if (header.data_offset < index_end || header.data_offset > file_size)
+			throw invalid("has its data at " + std::to_string(header.data_offset) + ", not between the end of the chunk index and the end of the file");
+
+		glsl::VcdatInfo info;
+		info.version = header.version;
+		info.type = static_cast<glsl::ShaderVariableType>(header.type);
+		info.layout = static_cast<glsl::BufferLayout>(header.layout);
+		info.nelem = header.nelem;
+		info.ndim1 = header.ndim1;
+		info.ndim2 = header.ndim2;
+		info.chunk_size = header.chunk_size;
+		info.chunks.resize(header.nchunks);
+
+		infile.seekg(header.index_offset);
+		if (!infile.read(reinterpret_cast<char*>(info.chunks.data()), info.chunks.size() * sizeof(glsl::VcdatChunk)))
+			throw invalid("has a chunk index that could not be read");
+
+		ui64 element_bytes = static_cast<ui64>(info.components()) * type_size(info.type);
+		// end of the previous chunk, chunks are in order and do not overlap
+		ui64 data_end = header.data_offset;
+		for (ui64 c = 0; c < info.chunks.size(); ++c) {
+			auto& chunk = info.chunks[c];
+			ui64 count = std::min(info.chunk_size, info.nelem - c * info.chunk_size);
+			if (chunk.size != count * element_bytes)
+				throw invalid("has chunk " + std::to_string(c) + " of " + std::to_string(chunk.size) + " bytes for " +
+					std::to_string(count) + " elements");
+			if (chunk.offset > file_size || chunk.size > file_size - chunk.offset)
+				throw invalid("has chunk " + std::to_string(c) + " outside of the file");
+			if (chunk.offset < data_end)
+				throw invalid("has chunk " + std::to_string(c) + " overlapping the chunk index or the chunk before it");
+			data_end = chunk.offset + chunk.size;
+		}
+
+		return info;
+	}
+
+}
+
+glsl::VcdatFile::VcdatFile(const std::filesystem::path& path, ShaderVariableType v1_type,
+	ui32 v1_ndim1, ui32 v1_ndim2, BufferLayout v1_layout)
+	: m_Path(path)
+{
+	auto info = read_v2_info(path);
+	if (info.has_value()) {
+		m_Info = std::move(*info);
+		return;
+	}
+
+	// v1, the raw values in one chunk
+	if (!std::filesystem::exists(path))
+		throw std::runtime_error("Could not open " + path.string());
+
+	ui64 size = std::filesystem::file_size(path);
+	ui64 element_bytes = static_cast<ui64>(v1_ndim1) * v1_ndim2 * type_size(v1_type);
+	if (element_bytes == 0 || size % element_bytes != 0)
+		throw std::runtime_error("File contents of " + path.string() + " was not divisible by the element size");
+
+	m_Info.version = 1;
+	m_Info.type = v1_type;
+	m_Info.layout = v1_layout;
+	m_Info.nelem = size / element_bytes;
+	m_Info.ndim1 = v1_ndim1;
+	m_Info.ndim2 = v1_ndim2;
+	m_Info.chunk_size = std::max<ui64>(m_Info.nelem, 1);
+	if (m_Info.nelem > 0)
+		m_Info.chunks.push_back({ 0, size, 0 });
+}
+
+ui64 glsl::VcdatFile::chunkFirst(ui64 chunk) const
+{
+	return chunk * m_Info.chunk_size;
+}
+
+ui64 glsl::VcdatFile::chunkCount(ui64 chunk) const
+{
+	if (chunk >= m_Info.chunks.size())
+		throw std::runtime_error("Chunk index out of range - vcdat");
+	return std::min(m_Info.chunk_size, m_Info.nelem - chunkFirst(chunk));
+}
+
+util::MappedFile glsl::VcdatFile::mapChunk(ui64 chunk) const
+{
+	if (chunk >= m_Info.chunks.size())
+		throw std::runtime_error("Chunk index out of range - vcdat");
+	return util::MappedFile(m_Path, m_Info.chunks[chunk].offset, m_Info.chunks[chunk].size);
+}
+
+std::optional<util::MappedFile> glsl::VcdatFile::mapData() const
+{
+	if (m_Info.chunks.empty())
+		return util::MappedFile(m_Path, 0, 0);
+
+	ui64 size = 0;
+	for (auto& chunk : m_Info.chunks) {
+		if (chunk.offset != m_Info.chunks.front().offset + size)
+			return std::nullopt;
+		size += chunk.size;
+	}
+	return util::MappedFile(m_Path, m_Info.chunks.front().offset, size);
+}
+
+void glsl::VcdatFile::read(ui64 first, ui64 count, void* dst, BufferLayout layout) const
+{
+	if (first > m_Info.nelem || count > m_Info.nelem - first)
+		throw std::runtime_error("Elements [" + std::to_string(first) + ", " + std::to_string(first + count) +
+			") are outside of " + m_Path.string());
+	if (count == 0)
+		return;
+
+	ui32 ncomp = m_Info.components();
+	ui64 es = type_size(m_Info.type);
+	ui64 element_bytes = ncomp * es;
+	std::byte* out = static_cast<std::byte*>(dst);
+
+	for (ui64 c = first / m_Info.chunk_size; c < m_Info.chunks.size() && chunkFirst(c) < first + count; ++c) {
+		ui64 chunk_first = chunkFirst(c);
+		ui64 chunk_count = chunkCount(c);
+		ui64 lo = std::max(first, chunk_first);
+		ui64 hi = std::min(first + count, chunk_first + chunk_count);
+		const auto& chunk = m_Info.chunks[c];
+
+		if (m_Info.layout == BufferLayout::AOS || ncomp == 1) {
+			// only the requested elements are mapped
+			util::MappedFile mapped(m_Path, chunk.offset + (lo - chunk_first) * element_bytes, (hi - lo) * element_bytes);
+			const std::byte* src = mapped.data();
+
+			if (layout == BufferLayout::AOS || ncomp == 1) {
+				std::memcpy(out + (lo - first) * element_bytes, src, (hi - lo) * element_bytes);
+				continue;
+			}
+			for (ui64 e = lo; e < hi; ++e) {
+				for (ui32 i = 0; i < ncomp; ++i)
+					std::memcpy(out + (i * count + (e - first)) * es, src + ((e - lo) * ncomp + i) * es, es);
+			}
+			continue;
+		}
+
+		// SoA chunks hold every component of the chunk in its own run
+		util::MappedFile mapped(m_Path, chunk.offset, chunk.size);
+		const std::byte* src = mapped.data();
+		for (ui32 i = 0; i < ncomp; ++i) {
+			const std::byte* run = src + (i * chunk_count + (lo - chunk_first)) * es;
+			if (layout == BufferLayout::SOA) {
+				std::memcpy(out + (i * count + (lo - first)) * es, run, (hi - lo) * es);
+				continue;
+			}
+			for (ui64 e = lo; e < hi; ++e)
+				std::memcpy(out + ((e - first) * ncomp + i) * es, run + (e - lo) * es, es);
+		}
+	}
+}
+
+bool glsl::VcdatFile::verifyChunk(ui64 chunk) const
+{
+	if (chunk >= m_Info.chunks.size())
+		throw std::runtime_error("Chunk index out of range - vcdat");
+	if (m_Info.version == 1)
+		return true;
+
+	auto mapped = mapChunk(chunk);
+	return checksum(mapped.data(), mapped.size()) == m_Info.chunks[chunk].checksum;
+}
+
+bool glsl::is_vcdat_v2(const std::filesystem::path& path)
+{
+	return read_v2_info(path).has_value();
+}
+
+void glsl::write_vcdat(const std::filesystem::path& path, const void* data, ShaderVariableType type,
+	ui64 nelem, ui32 ndim1, ui32 ndim2, BufferLayout layout, ui64 chunk_size)
+{
+	if (ndim1 == 0 || ndim2 == 0 || chunk_size == 0)
+		throw std::runtime_error("Elements and chunks must not be empty - write_vcdat");
+
+	ui32 ncomp = ndim1 * ndim2;
+	ui64 es = type_size(type);
+	ui64 element_bytes = ncomp * es;
+
+	VcdatHeader header{};
+	header.magic = VCDAT_MAGIC;
+	header.version = VCDAT_VERSION;
+	header.type = static_cast<ui32>(type);
+	header.layout = static_cast<ui32>(layout);
+	header.nelem = nelem;
+	header.ndim1 = ndim1;
+	header.ndim2 = ndim2;
+	header.chunk_size = chunk_size;
+	header.nchunks = (nelem + chunk_size - 1) / chunk_size;
+	header.index_offset = sizeof(VcdatHeader);
+	header.data_offset = header.index_offset + header.nchunks * sizeof(VcdatChunk);
+
+	std::vector<VcdatChunk> index(header.nchunks);
+	std::vector<std::byte> soa;
+	const std::byte* values = static_cast<const std::byte*>(data);
+
+	std::ofstream outfile(path, std::ios::out | std::ios::binary);
+	outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	// the index is written once the checksums are known
+	outfile.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(VcdatChunk));
+
+	ui64 offset = header.data_offset;
+	for (ui64 c = 0; c < header.nchunks; ++c) {
+		ui64 count = std::min(chunk_size, nelem - c * chunk_size);
+		const std::byte* chunk = values + c * chunk_size * element_bytes;
+		ui64 size = count * element_bytes;
+
+		if (layout == BufferLayout::SOA && ncomp != 1) {
+			soa.resize(size);
+			for (ui64 e = 0; e < count; ++e) {
+				for (ui32 i = 0; i < ncomp; ++i)
+					std::memcpy(soa.data() + (i * count + e) * es, chunk + (e * ncomp + i) * es, es);
+			}
+			chunk = soa.data();
+		}
+
+		index[c] = { offset, size, checksum(chunk, size) };
+		outfile.write(reinterpret_cast<const char*>(chunk), size);
+		offset += size;
+	}
+
+	outfile.seekp(header.index_offset);
+	outfile.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(VcdatChunk));
+	outfile.close();
+	if (!outfile)
+		throw std::runtime_error("Could not write " + path.string());
+}
@@ -0,0 +1,105 @@
+module;
+
+export module vcdat;
+
+import <vector>;
+import <filesystem>;
+import <optional>;
+
+import vc;
+import variable;
+import mapped_file;
+
+namespace glsl {
+
+	// .vcdat v1 files are the raw values of all elements, the type, shape and layout are known out of band.
+	// v2 files start with a VcdatHeader followed by nchunks VcdatChunk entries and the chunks. A chunk holds
+	// chunk_size elements (the last one what is left) of ndim1 x ndim2 values each, in layout order within the
+	// chunk, so component i of element e of an SoA chunk is found at i * count + e. Chunks start at data_offset,
+	// after the index, and are in order without overlapping. write_vcdat puts them back to back, each with
+	// the util::stable_hash of its bytes. All fields are little endian
+	export constexpr vc::ui32 VCDAT_MAGIC = 0x32444356; // "VCD2"
+	export constexpr vc::ui32 VCDAT_VERSION = 2;
+	export constexpr vc::ui64 VCDAT_DEFAULT_CHUNK_SIZE = 1ull << 16;
+
+	export struct VcdatHeader {
+		vc::ui32 magic;
+		vc::ui32 version;
+		// ShaderVariableType and BufferLayout values
+		vc::ui32 type;
+		vc::ui32 layout;
+		vc::ui64 nelem;
+		vc::ui32 ndim1;
+		vc::ui32 ndim2;
+		vc::ui64 chunk_size;
+		vc::ui64 nchunks;
+		vc::ui64 index_offset;
+		vc::ui64 data_offset;
+	};
+	static_assert(sizeof(VcdatHeader) == 64);
+
+	export struct VcdatChunk {
+		vc::ui64 offset;
+		vc::ui64 size;
+		vc::ui64 checksum;
+	};
+	static_assert(sizeof(VcdatChunk) == 24);
+
+	export struct VcdatInfo {
+		vc::ui32 version;
+		ShaderVariableType type;
+		BufferLayout layout;
+		vc::ui64 nelem;
+		vc::ui32 ndim1;
+		vc::ui32 ndim2;
+		vc::ui64 chunk_size;
+		std::vector<VcdatChunk> chunks;
+
+		vc::ui32 components() const { return ndim1 * ndim2; }
+	};
+
+	// Reads v2 files and v1 raw files, for which the type, shape and layout given are assumed and the whole
+	// file is one chunk without checksum. These are ignored for v2 files, whose header describes them. Files
+	// starting with the v2 magic are always read as v2 and throw when their header or chunk index is invalid
+	export class VcdatFile {
+	public:
+
+		VcdatFile(const std::filesystem::path& path, ShaderVariableType v1_type = ShaderVariableType::FLOAT,
+			vc::ui32 v1_ndim1 = 1, vc::ui32 v1_ndim2 = 1, BufferLayout v1_layout = BufferLayout::AOS);
+
+		const VcdatInfo& info() const { return m_Info; }
+
+		const std::filesystem::path& path() const { return m_Path; }
+
+		// first element of a chunk and the number of elements in it
+		vc::ui64 chunkFirst(vc::ui64 chunk) const;
+		vc::ui64 chunkCount(vc::ui64 chunk) const;
+
+		// maps only the bytes of one chunk, the values are used in place
+		util::MappedFile mapChunk(vc::ui64 chunk) const;
+
+		// maps the values of all chunks when they lie back to back, as written by write_vcdat, nullopt otherwise
+		std::optional<util::MappedFile> mapData() const;
+
+		// copies the elements [first, first + count) to dst in layout order over count elements,
+		// mapping only the chunks they lie in
+		void read(vc::ui64 first, vc::ui64 count, void* dst, BufferLayout layout = BufferLayout::AOS) const;
+
+		// whether the checksum of a chunk matches its bytes, always true for v1 files
+		bool verifyChunk(vc::ui64 chunk) const;
+
+	private:
+		std::filesystem::path m_Path;
+		VcdatInfo m_Info;
+	};
+
+	// true when the file starts with the v2 magic, throws when the header and chunk index are not consistent
+	export bool is_vcdat_v2(const std::filesystem::path& path);
+
+	// Writes nelem elements of ndim1 x ndim2 values given in AoS order as a v2 file,
+	// the chunks are stored in layout
+	export void write_vcdat(const std::filesystem::path& path, const void* data, ShaderVariableType type,
+		vc::ui64 nelem, vc::ui32 ndim1, vc::ui32 ndim2, BufferLayout layout = BufferLayout::AOS,
+		vc::ui64 chunk_size = VCDAT_DEFAULT_CHUNK_SIZE);
+
+}
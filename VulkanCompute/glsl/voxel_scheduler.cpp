@@ -0,0 +1,376 @@
+module;
+
+#define KOMPUTE_LOG_LEVEL KOMPUTE_LOG_LEVEL_CRITICAL
+#include <kompute/Kompute.hpp>
+
+module voxel_scheduler;
+
+import <vector>;
+import <memory>;
+import <string>;
+import <optional>;
+import <mutex>;
+import <thread>;
+import <chrono>;
+import <exception>;
+import <algorithm>;
+import <numeric>;
+import <cstring>;
+import <cmath>;
+import <stdexcept>;
+
+import vc;
+import glsl;
+import variable;
+import shader;
+import tensor_var;
+import thread_pool;
+import jit;
+import cpu_shader;
+
+using namespace vc;
+
+namespace {
+
+	ui32 type_size(glsl::ShaderVariableType type)
+	{
+		switch (type) {
+		case glsl::ShaderVariableType::INT:
+			return sizeof(int32_t);
+		case glsl::ShaderVariableType::FLOAT:
+			return sizeof(float);
+		case glsl::ShaderVariableType::DOUBLE:
+			return sizeof(double);
+		default:
+			throw std::runtime_error("Unsupported type - voxel_scheduler");
+		}
+	}
+
+	kp::Tensor::TensorDataTypes tensor_type(glsl::ShaderVariableType type)
+	{
+		switch (type) {
+		case glsl::ShaderVariableType::INT:
+			return kp::Tensor::TensorDataTypes::eInt;
+		case glsl::ShaderVariableType::FLOAT:
+			return kp::Tensor::TensorDataTypes::eFloat;
+		case glsl::ShaderVariableType::DOUBLE:
+			return kp::Tensor::TensorDataTypes::eDouble;
+		default:
+			throw std::runtime_error("Unsupported type - voxel_scheduler");
+		}
+	}
+
+	// bytes of one voxel for per voxel buffers, of the whole buffer for shared ones
+	ui64 stride(const glsl::VoxelBuffer& buffer)
+	{
+		return ui64(buffer.components) * type_size(buffer.type);
+	}
+
+	std::byte* voxel_data(const glsl::VoxelBuffer& buffer, ui64 voxel)
+	{
+		return static_cast<std::byte*>(buffer.data) + voxel * stride(buffer);
+	}
+
+	struct Chunk {
+		ui64 first;
+		ui32 count;
+	};
+
+	// Hands out consecutive voxel ranges to the backends and keeps their throughput estimates
+	class ChunkQueue {
+	public:
+
+		ChunkQueue(ui64 nvoxels, ui32 nbackends, const glsl::VoxelSchedulerOptions& options)
+			: m_NVoxels(nvoxels), m_Options(options), m_Rates(nbackends, 0.0) {}
+
+		std::optional<Chunk> claim(ui32 backend)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (m_Stopped || m_Next >= m_NVoxels)
+				return std::nullopt;
+
+			ui64 remaining = m_NVoxels - m_Next;
+			double rate = m_Rates[backend];
+
+			// backends without an estimate yet measure themselves on a small chunk
+			ui64 count = m_Options.min_chunk;
+			if (rate > 0.0) {
+				double total = std::accumulate(m_Rates.begin(), m_Rates.end(), 0.0);
+				double share = std::ceil(remaining * (rate / total));
+				count = static_cast<ui64>(std::min(rate * m_Options.target_chunk_seconds, share));
+			}
+			count = std::clamp<ui64>(count, m_Options.min_chunk, m_Options.max_chunk);
+			count = std::min(count, remaining);
+
+			Chunk ret{ m_Next, static_cast<ui32>(count) };
+			m_Next += count;
+			return ret;
+		}
+
+		void report(ui32 backend, ui32 count, double seconds)
+		{
+			double measured = count / std::max(seconds, 1e-9);
+
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			double& rate = m_Rates[backend];
+			rate = rate > 0.0 ? m_Options.smoothing * measured + (1.0 - m_Options.smoothing) * rate : measured;
+		}
+
+		// no more chunks are handed out, after a backend failed
+		void stop()
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stopped = true;
+		}
+
+		double throughput(ui32 backend)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			return m_Rates[backend];
+		}
+
+	private:
+		ui64 m_NVoxels;
+		ui64 m_Next = 0;
+		bool m_Stopped = false;
+		const glsl::VoxelSchedulerOptions& m_Options;
+
+		std::mutex m_Mutex;
+		std::vector<double> m_Rates;
+	};
+
+	double seconds_since(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+}
+
+std::vector<std::shared_ptr<kp::Manager>> glsl::create_device_managers()
+{
+	std::vector<std::shared_ptr<kp::Manager>> ret;
+	ret.push_back(std::make_shared<kp::Manager>(0));
+
+	auto ndevices = ret.front()->listDevices().size();
+	for (ui32 i = 1; i < ndevices; ++i) {
+		ret.push_back(std::make_shared<kp::Manager>(i));
+	}
+	return ret;
+}
+
+glsl::VoxelScheduler::VoxelScheduler(const std::vector<std::shared_ptr<AutogenShader>>& pipeline,
+	const std::shared_ptr<kp::Manager>& mgr, cpu::JitCompiler& jit, const VoxelSchedulerOptions& options)
+	: VoxelScheduler(pipeline, mgr ? std::vector<std::shared_ptr<kp::Manager>>{ mgr } : std::vector<std::shared_ptr<kp::Manager>>{},
+		jit, options)
+{}
+
+glsl::VoxelScheduler::VoxelScheduler(const std::vector<std::shared_ptr<AutogenShader>>& pipeline,
+	const std::vector<std::shared_ptr<kp::Manager>>& managers, cpu::JitCompiler& jit, const VoxelSchedulerOptions& options)
+	: m_Pipeline(pipeline), m_Managers(managers), m_Options(options)
+{
+	if (m_Pipeline.empty())
+		throw std::runtime_error("VoxelScheduler needs at least one shader");
+	if (!m_Options.use_gpu && !m_Options.use_cpu)
+		throw std::runtime_error("VoxelScheduler needs the gpu, the cpu or both enabled");
+	if (m_Options.use_gpu && m_Managers.empty())
+		throw std::runtime_error("VoxelScheduler was given no manager to run on the gpu");
+	if (std::find(m_Managers.begin(), m_Managers.end(), nullptr) != m_Managers.end())
+		throw std::runtime_error("VoxelScheduler was given a null manager");
+	if (m_Options.min_chunk == 0 || m_Options.max_chunk < m_Options.min_chunk)
+		throw std::runtime_error("VoxelScheduler chunk sizes must satisfy 0 < min_chunk <= max_chunk");
+
+	for (auto& shader : m_Pipeline) {
+		std::string source = shader->compile();
+		if (m_Options.use_gpu)
+			m_Spirv.push_back(compileSource(source));
+		if (m_Options.use_cpu) {
+			m_CpuShaders.emplace_back(source, jit);
+			m_Bindings.push_back(m_CpuShaders.back().get_bindings());
+		}
+		else {
+			m_Bindings.push_back(cpu::glsl_to_cpp(source).bindings);
+		}
+	}
+}
+
+glsl::VoxelScheduleStats glsl::VoxelScheduler::run(ui32 nvoxels, const std::vector<VoxelBuffer>& buffers, util::ThreadPool& pool)
+{
+	check_buffers(buffers);
+
+	auto run_start = std::chrono::steady_clock::now();
+
+	ui32 ndevices = m_Options.use_gpu ? m_Managers.size() : 0;
+
+	VoxelScheduleStats stats;
+	for (ui32 i = 0; i < ndevices; ++i) {
+		std::string name = m_Managers[i]->getDeviceProperties().deviceName;
+		stats.backends.push_back(BackendStats{ "gpu " + std::to_string(i) + " (" + name + ")" });
+	}
+	if (m_Options.use_cpu)
+		stats.backends.push_back(BackendStats{ "cpu" });
+
+	ChunkQueue queue(nvoxels, stats.backends.size(), m_Options);
+
+	auto gpu_backend = [this, nvoxels, &buffers, &queue](const std::shared_ptr<kp::Manager>& mgr, BackendStats& gpu_stats, ui32 backend) {
+		ui32 capacity = std::max(std::min(m_Options.max_chunk, nvoxels), 1u);
+
+		// per voxel tensors hold one chunk, shared ones are uploaded once
+		std::vector<std::shared_ptr<kp::Tensor>> tensors;
+		std::vector<std::shared_ptr<kp::Tensor>> voxel_tensors;
+		std::vector<std::shared_ptr<kp::Tensor>> shared_tensors;
+		for (auto& buffer : buffers) {
+			if (buffer.per_voxel) {
+				std::vector<std::byte> zeros(capacity * stride(buffer));
+				tensors.push_back(mgr->tensor(zeros.data(), capacity * buffer.components,
+					type_size(buffer.type), tensor_type(buffer.type)));
+				voxel_tensors.push_back(tensors.back());
+			}
+			else {
+				tensors.push_back(mgr->tensor(buffer.data, buffer.components,
+					type_size(buffer.type), tensor_type(buffer.type)));
+				shared_tensors.push_back(tensors.back());
+			}
+		}
+
+		// every chunk dispatches the workgroups of a full chunk, invocations beyond the nelem push constant return
+		std::vector<std::shared_ptr<kp::Algorithm>> algorithms;
+		for (size_t i = 0; i < m_Pipeline.size(); ++i) {
+			algorithms.push_back(mgr->algorithm<float, ui32>(tensors, m_Spirv[i],
+				m_Pipeline[i]->getWorkgroup(capacity), {}, { capacity }));
+		}
+
+		if (!shared_tensors.empty())
+			mgr->sequence()->eval<kp::OpTensorSyncDevice>(shared_tensors);
+
+		auto seq = mgr->sequence();
+		while (auto chunk = queue.claim(backend)) {
+			auto start = std::chrono::steady_clock::now();
+
+			for (size_t b = 0, t = 0; b < buffers.size(); ++b) {
+				if (!buffers[b].per_voxel)
+					continue;
+				std::memcpy(voxel_tensors[t++]->rawData(), voxel_data(buffers[b], chunk->first), chunk->count * stride(buffers[b]));
+			}
+
+			seq->clear();
+			seq->record<kp::OpTensorSyncDevice>(voxel_tensors);
+			for (size_t i = 0; i < algorithms.size(); ++i) {
+				if (i > 0) {
+					seq->record<kp::OpMemoryBarrier>(voxel_tensors, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead,
+						vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader);
+				}
+				seq->record<kp::OpAlgoDispatch>(algorithms[i], std::vector<ui32>{ chunk->count });
+			}
+			seq->record<kp::OpTensorSyncLocal>(voxel_tensors);
+			seq->eval();
+
+			for (size_t b = 0, t = 0; b < buffers.size(); ++b) {
+				if (!buffers[b].per_voxel)
+					continue;
+				std::memcpy(voxel_data(buffers[b], chunk->first), voxel_tensors[t++]->rawData(), chunk->count * stride(buffers[b]));
+			}
+
+			double seconds = seconds_since(start);
+			queue.report(backend, chunk->count, seconds);
+			gpu_stats.voxels += chunk->count;
+			gpu_stats.chunks += 1;
+			gpu_stats.busy_seconds += seconds;
+		}
+	};
+
+	auto cpu_backend = [this, &buffers, &queue, &pool](BackendStats& cpu_stats, ui32 backend) {
+		std::vector<void*> pointers(buffers.size());
+		while (auto chunk = queue.claim(backend)) {
+			auto start = std::chrono::steady_clock::now();
+
+			for (size_t b = 0; b < buffers.size(); ++b) {
+				pointers[b] = buffers[b].per_voxel ? voxel_data(buffers[b], chunk->first) : buffers[b].data;
+			}
+			for (auto& shader : m_CpuShaders) {
+				shader.run(chunk->count, pointers, pool, m_Options.cpu_grain);
+			}
+
+			double seconds = seconds_since(start);
+			queue.report(backend, chunk->count, seconds);
+			cpu_stats.voxels += chunk->count;
+			cpu_stats.chunks += 1;
+			cpu_stats.busy_seconds += seconds;
+		}
+	};
+
+	// device threads mostly wait on fences, they are kept out of the pool so they never delay cpu chunks
+	std::vector<std::exception_ptr> gpu_errors(ndevices);
+	std::vector<std::thread> gpu_threads;
+	for (ui32 i = 0; i < ndevices; ++i) {
+		gpu_threads.emplace_back([&, i]() {
+			try {
+				gpu_backend(m_Managers[i], stats.backends[i], i);
+			}
+			catch (...) {
+				gpu_errors[i] = std::current_exception();
+				queue.stop();
+			}
+		});
+	}
+
+	std::exception_ptr cpu_error;
+	if (m_Options.use_cpu) {
+		ui32 backend = stats.backends.size() - 1;
+		try {
+			cpu_backend(stats.backends[backend], backend);
+		}
+		catch (...) {
+			cpu_error = std::current_exception();
+			queue.stop();
+		}
+	}
+
+	for (auto& thread : gpu_threads) {
+		thread.join();
+	}
+
+	for (auto& error : gpu_errors) {
+		if (error)
+			std::rethrow_exception(error);
+	}
+	if (cpu_error)
+		std::rethrow_exception(cpu_error);
+
+	for (ui32 i = 0; i < stats.backends.size(); ++i) {
+		stats.backends[i].throughput = queue.throughput(i);
+	}
+	stats.seconds = seconds_since(run_start);
+	return stats;
+}
+
+void glsl::check_voxel_buffers(const std::vector<cpu::CpuBinding>& bindings, const std::vector<VoxelBuffer>& buffers)
+{
+	for (auto& b : bindings) {
+		std::string what = " for binding " + std::to_string(b.binding) + " (" + b.name + ")";
+		if (b.binding >= buffers.size())
+			throw std::runtime_error("No buffer given" + what);
+
+		auto& buffer = buffers[b.binding];
+		if (shader_variable_type_to_str(buffer.type) != b.type)
+			throw std::runtime_error("Buffer of type " + shader_variable_type_to_str(buffer.type) + " given" + what);
+		if (buffer.per_voxel == b.size.has_value())
+			throw std::runtime_error(std::string(buffer.per_voxel ? "Per voxel" : "Shared") + " buffer given" + what +
+				", per voxel buffers must be unsized and shared ones sized");
+		if (!buffer.per_voxel && buffer.components < b.size.value())
+			throw std::runtime_error("Shared buffer of " + std::to_string(buffer.components) + " values given" + what +
+				", the shader declares " + std::to_string(b.size.value()));
+	}
+}
+
+void glsl::VoxelScheduler::check_buffers(const std::vector<VoxelBuffer>& buffers) const
+{
+	for (auto& shader_bindings : m_Bindings) {
+		check_voxel_buffers(shader_bindings, buffers);
+	}
+
+	// buffers not used by the pipeline are bound as well, kompute binds tensors by position
+	for (size_t b = 0; b < buffers.size(); ++b) {
+		if (buffers[b].data == nullptr)
+			throw std::runtime_error("No data given for the buffer of binding " + std::to_string(b));
+	}
+}
@@ -0,0 +1,104 @@
+module;
+
+export module voxel_scheduler;
+
+import <vector>;
+import <memory>;
+import <string>;
+
+import vc;
+import variable;
+import shader;
+import tensor_var;
+import thread_pool;
+import jit;
+import cpu_shader;
+
+namespace glsl {
+
+	// Host memory of one binding of a scheduled pipeline. Per voxel buffers hold components values
+	// for every voxel in AoS order and are split into chunks, shared buffers hold components values
+	// in total and are given whole to every backend
+	export struct VoxelBuffer {
+		void* data;
+		ShaderVariableType type;
+		vc::ui32 components;
+		bool per_voxel;
+	};
+
+	export struct VoxelSchedulerOptions {
+		// a backend claims about this much work at its estimated throughput
+		double target_chunk_seconds = 0.05;
+		vc::ui32 min_chunk = 4096;
+		// also the number of voxels the device buffers are allocated for
+		vc::ui32 max_chunk = 1u << 18;
+		// weight of the latest chunk in the throughput estimates
+		double smoothing = 0.5;
+		// invocations per pool task on the cpu
+		vc::ui32 cpu_grain = 64;
+		bool use_gpu = true;
+		bool use_cpu = true;
+	};
+
+	export struct BackendStats {
+		std::string name;
+		vc::ui64 voxels = 0;
+		vc::ui32 chunks = 0;
+		// time spent on chunks, for the gpu including the transfers
+		double busy_seconds = 0.0;
+		// final estimate in voxels per second
+		double throughput = 0.0;
+	};
+
+	export struct VoxelScheduleStats {
+		std::vector<BackendStats> backends;
+		double seconds = 0.0;
+	};
+
+	// Throws if buffers, in binding order, do not match the bindings of a shader in type, in being per voxel
+	// (unsized) or shared (sized) and in the size of shared buffers. Data pointers are not checked
+	export void check_voxel_buffers(const std::vector<cpu::CpuBinding>& bindings, const std::vector<VoxelBuffer>& buffers);
+
+	// One manager per physical device, device i on manager i. With several ICDs in VK_ICD_FILENAMES
+	// (lavapipe and SwiftShader) software devices can stand in for multiple GPUs
+	export std::vector<std::shared_ptr<kp::Manager>> create_device_managers();
+
+	// Runs a pipeline of shaders over a range of voxels on Vulkan devices and on the cpu, through the
+	// C++ translation of the same shaders, at the same time. The range is handed out in consecutive
+	// chunks sized from the measured throughput of the backend claiming them, towards the end every
+	// backend only takes its throughput share of what is left so they finish together. Chunks are
+	// copied to and from the voxel offset of the host buffers, so results end up in voxel order.
+	// Buffers are given in binding order like the tensors of a kompute algorithm, per voxel buffers must
+	// be unsized and in AoS layout. Every device gets its own copies of the shared buffers and algorithms
+	// built from the same SPIR-V. A software driver (lavapipe, SwiftShader) can stand in for the GPU
+	export class VoxelScheduler {
+	public:
+
+		// mgr may be null when options.use_gpu is false
+		VoxelScheduler(const std::vector<std::shared_ptr<AutogenShader>>& pipeline, const std::shared_ptr<kp::Manager>& mgr,
+			cpu::JitCompiler& jit, const VoxelSchedulerOptions& options = {});
+
+		VoxelScheduler(const std::vector<std::shared_ptr<AutogenShader>>& pipeline, const std::vector<std::shared_ptr<kp::Manager>>& managers,
+			cpu::JitCompiler& jit, const VoxelSchedulerOptions& options = {});
+
+		// the calling thread and the pool run the cpu chunks, every device is fed from a separate thread.
+		// Stats list the devices in manager order followed by the cpu
+		VoxelScheduleStats run(vc::ui32 nvoxels, const std::vector<VoxelBuffer>& buffers, util::ThreadPool& pool);
+
+		const VoxelSchedulerOptions& getOptions() const { return m_Options; }
+
+	private:
+
+		void check_buffers(const std::vector<VoxelBuffer>& buffers) const;
+
+	private:
+		std::vector<std::shared_ptr<AutogenShader>> m_Pipeline;
+		std::vector<std::shared_ptr<kp::Manager>> m_Managers;
+		VoxelSchedulerOptions m_Options;
+
+		std::vector<std::vector<cpu::CpuBinding>> m_Bindings;
+		std::vector<std::vector<vc::ui32>> m_Spirv;
+		std::vector<cpu::CpuShader> m_CpuShaders;
+	};
+
+}
@@ -0,0 +1,180 @@
+module;
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+module mapped_file;
+
+import <filesystem>;
+import <cstddef>;
+import <optional>;
+import <string>;
+import <utility>;
+import <stdexcept>;
+
+import vc;
+
+using namespace vc;
+using namespace util;
+
+namespace {
+
+	// mapping offsets must be multiples of this
+	ui64 map_granularity()
+	{
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwAllocationGranularity;
+#else
+		return static_cast<ui64>(sysconf(_SC_PAGESIZE));
+#endif
+	}
+
+}
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+	map(path, 0, std::nullopt);
+}
+
+MappedFile::MappedFile(const std::filesystem::path& path, ui64 offset, ui64 size)
+{
+	map(path, offset, size);
+}
+
+MappedFile::~MappedFile()
+{
+	unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+	: m_Data(std::exchange(other.m_Data, nullptr)), m_Size(std::exchange(other.m_Size, 0)),
+	m_Base(std::exchange(other.m_Base, nullptr)), m_MappedSize(std::exchange(other.m_MappedSize, 0))
+#ifdef _WIN32
+	, m_File(std::exchange(other.m_File, nullptr)), m_Mapping(std::exchange(other.m_Mapping, nullptr))
+#endif
+{}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other) {
+		unmap();
+		m_Data = std::exchange(other.m_Data, nullptr);
+		m_Size = std::exchange(other.m_Size, 0);
+		m_Base = std::exchange(other.m_Base, nullptr);
+		m_MappedSize = std::exchange(other.m_MappedSize, 0);
+#ifdef _WIN32
+		m_File = std::exchange(other.m_File, nullptr);
+		m_Mapping = std::exchange(other.m_Mapping, nullptr);
+#endif
+	}
+	return *this;
+}
+
+void MappedFile::map(const std::filesystem::path& path, ui64 offset, std::optional<ui64> size)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Could not open " + path.string() + " for mapping");
+	m_File = file;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		unmap();
+		throw std::runtime_error("Could not get the size of " + path.string());
+	}
+	ui64 total = static_cast<ui64>(file_size.QuadPart);
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("Could not open " + path.string() + " for mapping");
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Could not get the size of " + path.string());
+	}
+	ui64 total = static_cast<ui64>(st.st_size);
+#endif
+
+	if (offset > total || size.value_or(0) > total - offset) {
+#ifdef _WIN32
+		unmap();
+#else
+		close(fd);
+#endif
+		throw std::runtime_error("Range [" + std::to_string(offset) + ", " + std::to_string(offset + size.value_or(0)) +
+			") is outside of " + path.string());
+	}
+
+	m_Size = size.value_or(total - offset);
+	if (m_Size == 0) {
+#ifdef _WIN32
+		unmap();
+#else
+		close(fd);
+#endif
+		return;
+	}
+
+	ui64 map_offset = offset - offset % map_granularity();
+	m_MappedSize = m_Size + (offset - map_offset);
+
+#ifdef _WIN32
+	m_Mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_Mapping == nullptr) {
+		unmap();
+		throw std::runtime_error("Could not map " + path.string());
+	}
+	m_Base = MapViewOfFile(m_Mapping, FILE_MAP_READ, static_cast<DWORD>(map_offset >> 32),
+		static_cast<DWORD>(map_offset & 0xFFFFFFFFull), m_MappedSize);
+	if (m_Base == nullptr) {
+		unmap();
+		throw std::runtime_error("Could not map " + path.string());
+	}
+#else
+	// the mapping keeps the file referenced, the descriptor is not needed after mmap
+	void* base = mmap(nullptr, m_MappedSize, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(map_offset));
+	close(fd);
+	if (base == MAP_FAILED) {
+		m_Size = 0;
+		m_MappedSize = 0;
+		throw std::runtime_error("Could not map " + path.string());
+	}
+	madvise(base, m_MappedSize, MADV_SEQUENTIAL);
+	m_Base = base;
+#endif
+	m_Data = static_cast<const std::byte*>(m_Base) + (offset - map_offset);
+}
+
+void MappedFile::unmap()
+{
+#ifdef _WIN32
+	if (m_Base)
+		UnmapViewOfFile(m_Base);
+	if (m_Mapping)
+		CloseHandle(m_Mapping);
+	if (m_File)
+		CloseHandle(m_File);
+	m_File = nullptr;
+	m_Mapping = nullptr;
+#else
+	if (m_Base)
+		munmap(m_Base, m_MappedSize);
+#endif
+	m_Base = nullptr;
+	m_MappedSize = 0;
+	m_Data = nullptr;
+	m_Size = 0;
+}
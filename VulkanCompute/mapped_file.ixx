@@ -0,0 +1,53 @@
+module;
+
+export module mapped_file;
+
+import <filesystem>;
+import <cstddef>;
+import <optional>;
+
+import vc;
+
+namespace util {
+
+	// Read only view of a file mapped into memory. Pages are read in by the OS as they are
+	// touched and are not counted twice like a copy in a buffer would be. Empty views map to nullptr
+	export class MappedFile {
+	public:
+
+		MappedFile(const std::filesystem::path& path);
+
+		// the bytes [offset, offset + size) of the file, the mapping starts at the page below offset
+		MappedFile(const std::filesystem::path& path, vc::ui64 offset, vc::ui64 size);
+
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+
+		const std::byte* data() const { return m_Data; }
+
+		vc::ui64 size() const { return m_Size; }
+
+	private:
+
+		void map(const std::filesystem::path& path, vc::ui64 offset, std::optional<vc::ui64> size);
+
+		void unmap();
+
+	private:
+		const std::byte* m_Data = nullptr;
+		vc::ui64 m_Size = 0;
+		// start and length of the mapping, which may begin before m_Data
+		void* m_Base = nullptr;
+		vc::ui64 m_MappedSize = 0;
+#ifdef _WIN32
+		void* m_File = nullptr;
+		void* m_Mapping = nullptr;
+#endif
+	};
+
+}
@@ -0,0 +1,200 @@
+module;
+
+export module thread_pool;
+
+import <vector>;
+import <deque>;
+import <thread>;
+import <mutex>;
+import <condition_variable>;
+import <functional>;
+import <future>;
+import <memory>;
+import <type_traits>;
+import <atomic>;
+import <exception>;
+import <algorithm>;
+
+import vc;
+
+namespace util {
+
+	export class ThreadPool {
+	public:
+
+		ThreadPool(vc::ui32 nthreads = std::thread::hardware_concurrency())
+		{
+			if (nthreads == 0)
+				nthreads = 1;
+
+			m_Workers.reserve(nthreads);
+			for (vc::ui32 i = 0; i < nthreads; ++i) {
+				m_Workers.emplace_back([this]() { worker(); });
+			}
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Stop = true;
+			}
+			m_Condition.notify_all();
+			for (auto& worker : m_Workers) {
+				worker.join();
+			}
+		}
+
+		template<typename F>
+		std::future<std::invoke_result_t<F>> submit(F&& func)
+		{
+			using R = std::invoke_result_t<F>;
+
+			// packaged_task is move only, std::function needs a copyable target
+			auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
+			std::future<R> ret = task->get_future();
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Tasks.emplace_back([task]() { (*task)(); });
+			}
+			m_Condition.notify_one();
+			return ret;
+		}
+
+		vc::ui32 size() const
+		{
+			return m_Workers.size();
+		}
+
+	private:
+
+		void worker()
+		{
+			for (;;) {
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(m_Mutex);
+					m_Condition.wait(lock, [this]() { return m_Stop || !m_Tasks.empty(); });
+					if (m_Stop && m_Tasks.empty())
+						return;
+					task = std::move(m_Tasks.front());
+					m_Tasks.pop_front();
+				}
+				task();
+			}
+		}
+
+	private:
+		std::vector<std::thread> m_Workers;
+		std::deque<std::function<void()>> m_Tasks;
+
+		std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		bool m_Stop = false;
+	};
+
+	// Calls func(first, last) on chunks of at most grain indices covering [begin, end), on the workers of pool
+	// and the calling thread. Every thread starts on its own contiguous part of the range and, when that runs
+	// out, steals the back half of the largest part left, so uneven chunk costs balance without a shared queue.
+	// The first exception thrown by func is rethrown after all threads are done. Must not be called from a
+	// task running on the same pool
+	export void parallel_for(ThreadPool& pool, vc::ui64 begin, vc::ui64 end, vc::ui64 grain,
+		const std::function<void(vc::ui64, vc::ui64)>& func)
+	{
+		if (begin >= end)
+			return;
+		grain = std::max<vc::ui64>(grain, 1);
+
+		vc::ui64 count = end - begin;
+		vc::ui32 nthreads = std::min<vc::ui64>(pool.size() + 1, (count + grain - 1) / grain);
+
+		struct Part {
+			std::mutex mutex;
+			vc::ui64 first;
+			vc::ui64 last;
+		};
+		std::unique_ptr<Part[]> parts(new Part[nthreads]);
+		for (vc::ui32 t = 0; t < nthreads; ++t) {
+			parts[t].first = begin + count * t / nthreads;
+			parts[t].last = begin + count * (t + 1) / nthreads;
+		}
+
+		std::mutex exception_mutex;
+		std::exception_ptr exception;
+		std::atomic<bool> failed = false;
+
+		auto work = [&](vc::ui32 t) {
+			Part& own = parts[t];
+			while (!failed) {
+				vc::ui64 first, last;
+				{
+					std::lock_guard<std::mutex> lock(own.mutex);
+					first = own.first;
+					last = std::min(own.first + grain, own.last);
+					own.first = last;
+				}
+
+				if (first < last) {
+					try {
+						func(first, last);
+					}
+					catch (...) {
+						std::lock_guard<std::mutex> lock(exception_mutex);
+						if (!exception)
+							exception = std::current_exception();
+						failed = true;
+					}
+					continue;
+				}
+
+				// own part is empty, find the largest one left
+				vc::ui32 victim = t;
+				vc::ui64 largest = 0;
+				for (vc::ui32 u = 0; u < nthreads; ++u) {
+					if (u == t)
+						continue;
+					std::lock_guard<std::mutex> lock(parts[u].mutex);
+					if (parts[u].last - parts[u].first > largest) {
+						largest = parts[u].last - parts[u].first;
+						victim = u;
+					}
+				}
+				if (largest == 0)
+					return;
+
+				{
+					std::lock_guard<std::mutex> lock(parts[victim].mutex);
+					vc::ui64 size = parts[victim].last - parts[victim].first;
+					if (size == 0)
+						continue;
+					// small parts are taken whole, the victim is about to finish them anyway
+					first = size > grain ? parts[victim].first + size / 2 : parts[victim].first;
+					last = parts[victim].last;
+					parts[victim].last = first;
+				}
+				{
+					std::lock_guard<std::mutex> lock(own.mutex);
+					own.first = first;
+					own.last = last;
+				}
+			}
+		};
+
+		std::vector<std::future<void>> futures;
+		futures.reserve(nthreads - 1);
+		for (vc::ui32 t = 1; t < nthreads; ++t) {
+			futures.push_back(pool.submit([&work, t]() { work(t); }));
+		}
+		work(0);
+		for (auto& future : futures) {
+			future.get();
+		}
+
+		if (exception)
+			std::rethrow_exception(exception);
+	}
+
+}
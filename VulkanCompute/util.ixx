@@ -56,6 +56,28 @@ namespace util {
         return ret;
     }
 
+    // FNV-1a, stable between runs and platforms unlike std::hash, use for anything persisted to disk
+    export constexpr std::uint64_t stable_hash(std::string_view str, std::uint64_t seed = 14695981039346656037ull)
+    {
+        std::uint64_t ret = seed;
+        for (unsigned char c : str) {
+            ret ^= c;
+            ret *= 1099511628211ull;
+        }
+        return ret;
+    }
+
+    export std::string to_hex(std::uint64_t num)
+    {
+        constexpr const char* digits = "0123456789abcdef";
+        std::string ret(16, '0');
+        for (int i = 15; i >= 0; --i) {
+            ret[i] = digits[num & 0xf];
+            num >>= 4;
+        }
+        return ret;
+    }
+
     export std::string to_lower_case(const std::string& str) {
         std::string ret = str;
         std::transform(ret.begin(), ret.end(), ret.begin(), [](unsigned char c) { return std::tolower(c); });